@@ -0,0 +1,197 @@
+#include "DtlsClient.h"
+
+#include <WiFi.h>
+#include <errno.h>
+#include <esp_system.h>
+#include <lwip/sockets.h>
+#include <mbedtls/net_sockets.h>
+
+// mbedTLS asks for random bytes through this; the RF subsystem is on
+// whenever there is a connection to make, so the hardware RNG is seeded
+static int fillRandom(void* context, unsigned char* out, size_t size) {
+    esp_fill_random(out, size);
+    return 0;
+}
+
+DtlsClient::DtlsClient()
+    : socket_(-1), setUp_(false), connected_(false), resumed_(false), sessionCached_(false), sessionPort_(0) {
+    memset(&timer_, 0, sizeof(timer_));
+    sessionHost_[0] = '\0';
+    mbedtls_ssl_session_init(&session_);
+}
+
+DtlsClient::~DtlsClient() {
+    stop();
+    mbedtls_ssl_session_free(&session_);
+}
+
+// ============================================================================
+// ASSOCIATION
+// ============================================================================
+
+bool DtlsClient::connect(const char* host, uint16_t port, uint32_t timeoutMs) {
+    stop();
+    uint32_t deadlineMs = millis() + timeoutMs;
+    resumed_ = false;
+
+    IPAddress address;
+    if (!WiFi.hostByName(host, address)) {
+        return false;
+    }
+    socket_ = lwip_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_ < 0) {
+        return false;
+    }
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = (uint32_t)address;
+    if (lwip_connect(socket_, (struct sockaddr*)&server, sizeof(server)) != 0) {
+        release();
+        return false;
+    }
+    lwip_fcntl(socket_, F_SETFL, lwip_fcntl(socket_, F_GETFL, 0) | O_NONBLOCK);
+
+    mbedtls_ssl_init(&ssl_);
+    mbedtls_ssl_config_init(&config_);
+    setUp_ = true;
+    if (mbedtls_ssl_config_defaults(&config_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_DATAGRAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+        release();
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&config_, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&config_, fillRandom, NULL);
+    mbedtls_ssl_conf_handshake_timeout(&config_, DTLS_HANDSHAKE_MIN_MS, DTLS_HANDSHAKE_MAX_MS);
+    // Resumption by session id, so resumed() can tell by the id the server
+    // echoes; with a ticket the client makes up a fresh id every time
+    mbedtls_ssl_conf_session_tickets(&config_, MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+    if (mbedtls_ssl_setup(&ssl_, &config_) != 0 || mbedtls_ssl_set_hostname(&ssl_, host) != 0) {
+        release();
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl_, this, send, receive, NULL);
+    mbedtls_ssl_set_timer_cb(&ssl_, &timer_, setTimer, getTimer);
+
+    bool offered = sessionCached_ && port == sessionPort_ && strcmp(host, sessionHost_) == 0;
+    if (offered && mbedtls_ssl_set_session(&ssl_, &session_) != 0) {
+        offered = false;
+    }
+
+    int code;
+    while ((code = mbedtls_ssl_handshake(&ssl_)) != 0) {
+        if ((code != MBEDTLS_ERR_SSL_WANT_READ && code != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            (int32_t)(millis() - deadlineMs) >= 0) {
+            release();
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DTLS_POLL_MS));
+    }
+
+    // A resumed session keeps its id; a full handshake brings a new one
+    uint8_t offeredId[32];
+    size_t offeredIdLength = offered ? session_.id_len : 0;
+    memcpy(offeredId, session_.id, offeredIdLength);
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    sessionCached_ = mbedtls_ssl_get_session(&ssl_, &session_) == 0;
+    resumed_ = sessionCached_ && offeredIdLength > 0 && session_.id_len == offeredIdLength &&
+               memcmp(session_.id, offeredId, offeredIdLength) == 0;
+    snprintf(sessionHost_, sizeof(sessionHost_), "%s", host);
+    sessionPort_ = port;
+    connected_ = true;
+    return true;
+}
+
+void DtlsClient::stop() {
+    if (connected_) {
+        mbedtls_ssl_close_notify(&ssl_);
+    }
+    release();
+}
+
+void DtlsClient::forgetSession() {
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    sessionCached_ = false;
+}
+
+void DtlsClient::release() {
+    if (setUp_) {
+        mbedtls_ssl_free(&ssl_);
+        mbedtls_ssl_config_free(&config_);
+        setUp_ = false;
+    }
+    if (socket_ >= 0) {
+        lwip_close(socket_);
+        socket_ = -1;
+    }
+    connected_ = false;
+}
+
+// ============================================================================
+// DATAGRAMS
+// ============================================================================
+
+int DtlsClient::write(const uint8_t* data, size_t size) {
+    if (!connected_) {
+        return -1;
+    }
+    int code = mbedtls_ssl_write(&ssl_, data, size);
+    return code == MBEDTLS_ERR_SSL_WANT_WRITE ? 0 : code;
+}
+
+int DtlsClient::read(uint8_t* buffer, size_t size) {
+    if (!connected_) {
+        return -1;
+    }
+    int code = mbedtls_ssl_read(&ssl_, buffer, size);
+    if (code == MBEDTLS_ERR_SSL_WANT_READ || code == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    if (code <= 0) {
+        release();                   // close_notify, or a fatal alert
+        return -1;
+    }
+    return code;
+}
+
+// ============================================================================
+// MBEDTLS CALLBACKS
+// ============================================================================
+
+int DtlsClient::send(void* context, const unsigned char* data, size_t size) {
+    DtlsClient* client = (DtlsClient*)context;
+    int sent = lwip_send(client->socket_, data, size, 0);
+    if (sent < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+    return sent;
+}
+
+int DtlsClient::receive(void* context, unsigned char* buffer, size_t size) {
+    DtlsClient* client = (DtlsClient*)context;
+    int received = lwip_recv(client->socket_, buffer, size, 0);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    return received;
+}
+
+void DtlsClient::setTimer(void* context, uint32_t intermediateMs, uint32_t finalMs) {
+    Timer* timer = (Timer*)context;
+    timer->startMs = millis();
+    timer->intermediateMs = intermediateMs;
+    timer->finalMs = finalMs;
+}
+
+// -1: cancelled, 0: running, 1: intermediate delay passed, 2: final delay passed
+int DtlsClient::getTimer(void* context) {
+    const Timer* timer = (const Timer*)context;
+    if (timer->finalMs == 0) {
+        return -1;
+    }
+    uint32_t elapsedMs = millis() - timer->startMs;
+    return elapsedMs >= timer->finalMs ? 2 : elapsedMs >= timer->intermediateMs ? 1 : 0;
+}
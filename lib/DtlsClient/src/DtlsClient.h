@@ -0,0 +1,96 @@
+// ============================================================================
+// DTLS CLIENT
+// ============================================================================
+//
+// A DTLS 1.2 association with one server over a connected lwIP UDP socket,
+// for datagram protocols (CoAP, lib/Watcher/src/CoapProbe.cpp). The ESP32
+// core has no DTLS counterpart of WiFiClientSecure, so this drives mbedTLS
+// directly; the native shim (lib/NativeShim) has a stand-in with the same
+// interface.
+//
+// - Session caching: after a handshake the session (id and master secret)
+//   is kept, and the next connect() to the same host and port offers it
+//   by its id (no session tickets).
+//   A server that still knows it answers with an abbreviated handshake:
+//   one round trip less than a full one and no certificate chain on the
+//   wire. stop() keeps the session; forgetSession() drops it.
+// - The socket is non-blocking and mbedTLS is polled: connect() waits in
+//   short vTaskDelay() steps, and read() returns 0 when no datagram is
+//   waiting. Handshake flights are retransmitted by mbedTLS itself.
+// - Like WiFiClientSecure::setInsecure(), the server certificate is not
+//   verified.
+//
+// The socket goes through lwip_send/lwip_recv, so the traffic meter
+// (lib/Watcher/src/net_meter.h) sees every datagram. Not thread-safe.
+//
+
+#ifndef DTLS_CLIENT_H
+#define DTLS_CLIENT_H
+
+#include <Arduino.h>
+#include <mbedtls/ssl.h>
+
+// Handshake flights go again after 1 s, doubling (RFC 6347), capped well
+// inside a check's timeout
+const uint32_t DTLS_HANDSHAKE_MIN_MS = 1000;
+const uint32_t DTLS_HANDSHAKE_MAX_MS = 8000;
+
+// connect() checks on the handshake this often
+const uint32_t DTLS_POLL_MS = 10;
+
+class DtlsClient {
+public:
+    DtlsClient();
+    ~DtlsClient();
+
+    void setInsecure() {}
+
+    // Resolve host and handshake within timeoutMs, offering the cached
+    // session when it is for the same server. True once the association is up.
+    bool connect(const char* host, uint16_t port, uint32_t timeoutMs);
+    bool connected() const { return connected_; }
+
+    // Send close_notify and close the socket; the session stays cached
+    void stop();
+    void forgetSession();
+
+    // Whether the last handshake resumed the cached session
+    bool resumed() const { return resumed_; }
+
+    // One datagram each. write() returns size, 0 when the socket is busy,
+    // or < 0 when it failed. read() returns the datagram's size, 0 when
+    // none is waiting, or < 0 once the server closed the association or it
+    // broke.
+    int write(const uint8_t* data, size_t size);
+    int read(uint8_t* buffer, size_t size);
+
+    int socketFd() const { return socket_; }
+
+private:
+    struct Timer {
+        uint32_t startMs;
+        uint32_t intermediateMs;
+        uint32_t finalMs;             // 0: cancelled
+    };
+
+    static int send(void* context, const unsigned char* data, size_t size);
+    static int receive(void* context, unsigned char* buffer, size_t size);
+    static void setTimer(void* context, uint32_t intermediateMs, uint32_t finalMs);
+    static int getTimer(void* context);
+
+    void release();
+
+    mbedtls_ssl_context ssl_;
+    mbedtls_ssl_config config_;
+    mbedtls_ssl_session session_;
+    Timer timer_;
+    int socket_;
+    bool setUp_;                      // ssl_ and config_ hold state to free
+    bool connected_;
+    bool resumed_;
+    bool sessionCached_;
+    char sessionHost_[64];
+    uint16_t sessionPort_;
+};
+
+#endif // DTLS_CLIENT_H
@@ -0,0 +1,132 @@
+// ============================================================================
+// ARDUINO STAND-IN (native builds only)
+// ============================================================================
+//
+// Just enough of the ESP32 Arduino core and FreeRTOS API for the firmware
+// sources to compile and run on the host. See NativeShim.h for the controls.
+//
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+#include <NativeShim.h>
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+// ============================================================================
+// TIME AND GPIO
+// ============================================================================
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+
+// Hardware RNG (esp_system.h); a fixed sequence natively, so runs repeat
+uint32_t esp_random();
+
+// ============================================================================
+// SERIAL
+// ============================================================================
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void onReceive(void (*callback)()) { (void)callback; }   // No input on the host
+    size_t write(uint8_t c) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+// ============================================================================
+// IP ADDRESS
+// ============================================================================
+
+class IPAddress {
+public:
+    IPAddress() : address_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address_((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    uint8_t operator[](int index) const { return (uint8_t)(address_ >> (8 * index)); }
+    operator uint32_t() const { return address_; }
+
+private:
+    uint32_t address_;
+};
+
+// ============================================================================
+// FREERTOS
+// ============================================================================
+
+typedef void* SemaphoreHandle_t;
+typedef struct NativeQueue* QueueHandle_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
+#define portNUM_PROCESSORS 2
+#define IRAM_ATTR
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+// Runs the task function inline; it is expected to end with vTaskDelete(NULL)
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackSize,
+                       void* parameter, UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+char* pcTaskGetName(TaskHandle_t task);   // NULL: the running (inline) task
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t cpu);   // The running task on core 0
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu);
+void vTaskDelay(TickType_t ticks);
+
+// Single-threaded queue: a receive on an empty queue sleeps the virtual
+// clock for the timeout; waiting forever on an empty queue is a deadlock
+// and aborts the program.
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif // ARDUINO_H
@@ -0,0 +1,49 @@
+// ============================================================================
+// DTLS CLIENT STAND-IN (native builds only)
+// ============================================================================
+//
+// Same interface as lib/DtlsClient. connect() asks the stand-in server
+// (StandInRequest::resuming tells whether a cached session is offered),
+// advances the virtual clock by the modelled handshake time and hands the
+// association to the exchange's StandInStream, which then sees each
+// datagram. The handshake, every record (13 header + 8 nonce + 16 tag
+// bytes) and the close_notify go through the lwIP stand-ins, so the
+// traffic meter sees them like on a device.
+//
+
+#ifndef DTLS_CLIENT_H
+#define DTLS_CLIENT_H
+
+#include <Arduino.h>
+#include <NativeShim.h>
+
+const uint32_t DTLS_HANDSHAKE_MIN_MS = 1000;
+const uint32_t DTLS_HANDSHAKE_MAX_MS = 8000;
+const uint32_t DTLS_POLL_MS = 10;
+
+class DtlsClient {
+public:
+    DtlsClient();
+
+    void setInsecure() {}
+    bool connect(const char* host, uint16_t port, uint32_t timeoutMs);
+    bool connected() const { return connected_; }
+    void stop();
+    void forgetSession() { sessionCached_ = false; }
+    bool resumed() const { return resumed_; }
+    int write(const uint8_t* data, size_t size);
+    int read(uint8_t* buffer, size_t size);
+    int socketFd() const { return socket_; }
+
+private:
+    StandInExchange exchange_;
+    StandInStream* stream_;
+    int socket_;
+    bool connected_;
+    bool resumed_;
+    bool sessionCached_;
+    char sessionHost_[64];
+    uint16_t sessionPort_;
+};
+
+#endif // DTLS_CLIENT_H
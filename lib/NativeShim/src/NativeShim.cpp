@@ -0,0 +1,1211 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <DtlsClient.h>
+#include <Preferences.h>
+#include <esp_freertos_hooks.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <random>
+#include <vector>
+
+// ============================================================================
+// STATE
+// ============================================================================
+
+static uint64_t clockMs = 0;
+
+static StandInHandler serverHandler = NULL;
+static void* serverContext = NULL;
+static char lastPath[160] = "";
+
+// Thrown out of a hanging connect() and caught by xTaskCreate(), which parks
+// the task instead of finishing it
+struct NativeTaskHang {};
+
+// Thrown out of a blocking lwip_select() that finds nothing to read; the
+// task is kept to run again from the start (nativeTaskSelectWake())
+struct NativeTaskSelect {};
+
+// Thrown out of a queue wait that would not end before nativeRunUntil()'s
+// end, and caught there
+struct NativeRunLimit {};
+
+struct SelectTask {
+    TaskFunction_t function;
+    void* parameter;
+    const char* name;
+    TaskHandle_t task;
+};
+
+const int MAX_HUNG_TASKS = 64;
+const int MAX_SELECT_TASKS = 4;
+
+static int liveTasks = 0;
+static TaskHandle_t hungTasks[MAX_HUNG_TASKS];
+static int hungTaskCount = 0;
+static SelectTask selectTasks[MAX_SELECT_TASKS];
+static int selectTaskCount = 0;
+static int nextSocket = 3;
+static const char* currentTaskName = "loopTask";
+static TaskHandle_t currentTask = (TaskHandle_t)&currentTaskName;   // Any non-NULL handle for loopTask
+static int liveClients = 0;
+static uint32_t tasksCreated = 0;
+
+static bool wifiConnected = true;
+static int8_t wifiTxPower = WIFI_POWER_19_5dBm;
+static bool wifiStarted = false;       // begin() was called
+static bool wifiModelled = false;      // A driver model is set (WIFI DRIVER MODEL)
+static uint32_t wifiGeneration = 0;    // Bumped when a modelled link drops
+static WiFiEventCb wifiEventCallback = NULL;
+static uint8_t wifiMac[6] = { 0x24, 0x6F, 0x28, 0x00, 0x00, 0x01 };
+static int pinStates[64];
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+// ============================================================================
+// CONTROL API
+// ============================================================================
+
+// Moves the clock forward through the WiFi driver's events (below)
+static void clockAdvanceTo(uint64_t toMs);
+
+static void clockAdvance(uint64_t deltaMs) { clockAdvanceTo(clockMs + deltaMs); }
+
+uint64_t nativeClockNowMs() { return clockMs; }
+void nativeClockSetMs(uint64_t nowMs) { clockAdvanceTo(nowMs); }
+void nativeClockAdvanceMs(uint64_t deltaMs) { clockAdvance(deltaMs); }
+
+static uint64_t waitLimitMs = UINT64_MAX;   // No queue wait sleeps past this (nativeRunUntil())
+static uint32_t queuedItems = 0;            // Across all queues
+
+void nativeRunUntil(uint64_t endMs, void (*step)()) {
+    waitLimitMs = endMs;
+    try {
+        while (clockMs < endMs || queuedItems > 0) {
+            step();
+        }
+    } catch (const NativeRunLimit&) {
+    }
+    waitLimitMs = UINT64_MAX;
+}
+
+void standInServerSet(StandInHandler handler, void* context) {
+    serverHandler = handler;
+    serverContext = context;
+}
+
+const char* standInLastPath() { return lastPath; }
+
+int nativeLiveTasks() { return liveTasks; }
+int nativeHungTasks() { return hungTaskCount; }
+int nativeLiveClients() { return liveClients; }
+uint32_t nativeTasksCreated() { return tasksCreated; }
+
+static void raiseWiFiEvent(arduino_event_id_t event) {
+    if (wifiEventCallback != NULL) {
+        wifiEventCallback(event);
+    }
+}
+
+void nativeWiFiSetConnected(bool connected) {
+    if (wifiModelled) {
+        nativeWiFiSetApUp(connected);
+        return;
+    }
+    bool changed = connected != wifiConnected;
+    wifiConnected = connected;
+    if (changed && wifiStarted) {
+        raiseWiFiEvent(connected ? ARDUINO_EVENT_WIFI_STA_GOT_IP : ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+}
+
+int nativePinState(int pin) {
+    return (pin >= 0 && pin < 64) ? pinStates[pin] : LOW;
+}
+
+// ============================================================================
+// ARDUINO CORE
+// ============================================================================
+
+unsigned long millis() { return (uint32_t)clockMs; }
+unsigned long micros() { return (uint32_t)(clockMs * 1000); }
+void delay(uint32_t ms) { clockAdvance(ms); }
+void pinMode(int pin, int mode) { (void)pin; (void)mode; }
+
+void digitalWrite(int pin, int value) {
+    if (pin >= 0 && pin < 64) {
+        pinStates[pin] = value;
+    }
+}
+
+// xorshift32
+uint32_t esp_random() {
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        write(buffer[i]);
+    }
+    return size;
+}
+
+int Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) {
+        write((const uint8_t*)buffer, min((size_t)length, sizeof(buffer) - 1));
+    }
+    return length;
+}
+
+// Serial output goes to stdout only when SHIM_SERIAL is set in the environment
+size_t HardwareSerial::write(uint8_t c) {
+    static int enabled = -1;
+    if (enabled < 0) {
+        enabled = getenv("SHIM_SERIAL") != NULL;
+    }
+    if (enabled) {
+        putchar(c);
+    }
+    return 1;
+}
+
+// ============================================================================
+// FREERTOS
+// ============================================================================
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    static int token;
+    return &token;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    (void)semaphore;
+    (void)ticks;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    (void)semaphore;
+    return pdTRUE;
+}
+
+// Run a task inline until it ends, hangs or waits in lwip_select()
+static void runTask(TaskFunction_t function, void* parameter, const char* name, TaskHandle_t task) {
+    const char* callerName = currentTaskName;
+    TaskHandle_t caller = currentTask;
+    currentTaskName = name;
+    currentTask = task;
+    try {
+        function(parameter);
+    } catch (const NativeTaskHang&) {
+        if (hungTaskCount == MAX_HUNG_TASKS) {
+            fprintf(stderr, "native shim: more than %d hung tasks\n", MAX_HUNG_TASKS);
+            abort();
+        }
+        hungTasks[hungTaskCount++] = task;
+    } catch (const NativeTaskSelect&) {
+        if (selectTaskCount == MAX_SELECT_TASKS) {
+            fprintf(stderr, "native shim: more than %d tasks in select()\n", MAX_SELECT_TASKS);
+            abort();
+        }
+        SelectTask waiting = { function, parameter, name, task };
+        selectTasks[selectTaskCount++] = waiting;
+    }
+    currentTaskName = callerName;
+    currentTask = caller;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackSize,
+                       void* parameter, UBaseType_t priority, TaskHandle_t* handle) {
+    (void)stackSize;
+    (void)priority;
+    liveTasks++;
+    tasksCreated++;
+    TaskHandle_t task = (TaskHandle_t)(uintptr_t)tasksCreated;
+    if (handle != NULL) {
+        *handle = task;
+    }
+    runTask(function, parameter, name, task);
+    return pdPASS;
+}
+
+void nativeTaskSelectBlock() {
+    throw NativeTaskSelect();
+}
+
+// Each waiting task runs again; one that still finds nothing to read waits
+// again
+void nativeTaskSelectWake() {
+    SelectTask waiting[MAX_SELECT_TASKS];
+    int count = selectTaskCount;
+    memcpy(waiting, selectTasks, sizeof(SelectTask) * count);
+    selectTaskCount = 0;
+    for (int i = 0; i < count; i++) {
+        runTask(waiting[i].function, waiting[i].parameter, waiting[i].name, waiting[i].task);
+    }
+}
+
+// NULL deletes the running task. A handle may only name a hung task: every
+// other task has already deleted itself, so deleting it again is the
+// double delete that would crash a device.
+void vTaskDelete(TaskHandle_t task) {
+    if (task != NULL) {
+        int i = 0;
+        while (i < hungTaskCount && hungTasks[i] != task) {
+            i++;
+        }
+        if (i == hungTaskCount) {
+            fprintf(stderr, "native shim: vTaskDelete() on a task that already ended\n");
+            abort();
+        }
+        hungTasks[i] = hungTasks[--hungTaskCount];
+    }
+    liveTasks--;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return currentTask; }
+
+static int idleTaskHandles[portNUM_PROCESSORS];
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t cpu) {
+    return cpu == 0 ? currentTask : (TaskHandle_t)&idleTaskHandles[cpu];
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu) {
+    return (TaskHandle_t)&idleTaskHandles[cpu];
+}
+
+// Firmware code takes no virtual time, so there is no tick on which a core
+// could be found busy: hooks are accepted and never called
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t callback, UBaseType_t cpu) {
+    (void)callback;
+    (void)cpu;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() { return (int64_t)(clockMs * 1000); }
+
+char* pcTaskGetName(TaskHandle_t task) {
+    (void)task;
+    return (char*)currentTaskName;
+}
+
+void vTaskDelay(TickType_t ticks) { clockAdvance(ticks); }
+
+struct NativeQueue {
+    uint8_t* items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    NativeQueue* queue = (NativeQueue*)malloc(sizeof(NativeQueue));
+    queue->items = (uint8_t*)malloc((size_t)length * itemSize);
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->head = 0;
+    queue->count = 0;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    (void)ticks;   // Nothing else runs, so a full queue never drains
+    if (queue->count == queue->length) {
+        return pdFALSE;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + (size_t)tail * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    queuedItems++;
+    return pdTRUE;
+}
+
+// Nothing but the WiFi driver's events can post while a task waits; a
+// wait for ever on a queue they never reach is a deadlock
+const uint64_t FOREVER_MS = 24 * 3600000ULL;
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    uint64_t deadlineMs = clockMs + (ticks == portMAX_DELAY ? FOREVER_MS : ticks);
+    bool limited = deadlineMs >= waitLimitMs;
+    if (limited) {
+        deadlineMs = max(clockMs, waitLimitMs);
+    }
+    while (queue->count == 0 && nativeWiFiNextEventMs() <= deadlineMs) {
+        clockAdvanceTo(nativeWiFiNextEventMs());
+    }
+    if (queue->count == 0) {
+        if (limited) {
+            clockAdvanceTo(deadlineMs);
+            throw NativeRunLimit();
+        }
+        if (ticks == portMAX_DELAY) {
+            fprintf(stderr, "native shim: %s waits forever on an empty queue\n", currentTaskName);
+            abort();
+        }
+        clockAdvanceTo(deadlineMs);
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + (size_t)queue->head * queue->itemSize, queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queuedItems--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+// ============================================================================
+// FLASH PARTITIONS
+// ============================================================================
+
+static esp_partition_t partition;
+static const uint8_t* partitionData = NULL;
+
+void nativePartitionSet(const char* label, uint8_t subtype, const void* data, size_t size) {
+    memset(&partition, 0, sizeof(partition));
+    partition.type = ESP_PARTITION_TYPE_DATA;
+    partition.subtype = subtype;
+    partition.size = (uint32_t)size;
+    snprintf(partition.label, sizeof(partition.label), "%s", label);
+    partitionData = (const uint8_t*)data;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    bool found = partitionData != NULL && type == partition.type && subtype == partition.subtype &&
+                 (label == NULL || strcmp(label, partition.label) == 0);
+    return found ? &partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* from, size_t offset, void* destination, size_t size) {
+    if (offset + size > from->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(destination, partitionData + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* from, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void** pointer, spi_flash_mmap_handle_t* handle) {
+    (void)memory;
+    if (offset + size > from->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *pointer = partitionData + offset;
+    *handle = 1;
+    return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) { (void)handle; }
+
+// ============================================================================
+// WIFI
+// ============================================================================
+
+static void wifiBegin();
+static void wifiDisconnect();
+
+wl_status_t WiFiClass::status() { return wifiConnected ? WL_CONNECTED : WL_DISCONNECTED; }
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+    (void)wifiOff;
+    (void)eraseAp;
+    if (wifiModelled) {
+        wifiDisconnect();
+    }
+    return true;
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) { (void)mode; return true; }
+bool WiFiClass::setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+bool WiFiClass::setHostname(const char* hostname) { (void)hostname; return true; }
+const char* WiFiClass::getHostname() { return "native"; }
+void WiFiClass::onEvent(WiFiEventCb callback) { wifiEventCallback = callback; }
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password) {
+    (void)ssid;
+    (void)password;
+    wifiStarted = true;
+    if (wifiModelled) {
+        wifiBegin();
+    } else if (wifiConnected) {
+        raiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }
+    return status();
+}
+IPAddress WiFiClass::localIP() { return IPAddress(127, 0, 0, 1); }
+IPAddress WiFiClass::gatewayIP() { return IPAddress(192, 168, 1, 1); }
+
+bool WiFiClass::setTxPower(wifi_power_t power) {
+    wifiTxPower = (int8_t)power;
+    return true;
+}
+
+wifi_power_t WiFiClass::getTxPower() {
+    return (wifi_power_t)wifiTxPower;
+}
+
+int8_t nativeWiFiTxPower() {
+    return wifiTxPower;
+}
+
+// Like the driver, 0 without a link
+int8_t WiFiClass::RSSI() {
+    if (!wifiModelled) {
+        return -50;
+    }
+    return wifiConnected ? nativeWiFiSignal() : 0;
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+    memcpy(mac, wifiMac, sizeof(wifiMac));
+    return mac;
+}
+
+void nativeWiFiSetMac(const uint8_t* mac) {
+    memcpy(wifiMac, mac, sizeof(wifiMac));
+}
+
+bool nativeWiFiLinkUp() { return wifiConnected; }
+
+// ============================================================================
+// WIFI DRIVER MODEL
+// ============================================================================
+
+enum WiFiPhase : uint8_t {
+    WIFI_PHASE_IDLE,          // Not started, or disconnect()ed
+    WIFI_PHASE_ASSOCIATING,   // Until wifiStepMs
+    WIFI_PHASE_DHCP,          // Associated, GOT_IP at wifiStepMs
+    WIFI_PHASE_UP,
+    WIFI_PHASE_RETRY,         // Auto-reconnect at wifiStepMs
+};
+
+const uint32_t SIGNAL_SAMPLE_MS = 1000;
+const double SIGNAL_CORRELATION = 0.9;      // Of one sample with the next
+
+static NativeWiFiModel wifiModel;
+static NativeWiFiStats wifiStats;
+static std::mt19937 wifiRandom;
+static uint8_t wifiPhase = WIFI_PHASE_IDLE;
+static uint64_t wifiStepMs = UINT64_MAX;
+static bool apUp = true;
+static int8_t signalMeanDbm = 0;
+static double signalOffsetDb = 0;           // Fluctuation around the mean
+static uint64_t signalSampleMs = UINT64_MAX;
+static uint64_t weakSinceMs = UINT64_MAX;   // Signal below lossDbm since
+static std::vector<NativeWiFiStep> wifiScript;
+static size_t wifiScriptNext = 0;
+
+static uint32_t wifiUniform(uint32_t low, uint32_t high) {
+    return high > low ? std::uniform_int_distribution<uint32_t>(low, high)(wifiRandom) : low;
+}
+
+static bool signalWeak() {
+    return nativeWiFiSignal() < wifiModel.lossDbm;
+}
+
+static void wifiSchedule(uint8_t phase, uint64_t atMs) {
+    wifiPhase = phase;
+    wifiStepMs = atMs;
+}
+
+static void wifiAttempt() {
+    wifiStats.attempts++;
+    wifiSchedule(WIFI_PHASE_ASSOCIATING, clockMs + wifiUniform(wifiModel.associateMinMs, wifiModel.associateMaxMs));
+}
+
+// The link (or the attempt past association) is lost; the driver tries
+// again on its own
+static void wifiDrop() {
+    if (wifiPhase == WIFI_PHASE_UP) {
+        wifiStats.drops++;
+        wifiGeneration++;
+        wifiConnected = false;
+    }
+    if (wifiPhase == WIFI_PHASE_UP || wifiPhase == WIFI_PHASE_DHCP) {
+        raiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+        wifiSchedule(WIFI_PHASE_RETRY, clockMs + wifiModel.retryMs);
+    }
+}
+
+static void wifiBegin() {
+    if (wifiPhase != WIFI_PHASE_UP) {
+        wifiAttempt();
+    }
+}
+
+static void wifiDisconnect() {
+    bool up = wifiPhase == WIFI_PHASE_UP;
+    if (up) {
+        wifiGeneration++;
+        wifiConnected = false;
+    }
+    wifiSchedule(WIFI_PHASE_IDLE, UINT64_MAX);
+    if (up && wifiStarted) {
+        raiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+}
+
+static void signalSample() {
+    std::normal_distribution<double> noise(0.0, 1.0);
+    double spread = wifiModel.rssiSwingDb * sqrt(1 - SIGNAL_CORRELATION * SIGNAL_CORRELATION);
+    signalOffsetDb = SIGNAL_CORRELATION * signalOffsetDb + spread * noise(wifiRandom);
+    signalSampleMs = clockMs + SIGNAL_SAMPLE_MS;
+
+    if (!signalWeak()) {
+        weakSinceMs = UINT64_MAX;
+        return;
+    }
+    weakSinceMs = min(weakSinceMs, clockMs);
+    if (wifiPhase == WIFI_PHASE_UP && clockMs - weakSinceMs >= wifiModel.beaconTimeoutMs) {
+        wifiDrop();
+    }
+}
+
+// One driver step at wifiStepMs
+static void wifiStep() {
+    if (wifiPhase == WIFI_PHASE_ASSOCIATING) {
+        std::uniform_int_distribution<uint32_t> permille(0, 999);
+        if (!apUp || signalWeak() || permille(wifiRandom) < wifiModel.joinFailPermille) {
+            wifiStats.failedAttempts++;
+            raiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+            wifiSchedule(WIFI_PHASE_RETRY, clockMs + wifiModel.retryMs);
+            return;
+        }
+        raiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+        wifiSchedule(WIFI_PHASE_DHCP, clockMs + wifiUniform(wifiModel.dhcpMinMs, wifiModel.dhcpMaxMs));
+    } else if (wifiPhase == WIFI_PHASE_DHCP) {
+        wifiSchedule(WIFI_PHASE_UP, UINT64_MAX);
+        wifiConnected = true;
+        raiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    } else if (wifiPhase == WIFI_PHASE_RETRY) {
+        wifiAttempt();
+    }
+}
+
+static void scriptStep(const NativeWiFiStep& step) {
+    switch (step.action) {
+        case NATIVE_WIFI_DEAUTH:
+            nativeWiFiDeauth();
+            break;
+        case NATIVE_WIFI_AP_DOWN:
+            nativeWiFiSetApUp(false);
+            break;
+        case NATIVE_WIFI_AP_UP:
+            nativeWiFiSetApUp(true);
+            break;
+        case NATIVE_WIFI_SIGNAL:
+            nativeWiFiSetSignal(step.signalDbm);
+            break;
+    }
+}
+
+static void clockAdvanceTo(uint64_t toMs) {
+    if (toMs < clockMs) {
+        clockMs = toMs;            // Harnesses may set the clock back; nothing fires
+        return;
+    }
+    while (wifiModelled && nativeWiFiNextEventMs() <= toMs) {
+        clockMs = max(clockMs, nativeWiFiNextEventMs());
+        if (clockMs >= signalSampleMs) {
+            signalSample();
+        }
+        while (wifiScriptNext < wifiScript.size() && clockMs >= wifiScript[wifiScriptNext].atMs) {
+            scriptStep(wifiScript[wifiScriptNext++]);
+        }
+        if (clockMs >= wifiStepMs) {
+            wifiStep();
+        }
+    }
+    clockMs = toMs;
+}
+
+void nativeWiFiModelSet(const NativeWiFiModel* model) {
+    wifiModelled = model != NULL;
+    wifiConnected = !wifiModelled;
+    wifiSchedule(WIFI_PHASE_IDLE, UINT64_MAX);
+    memset(&wifiStats, 0, sizeof(wifiStats));
+    signalSampleMs = UINT64_MAX;
+    wifiScript.clear();
+    wifiScriptNext = 0;
+    if (model != NULL) {
+        wifiModel = *model;
+        wifiRandom.seed(model->seed);
+        signalMeanDbm = model->rssiDbm;
+        signalOffsetDb = 0;
+        signalSampleMs = clockMs + SIGNAL_SAMPLE_MS;
+        weakSinceMs = UINT64_MAX;
+        apUp = true;
+    }
+}
+
+void nativeWiFiSetApUp(bool up) {
+    apUp = up;
+    if (!up) {
+        wifiDrop();
+    }
+}
+
+void nativeWiFiDeauth() {
+    wifiDrop();
+}
+
+void nativeWiFiSetSignal(int8_t rssiDbm) { signalMeanDbm = rssiDbm; }
+
+int8_t nativeWiFiSignal() {
+    double dbm = signalMeanDbm + signalOffsetDb;
+    return (int8_t)max(-127.0, min(0.0, round(dbm)));
+}
+
+void nativeWiFiScript(const NativeWiFiStep* steps, size_t count) {
+    wifiScript.assign(steps, steps + count);
+    wifiScriptNext = 0;
+}
+
+uint64_t nativeWiFiNextEventMs() {
+    if (!wifiModelled) {
+        return UINT64_MAX;
+    }
+    uint64_t scriptMs = wifiScriptNext < wifiScript.size() ? wifiScript[wifiScriptNext].atMs : UINT64_MAX;
+    return min(min(wifiStepMs, signalSampleMs), scriptMs);
+}
+
+const NativeWiFiStats& nativeWiFiStats() { return wifiStats; }
+
+// Modelled traffic has no route
+static bool wifiLinkMissing() {
+    return wifiModelled && !wifiConnected;
+}
+
+// The AP does not hear the station at its TX power (see NativeWiFiModel)
+static bool wifiUnheard() {
+    return wifiModelled && wifiConnected &&
+           nativeWiFiSignal() - (WIFI_POWER_19_5dBm - wifiTxPower) / 4 < wifiModel.lossDbm;
+}
+
+bool nativeWiFiUplinkUp() {
+    return !wifiUnheard();
+}
+
+// A modelled connection opened with link generation link lost its path
+static bool wifiCut(uint32_t link) {
+    return wifiModelled && link != wifiGeneration;
+}
+
+// ============================================================================
+// PREFERENCES
+// ============================================================================
+
+struct NativePreference {
+    char name[16];       // NVS limits namespaces and keys to 15 characters
+    char key[16];
+    uint8_t value[64];
+    size_t length;
+};
+
+const int MAX_PREFERENCES = 8;
+static NativePreference preferences[MAX_PREFERENCES];
+static int preferenceCount = 0;
+
+static NativePreference* findPreference(const char* name, const char* key) {
+    for (int i = 0; i < preferenceCount; i++) {
+        if (strcmp(preferences[i].name, name) == 0 && (key == NULL || strcmp(preferences[i].key, key) == 0)) {
+            return &preferences[i];
+        }
+    }
+    return NULL;
+}
+
+void nativePreferencesClear() { preferenceCount = 0; }
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    if (readOnly && findPreference(name, NULL) == NULL) {
+        return false;
+    }
+    namespace_ = name;
+    readOnly_ = readOnly;
+    return true;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    NativePreference* entry = namespace_ != NULL ? findPreference(namespace_, key) : NULL;
+    return entry != NULL ? entry->length : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    NativePreference* entry = namespace_ != NULL ? findPreference(namespace_, key) : NULL;
+    if (entry == NULL || entry->length > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, entry->value, entry->length);
+    return entry->length;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    if (namespace_ == NULL || readOnly_ || length > sizeof(preferences[0].value)) {
+        return 0;
+    }
+    NativePreference* entry = findPreference(namespace_, key);
+    if (entry == NULL) {
+        if (preferenceCount == MAX_PREFERENCES) {
+            return 0;
+        }
+        entry = &preferences[preferenceCount++];
+        snprintf(entry->name, sizeof(entry->name), "%s", namespace_);
+        snprintf(entry->key, sizeof(entry->key), "%s", key);
+    }
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    return length;
+}
+
+// ============================================================================
+// SECURE CLIENT
+// ============================================================================
+
+// Bytes on the socket modelled after a TLS 1.2 ECDHE-RSA-AES128-GCM session:
+// every record costs 5 header + 8 nonce + 16 tag bytes
+const uint32_t TLS_HANDSHAKE_SENT_BYTES = 650;        // ClientHello, key exchange, Finished
+const uint32_t TLS_HANDSHAKE_RECEIVED_BYTES = 4400;   // ServerHello, certificate chain, Finished
+const uint32_t TLS_RECORD_OVERHEAD_BYTES = 29;
+const uint32_t TLS_ALERT_BYTES = TLS_RECORD_OVERHEAD_BYTES + 2;
+
+WiFiClientSecure::WiFiClientSecure()
+    : port_(0), connected_(false), requestSent_(false), keepAlive_(false), responseAtMs_(0),
+      idleUntilMs_(0), responseLength_(0), headerLength_(0), trailer_(""), delivered_(0), stream_(NULL),
+      recordLeft_(0), link_(0), requestCut_(false) {
+    host_[0] = '\0';
+    memset(&exchange_, 0, sizeof(exchange_));
+    context_.socket = -1;
+    sslclient = &context_;
+    liveClients++;
+}
+
+WiFiClientSecure::~WiFiClientSecure() {
+    liveClients--;
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+    exchange_.reachable = true;
+    exchange_.connectMs = 0;
+    exchange_.responseMs = 0;
+    exchange_.status = 200;
+    exchange_.bodyBytes = 2;
+    exchange_.body = NULL;
+    exchange_.chunked = false;
+    exchange_.closeEarly = false;
+    exchange_.hang = false;
+    exchange_.handshakeSentBytes = TLS_HANDSHAKE_SENT_BYTES;
+    exchange_.handshakeReceivedBytes = TLS_HANDSHAKE_RECEIVED_BYTES;
+    exchange_.keepAliveMs = 60000;
+    exchange_.retryAfterS = 0;
+    exchange_.etag = NULL;
+    exchange_.lastModified = NULL;
+    exchange_.stream = NULL;
+    exchange_.sessionUnknown = false;
+    snprintf(host_, sizeof(host_), "%s", host);
+    port_ = port;
+    context_.socket = nextSocket++;
+    if (serverHandler != NULL) {
+        StandInRequest request = { host_, port_, NULL, false };
+        serverHandler(request, &exchange_, serverContext);
+    }
+    if (exchange_.hang) {
+        throw NativeTaskHang();
+    }
+    if (wifiLinkMissing()) {
+        wifiStats.refusedConnects++;
+        return 0;                        // No route
+    }
+    if (wifiUnheard()) {
+        wifiStats.unheardConnects++;
+        clockAdvance((uint32_t)timeoutMs);   // The SYN is never acknowledged
+        return 0;
+    }
+
+    if (!exchange_.reachable || exchange_.connectMs >= (uint32_t)timeoutMs) {
+        bool failsFast = !exchange_.reachable && exchange_.connectMs > 0;
+        clockAdvance(failsFast ? min(exchange_.connectMs, (uint32_t)timeoutMs) : (uint32_t)timeoutMs);
+        return 0;
+    }
+
+    link_ = wifiGeneration;
+    clockAdvance(exchange_.connectMs);
+    if (wifiCut(link_)) {
+        clockAdvance((uint32_t)timeoutMs - exchange_.connectMs);   // The handshake stalls
+        return 0;
+    }
+    lwip_write(context_.socket, NULL, exchange_.handshakeSentBytes);
+    lwip_read(context_.socket, NULL, exchange_.handshakeReceivedBytes);
+    connected_ = true;
+    requestSent_ = false;
+    keepAlive_ = false;
+    delivered_ = 0;
+    responseLength_ = 0;
+    stream_ = exchange_.stream;
+    recordLeft_ = 0;
+    if (stream_ != NULL) {
+        stream_->opened();
+    }
+    return 1;
+}
+
+uint8_t WiFiClientSecure::connected() {
+    if (stream_ != NULL) {
+        return connected_ && stream_->open();
+    }
+    if (exchange_.closeEarly && requestSent_ && clockMs >= responseAtMs_) {
+        return 0;
+    }
+    if (keepAlive_ && requestSent_ && delivered_ >= responseLength_) {
+        return connected_ && clockMs < idleUntilMs_;
+    }
+    return connected_ && delivered_ < responseLength_;
+}
+
+void WiFiClientSecure::stop() {
+    if (connected_) {
+        lwip_write(context_.socket, NULL, TLS_ALERT_BYTES);   // close_notify
+        if (stream_ != NULL) {
+            stream_->closed();
+        }
+    }
+    stream_ = NULL;
+    connected_ = false;
+    context_.socket = -1;
+}
+
+// Whether the request carries header with exactly value (value NULL: no)
+static bool requestNames(const uint8_t* request, size_t size, const char* header, const char* value) {
+    if (value == NULL) {
+        return false;
+    }
+    char line[128];
+    int length = snprintf(line, sizeof(line), "\r\n%s%s\r\n", header, value);
+    return length < (int)sizeof(line) && memmem(request, size, line, length) != NULL;
+}
+
+size_t WiFiClientSecure::write(const uint8_t* buffer, size_t size) {
+    if (!connected_) {
+        return 0;
+    }
+    if (stream_ != NULL) {
+        if (!stream_->open()) {
+            return 0;
+        }
+        stream_->received(buffer, size);
+        lwip_write(context_.socket, NULL, size + TLS_RECORD_OVERHEAD_BYTES);
+        return size;
+    }
+    if (requestSent_ && delivered_ >= responseLength_) {
+        // Next request on the same connection: only after a kept-alive response
+        if (!keepAlive_ || clockMs >= idleUntilMs_) {
+            connected_ = false;
+            return 0;
+        }
+        requestSent_ = false;
+    }
+    if (!requestSent_) {
+        // Remember the request target: "GET <path> HTTP/1.1"
+        const char* space = (const char*)memchr(buffer, ' ', size);
+        size_t length = 0;
+        if (space != NULL) {
+            const char* path = space + 1;
+            while (path + length < (const char*)buffer + size && path[length] != ' ' &&
+                   length + 1 < sizeof(lastPath)) {
+                length++;
+            }
+            memcpy(lastPath, path, length);
+        }
+        lastPath[length] = '\0';
+
+        if (serverHandler != NULL) {
+            StandInRequest request = { host_, port_, lastPath, false };
+            serverHandler(request, &exchange_, serverContext);
+        }
+        // Keep-alive is only answered when asked for, so plain exchanges
+        // keep their exact byte count
+        bool askedKeepAlive = memmem(buffer, size, "Connection: keep-alive", 22) != NULL;
+        keepAlive_ = askedKeepAlive && exchange_.keepAliveMs > 0;
+        char retryAfter[32] = "";
+        if (exchange_.retryAfterS > 0) {
+            snprintf(retryAfter, sizeof(retryAfter), "Retry-After: %lu\r\n", (unsigned long)exchange_.retryAfterS);
+        }
+        const char* connection = "";
+        if (keepAlive_) {
+            connection = "Connection: keep-alive\r\n";
+        } else if (askedKeepAlive) {
+            connection = "Connection: close\r\n";
+        }
+
+        // Validators, and a 304 without a body for a request that names one
+        char validators[96] = "";
+        size_t validatorsLength = 0;
+        if (exchange_.etag != NULL) {
+            validatorsLength = snprintf(validators, sizeof(validators), "ETag: %s\r\n", exchange_.etag);
+        }
+        if (exchange_.lastModified != NULL && validatorsLength < sizeof(validators)) {
+            snprintf(validators + validatorsLength, sizeof(validators) - validatorsLength, "Last-Modified: %s\r\n",
+                     exchange_.lastModified);
+        }
+        int status = exchange_.status;
+        bodyLength_ = exchange_.bodyBytes;
+        size_t declaredLength = bodyLength_;
+        if (status == 200 && (requestNames(buffer, size, "If-None-Match: ", exchange_.etag) ||
+                              requestNames(buffer, size, "If-Modified-Since: ", exchange_.lastModified))) {
+            status = 304;
+            bodyLength_ = 0;
+        }
+
+        // The first bytes of the body for "Range: bytes=0-N"
+        char contentRange[64] = "";
+        const char* range = (const char*)memmem(buffer, size, "Range: bytes=0-", 15);
+        if (status == 200 && range != NULL && !exchange_.ignoresRange) {
+            unsigned long last = strtoul(range + 15, NULL, 10);
+            if (last + 1 < bodyLength_) {
+                bodyLength_ = last + 1;
+            }
+            snprintf(contentRange, sizeof(contentRange), "Content-Range: bytes 0-%lu/%lu\r\n",
+                     (unsigned long)(bodyLength_ > 0 ? bodyLength_ - 1 : 0), (unsigned long)declaredLength);
+            declaredLength = bodyLength_;
+            status = 206;
+        }
+        // HEAD: the headers a GET would get, no body
+        bool head = size >= 5 && memcmp(buffer, "HEAD ", 5) == 0;
+        if (head) {
+            bodyLength_ = 0;
+        }
+
+        if (status == 304) {
+            headerLength_ = snprintf(response_, sizeof(response_), "HTTP/1.1 304 Stand-In\r\n%s%s\r\n",
+                                     validators, connection);
+            trailer_ = "";
+        } else if (exchange_.chunked) {
+            // The chunk-size line goes with the header, the end of the body
+            // with the trailer
+            headerLength_ = snprintf(response_, sizeof(response_),
+                                     "HTTP/1.1 %d Stand-In\r\nTransfer-Encoding: chunked\r\n%s%s%s%s\r\n",
+                                     status, contentRange, validators, retryAfter, connection);
+            if (bodyLength_ > 0) {
+                headerLength_ += snprintf(response_ + headerLength_, sizeof(response_) - headerLength_, "%x\r\n",
+                                          (unsigned)bodyLength_);
+                trailer_ = "\r\n0\r\n\r\n";
+            } else {
+                trailer_ = head ? "" : "0\r\n\r\n";
+            }
+        } else {
+            headerLength_ = snprintf(response_, sizeof(response_),
+                                     "HTTP/1.1 %d Stand-In\r\nContent-Length: %u\r\n%s%s%s%s\r\n",
+                                     status, (unsigned)declaredLength, contentRange, validators, retryAfter,
+                                     connection);
+            trailer_ = "";
+        }
+        responseLength_ = headerLength_ + bodyLength_ + strlen(trailer_);
+        delivered_ = 0;
+        requestSent_ = true;
+        requestCut_ = false;
+        responseAtMs_ = clockMs + exchange_.responseMs;
+    }
+    lwip_write(context_.socket, NULL, size + TLS_RECORD_OVERHEAD_BYTES);
+    return size;
+}
+
+bool WiFiClientSecure::responseReady() {
+    if (connected_ && requestSent_ && delivered_ == 0 && wifiCut(link_)) {
+        wifiStats.cutRequests += requestCut_ ? 0 : 1;
+        requestCut_ = true;
+        return false;
+    }
+    return connected_ && requestSent_ && !exchange_.closeEarly && clockMs >= responseAtMs_;
+}
+
+int WiFiClientSecure::available() {
+    if (stream_ != NULL) {
+        return connected_ ? (int)(recordLeft_ > 0 ? recordLeft_ : stream_->ready()) : 0;
+    }
+    return responseReady() ? (int)(responseLength_ - delivered_) : 0;
+}
+
+int WiFiClientSecure::read() {
+    if (stream_ != NULL) {
+        // Whatever is ready arrives as one TLS record
+        if (recordLeft_ == 0) {
+            recordLeft_ = connected_ ? stream_->ready() : 0;
+            if (recordLeft_ == 0) {
+                return -1;
+            }
+            lwip_read(context_.socket, NULL, recordLeft_ + TLS_RECORD_OVERHEAD_BYTES);
+        }
+        uint8_t c;
+        stream_->take(&c, 1);
+        recordLeft_--;
+        return c;
+    }
+    if (!responseReady() || delivered_ >= responseLength_) {
+        return -1;
+    }
+    if (delivered_ == 0) {
+        // The whole response arrives as one TLS record
+        lwip_read(context_.socket, NULL, responseLength_ + TLS_RECORD_OVERHEAD_BYTES);
+    }
+    char c;
+    size_t bodyEnd = headerLength_ + bodyLength_;
+    if (delivered_ < headerLength_) {
+        c = response_[delivered_];
+    } else if (delivered_ < bodyEnd) {
+        size_t offset = delivered_ - headerLength_;
+        c = exchange_.body != NULL && exchange_.body[0] != '\0' ? exchange_.body[offset % strlen(exchange_.body)] : 'x';
+    } else {
+        c = trailer_[delivered_ - bodyEnd];
+    }
+    delivered_++;
+    if (delivered_ == responseLength_) {
+        idleUntilMs_ = clockMs + exchange_.keepAliveMs;
+    }
+    return (uint8_t)c;
+}
+
+int WiFiClientSecure::read(uint8_t* buffer, size_t size) {
+    size_t count = 0;
+    while (count < size) {
+        int c = read();
+        if (c < 0) {
+            break;
+        }
+        buffer[count++] = (uint8_t)c;
+    }
+    return count > 0 ? (int)count : -1;
+}
+
+// ============================================================================
+// DTLS CLIENT
+// ============================================================================
+
+// DTLS 1.2 with the same certificate chain as the TLS model, plus the
+// cookie exchange (HelloVerifyRequest and a second ClientHello) and the
+// longer DTLS handshake headers. An abbreviated handshake has no
+// certificate and no key exchange.
+const uint32_t DTLS_FULL_SENT_BYTES = 870;
+const uint32_t DTLS_FULL_RECEIVED_BYTES = 4560;
+const uint32_t DTLS_RESUMED_SENT_BYTES = 460;
+const uint32_t DTLS_RESUMED_RECEIVED_BYTES = 230;
+const uint32_t DTLS_RECORD_OVERHEAD_BYTES = 37;
+const uint32_t DTLS_ALERT_BYTES = DTLS_RECORD_OVERHEAD_BYTES + 2;
+
+static uint32_t dtlsHandshakes = 0;
+static uint32_t dtlsResumptions = 0;
+
+uint32_t nativeDtlsHandshakes() { return dtlsHandshakes; }
+uint32_t nativeDtlsResumptions() { return dtlsResumptions; }
+
+DtlsClient::DtlsClient()
+    : stream_(NULL), socket_(-1), connected_(false), resumed_(false), sessionCached_(false), sessionPort_(0) {
+    memset(&exchange_, 0, sizeof(exchange_));
+    sessionHost_[0] = '\0';
+}
+
+bool DtlsClient::connect(const char* host, uint16_t port, uint32_t timeoutMs) {
+    stop();
+    bool offered = sessionCached_ && port == sessionPort_ && strcmp(host, sessionHost_) == 0;
+    memset(&exchange_, 0, sizeof(exchange_));
+    exchange_.reachable = true;
+    if (serverHandler != NULL) {
+        StandInRequest request = { host, port, NULL, offered };
+        serverHandler(request, &exchange_, serverContext);
+    }
+    resumed_ = offered && !exchange_.sessionUnknown;
+    if (wifiLinkMissing()) {
+        wifiStats.refusedConnects++;
+        resumed_ = false;
+        return false;
+    }
+    if (wifiUnheard()) {
+        wifiStats.unheardConnects++;
+        clockAdvance(timeoutMs);
+        resumed_ = false;
+        return false;
+    }
+
+    if (!exchange_.reachable || exchange_.connectMs >= timeoutMs) {
+        bool failsFast = !exchange_.reachable && exchange_.connectMs > 0;
+        clockAdvance(failsFast ? min(exchange_.connectMs, timeoutMs) : timeoutMs);
+        resumed_ = false;
+        return false;
+    }
+
+    clockAdvance(exchange_.connectMs);
+    socket_ = nextSocket++;
+    lwip_send(socket_, NULL, resumed_ ? DTLS_RESUMED_SENT_BYTES : DTLS_FULL_SENT_BYTES, 0);
+    lwip_recv(socket_, NULL, resumed_ ? DTLS_RESUMED_RECEIVED_BYTES : DTLS_FULL_RECEIVED_BYTES, 0);
+    dtlsHandshakes++;
+    dtlsResumptions += resumed_ ? 1 : 0;
+    sessionCached_ = true;
+    snprintf(sessionHost_, sizeof(sessionHost_), "%s", host);
+    sessionPort_ = port;
+    connected_ = true;
+    stream_ = exchange_.stream;
+    if (stream_ != NULL) {
+        stream_->opened();
+    }
+    return true;
+}
+
+void DtlsClient::stop() {
+    if (connected_) {
+        lwip_send(socket_, NULL, DTLS_ALERT_BYTES, 0);   // close_notify
+        if (stream_ != NULL) {
+            stream_->closed();
+        }
+    }
+    stream_ = NULL;
+    connected_ = false;
+    socket_ = -1;
+}
+
+// A datagram to a server that lost the association, or without a link,
+// goes nowhere
+int DtlsClient::write(const uint8_t* data, size_t size) {
+    if (!connected_) {
+        return -1;
+    }
+    lwip_send(socket_, NULL, size + DTLS_RECORD_OVERHEAD_BYTES, 0);
+    if (stream_ != NULL && stream_->open() && !wifiLinkMissing()) {
+        stream_->received(data, size);
+    }
+    return (int)size;
+}
+
+int DtlsClient::read(uint8_t* buffer, size_t size) {
+    if (!connected_) {
+        return -1;
+    }
+    size_t ready = stream_ != NULL ? stream_->ready() : 0;
+    if (ready == 0) {
+        return 0;
+    }
+    lwip_recv(socket_, NULL, ready + DTLS_RECORD_OVERHEAD_BYTES, 0);
+    uint8_t datagram[1500];
+    size_t taken = stream_->take(datagram, min(ready, sizeof(datagram)));
+    size_t kept = min(taken, size);        // Like recv(), the rest of a datagram is lost
+    memcpy(buffer, datagram, kept);
+    return (int)kept;
+}
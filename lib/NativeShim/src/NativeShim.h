@@ -0,0 +1,269 @@
+// ============================================================================
+// NATIVE SHIM CONTROL
+// ============================================================================
+//
+// Host-side hooks behind the Arduino stand-in headers in this library.
+//
+// - Virtual clock: millis()/micros() read it, delay() advances it. The clock
+//   is 64-bit internally; millis() truncates to 32 bits exactly like the
+//   ESP32, so wraparound behaviour matches the device.
+// - Stand-in server: every WiFiClientSecure connection and DtlsClient
+//   association asks a handler how the exchange should go (latency,
+//   status, failure). The default handler answers 200 OK instantly. A
+//   handler may hand a connection to a StandInStream for protocols other
+//   than HTTP.
+// - Tasks run inline: xTaskCreate() calls the task function to completion.
+//   Counters for live tasks and live secure clients expose leaks, and
+//   pcTaskGetName(NULL) tells a handler which task is talking to it. A task
+//   whose exchange hangs is parked instead: it stays alive (and counted)
+//   until someone deletes it through its handle. A task that blocks in
+//   lwip_select() with nothing to read is parked too, and runs again from
+//   the start whenever inbound traffic is delivered or a socket is closed.
+// - Sockets: lwip_send/recv/write/read only count bytes and live in their
+//   own object file, so native tools can be linked with the same
+//   -Wl,--wrap flags as the firmware (GNU ld only).
+//
+// - Flash partitions: nativePartitionSet() serves a buffer as a data
+//   partition to esp_partition_find_first/read/mmap.
+// - WiFi link: nativeWiFiSetConnected() flips the link and raises the same
+//   events as the ESP32 driver (GOT_IP once begin() was called, DISCONNECTED
+//   when it drops). With a driver model set (nativeWiFiModelSet()), joining
+//   takes association and DHCP time, can fail, and the signal fluctuates;
+//   the virtual clock raises the driver's events at their time wherever it
+//   advances.
+// - Network: bare TCP connects follow nativeNetworkSet(); UDP goes nowhere
+//   unless nativeHostUdpSet() hands it to the host's network stack.
+//   Inbound datagrams and HTTP connections come from nativeUdpDeliver()
+//   and nativeTcpDeliver().
+//
+// Only the single-threaded firmware control flow is modelled; nothing here
+// tries to emulate real concurrency.
+//
+
+#ifndef NATIVE_SHIM_H
+#define NATIVE_SHIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// VIRTUAL CLOCK
+// ============================================================================
+
+uint64_t nativeClockNowMs();
+void nativeClockSetMs(uint64_t nowMs);
+void nativeClockAdvanceMs(uint64_t deltaMs);
+
+// Call step() (the firmware's loop(), or a harness function around it)
+// until the clock reaches endMs and no queue holds an event. A queue wait
+// that would not end before endMs abandons the step instead: the clock
+// stops at endMs, and the next call runs the step again from the start.
+// A step may run past endMs; the clock never goes back.
+void nativeRunUntil(uint64_t endMs, void (*step)());
+
+// ============================================================================
+// STAND-IN SERVER
+// ============================================================================
+
+struct StandInRequest {
+    const char* host;
+    uint16_t port;
+    const char* path;        // NULL while connecting, request target afterwards
+    bool resuming;           // DtlsClient connecting: a cached session is offered
+};
+
+// A peer that speaks a protocol of its own over the secure client instead
+// of HTTP (the MQTT broker of src/host/mqtt.cpp). A handler that sets
+// exchange->stream while connecting gets every byte the client writes; the
+// client reads whatever the peer has ready at the current virtual time,
+// each batch as one TLS record. One stream serves one connection at a time.
+//
+// Behind a DtlsClient (the CoAP server of src/host/coap.cpp) the stream
+// sees datagrams: received() gets one per write(), ready() is the size of
+// the next one readable now (0: none) and take() hands out exactly that
+// one. open() false means the server lost the association; the client
+// cannot tell, its datagrams just go nowhere.
+class StandInStream {
+public:
+    virtual ~StandInStream() {}
+    virtual void opened() = 0;                                    // connect() succeeded
+    virtual void received(const uint8_t* data, size_t size) = 0;  // The client wrote
+    virtual size_t ready() = 0;                                   // Readable now
+    virtual size_t take(uint8_t* out, size_t size) = 0;
+    virtual bool open() = 0;                                      // False once the peer closed
+    virtual void closed() = 0;                                    // The client stopped
+};
+
+struct StandInExchange {
+    bool reachable;          // false: connect() fails after connectMs (0: the client timeout)
+    uint32_t connectMs;      // Time spent in connect() (TCP + TLS)
+    uint32_t responseMs;     // Delay between request and first response byte
+    int status;              // HTTP status code to answer with
+    uint32_t bodyBytes;      // Size of the response body
+    const char* body;        // Its text, repeated to bodyBytes (NULL: 'x' filler)
+    bool chunked;            // Sent as one chunk with Transfer-Encoding: chunked
+    bool closeEarly;         // Peer closes after responseMs without answering
+    bool hang;               // connect() never returns: the task stays wedged
+    uint32_t handshakeSentBytes;      // TLS handshake on the socket (defaults
+    uint32_t handshakeReceivedBytes;  // to a full handshake with an RSA chain)
+    uint32_t keepAliveMs;    // Idle timeout of a kept-alive connection, 0: always close
+    uint32_t retryAfterS;    // Retry-After header to send (seconds), 0: none
+    const char* etag;        // ETag header to send (NULL: none); a request
+    const char* lastModified;   // naming it (or this Last-Modified) gets a 304
+    StandInStream* stream;   // Set on connect: the connection is this peer's, not HTTP
+    bool sessionUnknown;     // DtlsClient: the offered session is refused (full handshake)
+    bool ignoresRange;       // A Range request gets the whole body with 200, not 206
+};
+
+// Called twice per connection: on connect() (path == NULL) to decide
+// reachable/connectMs, and when the request line is written to decide the
+// response (again for every further request on a kept-alive connection).
+// HEAD gets the headers without the body, and "Range: bytes=0-N" a 206 with
+// at most N + 1 bytes of it unless ignoresRange.
+// The exchange keeps its values between the two calls, so a handler may fill
+// in everything up front and ignore the second call.
+typedef void (*StandInHandler)(const StandInRequest& request, StandInExchange* exchange, void* context);
+
+void standInServerSet(StandInHandler handler, void* context);
+
+// Path of the most recent request line seen by the stand-in server
+const char* standInLastPath();
+
+// ============================================================================
+// RESOURCE COUNTERS
+// ============================================================================
+
+int nativeLiveTasks();          // Created and not yet deleted (includes hung)
+int nativeHungTasks();          // Parked by a hanging exchange, not yet deleted
+uint32_t nativeSocketShutdowns(); // lwip_shutdown() calls
+uint64_t nativeSocketBytes();     // Passed through lwip_send/recv/write/read
+int nativeLiveClients();        // WiFiClientSecure instances alive
+uint32_t nativeDtlsHandshakes();  // Completed by DtlsClient, full or abbreviated
+uint32_t nativeDtlsResumptions(); // ... of them abbreviated (session resumed)
+uint32_t nativeTasksCreated();  // Total since start
+
+// For the socket stand-ins: park the running task in a blocking select(),
+// and run the parked ones again after a socket changed
+void nativeTaskSelectBlock();
+void nativeTaskSelectWake();
+
+// ============================================================================
+// FLASH PARTITIONS
+// ============================================================================
+
+// Serve size bytes of data (which must stay valid) as the data partition
+// label with the given subtype; one partition at a time
+void nativePartitionSet(const char* label, uint8_t subtype, const void* data, size_t size);
+
+// ============================================================================
+// WIFI AND GPIO STATE
+// ============================================================================
+
+void nativeWiFiSetConnected(bool connected);   // Fires WiFi.onEvent() callbacks (modelled: the AP comes and goes)
+void nativeWiFiSetMac(const uint8_t* mac);     // 6 bytes; default 24:6F:28:00:00:01
+bool nativeWiFiLinkUp();                       // The station has its IP address
+bool nativeWiFiUplinkUp();                     // The AP hears it (see NativeWiFiModel)
+
+// Reachability of bare TCP connects (lwip_connect()): the gateway
+// (WiFi.gatewayIP(), 192.168.1.1) answers while gatewayUp, every other
+// address while both are up, and neither without the WiFi link. The
+// stand-in server is not affected; its handler decides for itself.
+void nativeNetworkSet(bool gatewayUp, bool wanUp);
+uint32_t nativeLinkConnects();   // lwip_connect() calls since start
+
+// UDP sockets (LAN peer announcements) are stand-ins that send into the
+// void and never receive, unless host UDP is on: then they are real host
+// sockets, so native instances on one machine reach each other over
+// loopback multicast (WiFi.localIP() is 127.0.0.1)
+void nativeHostUdpSet(bool enabled);
+uint32_t nativeUdpSent();        // Datagrams sent since start
+
+// Inbound traffic for listeners on the stand-ins: a datagram for the UDP
+// socket bound to port, or a connection that sends request and then waits
+// for the answer. False when nothing listens there or the queue is full.
+bool nativeUdpDeliver(uint16_t port, const void* data, size_t size);
+bool nativeTcpDeliver(uint16_t port, const char* request);
+uint32_t nativeTcpResponses();          // Answers sent on accepted connections
+const char* nativeTcpLastResponse();    // The latest of them
+int nativePinState(int pin);
+
+// ============================================================================
+// WIFI DRIVER MODEL
+// ============================================================================
+
+// How the simulated ESP32 station joins and keeps its AP. Without a model
+// (the default) the link is up as soon as begin() is called.
+//
+// begin() starts an attempt: association takes associateMinMs to
+// associateMaxMs and raises STA_CONNECTED, DHCP another dhcpMinMs to
+// dhcpMaxMs and raises GOT_IP. An attempt fails (DISCONNECTED after the
+// association time) when the AP is away, the signal is below lossDbm, or
+// by joinFailPermille; like the driver with auto-reconnect, the station
+// tries again retryMs later, until begin() restarts it. A link that is up
+// drops (DISCONNECTED) when the AP goes away, on nativeWiFiDeauth(), and
+// when the signal stays below lossDbm for beaconTimeoutMs.
+//
+// Disturbances can be scripted ahead with nativeWiFiScript(): each step
+// takes effect when the virtual clock reaches it, also while a request
+// task is inside connect() or waiting for its response.
+//
+// The signal is sampled every second: rssiDbm (or what nativeWiFiSetSignal()
+// made it) plus a correlated fluctuation of rssiSwingDb standard deviation.
+//
+// Traffic follows the link: secure clients and bare TCP connects fail at
+// once without it, and a connection that was open when the link dropped
+// never gets its response (the request runs into its timeout).
+//
+// The path is symmetric and the AP sends at 19.5 dBm: below that, the AP
+// hears the station's frames as much weaker as WiFi.setTxPower() made
+// them. When that falls below lossDbm, connects stall into their timeout
+// (the link itself stays up: beacons still arrive).
+struct NativeWiFiModel {
+    uint32_t associateMinMs;     // Scan, authentication, association
+    uint32_t associateMaxMs;
+    uint32_t dhcpMinMs;          // From association to the IP address
+    uint32_t dhcpMaxMs;
+    uint16_t joinFailPermille;   // Attempts the AP turns down (auth timeout, ...)
+    uint32_t retryMs;            // After a failed attempt
+    int8_t rssiDbm;              // Mean signal
+    uint8_t rssiSwingDb;
+    int8_t lossDbm;              // Beacons are lost below this
+    uint32_t beaconTimeoutMs;
+    uint32_t seed;
+};
+
+struct NativeWiFiStats {
+    uint32_t attempts;           // Association attempts, retries included
+    uint32_t failedAttempts;
+    uint32_t drops;              // Links lost after GOT_IP
+    uint32_t cutRequests;        // Responses lost to a drop
+    uint32_t refusedConnects;    // Connects without a link
+    uint32_t unheardConnects;    // Connects the AP could not hear (TX power too low)
+};
+
+enum NativeWiFiAction : uint8_t {
+    NATIVE_WIFI_DEAUTH,
+    NATIVE_WIFI_AP_DOWN,
+    NATIVE_WIFI_AP_UP,
+    NATIVE_WIFI_SIGNAL,          // New mean signal: signalDbm
+};
+
+struct NativeWiFiStep {
+    uint64_t atMs;
+    uint8_t action;              // NativeWiFiAction
+    int8_t signalDbm;
+};
+
+// NULL: back to the instant link. Setting a model takes the link down
+// (no event) until begin().
+void nativeWiFiModelSet(const NativeWiFiModel* model);
+void nativeWiFiSetApUp(bool up);
+void nativeWiFiDeauth();                       // The AP kicks the station; it may join again
+void nativeWiFiSetSignal(int8_t rssiDbm);      // New mean signal (a fade, or its end)
+int8_t nativeWiFiSignal();                     // Current signal
+int8_t nativeWiFiTxPower();                    // Set by WiFi.setTxPower(), 0.25 dBm
+void nativeWiFiScript(const NativeWiFiStep* steps, size_t count);   // Replaces the pending script; steps in time order
+uint64_t nativeWiFiNextEventMs();              // Next driver step, signal sample or script step (UINT64_MAX: none)
+const NativeWiFiStats& nativeWiFiStats();
+
+#endif // NATIVE_SHIM_H
@@ -0,0 +1,35 @@
+// ============================================================================
+// PREFERENCES (NVS) STAND-IN (native builds only)
+// ============================================================================
+//
+// Byte blobs only, held in a small fixed table (no heap) that outlives
+// every Preferences object, so state written before a simulated reboot
+// can be read back after it. nativePreferencesClear() wipes the table.
+//
+
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+    Preferences() : namespace_(NULL), readOnly_(true) {}
+    ~Preferences() { end(); }
+
+    // Read-only access to a namespace nothing was written to fails, as on the device
+    bool begin(const char* name, bool readOnly = false);
+    void end() { namespace_ = NULL; }
+
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+    size_t putBytes(const char* key, const void* value, size_t length);
+
+private:
+    const char* namespace_;
+    bool readOnly_;
+};
+
+void nativePreferencesClear();
+
+#endif // PREFERENCES_H
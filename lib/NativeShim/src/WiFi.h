@@ -0,0 +1,62 @@
+// ============================================================================
+// WIFI STAND-IN (native builds only)
+// ============================================================================
+
+#ifndef WIFI_H
+#define WIFI_H
+
+#include <Arduino.h>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+} arduino_event_id_t;
+
+typedef void (*WiFiEventCb)(arduino_event_id_t event);
+
+// In 0.25 dBm, as esp_wifi_set_max_tx_power() takes them; any value in
+// between may be passed too
+typedef enum {
+    WIFI_POWER_19_5dBm = 78,
+    WIFI_POWER_17dBm = 68,
+    WIFI_POWER_15dBm = 60,
+    WIFI_POWER_13dBm = 52,
+    WIFI_POWER_11dBm = 44,
+    WIFI_POWER_8_5dBm = 34,
+    WIFI_POWER_2dBm = 8,
+} wifi_power_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+} wifi_mode_t;
+
+class WiFiClass {
+public:
+    wl_status_t status();
+    void onEvent(WiFiEventCb callback);   // Called synchronously on link changes
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    bool mode(wifi_mode_t mode);
+    bool setAutoReconnect(bool autoReconnect);
+    bool setHostname(const char* hostname);
+    const char* getHostname();
+    wl_status_t begin(const char* ssid, const char* password);
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    uint8_t* macAddress(uint8_t* mac);
+    int8_t RSSI();
+    bool setTxPower(wifi_power_t power);
+    wifi_power_t getTxPower();
+};
+
+extern WiFiClass WiFi;
+
+#endif // WIFI_H
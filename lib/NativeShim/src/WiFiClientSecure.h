@@ -0,0 +1,72 @@
+// ============================================================================
+// SECURE CLIENT STAND-IN (native builds only)
+// ============================================================================
+//
+// Plays one HTTP exchange per connection against the stand-in server: the
+// connect() call advances the virtual clock by the modelled connect time,
+// and the response becomes readable responseMs after the request is sent.
+// A request asking for keep-alive leaves the connection open for the next
+// one until the server's idle timeout (StandInExchange::keepAliveMs).
+// A handler may hand the connection to a StandInStream instead, which then
+// sees the raw bytes (a protocol other than HTTP, e.g. MQTT).
+// The TLS bytes of the exchange (handshake, request and response records,
+// close_notify) go through the lwIP stand-ins, so the traffic meter sees
+// them like on a device.
+//
+
+#ifndef WIFI_CLIENT_SECURE_H
+#define WIFI_CLIENT_SECURE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <NativeShim.h>
+
+// Same member the ESP32 core keeps the socket in
+struct sslclient_context {
+    int socket;
+};
+
+class WiFiClientSecure : public Stream {
+public:
+    WiFiClientSecure();
+    ~WiFiClientSecure();
+
+    void setInsecure() {}
+    int connect(const char* host, uint16_t port, int32_t timeoutMs);
+    uint8_t connected();
+    void stop();
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    virtual int read(uint8_t* buffer, size_t size);
+
+protected:
+    sslclient_context* sslclient;
+
+private:
+    bool responseReady();
+
+    sslclient_context context_;
+    char host_[64];
+    uint16_t port_;
+    StandInExchange exchange_;
+    bool connected_;
+    bool requestSent_;
+    bool keepAlive_;          // Current exchange keeps the connection open
+    uint64_t responseAtMs_;
+    uint64_t idleUntilMs_;    // Server closes a kept-alive connection then
+    char response_[320];
+    size_t responseLength_;
+    size_t headerLength_;
+    size_t bodyLength_;       // 0 for a 304
+    const char* trailer_;     // After the body (end of a chunked body)
+    size_t delivered_;
+    StandInStream* stream_;   // Raw peer of this connection (NULL: HTTP)
+    size_t recordLeft_;       // Unread bytes of the stream's current record
+    uint32_t link_;           // WiFi link generation at connect (driver model)
+    bool requestCut_;         // A link drop took the response
+};
+
+#endif // WIFI_CLIENT_SECURE_H
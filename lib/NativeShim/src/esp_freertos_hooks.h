@@ -0,0 +1,19 @@
+// ============================================================================
+// FREERTOS HOOKS STAND-IN (native builds only)
+// ============================================================================
+
+#ifndef ESP_FREERTOS_HOOKS_H
+#define ESP_FREERTOS_HOOKS_H
+
+#include <Arduino.h>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#endif
+
+typedef void (*esp_freertos_tick_cb_t)();
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t callback, UBaseType_t cpu);
+
+#endif // ESP_FREERTOS_HOOKS_H
@@ -0,0 +1,13 @@
+// ============================================================================
+// ESP TIMER STAND-IN (native builds only)
+// ============================================================================
+
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+// Microseconds on the virtual clock
+int64_t esp_timer_get_time();
+
+#endif // ESP_TIMER_H
@@ -0,0 +1,58 @@
+// ============================================================================
+// LWIP SOCKETS STAND-IN (native builds only)
+// ============================================================================
+
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+
+// SHUT_*, MSG_PEEK, AF_INET, fd_set and the errno values come from the
+// host's headers
+
+// C linkage like lwIP, so -Wl,--wrap matches the plain symbol names
+extern "C" {
+
+// Counted by the shim (see nativeSocketShutdowns()); a wedged stand-in
+// connection stays wedged, like a TLS stack that ignores the shutdown
+int lwip_shutdown(int socket, int how);
+
+// Move no data: they report size bytes transferred and add them to
+// nativeSocketBytes(). The buffer is never touched and may be NULL.
+ssize_t lwip_send(int socket, const void* data, size_t size, int flags);
+ssize_t lwip_recv(int socket, void* buffer, size_t size, int flags);
+ssize_t lwip_write(int socket, const void* data, size_t size);
+ssize_t lwip_read(int socket, void* buffer, size_t size);
+
+// Bare TCP connects (link probes) against the network model of
+// nativeNetworkSet(): non-blocking connects complete after a LAN or WAN
+// round trip, or never when the target is cut off. No data moves.
+int lwip_socket(int domain, int type, int protocol);
+int lwip_fcntl(int socket, int command, int value);
+int lwip_connect(int socket, const struct sockaddr* address, socklen_t length);
+int lwip_select(int count, fd_set* readable, fd_set* writable, fd_set* failed, struct timeval* timeout);
+int lwip_getsockopt(int socket, int level, int option, void* value, socklen_t* length);
+int lwip_close(int socket);
+
+// UDP (see nativeHostUdpSet()). SOCK_DGRAM sockets also work with
+// lwip_fcntl() and lwip_close() above. A SOCK_STREAM socket bound to a
+// port can listen and accept the connections of nativeTcpDeliver(), which
+// move their data through lwip_recvfrom() and lwip_sendto().
+int lwip_bind(int socket, const struct sockaddr* address, socklen_t length);
+int lwip_setsockopt(int socket, int level, int option, const void* value, socklen_t length);
+ssize_t lwip_sendto(int socket, const void* data, size_t size, int flags, const struct sockaddr* to,
+                    socklen_t length);
+ssize_t lwip_recvfrom(int socket, void* buffer, size_t size, int flags, struct sockaddr* from, socklen_t* length);
+int lwip_listen(int socket, int backlog);
+int lwip_accept(int socket, struct sockaddr* address, socklen_t* length);
+
+}  // extern "C"
+
+#endif // LWIP_SOCKETS_H
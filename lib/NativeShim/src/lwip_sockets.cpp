@@ -0,0 +1,515 @@
+// Kept apart from NativeShim.cpp: -Wl,--wrap only redirects references
+// between object files, and the secure client stand-in must reach these
+// through the wrappers like mbedTLS does on the device.
+
+#include <NativeShim.h>
+#include <lwip/sockets.h>
+
+#include <string.h>
+#include <unistd.h>
+
+static uint32_t socketShutdowns = 0;
+static uint64_t socketBytes = 0;
+
+uint32_t nativeSocketShutdowns() { return socketShutdowns; }
+uint64_t nativeSocketBytes() { return socketBytes; }
+
+int lwip_shutdown(int socket, int how) {
+    (void)socket;
+    (void)how;
+    socketShutdowns++;
+    return 0;
+}
+
+ssize_t lwip_send(int socket, const void* data, size_t size, int flags) {
+    (void)socket;
+    (void)data;
+    (void)flags;
+    socketBytes += size;
+    return (ssize_t)size;
+}
+
+ssize_t lwip_recv(int socket, void* buffer, size_t size, int flags) {
+    (void)socket;
+    (void)buffer;
+    if ((flags & MSG_PEEK) == 0) {
+        socketBytes += size;
+    }
+    return (ssize_t)size;
+}
+
+ssize_t lwip_write(int socket, const void* data, size_t size) {
+    return lwip_send(socket, data, size, 0);
+}
+
+ssize_t lwip_read(int socket, void* buffer, size_t size) {
+    return lwip_recv(socket, buffer, size, 0);
+}
+
+// ============================================================================
+// BARE TCP CONNECTS
+// ============================================================================
+
+const int LINK_SOCKET_BASE = 1000;       // Within FD_SETSIZE; only link calls look these up
+const int LINK_SOCKETS = 4;
+const uint32_t LAN_ROUND_TRIP_MS = 2;
+const uint32_t WAN_ROUND_TRIP_MS = 30;
+static const uint8_t GATEWAY[4] = { 192, 168, 1, 1 };
+
+struct LinkSocket {
+    bool open;
+    bool connecting;
+    bool reachable;
+    uint64_t connectedAtMs;
+    uint16_t port;                       // Bound to (listeners)
+    bool listening;
+};
+
+static LinkSocket linkSockets[LINK_SOCKETS];
+static bool gatewayUp = true;
+static bool wanUp = true;
+static uint32_t linkConnects = 0;
+
+void nativeNetworkSet(bool gateway, bool wan) {
+    gatewayUp = gateway;
+    wanUp = wan;
+}
+
+uint32_t nativeLinkConnects() { return linkConnects; }
+
+static LinkSocket* linkSocket(int socket) {
+    int index = socket - LINK_SOCKET_BASE;
+    return index >= 0 && index < LINK_SOCKETS && linkSockets[index].open ? &linkSockets[index] : NULL;
+}
+
+static int udpSocket(int protocol);
+static bool udpFcntl(int socket, int command, int value, int* result);
+static bool udpClose(int socket);
+static bool inboundOpen(int socket);
+static bool inboundClose(int socket);
+
+int lwip_socket(int domain, int type, int protocol) {
+    if (domain == AF_INET && type == SOCK_DGRAM) {
+        return udpSocket(protocol);
+    }
+    if (domain != AF_INET || type != SOCK_STREAM) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < LINK_SOCKETS; i++) {
+        if (!linkSockets[i].open) {
+            linkSockets[i] = { true, false, false, 0, 0, false };
+            return LINK_SOCKET_BASE + i;
+        }
+    }
+    errno = ENFILE;
+    return -1;
+}
+
+int lwip_fcntl(int socket, int command, int value) {
+    int result;
+    if (udpFcntl(socket, command, value, &result)) {
+        return result;
+    }
+    if (linkSocket(socket) == NULL && !inboundOpen(socket)) {
+        errno = EBADF;
+        return -1;
+    }
+    return command == F_GETFL ? O_NONBLOCK : 0;   // Always non-blocking
+}
+
+// The link state is taken when the SYN goes out
+int lwip_connect(int socket, const struct sockaddr* address, socklen_t length) {
+    LinkSocket* link = linkSocket(socket);
+    if (link == NULL || length < sizeof(struct sockaddr_in)) {
+        errno = EBADF;
+        return -1;
+    }
+    const struct sockaddr_in* peer = (const struct sockaddr_in*)address;
+    bool gateway = memcmp(&peer->sin_addr.s_addr, GATEWAY, sizeof(GATEWAY)) == 0;
+    linkConnects++;
+    link->connecting = true;
+    link->reachable = nativeWiFiLinkUp() && nativeWiFiUplinkUp() && gatewayUp && (gateway || wanUp);
+    link->connectedAtMs = nativeClockNowMs() + (gateway ? LAN_ROUND_TRIP_MS : WAN_ROUND_TRIP_MS);
+    errno = EINPROGRESS;
+    return -1;
+}
+
+// Only writability of connecting sockets is modelled, and only a zero
+// timeout (the link probe polls)
+static bool socketReadable(int socket);
+
+// Without a timeout, a task that finds nothing ready is parked until the
+// next socket change (see nativeTaskSelectWake())
+int lwip_select(int count, fd_set* readable, fd_set* writable, fd_set* failed, struct timeval* timeout) {
+    int ready = 0;
+    for (int socket = 0; socket < count; socket++) {
+        if (failed != NULL) {
+            FD_CLR(socket, failed);
+        }
+        if (readable != NULL && FD_ISSET(socket, readable)) {
+            if (socketReadable(socket)) {
+                ready++;
+            } else {
+                FD_CLR(socket, readable);
+            }
+        }
+        if (writable == NULL || !FD_ISSET(socket, writable)) {
+            continue;
+        }
+        LinkSocket* link = linkSocket(socket);
+        if (link != NULL && link->connecting && link->reachable && nativeClockNowMs() >= link->connectedAtMs) {
+            ready++;
+        } else {
+            FD_CLR(socket, writable);
+        }
+    }
+    if (ready == 0 && timeout == NULL) {
+        nativeTaskSelectBlock();
+    }
+    return ready;
+}
+
+int lwip_getsockopt(int socket, int level, int option, void* value, socklen_t* length) {
+    if (linkSocket(socket) == NULL || level != SOL_SOCKET || option != SO_ERROR || *length < sizeof(int)) {
+        errno = EINVAL;
+        return -1;
+    }
+    *(int*)value = 0;
+    return 0;
+}
+
+// Like lwIP, closing a socket wakes a select() waiting on it
+int lwip_close(int socket) {
+    if (!udpClose(socket) && !inboundClose(socket)) {
+        LinkSocket* link = linkSocket(socket);
+        if (link == NULL) {
+            errno = EBADF;
+            return -1;
+        }
+        link->open = false;
+    }
+    nativeTaskSelectWake();
+    return 0;
+}
+
+// ============================================================================
+// UDP
+// ============================================================================
+
+const int UDP_SOCKET_BASE = 1008;        // Stand-ins, after the link sockets
+const int UDP_SOCKETS = 4;
+
+const int UDP_QUEUE = 8;
+const size_t UDP_DATAGRAM_BYTES = 128;
+
+struct UdpSocket {
+    bool open;
+    int hostFd;                          // -1: a stand-in
+    uint16_t port;                       // Stand-in: bound to
+    uint8_t queued;                      // Stand-in: datagrams from nativeUdpDeliver()
+    uint8_t head;
+    size_t sizes[UDP_QUEUE];
+    char datagrams[UDP_QUEUE][UDP_DATAGRAM_BYTES];
+};
+
+static UdpSocket udpSockets[UDP_SOCKETS];
+static bool hostUdp = false;
+static uint32_t udpSent = 0;
+
+void nativeHostUdpSet(bool enabled) { hostUdp = enabled; }
+uint32_t nativeUdpSent() { return udpSent; }
+
+static UdpSocket* findUdpSocket(int socket) {
+    for (int i = 0; i < UDP_SOCKETS; i++) {
+        UdpSocket& udp = udpSockets[i];
+        if (udp.open && (udp.hostFd >= 0 ? udp.hostFd == socket : UDP_SOCKET_BASE + i == socket)) {
+            return &udp;
+        }
+    }
+    return NULL;
+}
+
+static int udpSocket(int protocol) {
+    for (int i = 0; i < UDP_SOCKETS; i++) {
+        UdpSocket& udp = udpSockets[i];
+        if (udp.open) {
+            continue;
+        }
+        udp.hostFd = -1;
+        udp.port = 0;
+        udp.queued = 0;
+        if (hostUdp) {
+            udp.hostFd = ::socket(AF_INET, SOCK_DGRAM, protocol);
+            if (udp.hostFd < 0) {
+                return -1;
+            }
+        }
+        udp.open = true;
+        return udp.hostFd >= 0 ? udp.hostFd : UDP_SOCKET_BASE + i;
+    }
+    errno = ENFILE;
+    return -1;
+}
+
+static bool udpFcntl(int socket, int command, int value, int* result) {
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp == NULL) {
+        return false;
+    }
+    *result = udp->hostFd >= 0 ? ::fcntl(udp->hostFd, command, value) : command == F_GETFL ? O_NONBLOCK : 0;
+    return true;
+}
+
+static bool udpClose(int socket) {
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp == NULL) {
+        return false;
+    }
+    if (udp->hostFd >= 0) {
+        ::close(udp->hostFd);
+    }
+    udp->open = false;
+    return true;
+}
+
+bool nativeUdpDeliver(uint16_t port, const void* data, size_t size) {
+    for (int i = 0; i < UDP_SOCKETS; i++) {
+        UdpSocket& udp = udpSockets[i];
+        if (!udp.open || udp.hostFd >= 0 || udp.port != port) {
+            continue;
+        }
+        if (udp.queued == UDP_QUEUE || size > UDP_DATAGRAM_BYTES) {
+            return false;
+        }
+        uint8_t slot = (udp.head + udp.queued) % UDP_QUEUE;
+        memcpy(udp.datagrams[slot], data, size);
+        udp.sizes[slot] = size;
+        udp.queued++;
+        nativeTaskSelectWake();
+        return true;
+    }
+    return false;
+}
+
+int lwip_bind(int socket, const struct sockaddr* address, socklen_t length) {
+    LinkSocket* link = linkSocket(socket);
+    if (link != NULL && length >= sizeof(struct sockaddr_in)) {
+        link->port = ntohs(((const struct sockaddr_in*)address)->sin_port);
+        return 0;
+    }
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp == NULL || length < sizeof(struct sockaddr_in)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (udp->hostFd >= 0) {
+        return ::bind(udp->hostFd, address, length);
+    }
+    udp->port = ntohs(((const struct sockaddr_in*)address)->sin_port);
+    return 0;
+}
+
+int lwip_setsockopt(int socket, int level, int option, const void* value, socklen_t length) {
+    if (linkSocket(socket) != NULL) {
+        return 0;
+    }
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    return udp->hostFd >= 0 ? ::setsockopt(udp->hostFd, level, option, value, length) : 0;
+}
+
+struct InboundSocket;
+static InboundSocket* inboundSocket(int socket);
+static ssize_t inboundSend(InboundSocket* inbound, const void* data, size_t size);
+static ssize_t inboundReceive(InboundSocket* inbound, void* buffer, size_t size);
+
+ssize_t lwip_sendto(int socket, const void* data, size_t size, int flags, const struct sockaddr* to,
+                    socklen_t length) {
+    InboundSocket* inbound = inboundSocket(socket);
+    if (inbound != NULL) {
+        return inboundSend(inbound, data, size);
+    }
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    udpSent++;
+    return udp->hostFd >= 0 ? ::sendto(udp->hostFd, data, size, flags, to, length) : (ssize_t)size;
+}
+
+// A stand-in only reads what nativeUdpDeliver() queued
+ssize_t lwip_recvfrom(int socket, void* buffer, size_t size, int flags, struct sockaddr* from, socklen_t* length) {
+    InboundSocket* inbound = inboundSocket(socket);
+    if (inbound != NULL) {
+        return inboundReceive(inbound, buffer, size);
+    }
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (udp->hostFd >= 0) {
+        return ::recvfrom(udp->hostFd, buffer, size, flags, from, length);
+    }
+    if (udp->queued == 0) {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+    size_t taken = udp->sizes[udp->head] < size ? udp->sizes[udp->head] : size;
+    memcpy(buffer, udp->datagrams[udp->head], taken);
+    udp->head = (udp->head + 1) % UDP_QUEUE;
+    udp->queued--;
+    return (ssize_t)taken;
+}
+
+// ============================================================================
+// INBOUND TCP
+// ============================================================================
+
+const int INBOUND_SOCKET_BASE = 1016;    // Accepted connections, after the UDP stand-ins (up to FD_SETSIZE)
+const int INBOUND_SOCKETS = 8;
+const size_t INBOUND_BYTES = 256;
+
+struct InboundSocket {
+    bool open;                           // Accepted and not closed yet
+    bool pending;                        // Waiting in the listen backlog
+    uint16_t port;
+    size_t length;
+    size_t read;
+    char request[INBOUND_BYTES];
+};
+
+static InboundSocket inboundSockets[INBOUND_SOCKETS];
+static uint32_t inboundResponses = 0;
+static char lastResponse[INBOUND_BYTES];
+
+uint32_t nativeTcpResponses() { return inboundResponses; }
+const char* nativeTcpLastResponse() { return lastResponse; }
+
+static InboundSocket* inboundSocket(int socket) {
+    int index = socket - INBOUND_SOCKET_BASE;
+    return index >= 0 && index < INBOUND_SOCKETS && inboundSockets[index].open ? &inboundSockets[index] : NULL;
+}
+
+static bool inboundOpen(int socket) {
+    return inboundSocket(socket) != NULL;
+}
+
+static bool inboundClose(int socket) {
+    InboundSocket* inbound = inboundSocket(socket);
+    if (inbound == NULL) {
+        return false;
+    }
+    inbound->open = false;
+    return true;
+}
+
+bool nativeTcpDeliver(uint16_t port, const char* request) {
+    bool listened = false;
+    for (int i = 0; i < LINK_SOCKETS; i++) {
+        listened |= linkSockets[i].open && linkSockets[i].listening && linkSockets[i].port == port;
+    }
+    size_t length = strlen(request);
+    if (!listened || length > INBOUND_BYTES) {
+        return false;
+    }
+    for (int i = 0; i < INBOUND_SOCKETS; i++) {
+        InboundSocket& inbound = inboundSockets[i];
+        if (!inbound.open && !inbound.pending) {
+            inbound.pending = true;
+            inbound.port = port;
+            inbound.length = length;
+            inbound.read = 0;
+            memcpy(inbound.request, request, length);
+            nativeTaskSelectWake();
+            return true;
+        }
+    }
+    return false;
+}
+
+int lwip_listen(int socket, int backlog) {
+    (void)backlog;
+    LinkSocket* link = linkSocket(socket);
+    if (link == NULL || link->port == 0) {
+        errno = EBADF;
+        return -1;
+    }
+    link->listening = true;
+    return 0;
+}
+
+int lwip_accept(int socket, struct sockaddr* address, socklen_t* length) {
+    (void)address;
+    (void)length;
+    LinkSocket* link = linkSocket(socket);
+    if (link == NULL || !link->listening) {
+        errno = EBADF;
+        return -1;
+    }
+    for (int i = 0; i < INBOUND_SOCKETS; i++) {
+        InboundSocket& inbound = inboundSockets[i];
+        if (inbound.pending && inbound.port == link->port) {
+            inbound.pending = false;
+            inbound.open = true;
+            return INBOUND_SOCKET_BASE + i;
+        }
+    }
+    errno = EWOULDBLOCK;
+    return -1;
+}
+
+static ssize_t inboundSend(InboundSocket* inbound, const void* data, size_t size) {
+    (void)inbound;
+    size_t kept = size < INBOUND_BYTES - 1 ? size : INBOUND_BYTES - 1;
+    memcpy(lastResponse, data, kept);
+    lastResponse[kept] = '\0';
+    inboundResponses++;
+    return (ssize_t)size;
+}
+
+// The sender keeps the connection open after its request, waiting for the
+// answer
+static ssize_t inboundReceive(InboundSocket* inbound, void* buffer, size_t size) {
+    size_t left = inbound->length - inbound->read;
+    if (left == 0) {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+    size_t taken = left < size ? left : size;
+    memcpy(buffer, inbound->request + inbound->read, taken);
+    inbound->read += taken;
+    return (ssize_t)taken;
+}
+
+// ============================================================================
+// SELECT
+// ============================================================================
+
+// A queued datagram, a connection waiting to be accepted, unread request
+// bytes, or a socket that is not open (any more)
+static bool socketReadable(int socket) {
+    UdpSocket* udp = findUdpSocket(socket);
+    if (udp != NULL) {
+        return udp->hostFd < 0 && udp->queued > 0;
+    }
+    InboundSocket* inbound = inboundSocket(socket);
+    if (inbound != NULL) {
+        return inbound->read < inbound->length;
+    }
+    LinkSocket* link = linkSocket(socket);
+    if (link == NULL) {
+        return true;
+    }
+    for (int i = 0; link->listening && i < INBOUND_SOCKETS; i++) {
+        if (inboundSockets[i].pending && inboundSockets[i].port == link->port) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,24 @@
+// ============================================================================
+// PLACEHOLDER SECRETS (native builds only)
+// ============================================================================
+//
+// Lets the host-side tools compile without include/secrets.h. When the real
+// file exists it is found first, which is harmless: native builds never
+// reach the network, the URLs are only fed to the stand-in server.
+//
+
+#ifndef SECRETS_H
+#define SECRETS_H
+
+#define WIFI_SSID "native-ssid"
+#define WIFI_PASSWORD "native-password"
+#define DEVICE_HOSTNAME "ESP32-Svitlo-Watcher"
+// Host tools may point the endpoints elsewhere with build flags
+#ifndef API_ENDPOINT_1
+#define API_ENDPOINT_1 "https://standin.local/endpoint-1"
+#endif
+#ifndef API_ENDPOINT_2
+#define API_ENDPOINT_2 "https://standin.local/endpoint-2"
+#endif
+
+#endif // SECRETS_H
@@ -0,0 +1,336 @@
+#include "CoapProbe.h"
+#include "log.h"
+
+#include <lwip/sockets.h>
+
+static const char SCHEME[] = "coaps://";
+const uint8_t TOKEN_BYTES = 4;
+
+// RFC 7252: a 4.29 without Max-Age means 60 seconds
+const uint32_t DEFAULT_MAX_AGE_S = 60;
+
+// check(): still waiting for the answer
+const int CHECK_PENDING = -2000;
+
+// ============================================================================
+// URLS
+// ============================================================================
+
+bool coapUrl(const char* url) {
+    return strncmp(url, SCHEME, sizeof(SCHEME) - 1) == 0;
+}
+
+bool coapParseUrl(const char* url, CoapTarget* out) {
+    if (!coapUrl(url)) {
+        return false;
+    }
+
+    const char* host = url + sizeof(SCHEME) - 1;
+    const char* hostEnd = host;
+    while (*hostEnd != '\0' && *hostEnd != '/' && *hostEnd != ':' && *hostEnd != '?') {
+        hostEnd++;
+    }
+    size_t hostLength = hostEnd - host;
+    if (hostLength == 0 || hostLength >= sizeof(out->host)) {
+        return false;
+    }
+    memcpy(out->host, host, hostLength);
+    out->host[hostLength] = '\0';
+
+    out->port = COAP_DEFAULT_PORT;
+    const char* path = hostEnd;
+    if (*path == ':') {
+        unsigned long port = 0;
+        path++;
+        while (*path >= '0' && *path <= '9') {
+            port = port * 10 + (*path - '0');
+            path++;
+        }
+        if (port == 0 || port > 65535) {
+            return false;
+        }
+        out->port = (uint16_t)port;
+    }
+    if (*path == '/') {
+        path++;
+    }
+
+    const char* query = strchr(path, '?');
+    size_t pathLength = query != NULL ? (size_t)(query - path) : strlen(path);
+    if (pathLength >= sizeof(out->path)) {
+        return false;
+    }
+    memcpy(out->path, path, pathLength);
+    out->path[pathLength] = '\0';
+    out->query = query != NULL ? query + 1 : NULL;
+    return true;
+}
+
+// ============================================================================
+// ASSOCIATION
+// ============================================================================
+
+CoapProbe::CoapProbe(const CoapProbeConfig& config)
+    : config_(config), mutex_(NULL), port_(0), messageId_(0), heardMs_(0), ioEndpoint_(-1), handshakes_(0),
+      resumptions_(0), transmissions_(0), retransmissions_(0) {
+    host_[0] = '\0';
+    memset(exchanges_, 0, sizeof(exchanges_));
+}
+
+void CoapProbe::begin() {
+    if (mutex_ == NULL) {
+        mutex_ = xSemaphoreCreateMutex();
+    }
+    client_.setInsecure();
+    messageId_ = (uint16_t)esp_random();
+    handshakes_ = 0;
+    resumptions_ = 0;
+    transmissions_ = 0;
+    retransmissions_ = 0;
+}
+
+bool CoapProbe::lock(const ProbeRequest& request, uint32_t waitMs) {
+    if (mutex_ == NULL || xSemaphoreTake(mutex_, pdMS_TO_TICKS(waitMs)) != pdTRUE) {
+        return false;
+    }
+    ioEndpoint_ = request.index - 1;
+    return true;
+}
+
+void CoapProbe::unlock() {
+    ioEndpoint_ = -1;
+    xSemaphoreGive(mutex_);
+}
+
+// DNS and the DTLS handshake, resuming the cached session if the server
+// agrees. Returns 0 once the association is up.
+int CoapProbe::open(const CoapTarget& target, int index, MiniHttpTiming* timing) {
+    client_.stop();
+    LOG_INFO("[%d] DTLS handshake with %s:%u... ", index, target.host, target.port);
+    uint32_t phaseStart = millis();
+    bool connected = client_.connect(target.host, target.port, config_.handshakeTimeoutMs);
+    timing->connectMs += millis() - phaseStart;
+    if (!connected) {
+        LOG_ERROR("[%d] ✗ DTLS handshake with %s failed\n", index, target.host);
+        return MINI_HTTP_ERROR_CONNECTION_REFUSED;
+    }
+    handshakes_++;
+    resumptions_ += client_.resumed() ? 1 : 0;
+    snprintf(host_, sizeof(host_), "%s", target.host);
+    port_ = target.port;
+    heardMs_ = millis();
+    LOG_INFO("[%d] ✓ DTLS session %s\n", index, client_.resumed() ? "resumed" : "new");
+    return 0;
+}
+
+bool CoapProbe::send(const uint8_t* datagram, size_t size, uint8_t meterSlot) {
+    netMeterSetPhase(meterSlot, TRAFFIC_REQUEST);
+    return client_.write(datagram, size) == (int)size;
+}
+
+// Hand every waiting datagram to the exchange it answers. They are metered
+// with the check that happens to read them.
+void CoapProbe::pump(uint8_t meterSlot) {
+    netMeterSetPhase(meterSlot, TRAFFIC_RESPONSE);
+    uint8_t datagram[COAP_DATAGRAM_BYTES];
+    int size;
+    while ((size = client_.read(datagram, sizeof(datagram))) > 0) {
+        heardMs_ = millis();
+        handle(datagram, (size_t)size);
+    }
+}
+
+void CoapProbe::handle(const uint8_t* datagram, size_t size) {
+    CoapReader reader;
+    if (!reader.parse(datagram, size)) {
+        return;
+    }
+    const CoapHeader& header = reader.header();
+
+    // A confirmable (separate) response is acknowledged even when no check
+    // waits for it any more, or the server would keep sending it
+    if (header.type == COAP_CON) {
+        uint8_t ack[4];
+        client_.write(ack, coapEncodeEmpty(COAP_ACK, header.messageId, ack, sizeof(ack)));
+    }
+
+    for (uint8_t i = 0; i < NET_METER_SLOTS; i++) {
+        Exchange& exchange = exchanges_[i];
+        if (!exchange.active || exchange.done) {
+            continue;
+        }
+        bool reply = (header.type == COAP_ACK || header.type == COAP_RST) &&
+                     header.messageId == exchange.request.messageId;
+        if (reply && header.type == COAP_RST) {
+            exchange.done = true;
+            exchange.code = COAP_EMPTY;
+            return;
+        }
+        if (reply && header.code == COAP_EMPTY) {
+            exchange.separate = true;
+            return;
+        }
+        bool response = header.code != COAP_EMPTY && (reply || header.type == COAP_CON || header.type == COAP_NON);
+        if (response && coapSameToken(exchange.request, header)) {
+            exchange.done = true;
+            exchange.code = header.code;
+            exchange.maxAgeS = reader.uintOption(COAP_OPTION_MAX_AGE);
+            return;
+        }
+    }
+}
+
+// ============================================================================
+// CHECKS
+// ============================================================================
+
+// Returns the response as a number (2.04 is 204) or a negative error code.
+// The mutex is let go between turns, so other checks can be in flight
+// while this one waits.
+int CoapProbe::check(const ProbeRequest& request, MiniHttpTiming* timing, uint32_t* maxAgeS) {
+    CoapTarget target;
+    if (!coapParseUrl(request.url, &target) || request.meterSlot >= NET_METER_SLOTS) {
+        return REQUEST_INIT_FAILED;
+    }
+    Exchange& exchange = exchanges_[request.meterSlot];
+    uint8_t datagram[COAP_DATAGRAM_BYTES];
+
+    if (!lock(request, config_.handshakeTimeoutMs)) {
+        return MINI_HTTP_ERROR_READ_TIMEOUT;
+    }
+    if (host_[0] != '\0' && (strcmp(host_, target.host) != 0 || port_ != target.port)) {
+        unlock();
+        LOG_ERROR("[%d] ✗ CoAP endpoints must share one server (%s:%u)\n", request.index, host_, port_);
+        return REQUEST_INIT_FAILED;
+    }
+    if (client_.connected() && timeReached(millis(), heardMs_ + config_.idleMs)) {
+        client_.stop();
+    }
+    bool kept = client_.connected();
+    if (!kept) {
+        int code = open(target, request.index, timing);
+        if (code != 0) {
+            unlock();
+            return code;
+        }
+    }
+
+    CoapHeader header = { COAP_CON, COAP_POST, messageId_++, TOKEN_BYTES, {0} };
+    uint32_t token = esp_random();
+    memcpy(header.token, &token, TOKEN_BYTES);
+    size_t size = coapEncodeRequest(header, target.path, target.query, NULL, 0, datagram, sizeof(datagram));
+    if (size == 0) {
+        unlock();
+        return REQUEST_INIT_FAILED;
+    }
+    exchange.request = header;
+    exchange.separate = false;
+    exchange.done = false;
+    exchange.maxAgeS = 0;
+    exchange.active = true;
+
+    uint32_t sentMs = millis();
+    uint32_t giveUpMs = sentMs + coapMaxTransmitWaitMs(config_.timing);
+    CoapRetransmitter retransmitter;
+    retransmitter.start(config_.timing, sentMs, (uint16_t)esp_random());
+    transmissions_++;
+    int code = send(datagram, size, request.meterSlot) ? CHECK_PENDING : MINI_HTTP_ERROR_SEND_HEADER_FAILED;
+
+    while (code == CHECK_PENDING) {
+        unlock();
+        vTaskDelay(pdMS_TO_TICKS(COAP_POLL_MS));
+        if (!lock(request, timeUntil(millis(), giveUpMs))) {
+            lock(request, portMAX_DELAY);   // The exchange slot is released under the mutex
+            code = MINI_HTTP_ERROR_READ_TIMEOUT;
+            break;
+        }
+        pump(request.meterSlot);
+        uint32_t now = millis();
+
+        if (exchange.done) {
+            timing->firstByteMs = now - sentMs;
+            *maxAgeS = exchange.maxAgeS;
+            code = exchange.code == COAP_EMPTY ? MINI_HTTP_ERROR_CONNECTION_LOST : coapStatus(exchange.code);
+        } else if (exchange.separate) {
+            code = timeReached(now, giveUpMs) ? MINI_HTTP_ERROR_READ_TIMEOUT : CHECK_PENDING;
+        } else if (retransmitter.due(now)) {
+            if (!retransmitter.retransmit(now)) {
+                code = MINI_HTTP_ERROR_READ_TIMEOUT;
+                continue;
+            }
+            // Silence on a kept association since the first transmission:
+            // the server has probably lost it. One lost datagram is no
+            // reason for a handshake, so only the last try goes to a new one.
+            bool last = retransmitter.transmissions() == config_.timing.maxRetransmit + 1;
+            bool silent = kept && last && !timeReached(heardMs_, sentMs);
+            if (!client_.connected() || silent) {
+                LOG_INFO("[%d] No answer on the DTLS association, handshaking again\n", request.index);
+                kept = false;
+                code = open(target, request.index, timing);
+                if (code != 0) {
+                    continue;
+                }
+                code = CHECK_PENDING;
+            }
+            transmissions_++;
+            retransmissions_++;
+            if (!send(datagram, size, request.meterSlot)) {
+                code = MINI_HTTP_ERROR_SEND_HEADER_FAILED;
+            }
+        }
+    }
+    exchange.active = false;
+    unlock();
+    return code;
+}
+
+// Runs on the request task. The worker's own client is not used.
+void CoapProbe::run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) {
+    int index = request.index;
+    MiniHttpTiming timing = {0, 0, 0};
+    uint32_t maxAgeS = 0;
+    LOG_INFO("[%d] Pinging over CoAP... ", index);
+    int code = check(request, &timing, &maxAgeS);
+
+    TraceRecord* trace = &result->trace;
+    trace->connectMs = traceSaturate(timing.connectMs);
+    trace->firstByteMs = traceSaturate(timing.firstByteMs);
+    trace->status = (int16_t)code;
+    if (code >= 200 && code < 300) {
+        trace->outcome = TRACE_OK;
+    } else if (code == 429) {
+        trace->outcome = TRACE_RATE_LIMITED;
+        result->retryAfterMs = (maxAgeS > 0 ? maxAgeS : DEFAULT_MAX_AGE_S) * 1000;
+    } else {
+        trace->outcome = code > 0 ? TRACE_HTTP_ERROR : HttpGetProbe::outcomeFor(code);
+    }
+
+    if (trace->outcome == TRACE_OK) {
+        LOG_INFO("[%d] ✓ %d.%02d in %lu ms\n", index, code / 100, code % 100, (unsigned long)timing.firstByteMs);
+    } else if (code == REQUEST_INIT_FAILED) {
+        LOG_ERROR("[%d] ✗ Not a CoAP check: %s\n", index, request.url);
+    } else if (code > 0) {
+        LOG_ERROR("[%d] ✗ CoAP %d.%02d\n", index, code / 100, code % 100);
+    } else {
+        LOG_ERROR("[%d] ✗ CoAP ping failed: %s\n", index, miniHttpErrorToString(code));
+    }
+}
+
+void CoapProbe::abandon(uint16_t endpoint) {
+    int socket = client_.socketFd();
+    if (ioEndpoint_ == (int32_t)endpoint && socket >= 0) {
+        lwip_shutdown(socket, SHUT_RDWR);
+    }
+}
+
+// ============================================================================
+// CONSOLE REPORT
+// ============================================================================
+
+void CoapProbe::printStatus(Print& out) {
+    out.printf("=== CoAP %s:%u, association %s ===\n", host_[0] != '\0' ? host_ : "-", port_,
+               client_.connected() ? "up" : "down");
+    out.printf("DTLS handshakes: %lu (%lu resumed)\n", (unsigned long)handshakes_, (unsigned long)resumptions_);
+    out.printf("Requests sent: %lu, retransmissions: %lu\n", (unsigned long)transmissions_,
+               (unsigned long)retransmissions_);
+}
@@ -0,0 +1,129 @@
+// ============================================================================
+// COAP PROBE
+// ============================================================================
+//
+// Checks endpoints with a confirmable CoAP request over DTLS instead of an
+// HTTPS request: no TCP handshake, a resumed DTLS session instead of a full
+// TLS handshake, and a ping of a few dozen bytes in one datagram each way.
+// The messages are CoapMessage's (lib/WatcherCore); the association is a
+// DtlsClient (lib/DtlsClient, a stand-in natively).
+//
+// An endpoint selects it with its URL:
+//
+//   coaps://<server>[:<port>]/<path>[?<query>]
+//
+// sends a confirmable POST with the path and query as Uri-Path and
+// Uri-Query options and succeeds on a 2.xx response. 4.29 Too Many
+// Requests is a rate limit, its Max-Age the time to wait.
+//
+// - The association is the probe's: all CoAP endpoints share it and must
+//   name the same server. It stays up between checks while the server was
+//   heard from within idleMs; after that the next check closes it and
+//   handshakes again, resuming the cached session when the server still
+//   knows it. Its handshake is counted with the check that made it.
+// - Retransmission follows RFC 7252 with config.timing: the request goes
+//   again after a random ackTimeoutMs to 1.5 x ackTimeoutMs, doubling each
+//   time. When a kept association has not been heard from since the first
+//   transmission, it is probably gone at the server (a NAT rebinding or a
+//   server restart cannot be seen from here): the check handshakes again
+//   before the last retransmission.
+// - An empty ACK announces a separate response; the check then waits for
+//   it until coapMaxTransmitWaitMs() has passed, and acknowledges it.
+//
+// Threading: run() is called on request tasks, possibly several at once,
+// abandon() on the owner task. The association is only touched under the
+// probe's mutex, which is not held while a check waits, so the checks of
+// several endpoints can be in flight together. Each request task has its
+// own exchange slot (by its traffic meter slot), which whoever holds the
+// mutex fills in when the answer comes.
+//
+
+#ifndef COAP_PROBE_H
+#define COAP_PROBE_H
+
+#include <Arduino.h>
+#include <CoapMessage.h>
+#include <DtlsClient.h>
+
+#include "Probe.h"
+#include "net_meter.h"
+
+const uint16_t COAP_DEFAULT_PORT = 5684;
+
+// A waiting check looks for its answer this often
+const uint32_t COAP_POLL_MS = 20;
+
+// Largest request or response handled
+const size_t COAP_DATAGRAM_BYTES = 256;
+
+struct CoapTarget {
+    char host[64];
+    uint16_t port;
+    char path[96];
+    const char* query;            // Into the URL; runs to its end (NULL: none)
+};
+
+// Split a coaps:// URL. False for other schemes, or parts that do not fit.
+bool coapParseUrl(const char* url, CoapTarget* out);
+
+// Whether url names a CoAP check
+bool coapUrl(const char* url);
+
+struct CoapProbeConfig {
+    CoapTiming timing;            // Retransmission of each request
+    uint32_t handshakeTimeoutMs;  // DNS and DTLS handshake
+    uint32_t idleMs;              // Keep the association this long after the last answer (0: never)
+};
+
+class CoapProbe : public Probe {
+public:
+    explicit CoapProbe(const CoapProbeConfig& config);
+
+    // Before the first check
+    void begin();
+
+    void run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) override;
+    void abandon(uint16_t endpoint) override;
+
+    // Console report of the association and the counters
+    void printStatus(Print& out);
+
+    uint32_t handshakes() const { return handshakes_; }
+    uint32_t resumptions() const { return resumptions_; }      // Handshakes that resumed the session
+    uint32_t transmissions() const { return transmissions_; }  // Requests sent, retransmissions included
+    uint32_t retransmissions() const { return retransmissions_; }
+
+private:
+    struct Exchange {
+        volatile bool active;
+        CoapHeader request;
+        bool separate;            // Empty ACK came: the response follows on its own
+        bool done;
+        uint8_t code;             // Response code, COAP_EMPTY for a reset
+        uint32_t maxAgeS;
+    };
+
+    bool lock(const ProbeRequest& request, uint32_t waitMs);
+    void unlock();
+    int open(const CoapTarget& target, int index, MiniHttpTiming* timing);
+    bool send(const uint8_t* datagram, size_t size, uint8_t meterSlot);
+    void pump(uint8_t meterSlot);
+    void handle(const uint8_t* datagram, size_t size);
+    int check(const ProbeRequest& request, MiniHttpTiming* timing, uint32_t* maxAgeS);
+
+    DtlsClient client_;
+    CoapProbeConfig config_;
+    SemaphoreHandle_t mutex_;
+    Exchange exchanges_[NET_METER_SLOTS];
+    char host_[64];               // Server of the association (empty: none yet)
+    uint16_t port_;
+    uint16_t messageId_;
+    uint32_t heardMs_;            // Last datagram from the server
+    volatile int32_t ioEndpoint_;   // Endpoint holding the mutex, -1: none
+    uint32_t handshakes_;
+    uint32_t resumptions_;
+    uint32_t transmissions_;
+    uint32_t retransmissions_;
+};
+
+#endif // COAP_PROBE_H
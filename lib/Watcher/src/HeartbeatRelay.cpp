@@ -0,0 +1,146 @@
+#include "HeartbeatRelay.h"
+#include "Watcher.h"
+#include "log.h"
+
+// Silent sources taken per collectSilent() call
+const uint16_t SILENT_BATCH = 8;
+
+HeartbeatRelay::HeartbeatRelay(HeartbeatSource* slots, uint16_t capacity, const HeartbeatRelayConfig& config,
+                               Probe& upstream)
+    : table_(slots, capacity, config.table), config_(config), upstream_(upstream), watcher_(NULL), endpoint_(0),
+      wake_(NULL), wakeContext_(NULL), linkUp_(false), listening_(false), polling_(false), changed_(false),
+      reportRequested_(false), transitions_(0), reports_(0) {
+    url_[0] = '\0';
+}
+
+void HeartbeatRelay::begin(Watcher& watcher, uint16_t endpoint, HeartbeatWakeHook wake, void* wakeContext) {
+    watcher_ = &watcher;
+    endpoint_ = endpoint;
+    wake_ = wake;
+    wakeContext_ = wakeContext;
+    table_.begin();
+    changed_ = false;
+    reportRequested_ = false;
+    transitions_ = 0;
+    reports_ = 0;
+}
+
+// ============================================================================
+// SERVICE
+// ============================================================================
+
+// Beats are only heard while the link is up. After an outage the sources
+// get a whole deadline again before they can be declared silent: the relay
+// was the one that was deaf.
+void HeartbeatRelay::service() {
+    if (!enabled()) {
+        return;
+    }
+    uint32_t now = millis();
+    if (!linkUp_) {
+        if (listening_) {
+            heartbeatListenerClose();
+            listening_ = false;
+        }
+        return;
+    }
+    if (!listening_) {
+        table_.resume(now);
+        listening_ = true;
+    }
+
+    // A listener that could not be opened is retried next time. Once the
+    // beats are in, the listener task waits for the next ones.
+    bool opened = heartbeatListenerOpen(config_.ports);
+    HeartbeatBeat beat;
+    while (heartbeatListenerReceive(&beat, now)) {
+        reportChange(table_.beat(beat, now), beat.name);
+    }
+    polling_ = !heartbeatListenerArm(wake_, wakeContext_) || !opened;
+
+    uint16_t silent[SILENT_BATCH];
+    uint16_t count;
+    do {
+        count = table_.collectSilent(now, silent, SILENT_BATCH);
+        for (uint16_t i = 0; i < count; i++) {
+            reportChange(HEARTBEAT_WENT_SILENT, table_.source(silent[i]).name);
+        }
+    } while (count == SILENT_BATCH);
+
+    // Once per report: a rate-limited endpoint must not be brought forward
+    // again on every pass
+    if (changed_ && !reportRequested_) {
+        reportRequested_ = watcher_->pollNow(endpoint_);
+    }
+}
+
+// Beats wake the owner through the listener task; the timers are the
+// sources' deadlines and the HTTP connections' timeouts
+uint32_t HeartbeatRelay::msUntilNextTimer() const {
+    if (!enabled() || !linkUp_) {
+        return UINT32_MAX;
+    }
+    uint32_t now = millis();
+    uint32_t wait = min(table_.msUntilNextDeadline(now), heartbeatListenerMsUntilTimeout(now));
+    return polling_ ? min(wait, HEARTBEAT_LISTEN_POLL_MS) : wait;
+}
+
+void HeartbeatRelay::reportChange(HeartbeatChange change, const char* name) {
+    if (change == HEARTBEAT_UNCHANGED) {
+        return;
+    }
+    if (change == HEARTBEAT_REJECTED) {
+        LOG_ERROR("✗ Heartbeat: table full (%u sources) - %s turned away\n", table_.capacity(), name);
+        return;
+    }
+
+    if (change == HEARTBEAT_NEW) {
+        LOG_INFO("♥ Heartbeat: %s joined\n", name);
+    } else if (change == HEARTBEAT_RESUMED) {
+        LOG_INFO("✓ Heartbeat: %s is back\n", name);
+    } else {
+        LOG_ERROR("⚠ Heartbeat: %s went silent\n", name);
+    }
+    transitions_++;
+    changed_ = true;
+}
+
+// ============================================================================
+// PROBE
+// ============================================================================
+
+void HeartbeatRelay::prepare(uint16_t endpoint, const char* url) {
+    char summary[HEARTBEAT_SUMMARY_BYTES];
+    table_.formatSummary(summary, sizeof(summary));
+    snprintf(url_, sizeof(url_), "%s%c%s", url, strchr(url, '?') != NULL ? '&' : '?', summary);
+    changed_ = false;
+    reportRequested_ = false;
+    reports_++;
+}
+
+void HeartbeatRelay::run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) {
+    ProbeRequest relayed = request;
+    relayed.url = url_;
+    upstream_.run(client, relayed, result);
+}
+
+// ============================================================================
+// CONSOLE REPORT
+// ============================================================================
+
+void HeartbeatRelay::printSources(Print& out) {
+    uint32_t now = millis();
+    out.printf("=== HEARTBEATS %u of %u source(s), %u silent, %lu beat(s), %lu turned away, %lu report(s) ===\n",
+               table_.sourceCount(), table_.capacity(), table_.silentCount(), (unsigned long)table_.beatsReceived(),
+               (unsigned long)table_.rejected(), (unsigned long)reports_);
+    out.printf("Name                  State   Period s  Last beat s ago     Beats\n");
+    for (uint16_t i = 0; i < table_.capacity(); i++) {
+        const HeartbeatSource& source = table_.source(i);
+        if (source.name[0] == '\0') {
+            continue;
+        }
+        out.printf("%-20s  %-6s  %8lu  %15lu  %8lu\n", source.name, heartbeatStateName(source.state),
+                   (unsigned long)(source.periodMs / 1000), (unsigned long)((now - source.lastBeatMs) / 1000),
+                   (unsigned long)source.beats);
+    }
+}
@@ -0,0 +1,99 @@
+// ============================================================================
+// HEARTBEAT RELAY
+// ============================================================================
+//
+// Turns the watcher into a passive aggregator for LAN gadgets: they send
+// plain heartbeats to it (heartbeat_listener.h), it keeps them in a
+// HeartbeatTable (lib/WatcherCore) and relays the state of all of them
+// upstream as one HTTPS request, instead of every gadget paying for a TLS
+// handshake of its own.
+//
+// The relay is the Probe of one ordinary watcher endpoint, whose URL is the
+// upstream collector. That endpoint is polled like any other (interval,
+// retries, rate limit, data budget, peer lease); right before each request
+// the relay appends the current summary to its URL as the query (see
+// HeartbeatTable::formatSummary()), and the request itself goes through the
+// upstream probe, normally the watcher's HttpGetProbe. When a gadget
+// appears, goes silent or comes back, the endpoint is polled right away
+// (Watcher::pollNow()), so transitions do not wait for the interval; beats
+// that change nothing only update the table.
+//
+// Threading: service(), msUntilNextTimer() and begin() belong to the
+// watcher's owner task, as does prepare(); run() is called on the request
+// task and only reads the URL prepare() built. The wake hook is called on
+// the listener task when a beat comes in (heartbeat_listener.h). One relay
+// serves one endpoint.
+//
+
+#ifndef HEARTBEAT_RELAY_H
+#define HEARTBEAT_RELAY_H
+
+#include <Arduino.h>
+#include <HeartbeatTable.h>
+
+#include "heartbeat_listener.h"
+#include "Probe.h"
+
+class Watcher;
+
+// Longest summary appended to the upstream URL. mini_http takes paths of up
+// to 159 bytes, which leaves room for a short collector path.
+const size_t HEARTBEAT_SUMMARY_BYTES = 120;
+
+struct HeartbeatRelayConfig {
+    HeartbeatConfig table;
+    HeartbeatPorts ports;      // Both 0: the relay is off
+};
+
+class HeartbeatRelay : public Probe {
+public:
+    HeartbeatRelay(HeartbeatSource* slots, uint16_t capacity, const HeartbeatRelayConfig& config, Probe& upstream);
+
+    // Relay through the watcher's endpoint, whose probe must be this relay;
+    // wake gets the owner task to call service() when beats arrive
+    void begin(Watcher& watcher, uint16_t endpoint, HeartbeatWakeHook wake, void* wakeContext);
+
+    bool enabled() const { return watcher_ != NULL && (config_.ports.udp != 0 || config_.ports.http != 0); }
+
+    // Listen only while the link is up
+    void setLinkUp(bool up) { linkUp_ = up; }
+
+    // Owner task: take in beats, find sources gone silent and request an
+    // immediate report when something changed. Call before Watcher::service().
+    void service();
+
+    // Time until service() has work to do (UINT32_MAX: none)
+    uint32_t msUntilNextTimer() const;
+
+    // Console report of the sources
+    void printSources(Print& out);
+
+    void prepare(uint16_t endpoint, const char* url) override;
+    void run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) override;
+    void abandon(uint16_t endpoint) override { upstream_.abandon(endpoint); }
+
+    const HeartbeatTable& table() const { return table_; }
+    uint32_t transitions() const { return transitions_; }      // New, silent and resumed since begin()
+    uint32_t reports() const { return reports_; }              // Summaries handed to the upstream probe
+
+private:
+    void reportChange(HeartbeatChange change, const char* name);
+
+    HeartbeatTable table_;
+    HeartbeatRelayConfig config_;
+    Probe& upstream_;
+    Watcher* watcher_;
+    uint16_t endpoint_;
+    HeartbeatWakeHook wake_;
+    void* wakeContext_;
+    bool linkUp_;
+    bool listening_;
+    bool polling_;              // No listener task waits: poll the sockets
+    bool changed_;              // A transition not in a prepared summary yet
+    bool reportRequested_;      // pollNow() accepted for it
+    uint32_t transitions_;
+    uint32_t reports_;
+    char url_[224];             // Upstream URL with the summary, read by run()
+};
+
+#endif // HEARTBEAT_RELAY_H
@@ -0,0 +1,359 @@
+#include "MqttProbe.h"
+#include "log.h"
+
+#include <lwip/sockets.h>
+
+static const char SCHEME[] = "mqtts://";
+static const char DEFAULT_PAYLOAD[] = "up";
+
+// step(): the check's publish is still waiting (for room in the window or
+// for its PUBACK)
+const int CHECK_PENDING = -2000;
+
+// ============================================================================
+// URLS
+// ============================================================================
+
+bool mqttUrl(const char* url) {
+    return strncmp(url, SCHEME, sizeof(SCHEME) - 1) == 0;
+}
+
+bool mqttParseUrl(const char* url, MqttTarget* out) {
+    if (!mqttUrl(url)) {
+        return false;
+    }
+
+    const char* host = url + sizeof(SCHEME) - 1;
+    const char* hostEnd = host;
+    while (*hostEnd != '\0' && *hostEnd != '/' && *hostEnd != ':') {
+        hostEnd++;
+    }
+    size_t hostLength = hostEnd - host;
+    if (hostLength == 0 || hostLength >= sizeof(out->host)) {
+        return false;
+    }
+    memcpy(out->host, host, hostLength);
+    out->host[hostLength] = '\0';
+
+    out->port = MQTT_DEFAULT_PORT;
+    const char* path = hostEnd;
+    if (*path == ':') {
+        unsigned long port = 0;
+        path++;
+        while (*path >= '0' && *path <= '9') {
+            port = port * 10 + (*path - '0');
+            path++;
+        }
+        if (port == 0 || port > 65535) {
+            return false;
+        }
+        out->port = (uint16_t)port;
+    }
+    if (*path != '/') {
+        return false;
+    }
+    path++;
+
+    const char* query = strchr(path, '?');
+    size_t topicLength = query != NULL ? (size_t)(query - path) : strlen(path);
+    if (topicLength == 0 || topicLength >= sizeof(out->topic)) {
+        return false;
+    }
+    memcpy(out->topic, path, topicLength);
+    out->topic[topicLength] = '\0';
+    out->payload = query != NULL ? query + 1 : DEFAULT_PAYLOAD;
+    return true;
+}
+
+// ============================================================================
+// CONNECTION
+// ============================================================================
+
+MqttProbe::MqttProbe(MqttMessage* slots, uint8_t capacity, const MqttProbeConfig& config)
+    : session_(slots, capacity, config.session), config_(config), mutex_(NULL), port_(0), ioEndpoint_(-1),
+      linkUp_(false), timerAtMs_(0), timerSet_(false), connections_(0) {
+    host_[0] = '\0';
+}
+
+void MqttProbe::begin() {
+    if (mutex_ == NULL) {
+        mutex_ = xSemaphoreCreateMutex();
+    }
+    client_.setInsecure();
+    session_.begin();
+    connections_ = 0;
+}
+
+// The connection and the session are the mutex holder's. Its socket
+// traffic is metered into request's slot, the owner's (request NULL) is not.
+bool MqttProbe::lock(const ProbeRequest* request, uint32_t waitMs) {
+    if (mutex_ == NULL || xSemaphoreTake(mutex_, pdMS_TO_TICKS(waitMs)) != pdTRUE) {
+        return false;
+    }
+    ioEndpoint_ = request != NULL ? request->index - 1 : -1;
+    client_.setMeterSlot(request != NULL ? request->meterSlot : NET_METER_SLOTS);
+    return true;
+}
+
+void MqttProbe::unlock() {
+    ioEndpoint_ = -1;
+    xSemaphoreGive(mutex_);
+}
+
+// TCP, TLS, CONNECT and its CONNACK. Returns 0 once connected, otherwise a
+// negative error code or the broker's CONNACK return code.
+int MqttProbe::open(const MqttTarget& target, int index, uint32_t deadlineMs) {
+    LOG_INFO("[%d] Connecting to MQTT broker %s:%u... ", index, target.host, target.port);
+    if (!client_.connect(target.host, target.port, (int32_t)timeUntil(millis(), deadlineMs))) {
+        client_.stop();
+        return MINI_HTTP_ERROR_CONNECTION_REFUSED;
+    }
+    connections_++;
+    snprintf(host_, sizeof(host_), "%s", target.host);
+    port_ = target.port;
+
+    uint8_t packet[MQTT_PACKET_BYTES];
+    size_t size = session_.connect(packet, sizeof(packet), millis());
+    if (size == 0) {
+        client_.stop();
+        return REQUEST_INIT_FAILED;
+    }
+    if (client_.write(packet, size) != size) {
+        drop("CONNECT not sent");
+        return MINI_HTTP_ERROR_SEND_HEADER_FAILED;
+    }
+
+    while (session_.state() == MQTT_CONNECTING) {
+        pump();
+        if (session_.state() != MQTT_CONNECTING) {
+            break;
+        }
+        if (!client_.connected()) {
+            drop("closed before CONNACK");
+            return MINI_HTTP_ERROR_CONNECTION_LOST;
+        }
+        if (timeReached(millis(), deadlineMs)) {
+            drop("no CONNACK");
+            return MINI_HTTP_ERROR_READ_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(MQTT_ACK_POLL_MS));
+    }
+
+    if (session_.state() == MQTT_REFUSED) {
+        client_.stop();
+        session_.connectionLost();
+        return session_.refusedCode();
+    }
+    LOG_INFO("[%d] ✓ MQTT session %s, %u publish(es) in flight\n", index,
+             session_.sessionPresent() ? "resumed" : "new", session_.inFlightCount());
+    return 0;
+}
+
+// Publishes written on the connection go again on the next one. A
+// graceful drop says DISCONNECT first, so the broker keeps the will: the
+// device is fine, only the connection is in doubt.
+void MqttProbe::drop(const char* reason, bool graceful) {
+    LOG_ERROR("✗ MQTT: %s - closing the connection to %s\n", reason, host_);
+    if (graceful && session_.state() == MQTT_CONNECTED) {
+        uint8_t packet[2];
+        size_t size = session_.disconnect(packet, sizeof(packet));
+        client_.write(packet, size);
+    }
+    client_.stop();
+    session_.connectionLost();
+}
+
+// Write everything the session has to send; false when the connection
+// took less
+bool MqttProbe::flush() {
+    uint8_t packet[MQTT_PACKET_BYTES];
+    size_t size;
+    while ((size = session_.nextPacket(packet, sizeof(packet), millis())) > 0) {
+        if (client_.write(packet, size) != size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hand everything the broker sent to the session
+void MqttProbe::pump() {
+    uint8_t buffer[64];
+    int available;
+    while ((available = client_.available()) > 0) {
+        int size = client_.read(buffer, min((size_t)available, sizeof(buffer)));
+        if (size <= 0) {
+            break;
+        }
+        session_.receive(buffer, (size_t)size);
+    }
+}
+
+// ============================================================================
+// CHECKS
+// ============================================================================
+
+// One turn at the connection, under the mutex. Connects if needed, queues
+// the check's publish once the window has room, and looks for its PUBACK.
+int MqttProbe::step(const ProbeRequest& request, const MqttTarget& target, uint16_t* packetId,
+                    uint32_t* publishedMs, MiniHttpTiming* timing, uint32_t deadlineMs) {
+    if (session_.state() == MQTT_CONNECTED && !client_.connected()) {
+        drop("connection closed by the broker");
+    }
+    if (*packetId != 0) {
+        // Acknowledged, possibly on a connection another check opened
+        if (session_.state() == MQTT_CONNECTED) {
+            pump();
+        }
+        if (!session_.inFlight(*packetId)) {
+            timing->firstByteMs = millis() - *publishedMs;
+            return 0;
+        }
+        if (session_.state() != MQTT_CONNECTED) {
+            return MINI_HTTP_ERROR_CONNECTION_LOST;
+        }
+        if (!flush()) {
+            drop("write failed");
+            return MINI_HTTP_ERROR_CONNECTION_LOST;
+        }
+        return CHECK_PENDING;
+    }
+
+    if (session_.state() != MQTT_CONNECTED) {
+        uint32_t phaseStart = millis();
+        int code = open(target, request.index, deadlineMs);
+        timing->connectMs += millis() - phaseStart;
+        if (code != 0) {
+            return code;
+        }
+    }
+    pump();
+    *packetId = session_.publish(target.topic, (const uint8_t*)target.payload, strlen(target.payload), false);
+    if (*packetId == 0) {
+        return CHECK_PENDING;   // Window full
+    }
+    *publishedMs = millis();
+    if (!flush()) {
+        drop("write failed");
+        return MINI_HTTP_ERROR_SEND_HEADER_FAILED;
+    }
+    return CHECK_PENDING;
+}
+
+// The mutex is let go between turns, so other checks can publish while
+// this one waits for its PUBACK
+int MqttProbe::check(const ProbeRequest& request, MiniHttpTiming* timing) {
+    MqttTarget target;
+    if (!mqttParseUrl(request.url, &target) || strlen(target.payload) > MQTT_PAYLOAD_BYTES) {
+        return REQUEST_INIT_FAILED;
+    }
+    uint32_t deadlineMs = millis() + config_.timeoutMs;
+    uint16_t packetId = 0;
+    uint32_t publishedMs = 0;
+
+    for (;;) {
+        if (!lock(&request, timeUntil(millis(), deadlineMs))) {
+            return MINI_HTTP_ERROR_READ_TIMEOUT;
+        }
+        if (host_[0] != '\0' && (strcmp(host_, target.host) != 0 || port_ != target.port)) {
+            unlock();
+            LOG_ERROR("[%d] ✗ MQTT endpoints must share one broker (%s:%u)\n", request.index, host_, port_);
+            return REQUEST_INIT_FAILED;
+        }
+        int code = step(request, target, &packetId, &publishedMs, timing, deadlineMs);
+        if (code == CHECK_PENDING && timeReached(millis(), deadlineMs)) {
+            // The publish stays in flight for the next connection
+            if (packetId != 0) {
+                drop("no PUBACK", true);
+            }
+            code = MINI_HTTP_ERROR_READ_TIMEOUT;
+        }
+        unlock();
+        if (code != CHECK_PENDING) {
+            return code;
+        }
+        vTaskDelay(pdMS_TO_TICKS(MQTT_ACK_POLL_MS));
+    }
+}
+
+// Runs on the request task. The worker's own client is not used.
+void MqttProbe::run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) {
+    int index = request.index;
+    MiniHttpTiming timing = {0, 0, 0};
+    LOG_INFO("[%d] Publishing... ", index);
+    int code = check(request, &timing);
+
+    TraceRecord* trace = &result->trace;
+    trace->connectMs = traceSaturate(timing.connectMs);
+    trace->firstByteMs = traceSaturate(timing.firstByteMs);
+    trace->status = (int16_t)code;
+    trace->outcome = code == 0 ? TRACE_OK : code > 0 ? TRACE_HTTP_ERROR : HttpGetProbe::outcomeFor(code);
+
+    if (code == 0) {
+        LOG_INFO("[%d] ✓ Acknowledged in %lu ms\n", index, (unsigned long)timing.firstByteMs);
+    } else if (code == REQUEST_INIT_FAILED) {
+        LOG_ERROR("[%d] ✗ Not an MQTT check: %s\n", index, request.url);
+    } else if (code > 0) {
+        LOG_ERROR("[%d] ✗ MQTT broker refused the connection: %s\n", index, mqttConnackName((uint8_t)code));
+    } else {
+        LOG_ERROR("[%d] ✗ Publish failed: %s\n", index, miniHttpErrorToString(code));
+    }
+}
+
+// ============================================================================
+// OWNER TASK
+// ============================================================================
+
+// Skipped while a check is at the connection; its result wakes the owner
+// task again
+void MqttProbe::service() {
+    if (!lock(NULL, 0)) {
+        return;
+    }
+    if (session_.state() != MQTT_DISCONNECTED) {
+        if (!linkUp_) {
+            drop("link down");
+        } else if (!client_.connected()) {
+            drop("connection closed by the broker");
+        } else {
+            pump();
+            if (session_.responseOverdue(millis())) {
+                drop("no PINGRESP");
+            } else if (!flush()) {
+                drop("write failed");
+            }
+        }
+    }
+    uint32_t now = millis();
+    uint32_t waitMs = session_.msUntilNextTimer(now);
+    timerSet_ = waitMs != UINT32_MAX;
+    timerAtMs_ = now + waitMs;
+    unlock();
+}
+
+uint32_t MqttProbe::msUntilNextTimer() const {
+    return timerSet_ ? timeUntil(millis(), timerAtMs_) : UINT32_MAX;
+}
+
+void MqttProbe::abandon(uint16_t endpoint) {
+    int socket = client_.socketFd();
+    if (ioEndpoint_ == (int32_t)endpoint && socket >= 0) {
+        lwip_shutdown(socket, SHUT_RDWR);
+    }
+}
+
+// ============================================================================
+// CONSOLE REPORT
+// ============================================================================
+
+void MqttProbe::printStatus(Print& out) {
+    static const char* const STATE_NAMES[] = {"disconnected", "connecting", "connected", "refused"};
+
+    out.printf("=== MQTT %s:%u %s, %u of %u publish(es) in flight ===\n", host_[0] != '\0' ? host_ : "-", port_,
+               STATE_NAMES[session_.state()], session_.inFlightCount(), config_.session.window);
+    out.printf("TLS connections: %lu, CONNACKs: %lu (%lu with the session resumed)\n", (unsigned long)connections_,
+               (unsigned long)session_.connects(), (unsigned long)session_.resumed());
+    out.printf("Published: %lu, acknowledged: %lu, sent again: %lu, pings: %lu\n",
+               (unsigned long)session_.published(), (unsigned long)session_.acked(),
+               (unsigned long)session_.resent(), (unsigned long)session_.pings());
+}
@@ -0,0 +1,126 @@
+// ============================================================================
+// MQTT PROBE
+// ============================================================================
+//
+// Checks endpoints by publishing to an MQTT broker over one long-lived
+// TLS connection instead of an HTTPS request each: after the first
+// connect, a check costs one PUBLISH and its PUBACK rather than a TLS
+// handshake. The session and packets are MqttSession's (lib/WatcherCore);
+// this is the socket side.
+//
+// An endpoint selects it with its URL:
+//
+//   mqtts://<broker>[:<port>]/<topic>[?<payload>]
+//
+// publishes <payload> (or "up") to <topic> with QoS 1. The check succeeds
+// when the broker acknowledges the publish within timeoutMs. All endpoints
+// on the probe share its connection and must name the same broker.
+//
+// - The connection is the probe's, not the worker's: it is opened by the
+//   first check and stays open across polls and workers, whatever the data
+//   budget says about reusing connections. Its TLS handshake is counted
+//   with the check that opened it.
+// - A publish the broker has not acknowledged within timeoutMs fails its
+//   check, and the connection is given up with a DISCONNECT (the device is
+//   fine, so the broker should not announce it offline). The publish stays
+//   in flight and goes again, DUP set, on the next connection (the broker
+//   keeps the session: MqttSession connects without Clean Session).
+// - The broker holds a will for the status topic: when the connection
+//   drops, or the device goes silent for one and a half keep-alive periods,
+//   it publishes the device offline on its own. The online message
+//   replaces it after each connect.
+// - Between checks the owner task keeps the connection alive (service():
+//   PINGREQ once three quarters of the keep-alive period passed without a
+//   write) and gives it up when a PINGRESP is late or the link went down.
+//   That traffic is not attributed to any endpoint.
+//
+// Threading: run() is called on request tasks, possibly several at once;
+// service(), begin(), setLinkUp() and abandon() on the owner task. The
+// connection and the session are only touched under the probe's mutex,
+// which is never held while a check waits for its PUBACK, so checks of
+// several endpoints share the in-flight window.
+//
+
+#ifndef MQTT_PROBE_H
+#define MQTT_PROBE_H
+
+#include <Arduino.h>
+#include <MqttSession.h>
+
+#include "Probe.h"
+#include "Watcher.h"
+
+const uint16_t MQTT_DEFAULT_PORT = 8883;
+
+// A check waiting for its PUBACK reads the connection this often
+const uint32_t MQTT_ACK_POLL_MS = 20;
+
+struct MqttTarget {
+    char host[64];
+    uint16_t port;
+    char topic[MQTT_TOPIC_BYTES];
+    const char* payload;          // Into the URL; runs to its end
+};
+
+// Split an mqtts:// URL. False for other schemes, an empty topic, or parts
+// that do not fit.
+bool mqttParseUrl(const char* url, MqttTarget* out);
+
+// Whether url names an MQTT check
+bool mqttUrl(const char* url);
+
+struct MqttProbeConfig {
+    MqttConfig session;
+    uint32_t timeoutMs;           // Connect (TCP, TLS and CONNACK), and each PUBACK
+};
+
+class MqttProbe : public Probe {
+public:
+    MqttProbe(MqttMessage* slots, uint8_t capacity, const MqttProbeConfig& config);
+
+    // Before the first check
+    void begin();
+
+    // The connection cannot outlive the link
+    void setLinkUp(bool up) { linkUp_ = up; }
+
+    // Owner task: keep-alive and late PUBACKs; gives up a dead connection
+    void service();
+
+    // Time until service() has work to do (UINT32_MAX: none)
+    uint32_t msUntilNextTimer() const;
+
+    // Console report of the connection and the session
+    void printStatus(Print& out);
+
+    void run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) override;
+    void abandon(uint16_t endpoint) override;
+
+    const MqttSession& session() const { return session_; }
+    uint32_t connections() const { return connections_; }    // TLS connections opened
+
+private:
+    bool lock(const ProbeRequest* request, uint32_t waitMs);
+    void unlock();
+    int open(const MqttTarget& target, int index, uint32_t deadlineMs);
+    void drop(const char* reason, bool graceful = false);
+    bool flush();
+    void pump();
+    int check(const ProbeRequest& request, MiniHttpTiming* timing);
+    int step(const ProbeRequest& request, const MqttTarget& target, uint16_t* packetId, uint32_t* publishedMs,
+             MiniHttpTiming* timing, uint32_t deadlineMs);
+
+    WatchedClient client_;
+    MqttSession session_;
+    MqttProbeConfig config_;
+    SemaphoreHandle_t mutex_;
+    char host_[64];               // Broker of the connection (empty: none yet)
+    uint16_t port_;
+    volatile int32_t ioEndpoint_;   // Endpoint holding the mutex, -1: none or the owner
+    volatile bool linkUp_;
+    uint32_t timerAtMs_;          // Next keep-alive step, as of the last service()
+    bool timerSet_;
+    uint32_t connections_;
+};
+
+#endif // MQTT_PROBE_H
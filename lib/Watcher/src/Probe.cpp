@@ -0,0 +1,234 @@
+#include "Probe.h"
+#include "log.h"
+
+#include <RateLimiter.h>
+
+#if !WATCHER_MINIMAL_HTTP
+#include <HTTPClient.h>
+#endif
+
+// ============================================================================
+// HTTPS GET PROBE
+// ============================================================================
+
+// Runs on the request task: fills in the result record and logs, but leaves
+// counters, health state and LEDs to the Watcher
+void HttpGetProbe::run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) {
+    int index = request.index;
+    size_t bodyLength = 0;
+    MiniHttpTiming timing = {0, 0, 0};
+    ContentHasher content(request.content);
+    int httpCode = perform(client, request, &bodyLength, &timing, &result->retryAfterMs,
+                           request.content != NULL ? &content : NULL, &result->validators);
+
+    // Record outcome and phase timings
+    TraceRecord* trace = &result->trace;
+    trace->connectMs = traceSaturate(timing.connectMs);
+    trace->firstByteMs = traceSaturate(timing.firstByteMs);
+    trace->transferMs = traceSaturate(timing.transferMs);
+    trace->status = (int16_t)max(-32768, min(32767, httpCode));
+    trace->bodyBytes = traceSaturate(bodyLength);
+    trace->outcome = outcomeFor(httpCode);
+    if ((httpCode == 200 || httpCode == 206) && content.finished()) {
+        result->contentDigest = content.digest();
+        result->contentBytes = content.bodyBytes();
+        result->contentHashed = true;
+    }
+    result->notModified = httpCode == 304 && request.validators != NULL;
+
+    if (httpCode == REQUEST_INIT_FAILED) {
+        LOG_ERROR("[%d] ✗ Failed to initialize HTTP client\n", index);
+        client.stop();
+        return;
+    }
+
+    // Handle response
+    if (httpCode > 0) {
+        LOG_INFO("[%d] Response code: %d\n", index, httpCode);
+
+        const HttpRequestMode& mode = request.mode;
+        if ((httpCode == 200 || httpCode == 206) && mode.method == HTTP_REQUEST_HEAD) {
+            LOG_INFO("[%d] ✓ Success! Headers only\n", index);
+        } else if (httpCode == 200 && mode.method == HTTP_REQUEST_RANGE && bodyLength >= mode.rangeBytes) {
+            LOG_INFO("[%d] ✓ Success! Range ignored, read the first %u bytes and closed\n", index,
+                     (unsigned)bodyLength);
+        } else if (httpCode == 200 || httpCode == 206) {
+            LOG_INFO("[%d] ✓ Success! Response length: %u bytes\n", index, (unsigned)bodyLength);
+        } else if (httpCode == 304) {
+            LOG_INFO("[%d] ✓ Not modified\n", index);
+        } else if (httpCode == 429) {
+            LOG_INFO("[%d] ⏸ Too many requests, Retry-After %lu ms\n", index, (unsigned long)result->retryAfterMs);
+        } else {
+            LOG_ERROR("[%d] ⚠ HTTP error code: %d\n", index, httpCode);
+        }
+    } else {
+        LOG_ERROR("[%d] ✗ Request failed: %s\n", index, miniHttpErrorToString(httpCode));
+
+        // Common error codes
+        if (httpCode == MINI_HTTP_ERROR_CONNECTION_REFUSED) {
+            LOG_ERROR("[%d]   → Connection refused by server\n", index);
+        } else if (httpCode == MINI_HTTP_ERROR_CONNECTION_LOST) {
+            LOG_ERROR("[%d]   → Connection lost during request\n", index);
+        } else if (httpCode == MINI_HTTP_ERROR_READ_TIMEOUT) {
+            LOG_ERROR("[%d]   → Read timeout exceeded\n", index);
+        }
+    }
+
+    // Clean up (the client object itself belongs to the endpoint); a
+    // kept-alive connection stays open for the endpoint's next request
+    if (!request.keepAlive) {
+        client.stop();
+    }
+}
+
+#if WATCHER_MINIMAL_HTTP
+
+// Lean path: hand-built request over the secure client (no HTTPClient/String)
+int HttpGetProbe::perform(WiFiClientSecure& client, const ProbeRequest& request, size_t* bodyLength,
+                          MiniHttpTiming* timing, uint32_t* retryAfterMs, ContentHasher* body,
+                          HttpValidators* validators) {
+    MiniHttpUrl target;
+    if (!miniHttpParseUrl(request.url, &target)) {
+        return REQUEST_INIT_FAILED;
+    }
+
+    LOG_INFO("[%d] Sending %s request... ", request.index, request.mode.method == HTTP_REQUEST_HEAD ? "HEAD" : "GET");
+    return miniHttpGet(client, target, userAgent_, timeoutMs_, bodyLength, timing, request.keepAlive,
+                       retryAfterMs, body, request.validators, validators, request.mode);
+}
+
+#else
+
+// Stream that takes the body from HTTPClient::writeToStream() (which undoes
+// chunked encoding) and only counts and hashes it. Once limit bytes are in
+// it takes no more, which makes writeToStream() give up and close the
+// connection.
+class BodySink : public Stream {
+public:
+    BodySink(ContentHasher* body, size_t limit) : body_(body), bytes_(0), limit_(limit) {}
+
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (size > limit_ - bytes_) {
+            size = limit_ - bytes_;
+        }
+        if (body_ != NULL) {
+            body_->update(buffer, size);
+        }
+        bytes_ += size;
+        return size;
+    }
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+    size_t bytes() const { return bytes_; }
+    bool full() const { return bytes_ >= limit_; }
+
+private:
+    ContentHasher* body_;
+    size_t bytes_;
+    size_t limit_;
+};
+
+// A response header into out; one that does not fit is dropped rather than
+// cut (a truncated validator would never match)
+static void copyValidator(const String& value, char* out, size_t size) {
+    size_t length = value.length() < size ? value.length() : 0;
+    memcpy(out, value.c_str(), length);
+    out[length] = '\0';
+}
+
+// HTTPClient connects inside GET(), so connect time is reported as part of
+// firstByteMs and connectMs stays 0 on this path.
+int HttpGetProbe::perform(WiFiClientSecure& client, const ProbeRequest& request, size_t* bodyLength,
+                          MiniHttpTiming* timing, uint32_t* retryAfterMs, ContentHasher* body,
+                          HttpValidators* validators) {
+    HTTPClient http;
+
+    // Configure HTTP client (an open connection of the client is reused
+    // either way; setReuse() decides whether it stays open afterwards)
+    http.setTimeout(timeoutMs_);
+    http.setConnectTimeout(timeoutMs_);
+    http.setReuse(request.keepAlive);
+
+    // Begin HTTP request
+    if (!http.begin(client, request.url)) {
+        http.end();
+        return REQUEST_INIT_FAILED;
+    }
+
+    // Set custom User-Agent (must use setUserAgent, not addHeader)
+    http.setUserAgent(userAgent_);
+    http.addHeader("Accept", "application/json");
+    const HttpValidators* conditional = request.validators;
+    if (conditional != NULL && conditional->etag[0] != '\0') {
+        http.addHeader("If-None-Match", conditional->etag);
+    }
+    if (conditional != NULL && conditional->lastModified[0] != '\0') {
+        http.addHeader("If-Modified-Since", conditional->lastModified);
+    }
+    const HttpRequestMode& mode = request.mode;
+    size_t limit = SIZE_MAX;
+    if (mode.method == HTTP_REQUEST_RANGE) {
+        limit = mode.rangeBytes > 0 ? mode.rangeBytes : 1;
+        char range[24];
+        snprintf(range, sizeof(range), "bytes=0-%lu", (unsigned long)(limit - 1));
+        http.addHeader("Range", range);
+    }
+
+    // Rate-limit hints (an HTTP-date Retry-After is taken relative to Date)
+    // and the validators to make the next request conditional with
+    const char* collected[] = {"Retry-After", "Date", "ETag", "Last-Modified"};
+    http.collectHeaders(collected, 4);
+
+    // Send the request (HTTPClient reads no body after HEAD)
+    bool head = mode.method == HTTP_REQUEST_HEAD;
+    LOG_INFO("[%d] Sending %s request... ", request.index, head ? "HEAD" : "GET");
+    uint32_t phaseStart = millis();
+    int httpCode = head ? http.sendRequest("HEAD") : http.GET();
+    timing->firstByteMs = millis() - phaseStart;
+    *retryAfterMs = httpRetryAfterMs(http.header("Retry-After").c_str(), http.header("Date").c_str());
+    copyValidator(http.header("ETag"), validators->etag, sizeof(validators->etag));
+    copyValidator(http.header("Last-Modified"), validators->lastModified, sizeof(validators->lastModified));
+
+    if (!head && (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_PARTIAL_CONTENT)) {
+        phaseStart = millis();
+        BodySink sink(body, limit);
+        int written = http.writeToStream(&sink);
+        *bodyLength = sink.bytes();
+        timing->transferMs = millis() - phaseStart;
+        if (body != NULL && (sink.full() || (written >= 0 && (http.getSize() < 0 || written == http.getSize())))) {
+            body->finish();
+        }
+        if (sink.full() && written < 0) {
+            client.stop();   // Cut off at the limit with more of the body on the way
+        }
+    }
+
+    http.end();
+    return httpCode;
+}
+
+#endif
+
+TraceOutcome HttpGetProbe::outcomeFor(int httpCode) {
+    if (httpCode == 200 || httpCode == 206 || httpCode == 304) {
+        return TRACE_OK;
+    }
+    if (httpCode == 429) {
+        return TRACE_RATE_LIMITED;
+    }
+    if (httpCode > 0) {
+        return TRACE_HTTP_ERROR;
+    }
+    switch (httpCode) {
+        case MINI_HTTP_ERROR_CONNECTION_REFUSED: return TRACE_CONNECT_FAILED;
+        case MINI_HTTP_ERROR_SEND_HEADER_FAILED: return TRACE_SEND_FAILED;
+        case MINI_HTTP_ERROR_CONNECTION_LOST:    return TRACE_CONNECTION_LOST;
+        case MINI_HTTP_ERROR_READ_TIMEOUT:       return TRACE_TIMEOUT;
+        default:                                 return TRACE_OTHER_ERROR;
+    }
+}
@@ -0,0 +1,92 @@
+// ============================================================================
+// PROBES
+// ============================================================================
+//
+// A probe is what a request task does against one endpoint: connect, send
+// the request and describe the outcome in the request's trace record. It
+// runs on the request task with the endpoint's own secure client, whose
+// socket traffic is already being metered, and must be able to fall out of
+// a socket the watchdog shuts down.
+//
+// Probes only fill in the result; counters, health state and LEDs are left
+// to the Watcher's owner task.
+//
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <NetTrace.h>
+#include <ResultQueue.h>
+#include <ContentHash.h>
+
+#include "mini_http.h"
+
+// The lean profile (env:esp32dev_lean) swaps HTTPClient for mini_http so the
+// String-heavy HTTPClient code is never linked in.
+#ifndef WATCHER_MINIMAL_HTTP
+#define WATCHER_MINIMAL_HTTP 0
+#endif
+
+// Returned by probes when the client could not be set up
+const int REQUEST_INIT_FAILED = -1000;
+
+// Status recorded for a request the watchdog gave up on
+const int REQUEST_HUNG = -1001;
+
+struct ProbeRequest {
+    const char* url;
+    int index;              // 1-based, for log output
+    bool keepAlive;         // Reuse an open connection and leave it open
+    const ContentWatch* content;   // Hash the body for change detection (NULL: don't)
+    const HttpValidators* validators;   // Make the request conditional (NULL: don't)
+    uint8_t meterSlot;      // Traffic meter slot of the request task (net_meter.h)
+    HttpRequestMode mode;   // GET, HEAD or the first bytes only (mini_http.h)
+};
+
+class Probe {
+public:
+    virtual ~Probe() {}
+
+    // Runs on the owner task right before a request task for endpoint is
+    // started, so the probe can take what it needs from owner-side state.
+    // Whatever it keeps must stay untouched until run() returns; the
+    // endpoint is not dispatched again before that.
+    virtual void prepare(uint16_t endpoint, const char* url) {}
+
+    // Runs on the request task. Fills in result->trace (all but startMs and
+    // endpoint) and result->retryAfterMs, and for request.content the
+    // digest, size and validators of a complete body (result->contentDigest
+    // / contentBytes / validators, contentHashed) or result->notModified.
+    virtual void run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) = 0;
+
+    // Runs on the owner task when the watchdog gives up on endpoint's
+    // request and shuts the client's socket down. A probe that talks over a
+    // connection of its own shuts that one down here.
+    virtual void abandon(uint16_t endpoint) {}
+};
+
+// HTTPS GET, HEAD or ranged GET as request.mode says: 200 and 206 are
+// success (as is 304 to a conditional request), 429 is a rate limit,
+// anything else a failure.
+// Goes through mini_http with WATCHER_MINIMAL_HTTP, HTTPClient otherwise;
+// either way the body streams through a small buffer and is never stored.
+class HttpGetProbe : public Probe {
+public:
+    HttpGetProbe(const char* userAgent, uint32_t timeoutMs) : userAgent_(userAgent), timeoutMs_(timeoutMs) {}
+
+    void run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) override;
+
+    static TraceOutcome outcomeFor(int httpCode);
+
+private:
+    int perform(WiFiClientSecure& client, const ProbeRequest& request, size_t* bodyLength,
+                MiniHttpTiming* timing, uint32_t* retryAfterMs, ContentHasher* body,
+                HttpValidators* validators);
+
+    const char* userAgent_;
+    uint32_t timeoutMs_;
+};
+
+#endif // PROBE_H
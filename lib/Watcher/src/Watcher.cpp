@@ -0,0 +1,963 @@
+#include "Watcher.h"
+#include "cpu_meter.h"
+#include "log.h"
+#include "profiler.h"
+
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+// Host part of "scheme://host[:port]/path" (not terminated, see urlHostLength())
+static const char* urlHost(const char* url) {
+    const char* host = strstr(url, "://");
+    return host != NULL ? host + 3 : url;
+}
+
+static uint16_t urlHostLength(const char* url) {
+    return (uint16_t)strcspn(urlHost(url), ":/");
+}
+
+// While a link check connects, its socket is polled this often
+static const uint32_t LINK_PROBE_POLL_MS = 10;
+
+// Table endpoints flagged for change detection hash the whole body
+static const ContentWatch WHOLE_BODY = { NULL, 0 };
+
+// ============================================================================
+// SETUP
+// ============================================================================
+
+Watcher::Watcher(const WatcherMemory& memory, const WatcherConfig& config, const WatcherBudget& budget,
+                 Probe& defaultProbe)
+    : memory_(memory), config_(config), budget_(budget), defaultProbe_(defaultProbe),
+      endpoints_(memory.endpoints), workers_(memory.workers), endpointCount_(0),
+      workerCount_(budget.maxTasks < memory.workerCapacity ? budget.maxTasks : memory.workerCapacity),
+      hostCount_(0),
+      scheduler_(memory.runtime, 0, config.scheduler),
+      watchdog_(memory.watch, 0, config.watchdog),
+      resultQueue_(memory.results, memory.resultCapacity),
+      traceBuffer_(memory.trace, memory.traceCapacity),
+      trafficLedger_(memory.trafficToday, 0, memory.trafficHistory, memory.historyDays),
+      dataBudget_(memory.budget, 0, config.scheduler.pollIntervalMs, config.dataBudget),
+      energyLedger_(memory.energy, 0, config.energy),
+      rateLimiter_(memory.hosts, 0, config.rateLimit),
+      contentTracker_(memory.content, 0),
+      failover_(memory.failover, 0, config.failover),
+      linkCheck_(config.linkCheck),
+      peerLease_(config.peers),
+      wake_(NULL), wakeContext_(NULL), observer_(NULL), linkUp_(false),
+      activeRequests_(0), cycleRequests_(0), failedRequests_(0), rateLimitedRequests_(0), contentChanges_(0),
+      notModified_(0), cycleAttempts_(0), unansweredAttempts_(0), cycleStartMs_(0), cycleStartBusyTicks_(0) {
+}
+
+void Watcher::begin(const EndpointConfig* endpoints, uint16_t count, WatcherWakeHook wake, void* wakeContext,
+                    ResultObserver* observer) {
+    count = claimEndpoints(count, wake, wakeContext, observer);
+    for (uint16_t i = 0; i < count; i++) {
+        endpoints_[i].url = endpoints[i].url;
+        endpoints_[i].probe = endpoints[i].probe != NULL ? endpoints[i].probe : &defaultProbe_;
+        endpoints_[i].content = endpoints[i].content;
+        endpoints_[i].alternates = endpoints[i].alternates;
+        endpoints_[i].mode = endpoints[i].request != NULL ? *endpoints[i].request : HTTP_MODE_GET;
+        memory_.budget[i].priority = endpoints[i].priority;
+    }
+    assignHosts();
+    start();
+}
+
+// Hosts come numbered in order of appearance, so the first count endpoints
+// use fewer host buckets than there are endpoints
+void Watcher::begin(const EndpointTable& table, WatcherWakeHook wake, void* wakeContext, ResultObserver* observer) {
+    uint16_t count = claimEndpoints(table.count(), wake, wakeContext, observer);
+    hostCount_ = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        const EndpointRecord& record = table.record(i);
+        endpoints_[i].url = table.url(i);
+        endpoints_[i].probe = &defaultProbe_;
+        endpoints_[i].content = (record.flags & ENDPOINT_FLAG_CONTENT) != 0 ? &WHOLE_BODY : NULL;
+        endpoints_[i].alternates = NULL;
+        endpoints_[i].mode.method = (record.flags & ENDPOINT_FLAG_HEAD) != 0  ? HTTP_REQUEST_HEAD
+                                  : (record.flags & ENDPOINT_FLAG_RANGE) != 0 ? HTTP_REQUEST_RANGE
+                                                                              : HTTP_REQUEST_GET;
+        endpoints_[i].mode.rangeBytes = record.rangeBytes;
+        endpoints_[i].host = record.host;
+        memory_.budget[i].priority = record.priority;
+        if (record.host >= hostCount_) {
+            hostCount_ = record.host + 1;
+        }
+    }
+    LOG_INFO("Rate limit: %u endpoint(s) on %u host(s), %u request(s)/min per host\n", endpointCount_,
+             hostCount_, config_.rateLimit.requestsPerMinute);
+    start();
+}
+
+// Bind the core state to count endpoints (at most the memory's capacity)
+uint16_t Watcher::claimEndpoints(uint16_t count, WatcherWakeHook wake, void* wakeContext, ResultObserver* observer) {
+    wake_ = wake;
+    wakeContext_ = wakeContext;
+    observer_ = observer;
+
+    if (count > memory_.endpointCapacity) {
+        LOG_ERROR("⚠ Watcher: room for %u endpoint(s), %u left out\n", memory_.endpointCapacity,
+                  count - memory_.endpointCapacity);
+        count = memory_.endpointCapacity;
+    }
+    endpointCount_ = count;
+    for (uint16_t i = 0; i < count; i++) {
+        endpoints_[i].worker = WATCHER_NO_WORKER;
+    }
+
+    scheduler_ = PollScheduler(memory_.runtime, count, config_.scheduler);
+    watchdog_ = RequestWatchdog(memory_.watch, count, config_.watchdog);
+    trafficLedger_ = TrafficLedger(memory_.trafficToday, count, memory_.trafficHistory, memory_.historyDays);
+    dataBudget_ = DataBudget(memory_.budget, count, config_.scheduler.pollIntervalMs, config_.dataBudget);
+    energyLedger_ = EnergyLedger(memory_.energy, count, config_.energy);
+    return count;
+}
+
+void Watcher::start() {
+    // Request clients are reused; certificate validation is disabled
+    for (uint8_t i = 0; i < workerCount_; i++) {
+        WatchWorker& worker = workers_[i];
+        worker.owner = this;
+        worker.index = i;
+        worker.endpoint = WATCHER_NO_ENDPOINT;
+        worker.openEndpoint = WATCHER_NO_ENDPOINT;
+        worker.openDestination = 0;
+        worker.task = NULL;
+        worker.exiting = false;
+        worker.client.setInsecure();
+        worker.client.setMeterSlot(i);
+    }
+
+    // Every endpoint is due as soon as the link is up
+    assignContentSlots();
+    assignFailoverSlots();
+    rateLimiter_ = RateLimiter(memory_.hosts, hostCount_, config_.rateLimit);
+    scheduler_.begin(millis());
+    trafficLedger_.begin(millis());
+    loadDataBudget();
+    contentTracker_.begin();
+    linkCheck_.begin(millis());
+    peerLease_.begin(peerLinkNodeId(), peerGroup(), millis());
+    cpuMeterBegin();
+    profilerBegin();
+    rateLimiter_.begin(millis());
+
+    LOG_INFO("Watcher: %u endpoint(s), up to %u request task(s) with %lu bytes of stack each\n",
+             endpointCount_, workerCount_, (unsigned long)budget_.taskStackBytes);
+}
+
+// Watched endpoints take the content slots in order; the ones beyond them
+// are polled for availability only, as are HEAD endpoints (no body)
+void Watcher::assignContentSlots() {
+    uint16_t used = 0;
+    uint16_t leftOut = 0;
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        endpoints_[i].contentSlot = WATCHER_NO_CONTENT;
+        if (endpoints_[i].content == NULL) {
+            continue;
+        }
+        if (endpoints_[i].mode.method == HTTP_REQUEST_HEAD) {
+            LOG_ERROR("⚠ Watcher: [%u] HEAD has no body to watch for content\n", i + 1);
+            endpoints_[i].content = NULL;
+            continue;
+        }
+        if (used == memory_.contentCapacity) {
+            endpoints_[i].content = NULL;
+            leftOut++;
+            continue;
+        }
+        endpoints_[i].contentSlot = used++;
+    }
+    if (leftOut > 0) {
+        LOG_ERROR("⚠ Watcher: room for %u content watch(es), %u left out\n", memory_.contentCapacity, leftOut);
+    }
+    contentTracker_ = ContentTracker(memory_.content, used);
+}
+
+// Endpoints with alternates take the failover slots in order; the ones
+// beyond them only use their own URL
+void Watcher::assignFailoverSlots() {
+    uint16_t used = 0;
+    uint16_t leftOut = 0;
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        endpoints_[i].failoverSlot = WATCHER_NO_FAILOVER;
+        if (endpoints_[i].alternates == NULL || endpoints_[i].alternates->count == 0) {
+            endpoints_[i].alternates = NULL;
+            continue;
+        }
+        if (used == memory_.failoverCapacity) {
+            endpoints_[i].alternates = NULL;
+            leftOut++;
+            continue;
+        }
+        endpoints_[i].failoverSlot = used++;
+    }
+    if (leftOut > 0) {
+        LOG_ERROR("⚠ Watcher: room for %u failover endpoint(s), %u left out\n", memory_.failoverCapacity, leftOut);
+    }
+    failover_ = FailoverTable(memory_.failover, used, config_.failover);
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        if (endpoints_[i].failoverSlot != WATCHER_NO_FAILOVER) {
+            failover_.begin(endpoints_[i].failoverSlot, 1 + endpoints_[i].alternates->count, millis());
+        }
+    }
+}
+
+// Destination 0 is the endpoint's own URL, the others its alternates
+const char* Watcher::destinationUrl(uint16_t endpoint, uint8_t destination) const {
+    const WatchEndpoint& entry = endpoints_[endpoint];
+    if (destination == 0 || entry.alternates == NULL || destination > entry.alternates->count) {
+        return entry.url;
+    }
+    return entry.alternates->urls[destination - 1];
+}
+
+// Watchers coordinate only with peers that poll the very same list
+uint32_t Watcher::peerGroup() const {
+    uint32_t hash = FNV1A32_OFFSET;
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        hash = fnv1a32(endpoints_[i].url, strlen(endpoints_[i].url) + 1, hash);
+    }
+    return hash;
+}
+
+// Endpoints on the same host share a rate-limit bucket
+void Watcher::assignHosts() {
+    hostCount_ = 0;
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        const char* host = urlHost(endpoints_[i].url);
+        uint16_t length = urlHostLength(endpoints_[i].url);
+
+        int shared = -1;
+        for (uint16_t j = 0; j < i && shared < 0; j++) {
+            if (urlHostLength(endpoints_[j].url) == length &&
+                strncasecmp(urlHost(endpoints_[j].url), host, length) == 0) {
+                shared = endpoints_[j].host;
+            }
+        }
+        endpoints_[i].host = shared >= 0 ? (uint16_t)shared : hostCount_++;
+    }
+    LOG_INFO("Rate limit: %u endpoint(s) on %u host(s), %u request(s)/min per host\n", endpointCount_,
+             hostCount_, config_.rateLimit.requestsPerMinute);
+}
+
+// ============================================================================
+// SERVICE
+// ============================================================================
+
+void Watcher::service() {
+    handleResults();
+    superviseRequests();
+    checkLink();
+    coordinatePeers();
+    pollDueEndpoints();
+}
+
+uint32_t Watcher::msUntilNextTimer() const {
+    uint32_t now = millis();
+    bool canPoll = linkUp_ && peerLease_.polls() && liveTasks() < workerCount_;
+    uint32_t waitMs = canPoll ? scheduler_.msUntilNextDue(now) : UINT32_MAX;
+    if (linkUp_) {
+        // A connect in flight is polled, nothing wakes the owner when it completes
+        uint32_t checkMs = linkCheck_.msUntilNextTimer(now);
+        waitMs = min(waitMs, linkCheck_.inFlight() ? min(checkMs, LINK_PROBE_POLL_MS) : checkMs);
+        waitMs = min(waitMs, peerLease_.msUntilNextTimer(now));
+    }
+    return min(waitMs, watchdog_.msUntilNextDeadline(now));
+}
+
+uint8_t Watcher::liveTasks() const {
+    uint8_t live = 0;
+    for (uint8_t i = 0; i < workerCount_; i++) {
+        if (workers_[i].endpoint != WATCHER_NO_ENDPOINT) {
+            live++;
+        }
+    }
+    return live;
+}
+
+// ============================================================================
+// POLLING
+// ============================================================================
+
+// Due endpoints are taken in batches of as many as there are free workers,
+// so a list of any length is polled through the fixed set of request tasks.
+// A poll cycle lasts from the first dispatch until no request is in flight;
+// endpoints that fall due meanwhile join it as workers become free.
+void Watcher::pollDueEndpoints() {
+    // Polling resumes as soon as the link is back; a follower leaves it
+    // to the leader, and its endpoints stay due for when it takes over
+    if (!linkUp_ || !peerLease_.polls()) {
+        return;
+    }
+
+    uint16_t due[NET_METER_SLOTS];
+    while (liveTasks() < workerCount_) {
+        uint16_t dueCount = scheduler_.collectDue(millis(), due, workerCount_ - liveTasks());
+        if (dueCount == 0 || pollEndpoints(due, dueCount) == 0) {
+            break;
+        }
+    }
+}
+
+void Watcher::beginPollCycle() {
+    LOG_INFO("\n========================================\n");
+    LOG_INFO("Starting PARALLEL API poll cycle\n");
+    LOG_INFO("========================================\n");
+
+    // Reset counters (activeRequests_ drops with each aggregated result).
+    // rateLimitedRequests_ is not: deferrals made while no cycle was open
+    // belong to this one, and finishPollCycle() clears it after the summary.
+    cycleRequests_ = 0;
+    failedRequests_ = 0;
+    cycleAttempts_ = 0;
+    unansweredAttempts_ = 0;
+    contentChanges_ = 0;
+    notModified_ = 0;
+    energyLedger_.beginCycle();
+    cycleStartMs_ = millis();
+    cycleStartBusyTicks_ = cpuMeterBusyTicks();
+    profilerSetActive(true);
+}
+
+// One request task per endpoint, each on a free worker. Returns the number
+// of requests started.
+uint16_t Watcher::pollEndpoints(const uint16_t* due, uint16_t dueCount) {
+    uint16_t started = 0;
+    for (uint16_t i = 0; i < dueCount; i++) {
+        uint16_t endpoint = due[i];
+        uint32_t now = millis();
+
+        // A hung worker of this endpoint is still being reclaimed
+        if (!watchdog_.idle(endpoint)) {
+            scheduler_.recordDeferred(endpoint, now, config_.watchdog.graceMs);
+            continue;
+        }
+
+        // Optional endpoint suspended to save data: check again next interval
+        if (dataBudget_.suspended(endpoint)) {
+            scheduler_.recordDeferred(endpoint, now, config_.scheduler.pollIntervalMs);
+            continue;
+        }
+
+        // No token for the endpoint's host: wait for the next one
+        uint16_t host = endpoints_[endpoint].host;
+        if (!rateLimiter_.tryAcquire(host, now)) {
+            uint32_t waitMs = rateLimiter_.msUntilAvailable(host, now);
+            scheduler_.recordDeferred(endpoint, now, waitMs);
+            rateLimitedRequests_++;
+            LOG_INFO("[%d/%d] Rate limited: deferred by %lu ms\n", endpoint + 1, endpointCount_,
+                     (unsigned long)waitMs);
+            continue;
+        }
+
+        if (dispatch(endpoint)) {
+            started++;
+        }
+    }
+    return started;
+}
+
+// A free worker, preferably the one still holding this endpoint's
+// connection open, otherwise one with no connection to close
+WatchWorker* Watcher::freeWorker(uint16_t endpoint) {
+    WatchWorker* found = NULL;
+    for (uint8_t i = 0; i < workerCount_; i++) {
+        WatchWorker& worker = workers_[i];
+        if (worker.endpoint != WATCHER_NO_ENDPOINT) {
+            continue;
+        }
+        if (worker.openEndpoint == endpoint) {
+            return &worker;
+        }
+        bool idle = worker.openEndpoint == WATCHER_NO_ENDPOINT;
+        bool foundIdle = found != NULL && found->openEndpoint == WATCHER_NO_ENDPOINT;
+        if (found == NULL || (idle && !foundIdle)) {
+            found = &worker;
+        }
+    }
+    return found;
+}
+
+bool Watcher::dispatch(uint16_t index) {
+    WatchWorker& worker = *freeWorker(index);
+    worker.endpoint = index;
+    worker.generation = watchdog_.start(index, millis());
+
+    // The destinations to try, best first (or a demoted one due for a probe)
+    worker.route[0] = 0;
+    worker.routeCount = 1;
+    uint16_t slot = endpoints_[index].failoverSlot;
+    if (slot != WATCHER_NO_FAILOVER) {
+        worker.routeCount = failover_.slot(slot).count;
+        if (failover_.plan(slot, millis(), worker.route)) {
+            LOG_INFO("[%d] Probing %s\n", index + 1, destinationUrl(index, worker.route[0]));
+        }
+    }
+
+    worker.keepAlive = dataBudget_.reuseConnections();
+    worker.reconnect = worker.openEndpoint != WATCHER_NO_ENDPOINT &&
+                       (worker.openEndpoint != index || worker.openDestination != worker.route[0]);
+    worker.openEndpoint = worker.keepAlive ? index : WATCHER_NO_ENDPOINT;
+    worker.openDestination = worker.route[0];
+    worker.exiting = false;
+    worker.attempt = 0;
+    endpoints_[index].worker = worker.index;
+    endpoints_[index].probe->prepare(index, destinationUrl(index, worker.route[0]));
+    activeRequests_++;
+
+    char taskName[32];
+    snprintf(taskName, sizeof(taskName), "HTTPTask_%d", index + 1);
+
+    BaseType_t created = xTaskCreate(
+        requestTask,              // Task function
+        taskName,                 // Task name
+        budget_.taskStackBytes,   // Stack size (bytes)
+        (void*)&worker,           // Task parameters
+        budget_.taskPriority,     // Priority
+        &worker.task              // Task handle (for the watchdog)
+    );
+    if (created != pdPASS) {
+        // No heap for the stack: give the worker back and try again later
+        watchdog_.finish(index, worker.generation);
+        releaseWorker(index);
+        activeRequests_--;
+        scheduler_.recordDeferred(index, millis(), config_.scheduler.retryBaseMs);
+        LOG_ERROR("[%d] ✗ Could not create a request task\n", index + 1);
+        return false;
+    }
+
+    // The first request in flight opens the poll cycle; when every due
+    // endpoint is deferred, none is opened that no result would close
+    if (activeRequests_ == 1) {
+        beginPollCycle();
+    }
+    LOG_INFO("[%d/%d] Launched task for: %s\n", index + 1, endpointCount_, destinationUrl(index, worker.route[0]));
+    return true;
+}
+
+// The endpoint's worker has exited (or was deleted): free it
+void Watcher::releaseWorker(uint16_t endpoint) {
+    uint8_t worker = endpoints_[endpoint].worker;
+    if (worker != WATCHER_NO_WORKER) {
+        workers_[worker].endpoint = WATCHER_NO_ENDPOINT;
+        endpoints_[endpoint].worker = WATCHER_NO_WORKER;
+    }
+}
+
+// ============================================================================
+// REQUEST TASK
+// ============================================================================
+
+// Forget what a failed attempt left in result before the next destination
+// is tried; the traffic adds up
+static void clearAttempt(RequestResult* result) {
+    uint32_t startMs = result->trace.startMs;
+    uint8_t endpoint = result->trace.endpoint;
+    memset(&result->trace, 0, sizeof(result->trace));
+    result->trace.startMs = startMs;
+    result->trace.endpoint = endpoint;
+    result->retryAfterMs = 0;
+    result->contentDigest = 0;
+    result->contentBytes = 0;
+    result->contentHashed = false;
+    result->notModified = false;
+    memset(&result->validators, 0, sizeof(result->validators));
+}
+
+void Watcher::requestTask(void* parameter) {
+    WatchWorker& worker = *(WatchWorker*)parameter;
+    Watcher& watcher = *worker.owner;
+    const uint16_t index = worker.endpoint;
+    const WatchEndpoint& endpoint = watcher.endpoints_[index];
+    // The validators are only rewritten by the owner task once this
+    // request's result is in
+    const HttpValidators* validators =
+        endpoint.contentSlot != WATCHER_NO_CONTENT ? &watcher.contentTracker_.validators(endpoint.contentSlot) : NULL;
+    ProbeRequest request = { watcher.destinationUrl(index, worker.route[0]), index + 1, worker.keepAlive,
+                             endpoint.content, validators, worker.index, endpoint.mode };
+
+    RequestResult result;
+    memset(&result, 0, sizeof(result));
+    result.endpoint = index;
+    result.generation = worker.generation;
+    result.trace.startMs = millis();
+    result.trace.endpoint = traceEndpoint(index);
+
+    // Socket bytes of this task are counted into result.traffic, and the
+    // request's radio window is the time it runs (the ledger merges the
+    // overlapping windows of a cycle). Closing a connection the worker kept
+    // open for another endpoint counts here too.
+    result.radioStartUs = esp_timer_get_time();
+    netMeterAttach(worker.index, &result.traffic);
+    if (worker.reconnect) {
+        worker.client.stop();
+    }
+
+    // An attempt that got no answer moves on to the next destination, as
+    // long as the request is young enough to finish before the watchdog
+    uint8_t attempts = 0;
+    for (; attempts < worker.routeCount; attempts++) {
+        uint8_t destination = worker.route[attempts];
+        if (attempts > 0) {
+            if (!failoverRetryable(result.trace.outcome, result.trace.status) ||
+                millis() - result.trace.startMs >= watcher.config_.failover.attemptWindowMs) {
+                break;
+            }
+            request.url = watcher.destinationUrl(index, destination);
+            LOG_INFO("[%d] ↷ Failing over to %s\n", index + 1, request.url);
+            worker.client.stop();
+            clearAttempt(&result);
+            worker.attempt = attempts;
+        }
+
+        uint32_t attemptStartMs = millis();
+        endpoint.probe->run(worker.client, request, &result);
+        if (endpoint.failoverSlot != WATCHER_NO_FAILOVER) {
+            FailoverAttempt& attempt = result.failover.attempts[result.failover.count++];
+            attempt.destination = destination;
+            attempt.outcome = result.trace.outcome;
+            attempt.status = result.trace.status;
+            attempt.durationMs = millis() - attemptStartMs;
+        }
+    }
+    netMeterDetach(worker.index);
+    result.radioUs = (uint32_t)(esp_timer_get_time() - result.radioStartUs);
+    result.traffic.requests = attempts;
+    result.traffic.connections = result.traffic.sent[TRAFFIC_HANDSHAKE] > 0 ? 1 : 0;
+
+    // Lost the race against the watchdog: it is deleting this task right now
+    if (worker.exiting.exchange(true)) {
+        for (;;) {
+            vTaskDelay(portMAX_DELAY);
+        }
+    }
+
+    // Hand the result to the owner task; nothing shared is written here
+    watcher.resultQueue_.push(result);
+    if (watcher.wake_ != NULL) {
+        watcher.wake_(watcher.wakeContext_);
+    }
+
+    // Delete this task
+    vTaskDelete(NULL);
+}
+
+// ============================================================================
+// RESULTS
+// ============================================================================
+
+void Watcher::handleResults() {
+    RequestResult result;
+    while (resultQueue_.pop(&result)) {
+        // A late result of a request already reported as hung is dropped
+        uint16_t endpoint = result.endpoint;
+        if (watchdog_.finish(endpoint, result.generation)) {
+            // A 429, or any response with Retry-After, holds the whole host back
+            if (result.trace.outcome == TRACE_RATE_LIMITED || result.retryAfterMs > 0) {
+                rateLimiter_.pause(endpoints_[endpoint].host, result.retryAfterMs, millis());
+            }
+            accountTraffic(endpoint, &result.traffic);
+            energyLedger_.addRequest(endpoint, result.radioStartUs, result.radioUs, result.traffic);
+            if (result.contentHashed || result.notModified) {
+                trackContent(endpoint, result);
+            }
+            if (result.failover.count > 0) {
+                trackFailover(endpoint, result);
+            }
+            aggregateResult(endpoint, result.trace);
+        }
+        // The worker is free once its request is off the watchdog. A late
+        // result of a reclaimed worker may arrive when the endpoint already
+        // runs on another one: the generation tells them apart.
+        uint8_t worker = endpoints_[endpoint].worker;
+        if (worker != WATCHER_NO_WORKER && workers_[worker].generation == result.generation &&
+            watchdog_.idle(endpoint)) {
+            releaseWorker(endpoint);
+        }
+    }
+}
+
+// Add the estimated DNS and TCP overhead to a measured request and book it
+void Watcher::accountTraffic(uint16_t endpoint, TrafficRecord* traffic) {
+    trafficEstimateDns(traffic, urlHostLength(endpoints_[endpoint].url));
+    trafficEstimateTcp(traffic);
+
+    if (trafficLedger_.add(endpoint, *traffic, millis())) {
+        const TrafficRecord& day = trafficLedger_.lastDay();
+        LOG_INFO("Traffic day %lu: %lu bytes in %lu request(s), handshake share %u%%\n",
+                 (unsigned long)trafficLedger_.day() - 1, (unsigned long)trafficTotal(day),
+                 (unsigned long)day.requests, trafficHandshakePercent(day));
+    }
+
+    if (dataBudget_.metered()) {
+        dataBudget_.record(endpoint, trafficTotal(*traffic), millis());
+        applyDataBudget();
+    }
+}
+
+// Requests past the hard deadline: shut their socket down so the worker
+// falls out of the TLS stack, and report them as failed right away. Workers
+// that still have not exited after the grace period are deleted.
+void Watcher::superviseRequests() {
+    uint32_t now = millis();
+    uint16_t endpoints[NET_METER_SLOTS];
+
+    uint16_t hungCount = watchdog_.collectHung(now, endpoints, NET_METER_SLOTS);
+    for (uint16_t i = 0; i < hungCount; i++) {
+        uint16_t endpoint = endpoints[i];
+        LOG_ERROR("[%d] ✗ Request hung for %lu ms - closing its socket\n", endpoint + 1,
+                  (unsigned long)config_.watchdog.hardDeadlineMs);
+
+        int socket = workers_[endpoints_[endpoint].worker].client.socketFd();
+        if (socket >= 0) {
+            lwip_shutdown(socket, SHUT_RDWR);
+        }
+        endpoints_[endpoint].probe->abandon(endpoint);
+        uint16_t slot = endpoints_[endpoint].failoverSlot;
+        if (slot != WATCHER_NO_FAILOVER) {
+            const WatchWorker& worker = workers_[endpoints_[endpoint].worker];
+            failover_.recordHung(slot, worker.route[worker.attempt], now);
+        }
+
+        TraceRecord hung;
+        memset(&hung, 0, sizeof(hung));
+        hung.startMs = now - config_.watchdog.hardDeadlineMs;
+        hung.status = REQUEST_HUNG;
+        hung.endpoint = traceEndpoint(endpoint);
+        hung.outcome = TRACE_HUNG;
+        aggregateResult(endpoint, hung);
+    }
+
+    uint16_t reclaimCount = watchdog_.collectReclaim(now, endpoints, NET_METER_SLOTS);
+    for (uint16_t i = 0; i < reclaimCount; i++) {
+        uint16_t endpoint = endpoints[i];
+        WatchWorker& worker = workers_[endpoints_[endpoint].worker];
+        if (!worker.exiting.exchange(true)) {
+            LOG_ERROR("[%d] ✗ Worker did not exit - deleting its task\n", endpoint + 1);
+            vTaskDelete(worker.task);
+            netMeterDetach(worker.index);   // Its record was on the deleted stack
+        }
+        worker.client.stop();   // Release whatever the worker left open
+        worker.openEndpoint = WATCHER_NO_ENDPOINT;
+        releaseWorker(endpoint);
+    }
+}
+
+// Bare TCP connect to the gateway (or the configured target) between the
+// polls. When it keeps failing, every healthy endpoint is polled right away
+// so its own request confirms the outage; when it answers again, the DOWN
+// ones are.
+void Watcher::checkLink() {
+    uint32_t now = millis();
+    if (!linkUp_) {
+        if (linkCheck_.inFlight()) {
+            linkProbeStop();
+            linkCheck_.cancel();
+        }
+        return;
+    }
+
+    if (linkCheck_.due(now)) {
+        linkCheck_.start(now);
+        if (!linkProbeStart(config_.linkCheckTarget)) {
+            linkCheck_.cancel();
+            return;
+        }
+    }
+    if (!linkCheck_.inFlight()) {
+        return;
+    }
+
+    LinkProbeState state = linkProbePoll();
+    if (state == LINK_PROBE_PENDING && !linkCheck_.timedOut(now)) {
+        return;
+    }
+    if (state == LINK_PROBE_PENDING) {
+        linkProbeStop();
+    }
+
+    LinkCheckVerdict verdict = linkCheck_.record(state == LINK_PROBE_REACHABLE, now);
+    if (verdict == LINK_CHECK_LOST) {
+        uint16_t expedited = scheduler_.expedite(HEALTH_UP, now);
+        LOG_ERROR("✗ Link check failed %u time(s) - polling %u endpoint(s) now\n",
+                  config_.linkCheck.failThreshold, expedited);
+    } else if (verdict == LINK_CHECK_RESTORED) {
+        uint16_t expedited = scheduler_.expedite(HEALTH_DOWN, now);
+        LOG_INFO("✓ Link check answered again - polling %u DOWN endpoint(s) now\n", expedited);
+    }
+}
+
+// Announce this watcher to its peers, take in theirs and follow the
+// election. While the link is down there is no one to talk to: back to
+// candidate, so the lead is only taken again after listening for a lease.
+void Watcher::coordinatePeers() {
+    if (!peerLease_.enabled()) {
+        return;
+    }
+    uint32_t now = millis();
+    if (!linkUp_) {
+        peerLinkClose();
+        peerLease_.rejoin(now);
+        return;
+    }
+
+    // Without a socket this watcher hears no one, and ends up polling alone
+    bool open = peerLinkOpen(config_.peerChannel);
+    PeerMessage message;
+    while (open && peerLinkReceive(&message)) {
+        reportPeerChange(peerLease_.receive(message, now));
+        if (message.role == PEER_LEADER && message.node == peerLease_.leader() &&
+            peerLease_.role() == PEER_FOLLOWER && observer_ != NULL) {
+            observer_->onLeaderReport(message.node, message.down);
+        }
+    }
+    reportPeerChange(peerLease_.update(now));
+
+    if (peerLease_.heartbeatDue(now)) {
+        PeerMessage heartbeat = peerLease_.heartbeat(endpointCount_, scheduler_.downCount(), now);
+        if (open) {
+            peerLinkSend(config_.peerChannel, heartbeat);
+        }
+    }
+}
+
+void Watcher::reportPeerChange(PeerChange change) {
+    if (change == PEER_LEADING) {
+        LOG_INFO("★ Peers: leading group %08lx as node %08lx (term %lu) - polling upstream\n",
+                 (unsigned long)peerLease_.group(), (unsigned long)peerLease_.node(),
+                 (unsigned long)peerLease_.term());
+    } else if (change == PEER_FOLLOWING) {
+        LOG_INFO("Peers: following node %08lx (term %lu) - upstream pings left to it\n",
+                 (unsigned long)peerLease_.leader(), (unsigned long)peerLease_.term());
+    } else if (change == PEER_LEADER_LOST) {
+        LOG_ERROR("⚠ Peers: leader %08lx silent for %lu ms - electing a new one\n",
+                  (unsigned long)peerLease_.leader(), (unsigned long)config_.peers.leaseMs);
+    }
+}
+
+// Compare a watched endpoint's body digest with the one from its last poll;
+// a 304 says it is the same without sending it
+void Watcher::trackContent(uint16_t endpoint, const RequestResult& result) {
+    uint16_t slot = endpoints_[endpoint].contentSlot;
+    if (slot == WATCHER_NO_CONTENT) {
+        return;
+    }
+    if (result.notModified) {
+        contentTracker_.recordNotModified(slot, result.trace.transferMs);
+        notModified_++;
+        return;
+    }
+
+    uint64_t digest = result.contentDigest;
+    if (contentTracker_.record(slot, digest, result.contentBytes, result.trace.transferMs, result.validators) !=
+        CONTENT_CHANGED) {
+        return;
+    }
+    contentChanges_++;
+    LOG_INFO("[%d] ✎ Content changed (digest %08lx%08lx)\n", endpoint + 1, (unsigned long)(digest >> 32),
+             (unsigned long)(uint32_t)digest);
+    if (observer_ != NULL) {
+        observer_->onContentChange(endpoint, digest);
+    }
+}
+
+// Learn from the destinations a request tried. A connection kept open
+// leads to the last of them.
+void Watcher::trackFailover(uint16_t endpoint, const RequestResult& result) {
+    uint16_t slot = endpoints_[endpoint].failoverSlot;
+    if (slot == WATCHER_NO_FAILOVER) {
+        return;
+    }
+    uint8_t last = result.failover.attempts[result.failover.count - 1].destination;
+    uint8_t worker = endpoints_[endpoint].worker;
+    if (worker != WATCHER_NO_WORKER) {
+        workers_[worker].openDestination = last;
+    }
+    if (result.failover.count > 1 && result.trace.outcome == TRACE_OK) {
+        LOG_INFO("[%d] ✓ Answered by %s after %u attempt(s)\n", endpoint + 1, destinationUrl(endpoint, last),
+                 result.failover.count);
+    }
+    // The attempts before the last one; aggregateResult() counts that
+    for (uint8_t i = 0; i + 1 < result.failover.count; i++) {
+        cycleAttempts_++;
+        if (traceUnanswered(result.failover.attempts[i].outcome)) {
+            unansweredAttempts_++;
+        }
+    }
+    if (failover_.record(slot, result.failover, millis())) {
+        LOG_INFO("[%d] ⇄ Preferred destination now %s\n", endpoint + 1,
+                 destinationUrl(endpoint, failover_.slot(slot).preferred));
+    }
+}
+
+// The single owner of health state and counters: feed one result into the
+// trace and the scheduler (retry/backoff and health state), tell the
+// observer, and close the poll cycle after the last one. With more
+// endpoints than workers some request is always in flight, so a cycle also
+// closes once it is a poll interval old; the requests still in flight then
+// count in the next one.
+void Watcher::aggregateResult(uint16_t endpoint, const TraceRecord& result) {
+    bool succeeded = result.outcome == TRACE_OK;
+    HealthChange change = HEALTH_UNCHANGED;
+    activeRequests_--;
+    cycleRequests_++;
+    cycleAttempts_++;
+    if (traceUnanswered(result.outcome)) {
+        unansweredAttempts_++;
+    }
+    traceBuffer_.append(result);
+
+    if (result.outcome == TRACE_RATE_LIMITED) {
+        // Not the endpoint's fault: health stays as it is, and the next
+        // attempt waits for the host's pause to end
+        uint32_t waitMs = rateLimiter_.msUntilAvailable(endpoints_[endpoint].host, millis());
+        rateLimitedRequests_++;
+        scheduler_.recordDeferred(endpoint, millis(), waitMs);
+        LOG_INFO("[%d] ⏸ Rate limited by the server, host paused for %lu ms\n", endpoint + 1,
+                 (unsigned long)waitMs);
+    } else {
+        if (!succeeded) {
+            failedRequests_++;
+        }
+
+        change = scheduler_.recordResult(endpoint, succeeded, millis());
+        if (!succeeded && linkCheck_.lost() && scheduler_.endpoint(endpoint).health != HEALTH_DOWN) {
+            // The link check already says why: no point waiting out the
+            // regular retry delay to confirm it
+            scheduler_.retrySooner(endpoint, millis(), config_.linkCheck.retryMs);
+        }
+        if (change == HEALTH_WENT_DOWN) {
+            LOG_ERROR("[%d] ⚠ Endpoint DOWN, retrying in %lu ms\n", endpoint + 1,
+                      (unsigned long)scheduler_.retryDelayMs(scheduler_.endpoint(endpoint).consecutiveFailures));
+        } else if (change == HEALTH_WENT_UP) {
+            LOG_INFO("[%d] ✓ Endpoint back UP\n", endpoint + 1);
+        }
+    }
+
+    if (observer_ != NULL) {
+        observer_->onResult(endpoint, result, change);
+    }
+    bool cycleDue = timeReached(millis(), cycleStartMs_ + config_.scheduler.pollIntervalMs);
+    if (activeRequests_ == 0 || cycleDue) {
+        finishPollCycle();
+    }
+    if (activeRequests_ > 0 && cycleDue) {
+        beginPollCycle();
+    }
+}
+
+void Watcher::finishPollCycle() {
+    profilerSetActive(false);
+    LOG_INFO("\n========================================\n");
+    if (failedRequests_ > 0) {
+        LOG_ERROR("Poll cycle complete - %d request(s) failed\n", failedRequests_);
+    } else {
+        LOG_INFO("Poll cycle complete - All requests successful\n");
+    }
+    if (rateLimitedRequests_ > 0) {
+        LOG_INFO("Rate limited: %d request(s) deferred (not counted as failures)\n", rateLimitedRequests_);
+    }
+    if (contentChanges_ > 0 || notModified_ > 0) {
+        LOG_INFO("Content: %d watched endpoint(s) changed, %d not modified (since boot %lu KB, %lu ms saved)\n",
+                 contentChanges_, notModified_, (unsigned long)(contentTracker_.savedBytes() / 1024),
+                 (unsigned long)contentTracker_.savedMs());
+    }
+
+    // CPU time of the whole cycle, split across its requests
+    uint32_t busyTicks = cpuMeterBusyTicks() - cycleStartBusyTicks_;
+    EnergyRecord cycle = energyLedger_.finishCycle((uint64_t)busyTicks * cpuMeterTickUs());
+    if (cycle.requests > 0) {
+        uint64_t microjoules = energyMicrojoules(cycle, config_.energy);
+        LOG_INFO("Energy: %lu.%03lu mJ, %lu uJ per ping (radio %lu ms, TX %lu ms, CPU %lu ms)\n",
+                 (unsigned long)(microjoules / 1000), (unsigned long)(microjoules % 1000),
+                 (unsigned long)(microjoules / cycle.requests), (unsigned long)(cycle.radioUs / 1000),
+                 (unsigned long)(cycle.txUs / 1000), (unsigned long)(cycle.cpuUs / 1000));
+    }
+    uint32_t deferrals = 0;
+    uint32_t throttled = 0;
+    for (uint16_t i = 0; i < hostCount_; i++) {
+        deferrals += rateLimiter_.bucket(i).deferrals;
+        throttled += rateLimiter_.bucket(i).throttled;
+    }
+    if (deferrals > 0 || throttled > 0) {
+        LOG_INFO("Rate limits since boot: %lu deferral(s), %lu rate-limit response(s)\n",
+                 (unsigned long)deferrals, (unsigned long)throttled);
+    }
+    if (watchdog_.hungCount() > 0) {
+        LOG_ERROR("Hung requests since boot: %lu (%lu worker(s) deleted)\n",
+                  (unsigned long)watchdog_.hungCount(), (unsigned long)watchdog_.reclaimedCount());
+    }
+
+    if (observer_ != NULL) {
+        CycleSummary summary = { cycleRequests_, failedRequests_, rateLimitedRequests_, scheduler_.downCount(),
+                                 contentChanges_, notModified_, cycleAttempts_, unansweredAttempts_ };
+        observer_->onCycleComplete(summary);
+    }
+    rateLimitedRequests_ = 0;
+    LOG_INFO("========================================\n\n");
+}
+
+// ============================================================================
+// DATA BUDGET
+// ============================================================================
+
+// Budget state survives reboots in NVS; a missing or mismatched blob starts
+// a fresh period
+void Watcher::loadDataBudget() {
+    DataBudgetState saved;
+    bool restored = false;
+    Preferences store;
+    if (dataBudget_.metered() && store.begin(config_.budgetNamespace, true)) {
+        restored = store.getBytesLength("state") == sizeof(saved) &&
+                   store.getBytes("state", &saved, sizeof(saved)) == sizeof(saved);
+        store.end();
+    }
+    dataBudget_.begin(millis(), restored ? &saved : NULL);
+
+    if (dataBudget_.metered()) {
+        const DataBudgetState& state = dataBudget_.state();
+        LOG_INFO("Data budget: %lu of %lu bytes used, %lu h into the period%s\n",
+                 (unsigned long)state.usedBytes, (unsigned long)dataBudget_.budgetBytes(),
+                 (unsigned long)(state.elapsedMs / 3600000UL), restored ? " (restored)" : "");
+    }
+}
+
+// Re-plan after every booked request: intervals follow the stretch factors
+// before the scheduler computes the endpoint's next due time
+void Watcher::applyDataBudget() {
+    BudgetPressure previous = dataBudget_.pressure();
+    BudgetPressure pressure = dataBudget_.plan(millis());
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        uint8_t stretch = dataBudget_.stretch(i);
+        scheduler_.setIntervalScale(i, stretch > 0 ? stretch : 1);
+    }
+
+    if (pressure != previous) {
+        if (pressure == BUDGET_OK) {
+            LOG_INFO("Data budget: back on track, regular intervals\n");
+        } else {
+            LOG_ERROR("Data budget %s: %lu of %lu bytes used - stretching intervals%s\n",
+                      budgetPressureName(pressure), (unsigned long)dataBudget_.state().usedBytes,
+                      (unsigned long)dataBudget_.budgetBytes(),
+                      dataBudget_.reuseConnections() ? ", reusing connections" : "");
+        }
+    }
+
+    if (dataBudget_.persistDue()) {
+        saveDataBudget();
+    }
+}
+
+void Watcher::saveDataBudget() {
+    Preferences store;
+    if (!store.begin(config_.budgetNamespace, false)) {
+        LOG_ERROR("Data budget: NVS not available, usage is not persisted\n");
+        return;
+    }
+    store.putBytes("state", &dataBudget_.state(), sizeof(DataBudgetState));
+    store.end();
+    dataBudget_.persisted();
+}
@@ -0,0 +1,442 @@
+// ============================================================================
+// WATCHER
+// ============================================================================
+//
+// The endpoint watcher as a library, for the svitlo-watcher sketch
+// (src/main.cpp) and any other firmware that wants to embed it. A Watcher
+// polls its endpoints in parallel request tasks and keeps, per endpoint,
+// retry/backoff and health state (PollScheduler), a hung-request watchdog,
+// traffic and energy accounting, a data budget, a per-host rate limit,
+// for endpoints that ask for it a digest of the body to detect content
+// changes, for endpoints with alternate URLs the choice of destination
+// (failover), between polls a bare TCP link check that brings the polls
+// forward when it fails, and a lease among watchers on one LAN so that only
+// one of them pings upstream (all from lib/WatcherCore).
+//
+// API:
+//   Watcher          the engine; one per firmware (the socket and CPU meters
+//                    it relies on are process-wide)
+//   EndpointConfig   an endpoint: URL, priority under the data budget, the
+//                    Probe that checks it, equivalent URLs to fail over
+//                    to and HEAD or a byte range for heavy pages. Large
+//                    lists come as an EndpointTable instead, read in place
+//                    from flash (config_partition.h)
+//   Probe            what a request task does against an endpoint (Probe.h;
+//                    HttpGetProbe is the HTTPS GET the sketch uses)
+//   ResultObserver   callbacks for every result and every finished poll cycle
+//
+// The resource budget is fixed at construction:
+//   memory   all state lives in a WatcherStorage<> the caller declares,
+//            sized by its template parameters (endpoints, request tasks,
+//            trace records, days of traffic history). The Watcher itself
+//            never allocates. Per endpoint it keeps only runtime state;
+//            secure clients belong to the request task slots (workers).
+//   tasks    at most WatcherBudget::maxTasks request tasks exist at once,
+//            hung ones the watchdog has not reclaimed yet included; due
+//            endpoints beyond that wait for a task to finish
+//   stack    each request task gets WatcherBudget::taskStackBytes from the
+//            FreeRTOS heap, so request tasks never take more than
+//            maxTasks * taskStackBytes of it. Inside the task only the
+//            probe may allocate (HttpGetProbe: not on the lean HTTP path).
+//
+// Threading: every Watcher method belongs to a single owner task (the
+// sketch's loop task). Request tasks only push into the lock-free result
+// queue and call the wake hook, which must be safe from any task; the owner
+// answers a wake-up (and the timer from msUntilNextTimer()) with service().
+//
+// The network link is not the Watcher's business: the owner manages it and
+// reports it with setLinkUp().
+//
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <atomic>
+
+#include <PollScheduler.h>
+#include <NetTrace.h>
+#include <ResultQueue.h>
+#include <RequestWatchdog.h>
+#include <TrafficMeter.h>
+#include <DataBudget.h>
+#include <EnergyMeter.h>
+#include <RateLimiter.h>
+#include <EndpointTable.h>
+#include <ContentHash.h>
+#include <LinkCheck.h>
+#include <PeerLease.h>
+#include <Failover.h>
+
+#include "net_meter.h"
+#include "link_probe.h"
+#include "peer_link.h"
+#include "Probe.h"
+
+// ============================================================================
+// CONFIGURATION AND BUDGET
+// ============================================================================
+
+// Equivalent destinations of an endpoint's check, after its own URL
+// (FAILOVER_MAX_DESTINATIONS - 1 at most). They go through the endpoint's
+// probe, share its rate limit and count as the endpoint.
+struct EndpointAlternates {
+    const char* const* urls;       // Must stay valid
+    uint8_t count;
+};
+
+struct EndpointConfig {
+    const char* url;               // Must stay valid
+    uint8_t priority;              // EndpointPriority: order of stretching under the data budget
+    Probe* probe;                  // NULL: the Watcher's default probe
+    const ContentWatch* content;   // Report body changes (NULL: availability only)
+    const EndpointAlternates* alternates;   // Fail over to these (NULL: the URL only)
+    const HttpRequestMode* request;   // HEAD or the first bytes only (NULL: GET; HttpGetProbe)
+};
+
+struct WatcherConfig {
+    SchedulerConfig scheduler;
+    WatchdogConfig watchdog;
+    DataBudgetConfig dataBudget;
+    const char* budgetNamespace;   // NVS namespace the budget state is kept in
+    EnergyModel energy;
+    RateLimitConfig rateLimit;
+    LinkCheckConfig linkCheck;
+    LinkProbeTarget linkCheckTarget;   // 0.0.0.0: the gateway
+    PeerConfig peers;
+    PeerChannel peerChannel;       // Multicast group the peers announce on
+    FailoverConfig failover;
+};
+
+struct WatcherBudget {
+    uint8_t maxTasks;              // Request tasks alive at once (at most the storage's TASKS)
+    uint32_t taskStackBytes;       // Stack of each request task
+    uint8_t taskPriority;          // FreeRTOS priority of the request tasks
+};
+
+// Outcome of one poll cycle, for ResultObserver::onCycleComplete()
+struct CycleSummary {
+    uint16_t requests;             // Results aggregated this cycle
+    uint16_t failed;
+    uint16_t rateLimited;          // Deferred by the rate limit or answered 429
+    uint16_t downCount;            // Endpoints DOWN after the cycle
+    uint16_t contentChanges;       // Watched bodies that differ from the last poll
+    uint16_t notModified;          // Watched endpoints that answered 304
+    uint16_t attempts;             // Requests sent, failover attempts included
+    uint16_t unanswered;           // ... that got no answer at all (traceUnanswered())
+};
+
+// Callbacks on the owner task. The default implementations do nothing.
+class ResultObserver {
+public:
+    virtual ~ResultObserver() {}
+
+    // A request finished, or was declared hung, and the scheduler has seen
+    // it. change is HEALTH_UNCHANGED for rate-limited results.
+    virtual void onResult(uint16_t endpoint, const TraceRecord& result, HealthChange change) {}
+
+    // The body of a watched endpoint hashed differently from its last
+    // successful response (not called for the first one after begin())
+    virtual void onContentChange(uint16_t endpoint, uint64_t digest) {}
+
+    // The last request of a poll cycle finished, or the cycle is a poll
+    // interval old. Whatever this logs goes inside the cycle's summary.
+    virtual void onCycleComplete(const CycleSummary& summary) {}
+
+    // While following, the leader announced how many endpoints it has DOWN
+    // (it polls for the group; this watcher does not)
+    virtual void onLeaderReport(uint32_t leader, uint16_t downCount) {}
+};
+
+// Wakes the owner task up; called from request tasks
+typedef void (*WatcherWakeHook)(void* context);
+
+// ============================================================================
+// STORAGE
+// ============================================================================
+
+// WiFiClientSecure with access to its socket, so the watchdog can shut the
+// connection down under a worker that is stuck inside the TLS stack. It also
+// moves the traffic meter from the handshake to the request and response
+// phases as the HTTP code starts writing and reading.
+class WatchedClient : public WiFiClientSecure {
+public:
+    void setMeterSlot(uint8_t slot) { meterSlot_ = slot; }
+    int socketFd() const { return sslclient != NULL ? sslclient->socket : -1; }
+
+    size_t write(const uint8_t* buffer, size_t size) override {
+        netMeterSetPhase(meterSlot_, TRAFFIC_REQUEST);
+        return WiFiClientSecure::write(buffer, size);
+    }
+
+    int available() override {
+        netMeterSetPhase(meterSlot_, TRAFFIC_RESPONSE);
+        return WiFiClientSecure::available();
+    }
+
+    int read() override {
+        netMeterSetPhase(meterSlot_, TRAFFIC_RESPONSE);
+        return WiFiClientSecure::read();
+    }
+
+    int read(uint8_t* buffer, size_t size) override {
+        netMeterSetPhase(meterSlot_, TRAFFIC_RESPONSE);
+        return WiFiClientSecure::read(buffer, size);
+    }
+
+private:
+    uint8_t meterSlot_ = 0;
+};
+
+class Watcher;
+
+const uint16_t WATCHER_NO_ENDPOINT = 0xFFFF;
+const uint8_t WATCHER_NO_WORKER = 0xFF;
+const uint16_t WATCHER_NO_CONTENT = 0xFFFF;
+const uint16_t WATCHER_NO_FAILOVER = 0xFFFF;
+
+// Per-endpoint state of the Watcher itself. url points into the caller's
+// EndpointConfig or the mapped EndpointTable; nothing of the configuration
+// is copied.
+struct WatchEndpoint {
+    const char* url;
+    Probe* probe;
+    const ContentWatch* content;
+    uint16_t contentSlot;          // Digest and validators, WATCHER_NO_CONTENT if not watched
+    const EndpointAlternates* alternates;
+    uint16_t failoverSlot;         // Destination EWMAs, WATCHER_NO_FAILOVER without alternates
+    HttpRequestMode mode;
+    uint16_t host;                 // Rate-limit bucket
+    uint8_t worker;                // Serving the current request, WATCHER_NO_WORKER if none
+};
+
+// A request task slot. The client and task handle are reused for every
+// request: a worker that has to be deleted leaves no heap behind. A worker
+// is handed out again only once the watchdog slot of its endpoint is idle.
+struct WatchWorker {
+    Watcher* owner;
+    uint8_t index;                 // Also the traffic meter slot
+    uint16_t endpoint;             // Being served, WATCHER_NO_ENDPOINT while free
+    uint16_t openEndpoint;         // Whose connection the client may hold open (keep-alive)
+    uint32_t generation;           // From watchdog.start(), echoed in the result
+    bool keepAlive;                // Reuse the open connection (data budget)
+    bool reconnect;                // Close another endpoint's connection first
+    uint8_t route[FAILOVER_MAX_DESTINATIONS];   // Destinations to try, in order
+    uint8_t routeCount;
+    uint8_t openDestination;       // Of openEndpoint's connection
+    WatchedClient client;
+    TaskHandle_t task;
+
+    // Set by whichever comes first: the worker on its way out, or the
+    // watchdog about to delete it. The loser backs off, so a task is never
+    // deleted twice.
+    std::atomic<bool> exiting;
+
+    // Index into route[] of the attempt in progress, written by the request
+    // task: a hung request is charged to the destination it hung on
+    std::atomic<uint8_t> attempt;
+};
+
+// Result queue slots: a power of two with room for two results per worker
+// (a hung request's late result can still be queued next to the new one)
+constexpr uint32_t watcherResultSlots(uint32_t workers) {
+    return workers <= 1 ? 2 : 2 * watcherResultSlots((workers + 1) / 2);
+}
+
+// Pointers into a WatcherStorage<>, as the Watcher sees it
+struct WatcherMemory {
+    uint16_t endpointCapacity;
+    uint8_t workerCapacity;
+    uint16_t traceCapacity;
+    uint8_t historyDays;
+    uint16_t contentCapacity;
+    uint16_t failoverCapacity;
+    uint32_t resultCapacity;
+    WatchEndpoint* endpoints;
+    WatchWorker* workers;
+    EndpointRuntime* runtime;
+    WatchSlot* watch;
+    BudgetEndpoint* budget;
+    EnergySlot* energy;
+    HostBucket* hosts;
+    ContentSlot* content;
+    FailoverSlot* failover;
+    TrafficRecord* trafficToday;
+    TrafficRecord* trafficHistory;
+    TraceRecord* trace;
+    ResultSlot* results;
+};
+
+// All memory of a Watcher with room for ENDPOINTS endpoints and TASKS
+// concurrent requests. Declare it statically (it is too big for a task
+// stack) and hand memory() to the Watcher's constructor. An endpoint costs
+// about 180 bytes, plus about 130 for each of the CONTENT_ENDPOINTS that may
+// be watched for content and about 100 for each of the FAILOVER_ENDPOINTS
+// that may have alternates; a worker (with its secure client) about 250
+// plus what the client allocates while connected.
+template <uint16_t ENDPOINTS, uint8_t TASKS, uint16_t TRACE_RECORDS = 256, uint8_t HISTORY_DAYS = 7,
+          uint16_t CONTENT_ENDPOINTS = ENDPOINTS, uint16_t FAILOVER_ENDPOINTS = ENDPOINTS>
+struct WatcherStorage {
+    static_assert(ENDPOINTS > 0 && ENDPOINTS < WATCHER_NO_ENDPOINT, "endpoint indices are 16 bits");
+    static_assert(CONTENT_ENDPOINTS > 0 && CONTENT_ENDPOINTS <= ENDPOINTS, "content slots are per endpoint");
+    static_assert(FAILOVER_ENDPOINTS > 0 && FAILOVER_ENDPOINTS <= ENDPOINTS, "failover slots are per endpoint");
+    static_assert(TASKS > 0 && TASKS <= NET_METER_SLOTS, "one traffic meter slot per worker");
+    static_assert(TRACE_RECORDS > 0 && HISTORY_DAYS > 0, "trace and traffic history need room");
+
+    WatchEndpoint endpoints[ENDPOINTS];
+    WatchWorker workers[TASKS];
+    EndpointRuntime runtime[ENDPOINTS];
+    WatchSlot watch[ENDPOINTS];
+    BudgetEndpoint budget[ENDPOINTS];
+    EnergySlot energy[ENDPOINTS];
+    HostBucket hosts[ENDPOINTS];               // At most one host per endpoint
+    ContentSlot content[CONTENT_ENDPOINTS];    // Handed out to watched endpoints in order
+    FailoverSlot failover[FAILOVER_ENDPOINTS]; // Handed out to endpoints with alternates in order
+    TrafficRecord trafficToday[ENDPOINTS];
+    TrafficRecord trafficHistory[HISTORY_DAYS];
+    TraceRecord trace[TRACE_RECORDS];
+    ResultSlot results[watcherResultSlots(TASKS)];
+
+    WatcherMemory memory() {
+        WatcherMemory memory = {
+            ENDPOINTS, TASKS, TRACE_RECORDS, HISTORY_DAYS, CONTENT_ENDPOINTS, FAILOVER_ENDPOINTS,
+            watcherResultSlots(TASKS), endpoints, workers, runtime, watch, budget, energy, hosts, content, failover,
+            trafficToday, trafficHistory, trace, results,
+        };
+        return memory;
+    }
+};
+
+// ============================================================================
+// WATCHER
+// ============================================================================
+
+class Watcher {
+public:
+    Watcher(const WatcherMemory& memory, const WatcherConfig& config, const WatcherBudget& budget,
+            Probe& defaultProbe);
+
+    // Take the endpoints from an array, or from a mapped table (all with the
+    // default probe); both must stay valid. Endpoints beyond the capacity of
+    // the memory are left out (and logged), as is change detection beyond
+    // its content slots, and alternates beyond the failover slots. Every
+    // endpoint becomes due as soon as the link is up. The observer may be
+    // NULL.
+    void begin(const EndpointConfig* endpoints, uint16_t count, WatcherWakeHook wake, void* wakeContext,
+               ResultObserver* observer);
+    void begin(const EndpointTable& table, WatcherWakeHook wake, void* wakeContext, ResultObserver* observer);
+
+    // Polling only starts while the link is up
+    void setLinkUp(bool up) { linkUp_ = up; }
+    bool linkUp() const { return linkUp_; }
+
+    // Owner task: take in results, supervise running requests and start
+    // the due ones. Call on every wake-up and timer expiry.
+    void service();
+
+    // Poll one endpoint as soon as a worker and its host's rate limit
+    // allow, e.g. because there is news to report. False while it is in
+    // flight; ask again once its result is in.
+    bool pollNow(uint16_t endpoint) { return scheduler_.pollNow(endpoint, millis()); }
+
+    // Time until service() has timed work to do (UINT32_MAX: none)
+    uint32_t msUntilNextTimer() const;
+
+    // Console reports, not affected by WATCHER_LOG_LEVEL (WatcherReport.cpp).
+    // printTrace() clears the trace.
+    void printTrace(Print& out);
+    void printTraffic(Print& out);
+    void printEnergy(Print& out);
+    void printContent(Print& out);
+    void printFailover(Print& out);
+
+    uint16_t endpointCount() const { return endpointCount_; }
+    const char* endpointUrl(uint16_t index) const { return endpoints_[index].url; }
+    int activeRequests() const { return activeRequests_; }
+    uint8_t liveTasks() const;
+
+    const PollScheduler& scheduler() const { return scheduler_; }
+    const RequestWatchdog& watchdog() const { return watchdog_; }
+    const TrafficLedger& trafficLedger() const { return trafficLedger_; }
+    const DataBudget& dataBudget() const { return dataBudget_; }
+    const EnergyLedger& energyLedger() const { return energyLedger_; }
+    const RateLimiter& rateLimiter() const { return rateLimiter_; }
+    const TraceBuffer& traceBuffer() const { return traceBuffer_; }
+    const ContentTracker& contentTracker() const { return contentTracker_; }
+    const FailoverTable& failover() const { return failover_; }
+    const LinkCheck& linkCheck() const { return linkCheck_; }
+    const PeerLease& peerLease() const { return peerLease_; }
+
+private:
+    static void requestTask(void* parameter);
+
+    uint16_t claimEndpoints(uint16_t count, WatcherWakeHook wake, void* wakeContext, ResultObserver* observer);
+    void start();
+    void assignHosts();
+    void assignContentSlots();
+    void assignFailoverSlots();
+    const char* destinationUrl(uint16_t endpoint, uint8_t destination) const;
+    void trackFailover(uint16_t endpoint, const RequestResult& result);
+    uint32_t peerGroup() const;
+    void pollDueEndpoints();
+    void beginPollCycle();
+    uint16_t pollEndpoints(const uint16_t* due, uint16_t dueCount);
+    bool dispatch(uint16_t endpoint);
+    WatchWorker* freeWorker(uint16_t endpoint);
+    void releaseWorker(uint16_t endpoint);
+    void handleResults();
+    void accountTraffic(uint16_t endpoint, TrafficRecord* traffic);
+    void superviseRequests();
+    void checkLink();
+    void coordinatePeers();
+    void reportPeerChange(PeerChange change);
+    void trackContent(uint16_t endpoint, const RequestResult& result);
+    void aggregateResult(uint16_t endpoint, const TraceRecord& result);
+    void finishPollCycle();
+
+    void loadDataBudget();
+    void applyDataBudget();
+    void saveDataBudget();
+
+    WatcherMemory memory_;
+    WatcherConfig config_;
+    WatcherBudget budget_;
+    Probe& defaultProbe_;
+    WatchEndpoint* endpoints_;
+    WatchWorker* workers_;
+    uint16_t endpointCount_;
+    uint8_t workerCount_;          // Workers in use: budget within the memory's capacity
+    uint16_t hostCount_;
+
+    PollScheduler scheduler_;
+    RequestWatchdog watchdog_;
+    ResultQueue resultQueue_;
+    TraceBuffer traceBuffer_;
+    TrafficLedger trafficLedger_;
+    DataBudget dataBudget_;
+    EnergyLedger energyLedger_;
+    RateLimiter rateLimiter_;
+    ContentTracker contentTracker_;
+    FailoverTable failover_;
+    LinkCheck linkCheck_;
+    PeerLease peerLease_;
+
+    WatcherWakeHook wake_;
+    void* wakeContext_;
+    ResultObserver* observer_;
+    bool linkUp_;
+
+    int activeRequests_;           // Requests in flight
+    uint16_t cycleRequests_;       // Results aggregated in the current poll cycle
+    uint16_t failedRequests_;      // Failed requests in the current poll cycle
+    uint16_t rateLimitedRequests_; // Deferred or answered 429 since the last poll cycle closed
+    uint16_t contentChanges_;      // Changed bodies in the current poll cycle
+    uint16_t notModified_;         // 304 answers in the current poll cycle
+    uint16_t cycleAttempts_;       // Requests sent in the current poll cycle, failovers included
+    uint16_t unansweredAttempts_;  // ... of them without any answer
+    uint32_t cycleStartMs_;        // When the current poll cycle opened
+    uint32_t cycleStartBusyTicks_; // CPU meter reading when the poll cycle started
+};
+
+#endif // WATCHER_H
@@ -0,0 +1,162 @@
+#include "Watcher.h"
+
+// ============================================================================
+// CONSOLE REPORTS
+// ============================================================================
+
+// One hex-encoded TraceRecord per line between BEGIN/END markers, so the
+// dump survives a plain serial monitor log (see scripts/trace_extract.py)
+void Watcher::printTrace(Print& out) {
+    out.printf("=== TRACE BEGIN v%u count=%u dropped=%lu ===\n",
+               TRACE_VERSION, traceBuffer_.count(), (unsigned long)traceBuffer_.dropped());
+
+    char line[2 * sizeof(TraceRecord) + 1];
+    for (uint16_t i = 0; i < traceBuffer_.count(); i++) {
+        const uint8_t* bytes = (const uint8_t*)&traceBuffer_.at(i);
+        for (size_t b = 0; b < sizeof(TraceRecord); b++) {
+            snprintf(line + 2 * b, 3, "%02x", bytes[b]);
+        }
+        out.printf("%s\n", line);
+    }
+
+    out.printf("=== TRACE END ===\n");
+    traceBuffer_.clear();
+}
+
+// Today's bytes per endpoint and phase, then whole days. DNS and TCP are
+// estimates; everything else is counted at the socket.
+void Watcher::printTraffic(Print& out) {
+    trafficLedger_.rollDays(millis());
+    out.printf("=== TRAFFIC day %lu since boot ===\n", (unsigned long)trafficLedger_.day());
+    out.printf("Endpoint  Requests  Conns");
+    for (uint8_t phase = 0; phase < TRAFFIC_PHASES; phase++) {
+        out.printf("  %9s", trafficPhaseName(phase));
+    }
+    out.printf("      Total  Per req  Handshake\n");
+
+    for (uint16_t i = 0; i <= endpointCount_; i++) {
+        bool isTotal = i == endpointCount_;
+        TrafficRecord record = isTotal ? trafficLedger_.todayTotal() : trafficLedger_.today(i);
+        uint32_t total = trafficTotal(record);
+
+        if (isTotal) {
+            out.printf("%8s", "all");
+        } else {
+            out.printf("%8d", i + 1);
+        }
+        out.printf("  %8lu  %5lu", (unsigned long)record.requests, (unsigned long)record.connections);
+        for (uint8_t phase = 0; phase < TRAFFIC_PHASES; phase++) {
+            out.printf("  %9lu", (unsigned long)trafficPhaseTotal(record, phase));
+        }
+        out.printf("  %9lu  %7lu  %8u%%\n", (unsigned long)total,
+                   (unsigned long)(record.requests > 0 ? total / record.requests : 0),
+                   trafficHandshakePercent(record));
+    }
+
+    for (uint8_t ago = 0; ago < trafficLedger_.historyCount(); ago++) {
+        const TrafficRecord& day = trafficLedger_.historyDay(ago);
+        out.printf("Day %lu: %lu bytes, %lu request(s), handshake share %u%%\n",
+                   (unsigned long)(trafficLedger_.day() - 1 - ago), (unsigned long)trafficTotal(day),
+                   (unsigned long)day.requests, trafficHandshakePercent(day));
+    }
+
+    if (dataBudget_.metered()) {
+        const DataBudgetState& budget = dataBudget_.state();
+        out.printf("Budget: %lu of %lu bytes (%lu%%), %lu of %lu h into period %lu, %s, connection reuse %s\n",
+                   (unsigned long)budget.usedBytes, (unsigned long)dataBudget_.budgetBytes(),
+                   (unsigned long)((uint64_t)budget.usedBytes * 100 / dataBudget_.budgetBytes()),
+                   (unsigned long)(budget.elapsedMs / 3600000UL), (unsigned long)(dataBudget_.periodMs() / 3600000UL),
+                   (unsigned long)budget.period, budgetPressureName(dataBudget_.pressure()),
+                   dataBudget_.reuseConnections() ? "on" : "off");
+        for (uint16_t i = 0; i < endpointCount_; i++) {
+            const BudgetEndpoint& endpoint = memory_.budget[i];
+            if (dataBudget_.suspended(i)) {
+                out.printf("  [%d] %s, suspended\n", i + 1, endpointPriorityName(endpoint.priority));
+            } else {
+                out.printf("  [%d] %s, every %lu s, %lu bytes/request\n", i + 1,
+                           endpointPriorityName(endpoint.priority),
+                           (unsigned long)(config_.scheduler.pollIntervalMs / 1000 * dataBudget_.stretch(i)),
+                           (unsigned long)endpoint.bytesPerRequest);
+            }
+        }
+    }
+    out.printf("=== TRAFFIC END (DNS and TCP estimated) ===\n");
+}
+
+// Times and energy per endpoint since boot, with the model they were
+// computed with
+void Watcher::printEnergy(Print& out) {
+    const EnergyModel& model = config_.energy;
+    out.printf("=== ENERGY since boot (%u mV; CPU %u mA, radio %u mA, TX +%u mA) ===\n",
+               model.supplyMv, model.cpuMa, model.radioMa, model.txMa);
+    out.printf("Endpoint  Requests   Radio ms    TX ms   CPU ms        mJ   uJ/ping\n");
+
+    for (uint16_t i = 0; i <= endpointCount_; i++) {
+        bool isTotal = i == endpointCount_;
+        EnergyRecord record = isTotal ? energyLedger_.grandTotal() : energyLedger_.total(i);
+        uint64_t microjoules = energyMicrojoules(record, model);
+
+        if (isTotal) {
+            out.printf("%8s", "all");
+        } else {
+            out.printf("%8d", i + 1);
+        }
+        out.printf("  %8lu  %9lu  %7lu  %7lu  %8lu  %8lu\n", (unsigned long)record.requests,
+                   (unsigned long)(record.radioUs / 1000), (unsigned long)(record.txUs / 1000),
+                   (unsigned long)(record.cpuUs / 1000), (unsigned long)(microjoules / 1000),
+                   (unsigned long)(record.requests > 0 ? microjoules / record.requests : 0));
+    }
+    out.printf("=== ENERGY END (estimated) ===\n");
+}
+
+// Body digests of the endpoints watched for content changes, and what
+// conditional requests saved them
+void Watcher::printContent(Print& out) {
+    out.printf("=== CONTENT %lu change(s), %lu not modified since boot ===\n",
+               (unsigned long)contentTracker_.changeCount(), (unsigned long)contentTracker_.notModifiedCount());
+    out.printf("Endpoint  Changes      304  Saved KB  Saved ms  Digest\n");
+
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        if (endpoints_[i].contentSlot == WATCHER_NO_CONTENT) {
+            continue;
+        }
+        const ContentSlot& slot = contentTracker_.slot(endpoints_[i].contentSlot);
+        out.printf("%8d  %7lu  %7lu  %8lu  %8lu  ", i + 1, (unsigned long)slot.changes,
+                   (unsigned long)slot.notModified, (unsigned long)(slot.savedBytes / 1024),
+                   (unsigned long)slot.savedMs);
+        if (slot.known) {
+            out.printf("%08lx%08lx\n", (unsigned long)(slot.digest >> 32), (unsigned long)(uint32_t)slot.digest);
+        } else {
+            out.printf("(not polled yet)\n");
+        }
+    }
+    out.printf("Saved: %lu KB, %lu ms of transfer\n", (unsigned long)(contentTracker_.savedBytes() / 1024),
+               (unsigned long)contentTracker_.savedMs());
+    out.printf("=== CONTENT END ===\n");
+}
+
+void Watcher::printFailover(Print& out) {
+    out.printf("=== FAILOVER %u endpoint(s) with alternates ===\n", failover_.count());
+    out.printf("Endpoint  Dest  Success  Latency ms  Score ms  Attempts  Failures  URL\n");
+
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        uint16_t index = endpoints_[i].failoverSlot;
+        if (index == WATCHER_NO_FAILOVER) {
+            continue;
+        }
+        const FailoverSlot& slot = failover_.slot(index);
+        for (uint8_t d = 0; d < slot.count; d++) {
+            const FailoverDestination& destination = slot.destinations[d];
+            out.printf("%8d  %3u%c  %6lu%%  %10lu%c  %8lu  %8lu  %8lu  %s\n", i + 1, d,
+                       d == slot.preferred ? '*' : ' ',
+                       (unsigned long)destination.success * 100 / FAILOVER_SUCCESS_ONE,
+                       (unsigned long)destination.latencyMs, destination.answered ? ' ' : '?',
+                       (unsigned long)failover_.score(index, d), (unsigned long)destination.attempts,
+                       (unsigned long)destination.failures, destinationUrl(i, d));
+        }
+        out.printf("%8d  %lu failover(s), %lu switch(es) of the preferred destination\n", i + 1,
+                   (unsigned long)slot.failovers, (unsigned long)slot.switches);
+    }
+    out.printf("* preferred, ? latency not measured yet\n");
+    out.printf("=== FAILOVER END ===\n");
+}
@@ -0,0 +1,44 @@
+#include <config_partition.h>
+#include <log.h>
+#include <esp_partition.h>
+
+bool configPartitionMap(const char* label, EndpointTable* table) {
+    const esp_partition_t* partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CONFIG_PARTITION_SUBTYPE, label);
+    if (partition == NULL) {
+        LOG_INFO("Config partition '%s' not found\n", label);
+        return false;
+    }
+
+    // The header says how much to map; an erased partition reads as 0xFF
+    EndpointTableHeader header;
+    if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) {
+        LOG_ERROR("Config partition '%s': read failed\n", label);
+        return false;
+    }
+    uint32_t size = EndpointTable::blobSize(header);
+    if (size == 0) {
+        LOG_INFO("Config partition '%s' holds no endpoint table\n", label);
+        return false;
+    }
+    if (size > partition->size) {
+        LOG_ERROR("Config partition '%s': table of %lu bytes does not fit\n", label, (unsigned long)size);
+        return false;
+    }
+
+    const void* blob = NULL;
+    spi_flash_mmap_handle_t handle;
+    if (esp_partition_mmap(partition, 0, size, SPI_FLASH_MMAP_DATA, &blob, &handle) != ESP_OK) {
+        LOG_ERROR("Config partition '%s': mapping %lu bytes failed\n", label, (unsigned long)size);
+        return false;
+    }
+
+    if (!table->begin(blob, size)) {
+        LOG_ERROR("Config partition '%s': %s\n", label, table->error());
+        spi_flash_munmap(handle);
+        return false;
+    }
+    LOG_INFO("Config partition '%s': %u endpoint(s) on %u host(s), %lu bytes mapped\n", label,
+             table->count(), table->hostCount(), (unsigned long)size);
+    return true;
+}
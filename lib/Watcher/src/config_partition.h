@@ -0,0 +1,28 @@
+// ============================================================================
+// CONFIG PARTITION
+// ============================================================================
+//
+// Maps the endpoint table (lib/WatcherCore/src/EndpointTable.h) from its own
+// data partition into the address space, so the records are read straight
+// from flash through the cache and never copied. The partition is declared
+// in partitions.csv (type data, subtype CONFIG_PARTITION_SUBTYPE) and
+// written with the output of scripts/config_pack.py.
+//
+// The mapping is kept for the rest of the uptime. Only the bytes the table
+// header describes are mapped, not the whole partition.
+//
+
+#ifndef CONFIG_PARTITION_H
+#define CONFIG_PARTITION_H
+
+#include <Arduino.h>
+#include <EndpointTable.h>
+
+// Custom data subtype of the config partition (0x40-0xFE are free for apps)
+const uint8_t CONFIG_PARTITION_SUBTYPE = 0x40;
+
+// Map the table in the partition called label into table. False (and the
+// reason logged) if there is no such partition or it holds no valid table.
+bool configPartitionMap(const char* label, EndpointTable* table);
+
+#endif // CONFIG_PARTITION_H
@@ -0,0 +1,38 @@
+#include <cpu_meter.h>
+#include <esp_freertos_hooks.h>
+
+static volatile uint32_t busyTicks[portNUM_PROCESSORS];
+
+// Tick interrupt of the respective core: keep it to a compare and an add
+static void IRAM_ATTR sampleCore0() {
+    if (xTaskGetCurrentTaskHandleForCPU(0) != xTaskGetIdleTaskHandleForCPU(0)) {
+        busyTicks[0]++;
+    }
+}
+
+#if portNUM_PROCESSORS > 1
+static void IRAM_ATTR sampleCore1() {
+    if (xTaskGetCurrentTaskHandleForCPU(1) != xTaskGetIdleTaskHandleForCPU(1)) {
+        busyTicks[1]++;
+    }
+}
+#endif
+
+void cpuMeterBegin() {
+    esp_register_freertos_tick_hook_for_cpu(sampleCore0, 0);
+#if portNUM_PROCESSORS > 1
+    esp_register_freertos_tick_hook_for_cpu(sampleCore1, 1);
+#endif
+}
+
+uint32_t cpuMeterBusyTicks() {
+    uint32_t total = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        total += busyTicks[core];
+    }
+    return total;
+}
+
+uint32_t cpuMeterTickUs() {
+    return portTICK_PERIOD_MS * 1000UL;
+}
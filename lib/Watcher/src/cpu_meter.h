@@ -0,0 +1,29 @@
+// ============================================================================
+// CPU ACTIVITY METER
+// ============================================================================
+//
+// Samples what each core is doing at every FreeRTOS tick: a tick that
+// finds anything but the core's idle task running counts as busy. Over a
+// poll cycle this gives the CPU active time to tick resolution (1 ms),
+// without the run-time statistics the Arduino core's FreeRTOS is built
+// without. The tick hooks only bump a counter per core.
+//
+// Energy per request is computed from this by EnergyLedger
+// (lib/WatcherCore/src/EnergyMeter.h).
+//
+
+#ifndef CPU_METER_H
+#define CPU_METER_H
+
+#include <Arduino.h>
+
+// Register the tick hooks (once, from setup())
+void cpuMeterBegin();
+
+// Busy ticks summed over both cores; wraps, so use differences
+uint32_t cpuMeterBusyTicks();
+
+// Microseconds per tick
+uint32_t cpuMeterTickUs();
+
+#endif // CPU_METER_H
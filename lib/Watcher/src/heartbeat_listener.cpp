@@ -0,0 +1,251 @@
+#include <heartbeat_listener.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+
+#include <atomic>
+
+// Longest request line or datagram taken in; a heartbeat needs about 50
+const size_t LINE_BYTES = 80;
+const uint8_t LISTEN_BACKLOG = 4;
+
+static const char RESPONSE_OK[] = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+static const char RESPONSE_BAD[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+
+struct HttpConnection {
+    int fd;                   // -1: slot free
+    uint32_t acceptedMs;
+    size_t length;
+    char line[LINE_BYTES];
+};
+
+static int udpSocket = -1;
+static int httpSocket = -1;
+static HttpConnection connections[HEARTBEAT_HTTP_CONNECTIONS];   // In use while httpSocket is open
+
+// Written by the owner task while no listener task waits, read by the task
+static std::atomic<bool> listening(false);
+static fd_set listenSet;
+static int listenMax = -1;
+static HeartbeatWakeHook listenWake = NULL;
+static void* listenContext = NULL;
+
+static int openSocket(int type, uint16_t port) {
+    int fd = lwip_socket(AF_INET, type, type == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP);
+    if (fd < 0) {
+        return -1;
+    }
+    int reuse = 1;
+    lwip_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in bound;
+    memset(&bound, 0, sizeof(bound));
+    bound.sin_family = AF_INET;
+    bound.sin_port = htons(port);
+    bound.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (lwip_bind(fd, (struct sockaddr*)&bound, sizeof(bound)) < 0 ||
+        (type == SOCK_STREAM && lwip_listen(fd, LISTEN_BACKLOG) < 0)) {
+        lwip_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool heartbeatListenerOpen(const HeartbeatPorts& ports) {
+    if (ports.udp != 0 && udpSocket < 0) {
+        udpSocket = openSocket(SOCK_DGRAM, ports.udp);
+    }
+    if (ports.http != 0 && httpSocket < 0) {
+        httpSocket = openSocket(SOCK_STREAM, ports.http);
+        for (uint8_t i = 0; i < HEARTBEAT_HTTP_CONNECTIONS; i++) {
+            connections[i].fd = -1;
+        }
+    }
+    return (ports.udp == 0 || udpSocket >= 0) && (ports.http == 0 || httpSocket >= 0);
+}
+
+static void closeConnection(HttpConnection& connection) {
+    lwip_close(connection.fd);
+    connection.fd = -1;
+}
+
+void heartbeatListenerClose() {
+    if (udpSocket >= 0) {
+        lwip_close(udpSocket);
+    }
+    if (httpSocket >= 0) {
+        for (uint8_t i = 0; i < HEARTBEAT_HTTP_CONNECTIONS; i++) {
+            if (connections[i].fd >= 0) {
+                closeConnection(connections[i]);
+            }
+        }
+        lwip_close(httpSocket);
+    }
+    udpSocket = -1;
+    httpSocket = -1;
+}
+
+// ============================================================================
+// HTTP
+// ============================================================================
+
+static void acceptConnections(uint32_t nowMs) {
+    for (uint8_t i = 0; i < HEARTBEAT_HTTP_CONNECTIONS; i++) {
+        HttpConnection& connection = connections[i];
+        if (connection.fd >= 0) {
+            continue;
+        }
+        int fd = lwip_accept(httpSocket, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        connection.fd = fd;
+        connection.acceptedMs = nowMs;
+        connection.length = 0;
+    }
+}
+
+// Answer and close. What is left of the request is read away first: lwIP
+// resets a connection closed with unread data, and the reset can overtake
+// the answer.
+static void answer(HttpConnection& connection, bool accepted) {
+    const char* response = accepted ? RESPONSE_OK : RESPONSE_BAD;
+    size_t size = accepted ? sizeof(RESPONSE_OK) - 1 : sizeof(RESPONSE_BAD) - 1;
+    lwip_sendto(connection.fd, response, size, 0, NULL, 0);
+    char discard[64];
+    for (uint8_t i = 0; i < 8; i++) {
+        if (lwip_recvfrom(connection.fd, discard, sizeof(discard), MSG_DONTWAIT, NULL, NULL) <= 0) {
+            break;
+        }
+    }
+    closeConnection(connection);
+}
+
+// Read what arrived; true once the request line was a heartbeat
+static bool serveConnection(HttpConnection& connection, HeartbeatBeat* beat, uint32_t nowMs) {
+    ssize_t size = lwip_recvfrom(connection.fd, connection.line + connection.length,
+                                 sizeof(connection.line) - connection.length, MSG_DONTWAIT, NULL, NULL);
+    if (size == 0 || (size < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+        closeConnection(connection);   // Gone before it said anything useful
+        return false;
+    }
+    if (size < 0) {
+        if (timeReached(nowMs, connection.acceptedMs + HEARTBEAT_HTTP_TIMEOUT_MS)) {
+            closeConnection(connection);
+        }
+        return false;
+    }
+    connection.length += (size_t)size;
+
+    const char* end = (const char*)memchr(connection.line, '\n', connection.length);
+    if (end == NULL) {
+        if (connection.length == sizeof(connection.line)) {
+            answer(connection, false);
+        }
+        return false;
+    }
+    size_t lineLength = (size_t)(end - connection.line);
+    if (lineLength > 0 && connection.line[lineLength - 1] == '\r') {
+        lineLength--;
+    }
+    bool accepted = heartbeatParseRequestLine(connection.line, lineLength, beat);
+    answer(connection, accepted);
+    return accepted;
+}
+
+// ============================================================================
+// RECEIVING
+// ============================================================================
+
+// Datagrams that are not heartbeats are skipped
+bool heartbeatListenerReceive(HeartbeatBeat* beat, uint32_t nowMs) {
+    char datagram[LINE_BYTES];
+    while (udpSocket >= 0) {
+        ssize_t size = lwip_recvfrom(udpSocket, datagram, sizeof(datagram), MSG_DONTWAIT, NULL, NULL);
+        if (size < 0) {
+            break;
+        }
+        if (heartbeatParseDatagram(datagram, (size_t)size, beat)) {
+            return true;
+        }
+    }
+
+    if (httpSocket < 0) {
+        return false;
+    }
+    acceptConnections(nowMs);
+    for (uint8_t i = 0; i < HEARTBEAT_HTTP_CONNECTIONS; i++) {
+        if (connections[i].fd >= 0 && serveConnection(connections[i], beat, nowMs)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// LISTENER TASK
+// ============================================================================
+
+static void addSocket(int fd) {
+    if (fd >= 0) {
+        FD_SET(fd, &listenSet);
+        listenMax = max(listenMax, fd);
+    }
+}
+
+// Blocks until a socket is readable (or closed), wakes the owner and ends
+static void listenerTask(void* parameter) {
+    fd_set readable = listenSet;
+    lwip_select(listenMax + 1, &readable, NULL, NULL, NULL);
+
+    HeartbeatWakeHook wake = listenWake;
+    void* context = listenContext;
+    listening = false;   // The owner may arm the next task from here on
+    wake(context);
+    vTaskDelete(NULL);
+}
+
+bool heartbeatListenerArm(HeartbeatWakeHook wake, void* context) {
+    if (listening) {
+        return true;
+    }
+
+    // The listen socket only while a connection slot is free: a backlog
+    // that cannot be accepted would wake the owner over and over
+    FD_ZERO(&listenSet);
+    listenMax = -1;
+    addSocket(udpSocket);
+    if (httpSocket >= 0) {
+        bool slotFree = false;
+        for (uint8_t i = 0; i < HEARTBEAT_HTTP_CONNECTIONS; i++) {
+            addSocket(connections[i].fd);
+            slotFree |= connections[i].fd < 0;
+        }
+        if (slotFree) {
+            addSocket(httpSocket);
+        }
+    }
+    if (listenMax < 0) {
+        return false;
+    }
+
+    listenWake = wake;
+    listenContext = context;
+    listening = true;
+    if (xTaskCreate(listenerTask, "HeartbeatListen", HEARTBEAT_LISTEN_TASK_STACK, NULL, 1, NULL) != pdPASS) {
+        listening = false;
+        return false;
+    }
+    return true;
+}
+
+uint32_t heartbeatListenerMsUntilTimeout(uint32_t nowMs) {
+    uint32_t wait = UINT32_MAX;
+    for (uint8_t i = 0; httpSocket >= 0 && i < HEARTBEAT_HTTP_CONNECTIONS; i++) {
+        if (connections[i].fd >= 0) {
+            wait = min(wait, timeUntil(nowMs, connections[i].acceptedMs + HEARTBEAT_HTTP_TIMEOUT_MS));
+        }
+    }
+    return wait;
+}
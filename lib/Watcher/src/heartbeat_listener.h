@@ -0,0 +1,65 @@
+// ============================================================================
+// HEARTBEAT LISTENER
+// ============================================================================
+//
+// The socket side of the heartbeat relay (lib/WatcherCore/src/HeartbeatTable.h):
+// a non-blocking UDP socket for datagram heartbeats and a non-blocking TCP
+// listener for gadgets that can only speak plain HTTP. Both are read from
+// the owner task. In between, a small listener task blocks in lwip_select()
+// on them and wakes the owner once something arrives; it never reads, and
+// it ends after every wake-up, so the owner arms it again once it has read
+// what came in. Only when the task cannot be created are the sockets polled
+// every HEARTBEAT_LISTEN_POLL_MS.
+//
+// An HTTP sender gets "204 No Content" as soon as its request line is in
+// (400 when it is not a heartbeat) and the connection is closed; headers
+// and body are never read. A connection that has not sent its request line
+// within HEARTBEAT_HTTP_TIMEOUT_MS is dropped. At most
+// HEARTBEAT_HTTP_CONNECTIONS are served at once, the rest wait in the
+// listen backlog.
+//
+// Inbound traffic goes through lwip_recvfrom/lwip_sendto, which the traffic
+// meter does not wrap: LAN beats are not upstream data.
+//
+
+#ifndef HEARTBEAT_LISTENER_H
+#define HEARTBEAT_LISTENER_H
+
+#include <Arduino.h>
+#include <HeartbeatTable.h>
+
+const uint32_t HEARTBEAT_LISTEN_POLL_MS = 250;
+const uint32_t HEARTBEAT_LISTEN_TASK_STACK = 2048;
+const uint32_t HEARTBEAT_HTTP_TIMEOUT_MS = 2000;
+const uint8_t HEARTBEAT_HTTP_CONNECTIONS = 2;
+
+// Ports on the station interface, 0: that listener is off
+struct HeartbeatPorts {
+    uint16_t udp;
+    uint16_t http;
+};
+
+// Open the listeners; true when all configured ones are (or already were)
+// open. A failed one is retried by the next call.
+bool heartbeatListenerOpen(const HeartbeatPorts& ports);
+
+// Close the listeners and drop the connections in progress. A listener
+// task waiting on them wakes up (lwIP wakes a select() on a closed socket).
+void heartbeatListenerClose();
+
+// Called on the listener task once a socket is readable
+typedef void (*HeartbeatWakeHook)(void* context);
+
+// Start the listener task on the open sockets unless it already waits;
+// call after the beats were received. False when nothing is open or the
+// task could not be created: then the caller polls instead.
+bool heartbeatListenerArm(HeartbeatWakeHook wake, void* context);
+
+// Time until an HTTP connection in progress times out (UINT32_MAX: none)
+uint32_t heartbeatListenerMsUntilTimeout(uint32_t nowMs);
+
+// The next beat that came in; false when there is none. HTTP senders are
+// answered in here.
+bool heartbeatListenerReceive(HeartbeatBeat* beat, uint32_t nowMs);
+
+#endif // HEARTBEAT_LISTENER_H
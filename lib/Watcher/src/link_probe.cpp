@@ -0,0 +1,75 @@
+#include <link_probe.h>
+#include <WiFi.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+
+static int probeSocket = -1;
+static LinkProbeState settled = LINK_PROBE_FAILED;   // Reported while no connect is pending
+
+bool linkProbeStart(const LinkProbeTarget& target) {
+    linkProbeStop();
+
+    IPAddress address(target.address[0], target.address[1], target.address[2], target.address[3]);
+    if ((uint32_t)address == 0) {
+        address = WiFi.gatewayIP();
+    }
+    if ((uint32_t)address == 0) {
+        return false;
+    }
+
+    int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return false;
+    }
+    lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(target.port);
+    uint8_t bytes[4] = { address[0], address[1], address[2], address[3] };
+    memcpy(&peer.sin_addr.s_addr, bytes, sizeof(bytes));
+
+    // Connected or refused right away: the target answered
+    if (lwip_connect(fd, (struct sockaddr*)&peer, sizeof(peer)) == 0 || errno == ECONNREFUSED) {
+        lwip_close(fd);
+        settled = LINK_PROBE_REACHABLE;
+        return true;
+    }
+    if (errno != EINPROGRESS) {
+        lwip_close(fd);
+        return false;
+    }
+    probeSocket = fd;
+    return true;
+}
+
+LinkProbeState linkProbePoll() {
+    if (probeSocket < 0) {
+        LinkProbeState state = settled;
+        settled = LINK_PROBE_FAILED;
+        return state;
+    }
+
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(probeSocket, &writable);
+    struct timeval noWait = { 0, 0 };
+    if (lwip_select(probeSocket + 1, NULL, &writable, NULL, &noWait) <= 0) {
+        return LINK_PROBE_PENDING;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    lwip_getsockopt(probeSocket, SOL_SOCKET, SO_ERROR, &error, &length);
+    linkProbeStop();
+    return error == 0 || error == ECONNREFUSED ? LINK_PROBE_REACHABLE : LINK_PROBE_FAILED;
+}
+
+void linkProbeStop() {
+    if (probeSocket >= 0) {
+        lwip_close(probeSocket);
+    }
+    probeSocket = -1;
+    settled = LINK_PROBE_FAILED;
+}
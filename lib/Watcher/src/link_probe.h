@@ -0,0 +1,40 @@
+// ============================================================================
+// LINK PROBE
+// ============================================================================
+//
+// The socket side of a link check (lib/WatcherCore/src/LinkCheck.h): a
+// non-blocking TCP connect, closed again as soon as it completes. A refused
+// connect counts as reachable too, since the RST came from the target. No
+// TLS and no payload: a handful of bare TCP segments on the LAN.
+//
+// The connect is started and polled from the owner task, which never
+// blocks on it. One probe at a time.
+//
+
+#ifndef LINK_PROBE_H
+#define LINK_PROBE_H
+
+#include <Arduino.h>
+
+// Where to connect; address 0.0.0.0 is the station's gateway
+struct LinkProbeTarget {
+    uint8_t address[4];
+    uint16_t port;
+};
+
+enum LinkProbeState : uint8_t {
+    LINK_PROBE_PENDING = 0,
+    LINK_PROBE_REACHABLE,
+    LINK_PROBE_FAILED,        // Connect error other than a refusal
+};
+
+// Start connecting; false when no socket could be set up
+bool linkProbeStart(const LinkProbeTarget& target);
+
+// State of the started connect; anything but PENDING closes the socket
+LinkProbeState linkProbePoll();
+
+// Give up on the started connect (timeout, link down)
+void linkProbeStop();
+
+#endif // LINK_PROBE_H
@@ -0,0 +1,39 @@
+// ============================================================================
+// COMPILE-TIME LOGGING
+// ============================================================================
+//
+// All serial output goes through these macros so that a build can strip it
+// at compile time. Messages above WATCHER_LOG_LEVEL expand to nothing, which
+// means their arguments are never evaluated and the formatting code (and any
+// String temporaries) is dropped by the compiler. Stripped calls still sit
+// behind "if (0)" so arguments stay type-checked and do not warn as unused.
+//
+// Set the level from platformio.ini, e.g. -DWATCHER_LOG_LEVEL=LOG_LEVEL_ERROR
+//
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1   // Failures only (✗ / ⚠ lines)
+#define LOG_LEVEL_INFO  2   // Full progress output (default)
+
+#ifndef WATCHER_LOG_LEVEL
+#define WATCHER_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if WATCHER_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do { if (0) Serial.printf(__VA_ARGS__); } while (0)
+#endif
+
+#if WATCHER_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { if (0) Serial.printf(__VA_ARGS__); } while (0)
+#endif
+
+#endif // LOG_H
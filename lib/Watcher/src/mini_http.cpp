@@ -0,0 +1,392 @@
+#include <mini_http.h>
+#include <RateLimiter.h>
+
+// ============================================================================
+// URL PARSING
+// ============================================================================
+
+bool miniHttpParseUrl(const char* url, MiniHttpUrl* out) {
+    const char* scheme = "https://";
+    const size_t schemeLength = strlen(scheme);
+    if (strncmp(url, scheme, schemeLength) != 0) {
+        return false;  // Only HTTPS is supported (the client is always secure)
+    }
+
+    const char* host = url + schemeLength;
+    const char* hostEnd = host;
+    while (*hostEnd != '\0' && *hostEnd != '/' && *hostEnd != ':') {
+        hostEnd++;
+    }
+
+    size_t hostLength = hostEnd - host;
+    if (hostLength == 0 || hostLength >= sizeof(out->host)) {
+        return false;
+    }
+    memcpy(out->host, host, hostLength);
+    out->host[hostLength] = '\0';
+
+    out->port = 443;
+    const char* path = hostEnd;
+    if (*path == ':') {
+        unsigned long port = 0;
+        path++;
+        while (*path >= '0' && *path <= '9') {
+            port = port * 10 + (*path - '0');
+            path++;
+        }
+        if (port == 0 || port > 65535) {
+            return false;
+        }
+        out->port = (uint16_t)port;
+    }
+
+    if (*path == '\0') {
+        path = "/";
+    }
+    if (strlen(path) >= sizeof(out->path)) {
+        return false;
+    }
+    strcpy(out->path, path);
+    return true;
+}
+
+// ============================================================================
+// RESPONSE READING
+// ============================================================================
+
+static bool deadlineReached(uint32_t deadline) {
+    return (int32_t)(millis() - deadline) >= 0;
+}
+
+// Read one header line (without CR/LF) into buffer, truncating long lines.
+// Returns the stored length or a negative error code.
+static int readLine(WiFiClientSecure& client, char* buffer, size_t size, uint32_t deadline) {
+    size_t length = 0;
+    for (;;) {
+        if (client.available() > 0) {
+            int c = client.read();
+            if (c < 0) {
+                continue;
+            }
+            if (c == '\n') {
+                buffer[length] = '\0';
+                return (int)length;
+            }
+            if (c != '\r' && length + 1 < size) {
+                buffer[length++] = (char)c;
+            }
+            continue;
+        }
+        if (!client.connected()) {
+            return MINI_HTTP_ERROR_CONNECTION_LOST;
+        }
+        if (deadlineReached(deadline)) {
+            return MINI_HTTP_ERROR_READ_TIMEOUT;
+        }
+        delay(1);
+    }
+}
+
+// How a body ended (negative: an error code)
+static const int BODY_COMPLETE = 1;
+static const int BODY_CUT_SHORT = 0;      // Connection closed before its end
+static const int BODY_LIMIT_REACHED = 2;  // More to come, but limit bytes were all that was wanted
+
+// Read count bytes of body (or up to the close with count < 0) through a
+// small buffer, into body if given, stopping once received reaches limit
+static int readBody(WiFiClientSecure& client, long count, uint32_t deadline, ContentHasher* body,
+                    size_t* received, size_t limit) {
+    uint8_t buffer[128];
+    long remaining = count;
+    while (count < 0 || remaining > 0) {
+        if (*received >= limit) {
+            return BODY_LIMIT_REACHED;
+        }
+        int available = client.available();
+        if (available > 0) {
+            size_t want = sizeof(buffer);
+            if (count >= 0 && (size_t)remaining < want) {
+                want = remaining;
+            }
+            if (limit - *received < want) {
+                want = limit - *received;
+            }
+            int read = client.read(buffer, min((size_t)available, want));
+            if (read > 0) {
+                *received += read;
+                remaining -= read;
+                if (body != NULL) {
+                    body->update(buffer, read);
+                }
+            }
+            continue;
+        }
+        if (!client.connected()) {
+            return count < 0 ? BODY_COMPLETE : BODY_CUT_SHORT;   // The close ends a body without a length
+        }
+        if (deadlineReached(deadline)) {
+            return MINI_HTTP_ERROR_READ_TIMEOUT;
+        }
+        delay(1);
+    }
+    return BODY_COMPLETE;
+}
+
+// A lost connection in the middle of a chunked body cuts it short
+static int chunkLineResult(int lineLength) {
+    return lineLength == MINI_HTTP_ERROR_CONNECTION_LOST ? BODY_CUT_SHORT : lineLength;
+}
+
+// Transfer-Encoding: chunked, decoded so that body sees the same bytes a
+// Content-Length response would carry
+static int readChunkedBody(WiFiClientSecure& client, uint32_t deadline, ContentHasher* body, size_t* received,
+                           size_t limit) {
+    char line[32];
+    for (;;) {
+        int lineLength = readLine(client, line, sizeof(line), deadline);
+        if (lineLength < 0) {
+            return chunkLineResult(lineLength);
+        }
+        long size = strtol(line, NULL, 16);   // Chunk extensions after ';' are ignored
+        if (size <= 0) {
+            break;
+        }
+        int ended = readBody(client, size, deadline, body, received, limit);
+        if (ended != BODY_COMPLETE) {
+            return ended;
+        }
+        lineLength = readLine(client, line, sizeof(line), deadline);   // CRLF after the data
+        if (lineLength != 0) {
+            return lineLength < 0 ? chunkLineResult(lineLength) : BODY_CUT_SHORT;
+        }
+    }
+
+    // Trailer fields, up to the empty line
+    for (;;) {
+        int lineLength = readLine(client, line, sizeof(line), deadline);
+        if (lineLength <= 0) {
+            return lineLength == 0 ? BODY_COMPLETE : chunkLineResult(lineLength);
+        }
+    }
+}
+
+// ============================================================================
+// REQUEST
+// ============================================================================
+
+// Header value after the colon, without leading blanks, into out; a value
+// that does not fit is dropped rather than cut
+static void copyHeaderValue(const char* value, char* out, size_t size) {
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    size_t length = strlen(value);
+    if (length >= size) {
+        length = 0;
+    }
+    memcpy(out, value, length);
+    out[length] = '\0';
+}
+
+static bool sendRequest(WiFiClientSecure& client, const MiniHttpUrl& target, const char* userAgent,
+                        bool keepAlive, const HttpValidators* conditional, const HttpRequestMode& mode) {
+    // Validators of the last full response make the request conditional
+    char ifNoneMatch[sizeof(conditional->etag) + 20] = "";
+    char ifModifiedSince[sizeof(conditional->lastModified) + 24] = "";
+    if (conditional != NULL && conditional->etag[0] != '\0') {
+        snprintf(ifNoneMatch, sizeof(ifNoneMatch), "If-None-Match: %s\r\n", conditional->etag);
+    }
+    if (conditional != NULL && conditional->lastModified[0] != '\0') {
+        snprintf(ifModifiedSince, sizeof(ifModifiedSince), "If-Modified-Since: %s\r\n", conditional->lastModified);
+    }
+    char range[40] = "";
+    if (mode.method == HTTP_REQUEST_RANGE) {
+        snprintf(range, sizeof(range), "Range: bytes=0-%lu\r\n",
+                 (unsigned long)(mode.rangeBytes > 0 ? mode.rangeBytes - 1 : 0));
+    }
+
+    // Host carries the port unless it is the default one (RFC 9110 7.2)
+    char port[8] = "";
+    if (target.port != 443) {
+        snprintf(port, sizeof(port), ":%u", (unsigned)target.port);
+    }
+
+    char request[512];
+    int requestLength = snprintf(request, sizeof(request),
+        "%s %s HTTP/1.1\r\n"
+        "Host: %s%s\r\n"
+        "User-Agent: %s\r\n"
+        "Accept: application/json\r\n"
+        "%s%s%s"
+        "Connection: %s\r\n"
+        "\r\n",
+        mode.method == HTTP_REQUEST_HEAD ? "HEAD" : "GET", target.path, target.host, port, userAgent,
+        range, ifNoneMatch, ifModifiedSince, keepAlive ? "keep-alive" : "close");
+    return requestLength > 0 && requestLength < (int)sizeof(request) &&
+           client.write((const uint8_t*)request, requestLength) == (size_t)requestLength;
+}
+
+int miniHttpGet(WiFiClientSecure& client, const MiniHttpUrl& target,
+                const char* userAgent, uint32_t timeoutMs, size_t* bodyLength,
+                MiniHttpTiming* timing, bool keepAlive, uint32_t* retryAfterMs, ContentHasher* body,
+                const HttpValidators* conditional, HttpValidators* validators, const HttpRequestMode& mode) {
+    MiniHttpTiming unused;
+    if (timing == NULL) {
+        timing = &unused;
+    }
+    uint32_t unusedRetryAfter;
+    if (retryAfterMs == NULL) {
+        retryAfterMs = &unusedRetryAfter;
+    }
+    *retryAfterMs = 0;
+    HttpValidators unusedValidators;
+    if (validators == NULL) {
+        validators = &unusedValidators;
+    }
+    validators->etag[0] = '\0';
+    validators->lastModified[0] = '\0';
+    timing->connectMs = 0;
+    timing->firstByteMs = 0;
+    timing->transferMs = 0;
+    *bodyLength = 0;
+
+    bool reused = keepAlive && client.connected();
+    if (!reused && client.connected()) {
+        client.stop();   // Left open by an earlier keep-alive request
+    }
+
+    uint32_t phaseStart;
+    uint32_t deadline;
+    char line[128];
+    int lineLength;
+    for (;;) {
+        if (!reused) {
+            phaseStart = millis();
+            bool connected = client.connect(target.host, target.port, timeoutMs);
+            timing->connectMs = millis() - phaseStart;
+            if (!connected) {
+                return MINI_HTTP_ERROR_CONNECTION_REFUSED;
+            }
+        }
+
+        if (!sendRequest(client, target, userAgent, keepAlive, conditional, mode)) {
+            client.stop();
+            if (reused) {
+                reused = false;   // The server closed the idle connection
+                continue;
+            }
+            return MINI_HTTP_ERROR_SEND_HEADER_FAILED;
+        }
+
+        phaseStart = millis();
+        deadline = phaseStart + timeoutMs;
+
+        // Status line: "HTTP/1.1 200 OK"
+        lineLength = readLine(client, line, sizeof(line), deadline);
+        timing->firstByteMs = millis() - phaseStart;
+        if (lineLength == MINI_HTTP_ERROR_CONNECTION_LOST && reused) {
+            client.stop();
+            reused = false;
+            continue;
+        }
+        break;
+    }
+
+    phaseStart = millis();
+    if (lineLength < 0) {
+        client.stop();
+        return lineLength;
+    }
+    const char* status = strchr(line, ' ');
+    int httpCode = (strncmp(line, "HTTP/", 5) == 0 && status != NULL) ? atoi(status + 1) : 0;
+    if (httpCode <= 0) {
+        client.stop();
+        return MINI_HTTP_ERROR_NO_HTTP_SERVER;
+    }
+
+    // Headers: only Content-Length, Transfer-Encoding, Connection, the
+    // validators and Retry-After (with Date, which an HTTP-date Retry-After
+    // is relative to) matter
+    long contentLength = -1;
+    bool chunked = false;
+    bool serverCloses = strncmp(line, "HTTP/1.0", 8) == 0;
+    char retryAfter[40] = "";
+    char date[40] = "";
+    for (;;) {
+        lineLength = readLine(client, line, sizeof(line), deadline);
+        if (lineLength < 0) {
+            client.stop();
+            timing->transferMs = millis() - phaseStart;
+            return lineLength;
+        }
+        if (lineLength == 0) {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLength = atol(line + 15);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            chunked = strstr(line + 18, "chunked") != NULL;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char* value = line + 11;
+            while (*value == ' ') {
+                value++;
+            }
+            serverCloses = strncasecmp(value, "close", 5) == 0;
+        } else if (strncasecmp(line, "Retry-After:", 12) == 0) {
+            snprintf(retryAfter, sizeof(retryAfter), "%.*s", (int)sizeof(retryAfter) - 1, line + 12);
+        } else if (strncasecmp(line, "ETag:", 5) == 0) {
+            copyHeaderValue(line + 5, validators->etag, sizeof(validators->etag));
+        } else if (strncasecmp(line, "Last-Modified:", 14) == 0) {
+            copyHeaderValue(line + 14, validators->lastModified, sizeof(validators->lastModified));
+        } else if (strncasecmp(line, "Date:", 5) == 0) {
+            snprintf(date, sizeof(date), "%.*s", (int)sizeof(date) - 1, line + 5);
+        }
+    }
+    *retryAfterMs = httpRetryAfterMs(retryAfter, date);
+
+    // Body: drain without storing (Connection: close ends it otherwise).
+    // 204, 304 and any answer to HEAD have none, whatever their
+    // Content-Length says. A range request takes no more than it asked for,
+    // even from a server that ignored the range.
+    size_t received = 0;
+    size_t limit = mode.method != HTTP_REQUEST_RANGE ? SIZE_MAX : mode.rangeBytes > 0 ? mode.rangeBytes : 1;
+    bool bodyless = httpCode == 204 || httpCode == 304 || mode.method == HTTP_REQUEST_HEAD;
+    int ended = bodyless ? BODY_COMPLETE
+              : chunked ? readChunkedBody(client, deadline, body, &received, limit)
+                        : readBody(client, contentLength, deadline, body, &received, limit);
+    if (ended < 0) {
+        client.stop();
+        *bodyLength = received;
+        timing->transferMs = millis() - phaseStart;
+        return ended;
+    }
+    if (ended != BODY_CUT_SHORT && !bodyless && body != NULL) {
+        body->finish();
+    }
+
+    // Only a response with a known end, read to it, leaves the connection
+    // reusable
+    if (!keepAlive || serverCloses || (contentLength < 0 && !chunked && !bodyless) || ended != BODY_COMPLETE) {
+        client.stop();
+    }
+    *bodyLength = received;
+    timing->transferMs = millis() - phaseStart;
+    return httpCode;
+}
+
+const char* miniHttpErrorToString(int code) {
+    switch (code) {
+        case -1:  return "connection refused";
+        case -2:  return "send header failed";
+        case -3:  return "send payload failed";
+        case -4:  return "not connected";
+        case -5:  return "connection lost";
+        case -6:  return "no stream";
+        case -7:  return "no HTTP server";
+        case -8:  return "too less ram";
+        case -9:  return "Transfer-Encoding not supported";
+        case -10: return "Stream write error";
+        case -11: return "read Timeout";
+        default:  return "unknown error";
+    }
+}
@@ -0,0 +1,97 @@
+// ============================================================================
+// MINIMAL HTTP CLIENT
+// ============================================================================
+//
+// A tiny HTTPS GET/HEAD implementation used by the lean firmware profile
+// instead of HTTPClient. It writes the request line and headers straight from fixed
+// buffers, parses only the status line and the few headers it acts on, and
+// drains the body without storing it (decoding chunked transfer encoding).
+// No String, no header collection, no redirects.
+//
+// Error codes deliberately reuse the HTTPClient numeric values so that the
+// rest of the firmware can report failures the same way for both paths.
+//
+
+#ifndef MINI_HTTP_H
+#define MINI_HTTP_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <ContentHash.h>
+
+const int MINI_HTTP_ERROR_CONNECTION_REFUSED = -1;
+const int MINI_HTTP_ERROR_SEND_HEADER_FAILED = -2;
+const int MINI_HTTP_ERROR_CONNECTION_LOST    = -5;
+const int MINI_HTTP_ERROR_NO_HTTP_SERVER     = -7;
+const int MINI_HTTP_ERROR_READ_TIMEOUT       = -11;
+
+// Phase durations of one request (milliseconds)
+struct MiniHttpTiming {
+    uint32_t connectMs;      // DNS + TCP + TLS handshake
+    uint32_t firstByteMs;    // Request written until the status line arrived
+    uint32_t transferMs;     // Headers and body
+};
+
+// What a request asks for. Heavy pages can be checked without their body:
+// HEAD gets the status and headers only; RANGE is a GET with
+// "Range: bytes=0-(rangeBytes - 1)", answered 206 Partial Content. A server
+// that ignores the range answers 200 with the whole body, of which only the
+// first rangeBytes are read before the connection is closed.
+enum HttpRequestMethod : uint8_t {
+    HTTP_REQUEST_GET = 0,
+    HTTP_REQUEST_HEAD,
+    HTTP_REQUEST_RANGE,
+};
+
+struct HttpRequestMode {
+    uint8_t method;          // HttpRequestMethod
+    uint32_t rangeBytes;     // RANGE: body bytes wanted (at least 1)
+};
+
+const HttpRequestMode HTTP_MODE_GET = { HTTP_REQUEST_GET, 0 };
+
+struct MiniHttpUrl {
+    char host[64];
+    char path[160];
+    uint16_t port;
+};
+
+// Split an https:// URL into host, port and path. Returns false for
+// unsupported schemes or components that do not fit the fixed buffers.
+bool miniHttpParseUrl(const char* url, MiniHttpUrl* out);
+
+// Send a request (GET unless mode says otherwise) over an already configured
+// secure client and drain the response. Returns the HTTP status code (> 0) or a negative error code.
+// The number of body bytes received is stored in bodyLength and, if timing
+// is not NULL, the duration of each phase reached is stored there.
+//
+// With keepAlive, an open connection left by the previous call is reused
+// (connectMs stays 0) and the connection is left open afterwards unless the
+// server closes it. A reused connection the server has dropped in the
+// meantime is replaced by a fresh one transparently. Without keepAlive the
+// client is always stopped on return.
+//
+// If retryAfterMs is not NULL, it receives the wait a Retry-After header
+// asked for (0 without one, see httpRetryAfterMs()). If body is not NULL,
+// every body byte is fed to it, and it is finished once the body arrived
+// complete.
+//
+// With conditional, non-empty validators go out as If-None-Match and
+// If-Modified-Since (the answer may be 304, which has no body). If
+// validators is not NULL, it receives the response's ETag and
+// Last-Modified (empty when absent or too long to keep).
+//
+// A HEAD response has no body. With a RANGE mode, at most rangeBytes body
+// bytes are read (and fed to body, which is then finished); a longer body
+// is cut off there and the connection closed.
+int miniHttpGet(WiFiClientSecure& client, const MiniHttpUrl& target,
+                const char* userAgent, uint32_t timeoutMs, size_t* bodyLength,
+                MiniHttpTiming* timing = NULL, bool keepAlive = false,
+                uint32_t* retryAfterMs = NULL, ContentHasher* body = NULL,
+                const HttpValidators* conditional = NULL, HttpValidators* validators = NULL,
+                const HttpRequestMode& mode = HTTP_MODE_GET);
+
+// Human-readable text for a negative error code (same wording as HTTPClient).
+const char* miniHttpErrorToString(int code);
+
+#endif // MINI_HTTP_H
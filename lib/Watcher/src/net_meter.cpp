@@ -0,0 +1,101 @@
+#include <net_meter.h>
+#include <lwip/sockets.h>
+
+// ============================================================================
+// SLOTS
+// ============================================================================
+
+struct MeterSlot {
+    TaskHandle_t volatile task;    // NULL: free
+    TrafficRecord* record;
+    TrafficPhase phase;
+};
+
+static MeterSlot slots[NET_METER_SLOTS];
+
+// FreeRTOS reuses the handles of deleted tasks: a slot still naming this
+// handle belongs to a dead task and must not catch its traffic
+void netMeterAttach(uint8_t slot, TrafficRecord* record) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; i < NET_METER_SLOTS; i++) {
+        if (slots[i].task == task) {
+            slots[i].task = NULL;
+        }
+    }
+    slots[slot].record = record;
+    slots[slot].phase = TRAFFIC_HANDSHAKE;
+    slots[slot].task = task;
+}
+
+void netMeterDetach(uint8_t slot) {
+    slots[slot].task = NULL;
+}
+
+void netMeterSetPhase(uint8_t slot, TrafficPhase phase) {
+    if (slot < NET_METER_SLOTS) {
+        slots[slot].phase = phase;
+    }
+}
+
+static MeterSlot* currentSlot() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; i < NET_METER_SLOTS; i++) {
+        if (slots[i].task == task) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void countSent(ssize_t bytes) {
+    MeterSlot* slot = currentSlot();
+    if (slot != NULL && bytes > 0) {
+        slot->record->sent[slot->phase] += (uint32_t)bytes;
+    }
+}
+
+static void countReceived(ssize_t bytes) {
+    MeterSlot* slot = currentSlot();
+    if (slot != NULL && bytes > 0) {
+        slot->record->received[slot->phase] += (uint32_t)bytes;
+    }
+}
+
+// ============================================================================
+// LWIP WRAPPERS (-Wl,--wrap=...)
+// ============================================================================
+
+extern "C" {
+
+ssize_t __real_lwip_send(int socket, const void* data, size_t size, int flags);
+ssize_t __real_lwip_recv(int socket, void* buffer, size_t size, int flags);
+ssize_t __real_lwip_write(int socket, const void* data, size_t size);
+ssize_t __real_lwip_read(int socket, void* buffer, size_t size);
+
+ssize_t __wrap_lwip_send(int socket, const void* data, size_t size, int flags) {
+    ssize_t result = __real_lwip_send(socket, data, size, flags);
+    countSent(result);
+    return result;
+}
+
+ssize_t __wrap_lwip_recv(int socket, void* buffer, size_t size, int flags) {
+    ssize_t result = __real_lwip_recv(socket, buffer, size, flags);
+    if ((flags & MSG_PEEK) == 0) {    // Peeked bytes are counted when read
+        countReceived(result);
+    }
+    return result;
+}
+
+ssize_t __wrap_lwip_write(int socket, const void* data, size_t size) {
+    ssize_t result = __real_lwip_write(socket, data, size);
+    countSent(result);
+    return result;
+}
+
+ssize_t __wrap_lwip_read(int socket, void* buffer, size_t size) {
+    ssize_t result = __real_lwip_read(socket, buffer, size);
+    countReceived(result);
+    return result;
+}
+
+}  // extern "C"
@@ -0,0 +1,38 @@
+// ============================================================================
+// SOCKET TRAFFIC METER
+// ============================================================================
+//
+// Counts the bytes request workers move through lwIP sockets, per endpoint
+// and phase. The firmware is linked with
+//
+//   -Wl,--wrap=lwip_send -Wl,--wrap=lwip_recv -Wl,--wrap=lwip_write -Wl,--wrap=lwip_read
+//
+// so every socket call (WiFiClient's send/recv, mbedTLS's write/read through
+// the VFS) passes through net_meter.cpp first. Calls are attributed to
+// the calling task: a worker attaches its TrafficRecord before connecting
+// and detaches it when done, so traffic of other tasks is never counted.
+//
+// Each slot is written only by the task attached to it, so no locking is
+// needed; the record is handed to the loop task with the request result.
+// The one exception is a worker the watchdog deletes: the loop task
+// detaches its slot, since the record lives on the deleted task's stack.
+//
+
+#ifndef NET_METER_H
+#define NET_METER_H
+
+#include <Arduino.h>
+#include <TrafficMeter.h>
+
+const uint8_t NET_METER_SLOTS = 8;
+
+// Calling task: count its socket traffic into record, starting in
+// TRAFFIC_HANDSHAKE (the TLS handshake runs inside connect())
+void netMeterAttach(uint8_t slot, TrafficRecord* record);
+void netMeterDetach(uint8_t slot);
+
+// Phase for traffic that follows (called from the worker's client);
+// NET_METER_SLOTS stands for no slot and is ignored
+void netMeterSetPhase(uint8_t slot, TrafficPhase phase);
+
+#endif // NET_METER_H
@@ -0,0 +1,94 @@
+#include <peer_link.h>
+#include <WiFi.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+
+static int peerSocket = -1;
+
+static void fillAddress(struct sockaddr_in* address, const uint8_t* bytes, uint16_t port) {
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    memcpy(&address->sin_addr.s_addr, bytes, 4);
+}
+
+bool peerLinkOpen(const PeerChannel& channel) {
+    if (peerSocket >= 0) {
+        return true;
+    }
+    IPAddress local = WiFi.localIP();
+    if ((uint32_t)local == 0) {
+        return false;
+    }
+    uint8_t station[4] = { local[0], local[1], local[2], local[3] };
+
+    int fd = lwip_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        return false;
+    }
+    int reuse = 1;
+    lwip_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in bound;
+    uint8_t any[4] = { 0, 0, 0, 0 };
+    fillAddress(&bound, any, channel.port);
+
+    struct ip_mreq membership;
+    memcpy(&membership.imr_multiaddr.s_addr, channel.group, 4);
+    memcpy(&membership.imr_interface.s_addr, station, 4);
+    uint8_t ttl = 1;
+    uint8_t loop = 1;   // Own messages are dropped by node id; other watchers on one host need them
+    struct in_addr outgoing;
+    memcpy(&outgoing.s_addr, station, 4);
+
+    if (lwip_bind(fd, (struct sockaddr*)&bound, sizeof(bound)) < 0 ||
+        lwip_setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0 ||
+        lwip_setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &outgoing, sizeof(outgoing)) < 0) {
+        lwip_close(fd);
+        return false;
+    }
+    lwip_setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    lwip_setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    peerSocket = fd;
+    return true;
+}
+
+void peerLinkClose() {
+    if (peerSocket >= 0) {
+        lwip_close(peerSocket);
+    }
+    peerSocket = -1;
+}
+
+bool peerLinkSend(const PeerChannel& channel, const PeerMessage& message) {
+    if (peerSocket < 0) {
+        return false;
+    }
+    uint8_t buffer[PEER_MESSAGE_BYTES];
+    size_t size = peerEncode(message, buffer);
+    struct sockaddr_in group;
+    fillAddress(&group, channel.group, channel.port);
+    return lwip_sendto(peerSocket, buffer, size, 0, (struct sockaddr*)&group, sizeof(group)) == (ssize_t)size;
+}
+
+// Datagrams that are not announcements are skipped
+bool peerLinkReceive(PeerMessage* message) {
+    uint8_t buffer[PEER_MESSAGE_BYTES + 1];
+    while (peerSocket >= 0) {
+        ssize_t size = lwip_recvfrom(peerSocket, buffer, sizeof(buffer), MSG_DONTWAIT, NULL, NULL);
+        if (size < 0) {
+            return false;
+        }
+        if (peerDecode(buffer, (size_t)size, message)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t peerLinkNodeId() {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    return ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+}
@@ -0,0 +1,40 @@
+// ============================================================================
+// PEER LINK
+// ============================================================================
+//
+// The socket side of LAN peer coordination (lib/WatcherCore/src/PeerLease.h):
+// one non-blocking UDP socket that has joined a multicast group on the
+// station interface. Announcements go out with TTL 1, so they never leave
+// the LAN; received ones are read without blocking from the owner task.
+//
+// The socket needs the station's address, so it is opened once the link is
+// up and closed again when it drops.
+//
+
+#ifndef PEER_LINK_H
+#define PEER_LINK_H
+
+#include <Arduino.h>
+#include <PeerLease.h>
+
+// Multicast group and UDP port the watchers of a site talk on
+struct PeerChannel {
+    uint8_t group[4];         // 239.255.0.0/16 is administratively scoped
+    uint16_t port;
+};
+
+// Open the socket and join the group; true when it is (or already was) open
+bool peerLinkOpen(const PeerChannel& channel);
+
+void peerLinkClose();
+
+// Send one announcement to the group
+bool peerLinkSend(const PeerChannel& channel, const PeerMessage& message);
+
+// The next well-formed announcement waiting; false when there is none
+bool peerLinkReceive(PeerMessage* message);
+
+// Node id of this watcher: the last four bytes of the station MAC
+uint32_t peerLinkNodeId();
+
+#endif // PEER_LINK_H
@@ -0,0 +1,154 @@
+#include <profiler.h>
+
+#if PROFILER_HZ > 0
+
+#include <freertos/xtensa_context.h>
+
+static_assert((PROFILER_SLOTS & (PROFILER_SLOTS - 1)) == 0, "PROFILER_SLOTS must be a power of two");
+
+const uint8_t PROFILER_VERSION = 1;
+const uint8_t PROFILER_TASKS = 24;            // Distinct task names
+const uint8_t PROFILER_FIRST_TIMER = 2;       // Hardware timers 2 and 3 (one per core)
+const uint8_t PROFILER_PROBES = 8;            // Hash slots tried before a sample is lost
+
+struct ProfilerSlot {
+    uint32_t pc;                  // 0: free
+    uint32_t count;
+    uint8_t task;
+};
+
+static ProfilerSlot slots[PROFILER_SLOTS];
+static char taskNames[PROFILER_TASKS][configMAX_TASK_NAME_LEN];
+static uint8_t taskCount;
+static volatile bool active;
+static uint32_t samples;
+static uint32_t idleSamples;
+static uint32_t lostSamples;      // Table full, or too many tasks
+static portMUX_TYPE profilerMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Index of the task named name, added on first sight (PROFILER_TASKS: no room)
+static uint8_t IRAM_ATTR taskIndex(const char* name) {
+    for (uint8_t i = 0; i < taskCount; i++) {
+        const char* known = taskNames[i];
+        uint8_t c = 0;
+        while (c < configMAX_TASK_NAME_LEN && known[c] == name[c] && name[c] != '\0') {
+            c++;
+        }
+        if (c == configMAX_TASK_NAME_LEN || known[c] == name[c]) {
+            return i;
+        }
+    }
+    if (taskCount == PROFILER_TASKS) {
+        return PROFILER_TASKS;
+    }
+    for (uint8_t c = 0; c < configMAX_TASK_NAME_LEN; c++) {
+        taskNames[taskCount][c] = name[c];
+        if (name[c] == '\0') {
+            break;
+        }
+    }
+    return taskCount++;
+}
+
+static void IRAM_ATTR record(uint32_t pc, uint8_t task) {
+    uint32_t index = ((pc >> 1) * 2654435761u) ^ task;
+    for (uint8_t probe = 0; probe < PROFILER_PROBES; probe++) {
+        ProfilerSlot& slot = slots[(index + probe) & (PROFILER_SLOTS - 1)];
+        if (slot.pc == 0) {
+            slot.pc = pc;
+            slot.task = task;
+        }
+        if (slot.pc == pc && slot.task == task) {
+            slot.count++;
+            return;
+        }
+    }
+    lostSamples++;
+}
+
+// Timer interrupt: on entry the interrupted task's stack pointer, which
+// addresses its interrupt frame, was saved as the first word of its TCB
+static void IRAM_ATTR sample() {
+    if (!active) {
+        return;
+    }
+    int core = xPortGetCoreID();
+    TaskHandle_t task = xTaskGetCurrentTaskHandleForCPU(core);
+    portENTER_CRITICAL_ISR(&profilerMux);
+    samples++;
+    if (task == xTaskGetIdleTaskHandleForCPU(core)) {
+        idleSamples++;
+    } else {
+        const XtExcFrame* frame = *(const XtExcFrame* const*)task;
+        uint8_t index = taskIndex(pcTaskGetName(task));
+        if (index < PROFILER_TASKS) {
+            record((uint32_t)frame->pc, index);
+        } else {
+            lostSamples++;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&profilerMux);
+}
+
+// The timer's interrupt goes to the core that attaches it
+static void startTimer(void* parameter) {
+    uint8_t core = (uint8_t)(uintptr_t)parameter;
+    hw_timer_t* timer = timerBegin(PROFILER_FIRST_TIMER + core, 80, true);   // 1 MHz from the 80 MHz APB clock
+    timerAttachInterrupt(timer, sample, true);
+    timerAlarmWrite(timer, 1000000 / PROFILER_HZ, true);
+    timerAlarmEnable(timer);
+    vTaskDelete(NULL);
+}
+
+void profilerBegin() {
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        xTaskCreatePinnedToCore(startTimer, "profiler", 2048, (void*)(uintptr_t)core, configMAX_PRIORITIES - 1, NULL,
+                                core);
+    }
+}
+
+void profilerSetActive(bool on) {
+    active = on;
+}
+
+// One line per task name, then one per address. Slots are freed as they
+// are printed (a sample taken meanwhile may land in a second slot for the
+// same address; the script adds them up). Task names are kept.
+void profilerPrint(Print& out) {
+    portENTER_CRITICAL(&profilerMux);
+    uint32_t total = samples;
+    uint32_t idle = idleSamples;
+    uint32_t lost = lostSamples;
+    samples = idleSamples = lostSamples = 0;
+    portEXIT_CRITICAL(&profilerMux);
+
+    out.printf("=== PROFILE BEGIN v%u hz=%u cores=%u samples=%lu idle=%lu lost=%lu ===\n", PROFILER_VERSION,
+               PROFILER_HZ, portNUM_PROCESSORS, (unsigned long)total, (unsigned long)idle, (unsigned long)lost);
+    for (uint8_t i = 0; i < taskCount; i++) {
+        out.printf("T %u %.*s\n", i, (int)configMAX_TASK_NAME_LEN, taskNames[i]);
+    }
+    for (uint32_t i = 0; i < PROFILER_SLOTS; i++) {
+        portENTER_CRITICAL(&profilerMux);
+        ProfilerSlot slot = slots[i];
+        slots[i] = ProfilerSlot{0, 0, 0};
+        portEXIT_CRITICAL(&profilerMux);
+        if (slot.count > 0) {
+            out.printf("S %08lx %u %lu\n", (unsigned long)slot.pc, slot.task, (unsigned long)slot.count);
+        }
+    }
+    out.printf("=== PROFILE END ===\n");
+}
+
+#else
+
+void profilerBegin() {}
+
+void profilerSetActive(bool active) {
+    (void)active;
+}
+
+void profilerPrint(Print& out) {
+    out.printf("Profiler not built in (PROFILER_HZ, environment esp32dev_profile)\n");
+}
+
+#endif // PROFILER_HZ
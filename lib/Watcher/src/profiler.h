@@ -0,0 +1,44 @@
+// ============================================================================
+// SAMPLING PROFILER
+// ============================================================================
+//
+// Built in with PROFILER_HZ (the esp32dev_profile environment); otherwise
+// these functions do nothing and the firmware carries no timers or tables.
+//
+// A hardware timer per core interrupts PROFILER_HZ times a second. The
+// interrupt reads the program counter of the task it interrupted from the
+// task's interrupt frame and counts it, with the task's name, in a fixed
+// hash table of PROFILER_SLOTS addresses. Only the interrupted address is
+// recorded, no call stack. Code that runs with interrupts masked (critical
+// sections, other interrupt handlers) cannot be interrupted, so its time
+// shows up on the instruction after it.
+//
+// Samples are only counted while the profiler is active: the Watcher turns
+// it on for each poll cycle, so the histogram shows where the cycles go.
+// The dump is hex addresses; scripts/profile_fold.py symbolizes it against
+// the firmware ELF into folded stacks for flame graph tools.
+//
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#ifndef PROFILER_HZ
+#define PROFILER_HZ 0
+#endif
+
+#ifndef PROFILER_SLOTS
+#define PROFILER_SLOTS 1024         // Distinct (address, task) pairs; a power of two
+#endif
+
+// Start the sampling timers (once, from setup())
+void profilerBegin();
+
+// Count samples only between profilerSetActive(true) and (false)
+void profilerSetActive(bool active);
+
+// Dump the histogram ("=== PROFILE BEGIN ... ===") and clear it
+void profilerPrint(Print& out);
+
+#endif // PROFILER_H
@@ -0,0 +1,261 @@
+#include <CoapMessage.h>
+#include <string.h>
+
+const uint8_t VERSION = 1;
+const uint8_t PAYLOAD_MARKER = 0xFF;
+
+// Option delta and length nibbles: 13 and 14 announce 1 and 2 extra bytes
+const uint8_t NIBBLE_BYTE = 13;
+const uint8_t NIBBLE_WORD = 14;
+const uint16_t BYTE_BASE = 13;
+const uint16_t WORD_BASE = 269;
+
+// ============================================================================
+// ENCODING
+// ============================================================================
+
+// Appends to a datagram buffer; once something did not fit, every later
+// call is a no-op and used() returns 0
+class DatagramWriter {
+public:
+    DatagramWriter(uint8_t* out, size_t size) : out_(out), size_(size), used_(0), ok_(true), lastOption_(0) {}
+
+    void byte(uint8_t value) { bytes(&value, 1); }
+
+    void bytes(const void* data, size_t size) {
+        if (!ok_ || size > size_ - used_) {
+            ok_ = false;
+            return;
+        }
+        memcpy(out_ + used_, data, size);
+        used_ += size;
+    }
+
+    void header(const CoapHeader& header) {
+        byte((uint8_t)(VERSION << 6 | (header.type & 3) << 4 | (header.tokenLength & 0x0F)));
+        byte(header.code);
+        byte((uint8_t)(header.messageId >> 8));
+        byte((uint8_t)header.messageId);
+        bytes(header.token, header.tokenLength <= COAP_MAX_TOKEN_BYTES ? header.tokenLength : 0);
+    }
+
+    // Options must come in ascending order of number
+    void option(uint16_t number, const void* value, size_t length) {
+        uint16_t delta = number - lastOption_;
+        lastOption_ = number;
+        uint8_t first = (uint8_t)(nibble(delta) << 4 | nibble((uint16_t)length));
+        byte(first);
+        extension(delta);
+        extension((uint16_t)length);
+        bytes(value, length);
+    }
+
+    void payload(const uint8_t* data, size_t size) {
+        if (size > 0) {
+            byte(PAYLOAD_MARKER);
+            bytes(data, size);
+        }
+    }
+
+    size_t used() const { return ok_ ? used_ : 0; }
+
+private:
+    static uint8_t nibble(uint16_t value) {
+        return value < BYTE_BASE ? (uint8_t)value : value < WORD_BASE ? NIBBLE_BYTE : NIBBLE_WORD;
+    }
+
+    void extension(uint16_t value) {
+        if (value >= WORD_BASE) {
+            uint16_t extra = value - WORD_BASE;
+            byte((uint8_t)(extra >> 8));
+            byte((uint8_t)extra);
+        } else if (value >= BYTE_BASE) {
+            byte((uint8_t)(value - BYTE_BASE));
+        }
+    }
+
+    uint8_t* out_;
+    size_t size_;
+    size_t used_;
+    bool ok_;
+    uint16_t lastOption_;
+};
+
+// One option per separator-delimited part of text; empty parts are skipped
+static void splitOptions(DatagramWriter* writer, uint16_t number, const char* text, char separator) {
+    while (text != NULL && *text != '\0') {
+        const char* end = strchr(text, separator);
+        size_t length = end != NULL ? (size_t)(end - text) : strlen(text);
+        if (length > 0) {
+            writer->option(number, text, length);
+        }
+        text = end != NULL ? end + 1 : NULL;
+    }
+}
+
+size_t coapEncodeRequest(const CoapHeader& header, const char* path, const char* query, const uint8_t* payload,
+                         size_t payloadBytes, uint8_t* out, size_t size) {
+    DatagramWriter datagram(out, size);
+    datagram.header(header);
+    splitOptions(&datagram, COAP_OPTION_URI_PATH, path, '/');
+    splitOptions(&datagram, COAP_OPTION_URI_QUERY, query, '&');
+    datagram.payload(payload, payloadBytes);
+    return datagram.used();
+}
+
+size_t coapEncodeResponse(const CoapHeader& header, const uint8_t* payload, size_t payloadBytes, uint8_t* out,
+                          size_t size) {
+    DatagramWriter datagram(out, size);
+    datagram.header(header);
+    datagram.payload(payload, payloadBytes);
+    return datagram.used();
+}
+
+size_t coapEncodeEmpty(uint8_t type, uint16_t messageId, uint8_t* out, size_t size) {
+    CoapHeader header = { type, COAP_EMPTY, messageId, 0, {0} };
+    DatagramWriter datagram(out, size);
+    datagram.header(header);
+    return datagram.used();
+}
+
+// ============================================================================
+// DECODING
+// ============================================================================
+
+// An extended option delta or length at *cursor; false when it runs past
+// end or does not fit 16 bits
+static bool readExtension(uint8_t nibble, const uint8_t** cursor, const uint8_t* end, uint16_t* value) {
+    if (nibble < NIBBLE_BYTE) {
+        *value = nibble;
+    } else if (nibble == NIBBLE_BYTE && end - *cursor >= 1) {
+        *value = BYTE_BASE + (*cursor)[0];
+        *cursor += 1;
+    } else if (nibble == NIBBLE_WORD && end - *cursor >= 2) {
+        uint32_t word = WORD_BASE + ((*cursor)[0] << 8 | (*cursor)[1]);
+        if (word > 0xFFFF) {
+            return false;
+        }
+        *value = (uint16_t)word;
+        *cursor += 2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool CoapReader::parse(const uint8_t* data, size_t size) {
+    if (size < 4 || data[0] >> 6 != VERSION) {
+        return false;
+    }
+    header_.type = (data[0] >> 4) & 3;
+    header_.tokenLength = data[0] & 0x0F;
+    header_.code = data[1];
+    header_.messageId = (uint16_t)(data[2] << 8 | data[3]);
+    if (header_.tokenLength > COAP_MAX_TOKEN_BYTES || size < 4u + header_.tokenLength) {
+        return false;
+    }
+    memcpy(header_.token, data + 4, header_.tokenLength);
+
+    // Walk the options once to find the payload and reject malformed ones
+    options_ = data + 4 + header_.tokenLength;
+    end_ = data + size;
+    cursor_ = options_;
+    lastOption_ = 0;
+    payload_ = NULL;
+    payloadBytes_ = 0;
+    uint16_t number;
+    const uint8_t* value;
+    size_t length;
+    while (nextOption(&number, &value, &length)) {
+    }
+    if (cursor_ == NULL) {
+        return false;
+    }
+    cursor_ = options_;
+    lastOption_ = 0;
+    return true;
+}
+
+// cursor_ NULL marks a malformed option; payload_ is set on the way
+bool CoapReader::nextOption(uint16_t* number, const uint8_t** value, size_t* length) {
+    if (cursor_ == NULL || cursor_ >= end_) {
+        return false;
+    }
+    if (*cursor_ == PAYLOAD_MARKER) {
+        payload_ = cursor_ + 1;
+        payloadBytes_ = end_ - payload_;
+        if (payloadBytes_ == 0) {
+            cursor_ = NULL;         // A marker must be followed by a payload
+        }
+        return false;
+    }
+    uint8_t first = *cursor_++;
+    uint16_t delta;
+    uint16_t size;
+    if (!readExtension(first >> 4, &cursor_, end_, &delta) || !readExtension(first & 0x0F, &cursor_, end_, &size) ||
+        size > end_ - cursor_ || delta > 0xFFFF - lastOption_) {
+        cursor_ = NULL;
+        return false;
+    }
+    lastOption_ += delta;
+    *number = lastOption_;
+    *value = cursor_;
+    *length = size;
+    cursor_ += size;
+    return true;
+}
+
+uint32_t CoapReader::uintOption(uint16_t wanted) {
+    const uint8_t* saved = cursor_;
+    uint16_t savedLast = lastOption_;
+    cursor_ = options_;
+    lastOption_ = 0;
+
+    uint32_t result = 0;
+    uint16_t number;
+    const uint8_t* value;
+    size_t length;
+    while (nextOption(&number, &value, &length)) {
+        if (number == wanted) {
+            for (size_t i = 0; i < length && i < 4; i++) {
+                result = result << 8 | value[i];
+            }
+            break;
+        }
+    }
+    cursor_ = saved;
+    lastOption_ = savedLast;
+    return result;
+}
+
+bool coapSameToken(const CoapHeader& request, const CoapHeader& response) {
+    return request.tokenLength == response.tokenLength &&
+           memcmp(request.token, response.token, request.tokenLength) == 0;
+}
+
+// ============================================================================
+// RETRANSMISSION
+// ============================================================================
+
+uint32_t coapMaxTransmitWaitMs(const CoapTiming& timing) {
+    uint32_t waitMs = timing.ackTimeoutMs * ((2u << timing.maxRetransmit) - 1);
+    return (uint32_t)((uint64_t)waitMs * timing.randomPermille / 1000);
+}
+
+void CoapRetransmitter::start(const CoapTiming& timing, uint32_t nowMs, uint16_t random) {
+    uint32_t spreadMs = timing.randomPermille > 1000 ? timing.ackTimeoutMs * (timing.randomPermille - 1000) / 1000 : 0;
+    sentMs_ = nowMs;
+    timeoutMs_ = timing.ackTimeoutMs + (uint32_t)((uint64_t)spreadMs * random / 65536);
+    transmissions_ = 1;
+    maxRetransmit_ = timing.maxRetransmit;
+}
+
+bool CoapRetransmitter::retransmit(uint32_t nowMs) {
+    if (transmissions_ > maxRetransmit_) {
+        return false;
+    }
+    sentMs_ = nowMs;
+    timeoutMs_ *= 2;
+    transmissions_++;
+    return true;
+}
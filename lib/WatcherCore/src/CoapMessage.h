@@ -0,0 +1,146 @@
+// ============================================================================
+// COAP MESSAGES
+// ============================================================================
+//
+// Just enough CoAP (RFC 7252) for a client that sends pings as confirmable
+// requests and for the stand-in server that answers them
+// (lib/Watcher/src/CoapProbe.cpp, src/host/coap.cpp):
+//
+// - coapEncodeRequest() builds a request with its Uri-Path and Uri-Query
+//   options; coapEncodeEmpty() the empty ACK or RST for a message id.
+// - CoapReader splits a datagram into header, token, options and payload.
+// - CoapRetransmitter times the retransmissions of one confirmable message:
+//   the first after a random timeout between ackTimeoutMs and
+//   ackTimeoutMs * randomPermille / 1000, each further one after twice the
+//   previous timeout, at most maxRetransmit of them.
+//
+// The caller passes in the random bits for message IDs, tokens and the
+// first timeout.
+//
+
+#ifndef COAP_MESSAGE_H
+#define COAP_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <WatcherTime.h>
+
+const uint8_t COAP_MAX_TOKEN_BYTES = 8;
+
+enum CoapType : uint8_t {
+    COAP_CON = 0,         // Confirmable: acknowledged, retransmitted until then
+    COAP_NON = 1,
+    COAP_ACK = 2,
+    COAP_RST = 3,
+};
+
+// Codes are class << 5 | detail, "2.04" is 0x44
+const uint8_t COAP_EMPTY = 0x00;
+const uint8_t COAP_GET = 0x01;
+const uint8_t COAP_POST = 0x02;
+const uint8_t COAP_CHANGED = 0x44;          // 2.04
+const uint8_t COAP_NOT_FOUND = 0x84;        // 4.04
+const uint8_t COAP_TOO_MANY_REQUESTS = 0x9D;   // 4.29 (RFC 8516)
+
+const uint16_t COAP_OPTION_URI_PATH = 11;
+const uint16_t COAP_OPTION_MAX_AGE = 14;
+const uint16_t COAP_OPTION_URI_QUERY = 15;
+
+// A code as a number in the style of HTTP statuses: 2.04 is 204
+inline int coapStatus(uint8_t code) { return (code >> 5) * 100 + (code & 0x1F); }
+
+struct CoapHeader {
+    uint8_t type;
+    uint8_t code;
+    uint16_t messageId;
+    uint8_t tokenLength;
+    uint8_t token[COAP_MAX_TOKEN_BYTES];
+};
+
+// ============================================================================
+// ENCODING
+// ============================================================================
+
+// Request with one Uri-Path option per '/'-separated segment of path and
+// one Uri-Query option per '&'-separated part of query (NULL: none).
+// Returns its size, 0 when it does not fit.
+size_t coapEncodeRequest(const CoapHeader& header, const char* path, const char* query, const uint8_t* payload,
+                         size_t payloadBytes, uint8_t* out, size_t size);
+
+// Response carrying code (payload may be NULL), for the server side
+size_t coapEncodeResponse(const CoapHeader& header, const uint8_t* payload, size_t payloadBytes, uint8_t* out,
+                          size_t size);
+
+// Empty ACK or RST for messageId (4 bytes)
+size_t coapEncodeEmpty(uint8_t type, uint16_t messageId, uint8_t* out, size_t size);
+
+// ============================================================================
+// DECODING
+// ============================================================================
+
+class CoapReader {
+public:
+    // False for anything that is not a well-formed CoAP 1 message
+    bool parse(const uint8_t* data, size_t size);
+
+    const CoapHeader& header() const { return header_; }
+
+    // Options in order; false after the last one
+    bool nextOption(uint16_t* number, const uint8_t** value, size_t* length);
+
+    // Unsigned option value (Max-Age, ...), 0 when absent
+    uint32_t uintOption(uint16_t number);
+
+    const uint8_t* payload() const { return payload_; }
+    size_t payloadBytes() const { return payloadBytes_; }
+
+private:
+    CoapHeader header_;
+    const uint8_t* options_;
+    const uint8_t* end_;
+    const uint8_t* cursor_;
+    uint16_t lastOption_;
+    const uint8_t* payload_;
+    size_t payloadBytes_;
+};
+
+// Whether a response carries the token of header
+bool coapSameToken(const CoapHeader& request, const CoapHeader& response);
+
+// ============================================================================
+// RETRANSMISSION
+// ============================================================================
+
+struct CoapTiming {
+    uint32_t ackTimeoutMs;    // RFC 7252: 2000
+    uint16_t randomPermille;  // ACK_RANDOM_FACTOR * 1000, RFC 7252: 1500
+    uint8_t maxRetransmit;    // RFC 7252: 4
+};
+
+// Longest a confirmable message may go unacknowledged before the sender
+// gives up (MAX_TRANSMIT_WAIT)
+uint32_t coapMaxTransmitWaitMs(const CoapTiming& timing);
+
+class CoapRetransmitter {
+public:
+    // The first transmission went out at nowMs; random (0..65535) picks
+    // the initial timeout
+    void start(const CoapTiming& timing, uint32_t nowMs, uint16_t random);
+
+    bool due(uint32_t nowMs) const { return timeReached(nowMs, sentMs_ + timeoutMs_); }
+    uint32_t msUntilDue(uint32_t nowMs) const { return timeUntil(nowMs, sentMs_ + timeoutMs_); }
+
+    // Once due: true when the message should go again (now), false when
+    // the retransmissions are used up and the exchange has failed
+    bool retransmit(uint32_t nowMs);
+
+    uint8_t transmissions() const { return transmissions_; }
+
+private:
+    uint32_t sentMs_;
+    uint32_t timeoutMs_;
+    uint8_t transmissions_;
+    uint8_t maxRetransmit_;
+};
+
+#endif // COAP_MESSAGE_H
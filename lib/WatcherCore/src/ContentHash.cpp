@@ -0,0 +1,158 @@
+#include <ContentHash.h>
+#include <string.h>
+
+static const char* const CHANGE_NAMES[] = {"first", "same", "changed"};
+
+const char* contentChangeName(uint8_t change) {
+    return change <= CONTENT_CHANGED ? CHANGE_NAMES[change] : "?";
+}
+
+// Marker bytes matched after the next byte: the longest prefix of marker
+// that ends the stream so far (a failure-table-free KMP step; markers are
+// short, so the quadratic fallback costs nothing in practice)
+static uint16_t advanceMatch(const char* marker, uint16_t matched, uint8_t byte) {
+    for (;;) {
+        if ((uint8_t)marker[matched] == byte) {
+            return matched + 1;
+        }
+        if (matched == 0) {
+            return 0;
+        }
+        uint16_t shorter = matched - 1;
+        while (shorter > 0 && memcmp(marker, marker + matched - shorter, shorter) != 0) {
+            shorter--;
+        }
+        matched = shorter;
+    }
+}
+
+static bool usableMarker(const char* marker) {
+    return marker != NULL && marker[0] != '\0';
+}
+
+// ============================================================================
+// HASHER
+// ============================================================================
+
+ContentHasher::ContentHasher(const ContentWatch* watch)
+    : watch_(watch), maskCount_(0), hash_(FNV1A64_OFFSET), offset_(0), hashed_(0), finished_(false) {
+    if (watch != NULL && watch->masks != NULL) {
+        maskCount_ = watch->maskCount < CONTENT_MAX_MASKS ? watch->maskCount : CONTENT_MAX_MASKS;
+    }
+    memset(matched_, 0, sizeof(matched_));
+    memset(inside_, 0, sizeof(inside_));
+}
+
+void ContentHasher::update(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (!masked(data[i])) {
+            hash_ ^= data[i];
+            hash_ *= FNV1A64_PRIME;
+            hashed_++;
+        }
+        offset_++;
+    }
+}
+
+// Whether the byte at offset_ falls into a masked region. Every mask sees
+// every byte, so overlapping masks keep their marker state.
+bool ContentHasher::masked(uint8_t byte) {
+    bool skip = false;
+    for (uint8_t i = 0; i < maskCount_; i++) {
+        const ContentMask& mask = watch_->masks[i];
+        if (mask.kind == CONTENT_MASK_RANGE) {
+            if (offset_ >= mask.offset && offset_ - mask.offset < mask.length) {
+                skip = true;
+            }
+            continue;
+        }
+        if (mask.kind != CONTENT_MASK_BETWEEN || !usableMarker(mask.begin) || !usableMarker(mask.end)) {
+            continue;
+        }
+
+        if (inside_[i]) {
+            // The end marker goes with the region
+            skip = true;
+            matched_[i] = advanceMatch(mask.end, matched_[i], byte);
+            if (mask.end[matched_[i]] == '\0') {
+                inside_[i] = false;
+                matched_[i] = 0;
+            }
+        } else {
+            matched_[i] = advanceMatch(mask.begin, matched_[i], byte);
+            if (mask.begin[matched_[i]] == '\0') {
+                inside_[i] = true;
+                matched_[i] = 0;
+            }
+        }
+    }
+    return skip;
+}
+
+// ============================================================================
+// TRACKER
+// ============================================================================
+
+ContentTracker::ContentTracker(ContentSlot* slots, uint16_t count) : slots_(slots), count_(count) {
+}
+
+void ContentTracker::begin() {
+    memset(slots_, 0, sizeof(ContentSlot) * count_);
+}
+
+ContentChange ContentTracker::record(uint16_t index, uint64_t digest, uint32_t bodyBytes, uint32_t transferMs,
+                                     const HttpValidators& validators) {
+    ContentSlot& slot = slots_[index];
+    ContentChange change = !slot.known ? CONTENT_FIRST : slot.digest == digest ? CONTENT_SAME : CONTENT_CHANGED;
+    if (change == CONTENT_CHANGED) {
+        slot.changes++;
+    }
+    slot.digest = digest;
+    slot.known = true;
+    slot.validators = validators;
+    slot.bodyBytes = bodyBytes;
+    slot.transferMs = transferMs;
+    return change;
+}
+
+// Savings are measured against the last full response
+void ContentTracker::recordNotModified(uint16_t index, uint32_t transferMs) {
+    ContentSlot& slot = slots_[index];
+    slot.notModified++;
+    slot.savedBytes += slot.bodyBytes;
+    if (slot.transferMs > transferMs) {
+        slot.savedMs += slot.transferMs - transferMs;
+    }
+}
+
+uint32_t ContentTracker::changeCount() const {
+    uint32_t changes = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        changes += slots_[i].changes;
+    }
+    return changes;
+}
+
+uint32_t ContentTracker::notModifiedCount() const {
+    uint32_t answers = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        answers += slots_[i].notModified;
+    }
+    return answers;
+}
+
+uint64_t ContentTracker::savedBytes() const {
+    uint64_t bytes = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        bytes += slots_[i].savedBytes;
+    }
+    return bytes;
+}
+
+uint32_t ContentTracker::savedMs() const {
+    uint32_t ms = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        ms += slots_[i].savedMs;
+    }
+    return ms;
+}
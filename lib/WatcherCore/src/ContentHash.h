@@ -0,0 +1,148 @@
+// ============================================================================
+// CONTENT HASH
+// ============================================================================
+//
+// Change detection for endpoints whose content matters, not just whether
+// they answer. The response body is hashed (FNV-1a 64) while it streams in,
+// so nothing of it is ever stored; per endpoint only the last digest is kept.
+//
+// Pages carry volatile parts (timestamps, counters, CSRF tokens) that would
+// read as a change on every poll. Masks take them out of the hash:
+//
+// - CONTENT_MASK_RANGE: bytes [offset, offset + length) of the body, for
+//   fixed layouts such as a binary status block.
+// - CONTENT_MASK_BETWEEN: everything after a begin marker up to and
+//   including the next end marker, e.g. begin "<span id=\"time\">" and end
+//   "</span>". Markers are matched in the stream, across reads of any size.
+//   A region still open when the body ends runs to its end.
+//
+// Offsets count bytes of the body as delivered (after any transfer
+// encoding is undone).
+//
+// The slot of a watched endpoint also keeps the validators (ETag,
+// Last-Modified) of its last full response, so the next request can be
+// conditional: a 304 Not Modified means the content is the same, and the
+// body bytes and transfer time it did not take are counted as saved.
+//
+// The caller provides the tracker's slots, one per watched endpoint.
+//
+
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ContentMaskKind : uint8_t {
+    CONTENT_MASK_RANGE = 0,
+    CONTENT_MASK_BETWEEN,
+};
+
+struct ContentMask {
+    uint8_t kind;             // ContentMaskKind
+    uint32_t offset;          // RANGE: first body byte of the region
+    uint32_t length;          // RANGE: bytes in the region
+    const char* begin;        // BETWEEN: opens the region (still hashed)
+    const char* end;          // BETWEEN: closes it (left out with the region)
+};
+
+// Masks of one endpoint (maskCount may be 0: the whole body is hashed)
+struct ContentWatch {
+    const ContentMask* masks;
+    uint8_t maskCount;        // At most CONTENT_MAX_MASKS are applied
+};
+
+const uint8_t CONTENT_MAX_MASKS = 4;
+
+const uint64_t FNV1A64_OFFSET = 14695981039346656037ull;
+const uint64_t FNV1A64_PRIME = 1099511628211ull;
+
+// Streaming hash of one body; lives on the request task's stack
+class ContentHasher {
+public:
+    explicit ContentHasher(const ContentWatch* watch);
+
+    // Next bytes of the body
+    void update(const uint8_t* data, size_t size);
+
+    // The body arrived complete; the digest of a cut-short body is not
+    // compared (it would read as a change)
+    void finish() { finished_ = true; }
+
+    bool finished() const { return finished_; }
+    uint64_t digest() const { return hash_; }
+    uint32_t bodyBytes() const { return offset_; }
+    uint32_t hashedBytes() const { return hashed_; }
+
+private:
+    bool masked(uint8_t byte);
+
+    const ContentWatch* watch_;
+    uint8_t maskCount_;
+    uint64_t hash_;
+    uint32_t offset_;
+    uint32_t hashed_;
+    bool finished_;
+    uint16_t matched_[CONTENT_MAX_MASKS];   // Marker bytes matched so far
+    bool inside_[CONTENT_MAX_MASKS];        // Within a BETWEEN region
+};
+
+// Validators of a response, as sent back in If-None-Match and
+// If-Modified-Since. Empty strings: the server sent none (or one too long
+// to keep), and the request goes out unconditional.
+struct HttpValidators {
+    char etag[48];
+    char lastModified[32];    // HTTP-date as received
+};
+
+enum ContentChange : uint8_t {
+    CONTENT_FIRST = 0,        // No digest to compare with yet
+    CONTENT_SAME,
+    CONTENT_CHANGED,
+};
+
+// State of one watched endpoint (owned by the caller, one entry per
+// watched endpoint)
+struct ContentSlot {
+    uint64_t digest;          // Of the last full response
+    uint32_t changes;         // Since boot
+    bool known;               // digest is valid
+    HttpValidators validators;   // Of the last full response
+    uint32_t bodyBytes;       // Size of the last full body
+    uint32_t transferMs;      // Time it took to arrive
+    uint32_t notModified;     // 304 answers since boot
+    uint64_t savedBytes;      // Body bytes those did not transfer
+    uint32_t savedMs;         // Transfer time they did not take
+};
+
+class ContentTracker {
+public:
+    ContentTracker(ContentSlot* slots, uint16_t count);
+
+    // Forget every digest and validator: the next response of each
+    // endpoint is its baseline
+    void begin();
+
+    // A full response of slot index: body of bodyBytes hashed to digest,
+    // transferred in transferMs, with the validators to send next time
+    ContentChange record(uint16_t index, uint64_t digest, uint32_t bodyBytes, uint32_t transferMs,
+                         const HttpValidators& validators);
+
+    // A 304 answer, transferred in transferMs: the content is the same
+    void recordNotModified(uint16_t index, uint32_t transferMs);
+
+    const ContentSlot& slot(uint16_t index) const { return slots_[index]; }
+    const HttpValidators& validators(uint16_t index) const { return slots_[index].validators; }
+    uint32_t changeCount() const;
+    uint32_t notModifiedCount() const;
+    uint64_t savedBytes() const;
+    uint32_t savedMs() const;
+
+private:
+    ContentSlot* slots_;
+    uint16_t count_;
+};
+
+const char* contentChangeName(uint8_t change);
+
+#endif // CONTENT_HASH_H
@@ -0,0 +1,168 @@
+#include <DataBudget.h>
+#include <TrafficMeter.h>
+
+#include <string.h>
+
+static const char* const PRIORITY_NAMES[PRIORITY_LEVELS] = {
+    "high", "normal", "low", "optional",
+};
+
+static const char* const PRESSURE_NAMES[] = {
+    "unmetered", "ok", "tight", "exceeded",
+};
+
+const char* endpointPriorityName(uint8_t priority) {
+    return priority < PRIORITY_LEVELS ? PRIORITY_NAMES[priority] : "?";
+}
+
+const char* budgetPressureName(uint8_t pressure) {
+    return pressure <= BUDGET_EXCEEDED ? PRESSURE_NAMES[pressure] : "?";
+}
+
+DataBudget::DataBudget(BudgetEndpoint* endpoints, uint16_t count, uint32_t pollIntervalMs,
+                       const DataBudgetConfig& config)
+    : endpoints_(endpoints), count_(count), pollIntervalMs_(pollIntervalMs), config_(config),
+      pressure_(BUDGET_UNMETERED), lastMs_(0), savedUsedBytes_(0), savedElapsedMs_(0), rolled_(false) {
+    memset(&state_, 0, sizeof(state_));
+}
+
+void DataBudget::begin(uint32_t nowMs, const DataBudgetState* saved) {
+    if (saved != NULL) {
+        state_ = *saved;
+    } else {
+        memset(&state_, 0, sizeof(state_));
+    }
+    for (uint16_t i = 0; i < count_; i++) {
+        endpoints_[i].stretch = 1;
+        endpoints_[i].bytesPerRequest = 0;
+    }
+    pressure_ = metered() ? BUDGET_OK : BUDGET_UNMETERED;
+    lastMs_ = nowMs;
+    savedUsedBytes_ = state_.usedBytes;
+    savedElapsedMs_ = state_.elapsedMs;
+    rolled_ = false;
+    advance(nowMs);      // A saved period may be over under a shorter configuration
+}
+
+// periodDays outside 1..31 is clamped: 0 would never end a period, and
+// more than 49 days overflows 32-bit milliseconds
+uint32_t DataBudget::periodMs() const {
+    uint16_t days = config_.periodDays < 1 ? 1 : config_.periodDays > 31 ? 31 : config_.periodDays;
+    return days * TRAFFIC_DAY_MS;
+}
+
+void DataBudget::advance(uint32_t nowMs) {
+    state_.elapsedMs += nowMs - lastMs_;
+    lastMs_ = nowMs;
+
+    while (state_.elapsedMs >= periodMs()) {
+        state_.elapsedMs -= periodMs();
+        state_.usedBytes = 0;
+        state_.period++;
+        state_.reuse = 0;
+        rolled_ = true;
+    }
+}
+
+void DataBudget::record(uint16_t index, uint32_t bytes, uint32_t nowMs) {
+    advance(nowMs);
+    state_.usedBytes = bytes > UINT32_MAX - state_.usedBytes ? UINT32_MAX : state_.usedBytes + bytes;
+
+    BudgetEndpoint& endpoint = endpoints_[index];
+    if (endpoint.bytesPerRequest == 0) {
+        endpoint.bytesPerRequest = bytes;
+    } else {
+        endpoint.bytesPerRequest = (uint32_t)((int32_t)endpoint.bytesPerRequest +
+                                              ((int32_t)bytes - (int32_t)endpoint.bytesPerRequest) / 8);
+    }
+}
+
+uint64_t DataBudget::projectedBytes(uint16_t index, uint8_t stretch, uint32_t remainingMs) const {
+    if (stretch == 0) {
+        return 0;
+    }
+    uint64_t requests = remainingMs / ((uint64_t)pollIntervalMs_ * stretch) + 1;
+    return requests * endpoints_[index].bytesPerRequest;
+}
+
+BudgetPressure DataBudget::plan(uint32_t nowMs) {
+    if (!metered()) {
+        return pressure_;
+    }
+    advance(nowMs);
+
+    uint32_t remainingMs = periodMs() - state_.elapsedMs;
+    uint64_t remainingBytes = state_.usedBytes < config_.budgetBytes ? config_.budgetBytes - state_.usedBytes : 0;
+
+    uint64_t projected = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        endpoints_[i].stretch = 1;
+        projected += projectedBytes(i, 1, remainingMs);
+    }
+    if (projected <= remainingBytes) {
+        pressure_ = BUDGET_OK;
+        return pressure_;
+    }
+
+    // Over budget from here on: reuse connections for the rest of the period
+    state_.reuse = 1;
+    for (uint16_t i = 0; i < count_; i++) {
+        if (endpoints_[i].priority >= PRIORITY_OPTIONAL) {
+            endpoints_[i].stretch = 0;
+        }
+    }
+
+    // Stretch one priority group at a time, lowest first, just far enough
+    for (int priority = PRIORITY_LOW; priority >= PRIORITY_HIGH; priority--) {
+        uint64_t others = 0;
+        uint64_t group = 0;
+        for (uint16_t i = 0; i < count_; i++) {
+            uint64_t bytes = projectedBytes(i, endpoints_[i].stretch, remainingMs);
+            if (endpoints_[i].priority == priority) {
+                group += bytes;
+            } else {
+                others += bytes;
+            }
+        }
+        if (others + group <= remainingBytes) {
+            pressure_ = BUDGET_TIGHT;
+            return pressure_;
+        }
+        if (group == 0) {
+            continue;
+        }
+
+        uint8_t stretch = config_.maxStretch;
+        if (others < remainingBytes) {
+            uint64_t needed = (group + (remainingBytes - others) - 1) / (remainingBytes - others);
+            stretch = needed < config_.maxStretch ? (uint8_t)(needed > 1 ? needed : 1) : config_.maxStretch;
+        }
+        for (uint16_t i = 0; i < count_; i++) {
+            if (endpoints_[i].priority == priority) {
+                endpoints_[i].stretch = stretch;
+            }
+        }
+    }
+
+    uint64_t total = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        total += projectedBytes(i, endpoints_[i].stretch, remainingMs);
+    }
+    pressure_ = total <= remainingBytes ? BUDGET_TIGHT : BUDGET_EXCEEDED;
+    return pressure_;
+}
+
+bool DataBudget::persistDue() const {
+    if (!metered()) {
+        return false;
+    }
+    uint32_t step = config_.budgetBytes / 64 > 0 ? config_.budgetBytes / 64 : 1;
+    return rolled_ || state_.usedBytes - savedUsedBytes_ >= step ||
+           state_.elapsedMs - savedElapsedMs_ >= BUDGET_PERSIST_INTERVAL_MS;
+}
+
+void DataBudget::persisted() {
+    savedUsedBytes_ = state_.usedBytes;
+    savedElapsedMs_ = state_.elapsedMs;
+    rolled_ = false;
+}
@@ -0,0 +1,124 @@
+// ============================================================================
+// DATA BUDGET
+// ============================================================================
+//
+// Keeps the traffic of a metered uplink within a budget per period (a day
+// or a month). Every request's bytes are booked here; plan() then projects
+// the usage of the rest of the period from each endpoint's average bytes
+// per request and, if the projection does not fit the bytes left:
+//
+//   1. suspends PRIORITY_OPTIONAL endpoints (telemetry) altogether,
+//   2. stretches poll intervals, lowest priority first, each group only as
+//      far as needed (up to maxStretch) before the next one is touched,
+//   3. asks for connections to be kept open and reused, which saves the
+//      TLS handshake on every request. Once on, reuse stays on until the
+//      period ends, so the lower per-request cost it brings does not flip
+//      the plan straight back.
+//
+// The device has no wall clock, so a period is measured in uptime: time
+// spent powered off does not count, which only makes the budget last
+// longer. The usage and elapsed time of the current period are kept in a
+// DataBudgetState the caller persists (NVS on the device) whenever
+// persistDue() says so.
+//
+// The caller provides one BudgetEndpoint per endpoint.
+//
+
+#ifndef DATA_BUDGET_H
+#define DATA_BUDGET_H
+
+#include <stdint.h>
+
+enum EndpointPriority : uint8_t {
+    PRIORITY_HIGH = 0,     // Stretched last
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,          // Stretched first
+    PRIORITY_OPTIONAL,     // Telemetry: suspended under pressure
+    PRIORITY_LEVELS,
+};
+
+enum BudgetPressure : uint8_t {
+    BUDGET_UNMETERED = 0,  // No budget configured
+    BUDGET_OK,             // Projected usage fits at the regular intervals
+    BUDGET_TIGHT,          // Fits with optional endpoints suspended / intervals stretched
+    BUDGET_EXCEEDED,       // Does not fit even at maxStretch
+};
+
+struct DataBudgetConfig {
+    uint32_t budgetBytes;  // Per period; 0 disables the budget
+    uint16_t periodDays;   // 1 (daily) to 31 (monthly), in uptime days; clamped to that
+    uint8_t maxStretch;    // Longest poll interval, as a multiple of the regular one
+};
+
+// Per-endpoint state (owned by the caller, one entry per endpoint)
+struct BudgetEndpoint {
+    uint8_t priority;          // EndpointPriority (configuration)
+    uint8_t stretch;           // Poll interval multiple from plan(); 0: suspended
+    uint32_t bytesPerRequest;  // Running average, 0 until the first request
+};
+
+// Persisted across reboots
+struct DataBudgetState {
+    uint32_t usedBytes;    // In the current period
+    uint32_t elapsedMs;    // Uptime spent in the current period
+    uint32_t period;       // Completed periods
+    uint8_t reuse;         // Connection reuse switched on this period
+};
+
+const char* endpointPriorityName(uint8_t priority);
+const char* budgetPressureName(uint8_t pressure);
+
+// Persist at least this often while the state changes, and after every
+// 1/64 of the budget: bounds both flash wear and what a reboot can lose
+const uint32_t BUDGET_PERSIST_INTERVAL_MS = 10UL * 60UL * 1000UL;
+
+class DataBudget {
+public:
+    DataBudget(BudgetEndpoint* endpoints, uint16_t count, uint32_t pollIntervalMs,
+               const DataBudgetConfig& config);
+
+    // Start from a saved state, or a fresh period if saved is NULL
+    void begin(uint32_t nowMs, const DataBudgetState* saved);
+
+    // Book the bytes of one request to endpoint
+    void record(uint16_t index, uint32_t bytes, uint32_t nowMs);
+
+    // Re-plan stretch factors and connection reuse for the rest of the
+    // period. Returns the resulting pressure.
+    BudgetPressure plan(uint32_t nowMs);
+
+    BudgetPressure pressure() const { return pressure_; }
+    bool metered() const { return config_.budgetBytes > 0; }
+    bool reuseConnections() const { return state_.reuse != 0; }
+    uint8_t stretch(uint16_t index) const { return endpoints_[index].stretch; }
+    bool suspended(uint16_t index) const { return endpoints_[index].stretch == 0; }
+
+    const DataBudgetState& state() const { return state_; }
+    uint32_t budgetBytes() const { return config_.budgetBytes; }
+    uint32_t periodMs() const;
+
+    // True when the state should be written out now; call persisted()
+    // once it was
+    bool persistDue() const;
+    void persisted();
+
+private:
+    // Move the uptime clock forward, rolling over into a new period
+    void advance(uint32_t nowMs);
+
+    // Bytes endpoint would use in remainingMs at the given stretch
+    uint64_t projectedBytes(uint16_t index, uint8_t stretch, uint32_t remainingMs) const;
+
+    BudgetEndpoint* endpoints_;
+    uint16_t count_;
+    uint32_t pollIntervalMs_;
+    DataBudgetConfig config_;
+    DataBudgetState state_;
+    BudgetPressure pressure_;
+    uint32_t lastMs_;
+    uint32_t savedUsedBytes_;
+    uint32_t savedElapsedMs_;
+    bool rolled_;             // A period ended since the last persist
+};
+
+#endif // DATA_BUDGET_H
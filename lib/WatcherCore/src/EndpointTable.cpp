@@ -0,0 +1,91 @@
+#include <EndpointTable.h>
+#include <DataBudget.h>
+
+uint32_t fnv1a32(const void* data, size_t size, uint32_t hash) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+EndpointTable::EndpointTable() : header_(NULL), records_(NULL), pool_(NULL), error_("not loaded") {
+}
+
+uint32_t EndpointTable::blobSize(const EndpointTableHeader& header) {
+    if (header.magic != ENDPOINT_TABLE_MAGIC || header.version != ENDPOINT_TABLE_VERSION ||
+        header.recordSize != sizeof(EndpointRecord)) {
+        return 0;
+    }
+    uint64_t size = sizeof(EndpointTableHeader) + (uint64_t)header.count * sizeof(EndpointRecord) + header.poolBytes;
+    return size <= UINT32_MAX ? (uint32_t)size : 0;
+}
+
+bool EndpointTable::begin(const void* blob, uint32_t size) {
+    header_ = NULL;
+    records_ = NULL;
+    pool_ = NULL;
+    error_ = check((const uint8_t*)blob, size);
+    if (error_ != NULL) {
+        return false;
+    }
+
+    header_ = (const EndpointTableHeader*)blob;
+    records_ = (const EndpointRecord*)(header_ + 1);
+    pool_ = (const char*)(records_ + header_->count);
+    return true;
+}
+
+// Reason the blob is unusable, or NULL
+const char* EndpointTable::check(const uint8_t* blob, uint32_t size) const {
+    if (blob == NULL || size < sizeof(EndpointTableHeader)) {
+        return "too short";
+    }
+    const EndpointTableHeader& header = *(const EndpointTableHeader*)blob;
+    uint32_t expected = blobSize(header);
+    if (expected == 0) {
+        return "not an endpoint table of this version";
+    }
+    if (expected > size) {
+        return "truncated";
+    }
+
+    const uint8_t* body = blob + sizeof(EndpointTableHeader);
+    if (fnv1a32(body, expected - sizeof(EndpointTableHeader)) != header.checksum) {
+        return "checksum mismatch";
+    }
+
+    const EndpointRecord* records = (const EndpointRecord*)body;
+    const char* pool = (const char*)(records + header.count);
+    uint16_t hosts = 0;
+    for (uint16_t i = 0; i < header.count; i++) {
+        const EndpointRecord& record = records[i];
+        if ((uint64_t)record.urlOffset + record.urlLength >= header.poolBytes ||
+            pool[record.urlOffset + record.urlLength] != '\0') {
+            return "URL outside the string pool";
+        }
+        if (record.hostLength == 0 || record.hostStart + record.hostLength > record.urlLength) {
+            return "host outside its URL";
+        }
+        if (record.host > hosts || record.host >= header.hostCount) {
+            return "hosts not numbered in order of appearance";
+        }
+        if (record.priority >= PRIORITY_LEVELS) {
+            return "unknown priority";
+        }
+        if ((record.flags & ~(ENDPOINT_FLAG_CONTENT | ENDPOINT_FLAG_HEAD | ENDPOINT_FLAG_RANGE)) != 0) {
+            return "unknown flags";
+        }
+        if ((record.flags & ENDPOINT_FLAG_HEAD) != 0 && (record.flags & ENDPOINT_FLAG_RANGE) != 0) {
+            return "HEAD and range on one endpoint";
+        }
+        if (((record.flags & ENDPOINT_FLAG_RANGE) != 0) != (record.rangeBytes > 0)) {
+            return "range size without the range flag or vice versa";
+        }
+        if (record.host == hosts) {
+            hosts++;
+        }
+    }
+    return hosts == header.hostCount ? NULL : "host count mismatch";
+}
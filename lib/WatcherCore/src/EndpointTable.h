@@ -0,0 +1,95 @@
+// ============================================================================
+// ENDPOINT TABLE
+// ============================================================================
+//
+// Read-only endpoint configuration as one binary blob, for deployments with
+// more endpoints than fit in RAM or NVS. scripts/config_pack.py builds it
+// from a text file; the firmware maps the "config" flash partition and reads
+// the records in place, so only the endpoints' runtime state takes RAM.
+//
+// Blob layout (little-endian like the ESP32):
+//   EndpointTableHeader, 32 bytes
+//   header.count EndpointRecord entries, 16 bytes each (two per 32-byte
+//   flash cache line; a record never straddles one)
+//   string pool of header.poolBytes: the URLs, each NUL-terminated
+//
+// Hosts are numbered in order of first appearance, so the endpoints of a
+// prefix of the table never use more host buckets than there are endpoints
+// in it.
+//
+// The table never copies or allocates; the blob must stay valid (mapped)
+// for as long as the table is used.
+//
+
+#ifndef ENDPOINT_TABLE_H
+#define ENDPOINT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint32_t ENDPOINT_TABLE_MAGIC = 0x50455653;   // "SVEP"
+const uint16_t ENDPOINT_TABLE_VERSION = 1;
+
+struct EndpointTableHeader {
+    uint32_t magic;           // ENDPOINT_TABLE_MAGIC
+    uint16_t version;         // ENDPOINT_TABLE_VERSION
+    uint16_t recordSize;      // sizeof(EndpointRecord)
+    uint16_t count;           // Records that follow
+    uint16_t hostCount;       // Distinct hosts (rate-limit buckets)
+    uint32_t poolBytes;       // String pool after the records
+    uint32_t checksum;        // FNV-1a 32 of the records and the pool
+    uint32_t reserved[3];     // 0
+};
+
+struct EndpointRecord {
+    uint32_t urlOffset;       // Into the string pool
+    uint16_t urlLength;       // Without the NUL
+    uint16_t host;            // Rate-limit bucket: same host name, same bucket
+    uint8_t hostStart;        // Host name within the URL
+    uint8_t hostLength;
+    uint8_t priority;         // EndpointPriority (see DataBudget.h)
+    uint8_t flags;            // ENDPOINT_FLAG_*
+    uint32_t rangeBytes;      // ENDPOINT_FLAG_RANGE: body bytes to ask for, 0 otherwise
+};
+
+// EndpointRecord::flags
+const uint8_t ENDPOINT_FLAG_CONTENT = 0x01;   // Report changes of the whole body (ContentHash.h)
+const uint8_t ENDPOINT_FLAG_HEAD    = 0x02;   // Check with HEAD instead of GET
+const uint8_t ENDPOINT_FLAG_RANGE   = 0x04;   // GET only the first rangeBytes of the body
+
+static_assert(sizeof(EndpointTableHeader) == 32, "EndpointTableHeader layout is part of the blob format");
+static_assert(sizeof(EndpointRecord) == 16, "EndpointRecord layout is part of the blob format");
+
+const uint32_t FNV1A32_OFFSET = 2166136261u;
+
+// FNV-1a over size bytes, continuing from hash
+uint32_t fnv1a32(const void* data, size_t size, uint32_t hash = FNV1A32_OFFSET);
+
+class EndpointTable {
+public:
+    EndpointTable();
+
+    // Bytes of the whole blob a header describes; 0 if it is not a header
+    // of this version
+    static uint32_t blobSize(const EndpointTableHeader& header);
+
+    // Check every record of a blob of size bytes and read endpoints from it
+    // from now on. On failure the table stays empty and error() says why.
+    bool begin(const void* blob, uint32_t size);
+
+    uint16_t count() const { return header_ != NULL ? header_->count : 0; }
+    uint16_t hostCount() const { return header_ != NULL ? header_->hostCount : 0; }
+    const EndpointRecord& record(uint16_t index) const { return records_[index]; }
+    const char* url(uint16_t index) const { return pool_ + records_[index].urlOffset; }
+    const char* error() const { return error_; }
+
+private:
+    const char* check(const uint8_t* blob, uint32_t size) const;
+
+    const EndpointTableHeader* header_;
+    const EndpointRecord* records_;
+    const char* pool_;
+    const char* error_;
+};
+
+#endif // ENDPOINT_TABLE_H
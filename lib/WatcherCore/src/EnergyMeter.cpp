@@ -0,0 +1,111 @@
+#include <EnergyMeter.h>
+
+#include <string.h>
+
+uint32_t energyTxUs(const TrafficRecord& traffic, const EnergyModel& model) {
+    uint32_t bytes = 0;
+    for (uint8_t phase = 0; phase < TRAFFIC_PHASES; phase++) {
+        bytes += traffic.sent[phase];
+    }
+    // One frame per TCP segment (see trafficEstimateTcp()) plus the DNS
+    // query of every new connection
+    uint32_t frames = traffic.sent[TRAFFIC_TCP] / TRAFFIC_SEGMENT_HEADER_BYTES + traffic.connections;
+    uint64_t airUs = (uint64_t)bytes * 8 * 1000 / model.phyRateKbps;
+    return (uint32_t)(airUs + (uint64_t)frames * model.frameOverheadUs);
+}
+
+uint64_t energyMicrojoules(const EnergyRecord& record, const EnergyModel& model) {
+    // mV * mA * us = pJ
+    uint64_t picojoules = (uint64_t)model.supplyMv *
+                          (model.cpuMa * record.cpuUs + model.radioMa * record.radioUs + model.txMa * record.txUs);
+    return picojoules / 1000000;
+}
+
+void energyAdd(EnergyRecord* total, const EnergyRecord& record) {
+    total->requests += record.requests;
+    total->radioUs += record.radioUs;
+    total->txUs += record.txUs;
+    total->cpuUs += record.cpuUs;
+}
+
+// ============================================================================
+// LEDGER
+// ============================================================================
+
+EnergyLedger::EnergyLedger(EnergySlot* slots, uint16_t count, const EnergyModel& model)
+    : slots_(slots), count_(count), model_(model), cycleRequests_(0), cycleFirstUs_(0), cycleLastUs_(0) {
+    memset(slots_, 0, sizeof(EnergySlot) * count_);
+}
+
+void EnergyLedger::beginCycle() {
+    for (uint16_t i = 0; i < count_; i++) {
+        memset(&slots_[i].cycle, 0, sizeof(EnergyRecord));
+        slots_[i].cycleWeight = 0;
+        slots_[i].cycleRadioWeight = 0;
+    }
+    cycleRequests_ = 0;
+    cycleFirstUs_ = 0;
+    cycleLastUs_ = 0;
+}
+
+void EnergyLedger::addRequest(uint16_t index, int64_t radioStartUs, uint32_t radioUs, const TrafficRecord& traffic) {
+    int64_t radioEndUs = radioStartUs + radioUs;
+    if (cycleRequests_ == 0 || radioStartUs < cycleFirstUs_) {
+        cycleFirstUs_ = radioStartUs;
+    }
+    if (cycleRequests_ == 0 || radioEndUs > cycleLastUs_) {
+        cycleLastUs_ = radioEndUs;
+    }
+    cycleRequests_++;
+
+    EnergySlot& slot = slots_[index];
+    slot.cycle.requests++;
+    slot.cycleRadioWeight += radioUs;
+    slot.cycle.txUs += energyTxUs(traffic, model_);
+    slot.cycleWeight += trafficPhaseTotal(traffic, TRAFFIC_HANDSHAKE) + trafficPhaseTotal(traffic, TRAFFIC_REQUEST) +
+                        trafficPhaseTotal(traffic, TRAFFIC_RESPONSE);
+}
+
+EnergyRecord EnergyLedger::finishCycle(uint64_t cpuUs) {
+    uint64_t weight = 0;
+    uint64_t radioWeight = 0;
+    uint32_t requests = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        weight += slots_[i].cycleWeight;
+        radioWeight += slots_[i].cycleRadioWeight;
+        requests += slots_[i].cycle.requests;
+    }
+
+    // The windows overlap, so the radio was on once for all of them: from
+    // the first socket activity to the last, then the tail
+    uint64_t radioUs = 0;
+    if (cycleRequests_ > 0) {
+        radioUs = (uint64_t)(cycleLastUs_ - cycleFirstUs_) + model_.radioTailMs * 1000UL;
+    }
+
+    EnergyRecord sum;
+    memset(&sum, 0, sizeof(sum));
+    for (uint16_t i = 0; i < count_; i++) {
+        EnergySlot& slot = slots_[i];
+        if (slot.cycle.requests == 0) {
+            continue;
+        }
+        // By window length and by TLS bytes; evenly per request if nothing
+        // was measured
+        slot.cycle.radioUs = radioWeight > 0 ? radioUs * slot.cycleRadioWeight / radioWeight
+                                             : radioUs * slot.cycle.requests / requests;
+        slot.cycle.cpuUs = weight > 0 ? cpuUs * slot.cycleWeight / weight : cpuUs * slot.cycle.requests / requests;
+        energyAdd(&slot.total, slot.cycle);
+        energyAdd(&sum, slot.cycle);
+    }
+    return sum;
+}
+
+EnergyRecord EnergyLedger::grandTotal() const {
+    EnergyRecord sum;
+    memset(&sum, 0, sizeof(sum));
+    for (uint16_t i = 0; i < count_; i++) {
+        energyAdd(&sum, slots_[i].total);
+    }
+    return sum;
+}
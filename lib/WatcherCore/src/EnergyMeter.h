@@ -0,0 +1,97 @@
+// ============================================================================
+// ENERGY ACCOUNTING
+// ============================================================================
+//
+// Estimated energy per poll cycle and per endpoint, from three times:
+//
+//   radio   the radio is on from the first socket activity of the cycle to
+//           the last (request windows measured by the firmware with
+//           esp_timer), plus the modem-sleep tail the station stays awake
+//           afterwards. Requests run concurrently, so their windows overlap:
+//           the cycle's radio time is split across them by the length of
+//           each window.
+//   TX      transmitting: bytes sent (TrafficRecord, estimates included) at
+//           the PHY rate, plus a fixed cost per frame (preamble, contention,
+//           ACK)
+//   CPU     either core running something other than its idle task during
+//           the cycle (sampled by the firmware at every tick). The cycle's
+//           CPU time is split across its requests by the TLS bytes each
+//           moved, which is where the crypto work goes.
+//
+// EnergyModel turns the times into microjoules. Each current is the draw on
+// top of the modem-sleep baseline while that part is busy, so the figures
+// add up and the baseline between cycles (beacon wake-ups) is left out: the
+// result is the cost of the pings themselves, comparable across keep-alive,
+// batching and sleep strategies.
+//
+
+#ifndef ENERGY_METER_H
+#define ENERGY_METER_H
+
+#include <stdint.h>
+#include "TrafficMeter.h"
+
+struct EnergyModel {
+    uint16_t supplyMv;          // Supply voltage
+    uint16_t cpuMa;             // CPU running (above modem sleep)
+    uint16_t radioMa;           // Radio on, receiving or listening
+    uint16_t txMa;              // Extra while transmitting
+    uint32_t phyRateKbps;       // Typical TX PHY rate
+    uint16_t frameOverheadUs;   // Per frame: preamble, DIFS, backoff, ACK
+    uint16_t radioTailMs;       // Radio stays on after the last packet
+};
+
+// Times of one request, or a sum of many
+struct EnergyRecord {
+    uint32_t requests;
+    uint64_t radioUs;
+    uint64_t txUs;
+    uint64_t cpuUs;
+};
+
+// Air time of the frames a request sent
+uint32_t energyTxUs(const TrafficRecord& traffic, const EnergyModel& model);
+
+uint64_t energyMicrojoules(const EnergyRecord& record, const EnergyModel& model);
+
+void energyAdd(EnergyRecord* total, const EnergyRecord& record);
+
+// Per-endpoint storage (owned by the caller, one entry per endpoint)
+struct EnergySlot {
+    EnergyRecord total;         // Since boot
+    EnergyRecord cycle;         // Current poll cycle
+    uint32_t cycleWeight;       // TLS bytes this cycle (CPU share)
+    uint64_t cycleRadioWeight;  // Socket windows this cycle, us (radio share)
+};
+
+// Collects the requests of a poll cycle and books them per endpoint once
+// the cycle's radio and CPU time are known. Single owner, no locking.
+class EnergyLedger {
+public:
+    EnergyLedger(EnergySlot* slots, uint16_t count, const EnergyModel& model);
+
+    void beginCycle();
+
+    // A request finished; its socket window began at radioStartUs (any
+    // monotonic microsecond clock) and lasted radioUs, and traffic holds its
+    // bytes (with the DNS/TCP estimates already filled in)
+    void addRequest(uint16_t index, int64_t radioStartUs, uint32_t radioUs, const TrafficRecord& traffic);
+
+    // Split the cycle's radio time and cpuUs across its requests and add the
+    // cycle to the per-endpoint totals. Returns the cycle's sum.
+    EnergyRecord finishCycle(uint64_t cpuUs);
+
+    const EnergyRecord& total(uint16_t index) const { return slots_[index].total; }
+    EnergyRecord grandTotal() const;
+    const EnergyModel& model() const { return model_; }
+
+private:
+    EnergySlot* slots_;
+    uint16_t count_;
+    EnergyModel model_;
+    uint32_t cycleRequests_;
+    int64_t cycleFirstUs_;      // First socket activity of the cycle
+    int64_t cycleLastUs_;       // Last one
+};
+
+#endif // ENERGY_METER_H
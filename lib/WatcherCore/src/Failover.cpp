@@ -0,0 +1,147 @@
+#include "Failover.h"
+#include "NetTrace.h"
+
+#include <string.h>
+
+bool failoverRetryable(uint8_t outcome, int16_t status) {
+    switch (outcome) {
+        case TRACE_CONNECT_FAILED:
+        case TRACE_SEND_FAILED:
+        case TRACE_CONNECTION_LOST:
+        case TRACE_TIMEOUT:
+        case TRACE_OTHER_ERROR:
+            return true;
+        case TRACE_HTTP_ERROR:
+            return status >= 500;
+        default:
+            return false;
+    }
+}
+
+FailoverTable::FailoverTable(FailoverSlot* slots, uint16_t count, const FailoverConfig& config)
+    : slots_(slots), count_(count), config_(config) {
+}
+
+void FailoverTable::begin(uint16_t index, uint8_t destinations, uint32_t nowMs) {
+    FailoverSlot& slot = slots_[index];
+    memset(&slot, 0, sizeof(slot));
+    slot.count = destinations < FAILOVER_MAX_DESTINATIONS ? destinations : FAILOVER_MAX_DESTINATIONS;
+    for (uint8_t i = 0; i < slot.count; i++) {
+        slot.destinations[i].success = FAILOVER_SUCCESS_ONE;
+        slot.destinations[i].latencyMs = config_.priorLatencyMs;
+        slot.destinations[i].triedMs = nowMs;
+    }
+}
+
+uint32_t FailoverTable::score(uint16_t index, uint8_t destination) const {
+    const FailoverDestination& entry = slots_[index].destinations[destination];
+    uint64_t penalty = (uint64_t)config_.failurePenaltyMs * (FAILOVER_SUCCESS_ONE - entry.success) /
+                       FAILOVER_SUCCESS_ONE;
+    return entry.latencyMs + (uint32_t)penalty + destination * config_.orderBiasMs;
+}
+
+uint8_t FailoverTable::best(uint16_t index) const {
+    uint8_t found = 0;
+    for (uint8_t i = 1; i < slots_[index].count; i++) {
+        if (score(index, i) < score(index, found)) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+bool FailoverTable::updatePreferred(uint16_t index) {
+    FailoverSlot& slot = slots_[index];
+    uint8_t preferred = best(index);
+    if (preferred == slot.preferred) {
+        return false;
+    }
+    slot.preferred = preferred;
+    slot.switches++;
+    return true;
+}
+
+bool FailoverTable::plan(uint16_t index, uint32_t nowMs, uint8_t* order) {
+    const FailoverSlot& slot = slots_[index];
+
+    // By score; insertion sort keeps ties in list order
+    for (uint8_t i = 0; i < slot.count; i++) {
+        uint8_t at = i;
+        uint32_t mine = score(index, i);
+        while (at > 0 && score(index, order[at - 1]) > mine) {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = i;
+    }
+    updatePreferred(index);
+
+    // The demoted destination waiting longest for a probe goes first
+    if (config_.probeIntervalMs == 0) {
+        return false;
+    }
+    uint8_t probe = 0;
+    uint32_t longestMs = 0;
+    for (uint8_t i = 1; i < slot.count; i++) {
+        uint32_t waitedMs = nowMs - slot.destinations[order[i]].triedMs;
+        if (waitedMs >= config_.probeIntervalMs && waitedMs > longestMs) {
+            probe = i;
+            longestMs = waitedMs;
+        }
+    }
+    if (probe == 0) {
+        return false;
+    }
+    uint8_t probed = order[probe];
+    for (uint8_t i = probe; i > 0; i--) {
+        order[i] = order[i - 1];
+    }
+    order[0] = probed;
+    return true;
+}
+
+void FailoverTable::sample(FailoverDestination& destination, bool success, uint32_t durationMs, uint32_t nowMs) {
+    uint32_t target = success ? FAILOVER_SUCCESS_ONE : 0;
+    destination.success = (uint16_t)((destination.success * (256u - config_.weight) + target * config_.weight) / 256u);
+    if (success) {
+        destination.latencyMs = destination.answered
+            ? (uint32_t)(((uint64_t)destination.latencyMs * (256u - config_.weight) +
+                          (uint64_t)durationMs * config_.weight) / 256u)
+            : durationMs;
+        destination.answered = true;
+    } else {
+        destination.failures++;
+    }
+    destination.attempts++;
+    destination.triedMs = nowMs;
+}
+
+bool FailoverTable::record(uint16_t index, const FailoverAttempts& attempts, uint32_t nowMs) {
+    FailoverSlot& slot = slots_[index];
+    for (uint8_t i = 0; i < attempts.count; i++) {
+        const FailoverAttempt& attempt = attempts.attempts[i];
+        if (attempt.destination >= slot.count) {
+            continue;
+        }
+        // Answers that say nothing about the destination (a rate limit,
+        // a client error) only count as tried
+        bool failed = failoverRetryable(attempt.outcome, attempt.status);
+        if (!failed && attempt.outcome != TRACE_OK) {
+            slot.destinations[attempt.destination].triedMs = nowMs;
+            continue;
+        }
+        sample(slot.destinations[attempt.destination], !failed, attempt.durationMs, nowMs);
+    }
+    if (attempts.count > 1 && attempts.attempts[attempts.count - 1].outcome == TRACE_OK) {
+        slot.failovers++;
+    }
+    return updatePreferred(index);
+}
+
+bool FailoverTable::recordHung(uint16_t index, uint8_t destination, uint32_t nowMs) {
+    FailoverSlot& slot = slots_[index];
+    if (destination < slot.count) {
+        sample(slot.destinations[destination], false, 0, nowMs);
+    }
+    return updatePreferred(index);
+}
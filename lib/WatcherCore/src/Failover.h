@@ -0,0 +1,121 @@
+// ============================================================================
+// DESTINATION FAILOVER
+// ============================================================================
+//
+// Some checks can go to any of several equivalent destinations, such as a
+// primary and a backup collector. Each such endpoint gets a slot here with
+// an exponentially weighted moving average (EWMA) per destination of:
+//
+// - success: the share of attempts that got an answer (no connect failure,
+//   timeout, lost connection or 5xx), starting at 1;
+// - latency: how long a successful attempt took, starting at
+//   priorLatencyMs until the destination has answered once.
+//
+// A destination's score is its expected cost in milliseconds: latency, plus
+// failurePenaltyMs (what a failed attempt costs before the next one can
+// start) times its failure rate, plus orderBiasMs for each place it stands
+// behind the endpoint's own URL, so ties go to the list's order. plan()
+// orders the destinations by score; the request tries them in that order
+// and fails over to the next one within the same request when an attempt
+// fails and there is still time.
+//
+// A demoted destination only gets new samples when it is tried: once it
+// has not been for probeIntervalMs, plan() puts it first for one request
+// (the best one follows, so a failed probe still ends in an answer). A
+// recovered primary is thus taken back after a few probes.
+//
+// The caller provides one FailoverSlot per endpoint with alternates.
+//
+
+#ifndef FAILOVER_H
+#define FAILOVER_H
+
+#include <stdint.h>
+
+// An endpoint's URL and up to three alternates
+const uint8_t FAILOVER_MAX_DESTINATIONS = 4;
+
+const uint16_t FAILOVER_SUCCESS_ONE = 65535;   // EWMA fixed point: always answers
+
+struct FailoverConfig {
+    uint8_t weight;               // Of a new sample in the EWMAs, in 1/256
+    uint32_t failurePenaltyMs;    // Cost of a failed attempt
+    uint32_t priorLatencyMs;      // Assumed for a destination that has not answered yet
+    uint32_t orderBiasMs;         // Added per place behind the endpoint's URL
+    uint32_t probeIntervalMs;     // A destination not tried this long goes first once (0: never)
+    uint32_t attemptWindowMs;     // Fail over only this soon after the request started
+};
+
+// One destination of a slot
+struct FailoverDestination {
+    uint16_t success;             // EWMA, FAILOVER_SUCCESS_ONE: always answers
+    uint32_t latencyMs;           // EWMA of successful attempts
+    uint32_t triedMs;             // Last attempt (or begin())
+    bool answered;                // latencyMs is measured, not the prior
+    uint32_t attempts;            // Since boot
+    uint32_t failures;
+};
+
+// State of one endpoint with alternates (owned by the caller)
+struct FailoverSlot {
+    FailoverDestination destinations[FAILOVER_MAX_DESTINATIONS];
+    uint8_t count;                // Destinations in use, 0 is the endpoint's URL
+    uint8_t preferred;            // Best score at the last plan() or record()
+    uint32_t failovers;           // Requests answered by another than their first destination
+    uint32_t switches;            // Changes of the preferred destination
+};
+
+// One attempt of a request, as the request task reports it
+struct FailoverAttempt {
+    uint8_t destination;
+    uint8_t outcome;              // TraceOutcome
+    int16_t status;               // HTTP status or client error code
+    uint32_t durationMs;
+};
+
+struct FailoverAttempts {
+    FailoverAttempt attempts[FAILOVER_MAX_DESTINATIONS];
+    uint8_t count;
+};
+
+// Whether an attempt that ended like this should be retried at the next
+// destination: no answer, or a server error. Rate limits and other HTTP
+// errors would be the same everywhere.
+bool failoverRetryable(uint8_t outcome, int16_t status);
+
+class FailoverTable {
+public:
+    FailoverTable(FailoverSlot* slots, uint16_t count, const FailoverConfig& config);
+
+    // Slot index serves destinations (1 to FAILOVER_MAX_DESTINATIONS) and
+    // starts from the priors
+    void begin(uint16_t index, uint8_t destinations, uint32_t nowMs);
+
+    // Order to try index's destinations in (count() of them). Returns true
+    // when the first one is a probe of a demoted destination.
+    bool plan(uint16_t index, uint32_t nowMs, uint8_t* order);
+
+    // Learn from a finished request's attempts. Returns true when the
+    // preferred destination changed.
+    bool record(uint16_t index, const FailoverAttempts& attempts, uint32_t nowMs);
+
+    // A request that never reported back (declared hung) counts as a
+    // failure of the destination it was trying
+    bool recordHung(uint16_t index, uint8_t destination, uint32_t nowMs);
+
+    uint32_t score(uint16_t index, uint8_t destination) const;
+    const FailoverSlot& slot(uint16_t index) const { return slots_[index]; }
+    uint16_t count() const { return count_; }
+    const FailoverConfig& config() const { return config_; }
+
+private:
+    void sample(FailoverDestination& destination, bool success, uint32_t durationMs, uint32_t nowMs);
+    uint8_t best(uint16_t index) const;
+    bool updatePreferred(uint16_t index);
+
+    FailoverSlot* slots_;
+    uint16_t count_;
+    FailoverConfig config_;
+};
+
+#endif // FAILOVER_H
@@ -0,0 +1,264 @@
+#include <HeartbeatTable.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* const STATE_NAMES[] = {"alive", "silent"};
+
+const char* heartbeatStateName(uint8_t state) {
+    return state <= HEARTBEAT_SILENT ? STATE_NAMES[state] : "?";
+}
+
+// ============================================================================
+// PARSING
+// ============================================================================
+
+static bool nameChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_' ||
+           c == '-';
+}
+
+// Name at data, up to the first character that cannot be part of one.
+// Returns its length, 0 when there is none or it is too long.
+static size_t parseName(const char* data, size_t size, char* name) {
+    size_t length = 0;
+    while (length < size && nameChar(data[length])) {
+        length++;
+    }
+    if (length == 0 || length >= HEARTBEAT_NAME_BYTES) {
+        return 0;
+    }
+    memcpy(name, data, length);
+    name[length] = '\0';
+    return length;
+}
+
+// Decimal seconds at data; returns the digits taken, 0 when there are none
+static size_t parsePeriod(const char* data, size_t size, uint32_t* periodMs) {
+    size_t length = 0;
+    uint32_t seconds = 0;
+    while (length < size && data[length] >= '0' && data[length] <= '9') {
+        if (seconds < HEARTBEAT_MAX_PERIOD_MS / 1000) {
+            seconds = seconds * 10 + (uint32_t)(data[length] - '0');
+        }
+        length++;
+    }
+    uint32_t ms = seconds < HEARTBEAT_MAX_PERIOD_MS / 1000 ? seconds * 1000 : HEARTBEAT_MAX_PERIOD_MS;
+    *periodMs = ms < HEARTBEAT_MIN_PERIOD_MS ? HEARTBEAT_MIN_PERIOD_MS : ms;
+    return length;
+}
+
+bool heartbeatParseDatagram(const char* data, size_t size, HeartbeatBeat* beat) {
+    while (size > 0 && (data[size - 1] == '\n' || data[size - 1] == '\r')) {
+        size--;
+    }
+    size_t at = parseName(data, size, beat->name);
+    if (at == 0) {
+        return false;
+    }
+    beat->periodMs = 0;
+    if (at < size && data[at] == ' ') {
+        size_t digits = parsePeriod(data + at + 1, size - at - 1, &beat->periodMs);
+        if (digits == 0) {
+            return false;
+        }
+        at += 1 + digits;
+    }
+    return at == size;
+}
+
+bool heartbeatParseRequestLine(const char* line, size_t size, HeartbeatBeat* beat) {
+    static const char PATH[] = "/hb/";
+    static const char PERIOD[] = "?period=";
+    static const char VERSION[] = " HTTP/1.";
+
+    size_t at;
+    if (size >= 4 && memcmp(line, "GET ", 4) == 0) {
+        at = 4;
+    } else if (size >= 5 && memcmp(line, "POST ", 5) == 0) {
+        at = 5;
+    } else {
+        return false;
+    }
+    if (size - at < sizeof(PATH) - 1 || memcmp(line + at, PATH, sizeof(PATH) - 1) != 0) {
+        return false;
+    }
+    at += sizeof(PATH) - 1;
+
+    size_t length = parseName(line + at, size - at, beat->name);
+    if (length == 0) {
+        return false;
+    }
+    at += length;
+    beat->periodMs = 0;
+    if (size - at >= sizeof(PERIOD) - 1 && memcmp(line + at, PERIOD, sizeof(PERIOD) - 1) == 0) {
+        at += sizeof(PERIOD) - 1;
+        size_t digits = parsePeriod(line + at, size - at, &beat->periodMs);
+        if (digits == 0) {
+            return false;
+        }
+        at += digits;
+    }
+    return size - at >= sizeof(VERSION) - 1 && memcmp(line + at, VERSION, sizeof(VERSION) - 1) == 0;
+}
+
+// ============================================================================
+// TABLE
+// ============================================================================
+
+HeartbeatTable::HeartbeatTable(HeartbeatSource* slots, uint16_t capacity, const HeartbeatConfig& config)
+    : slots_(slots), capacity_(capacity), config_(config), beatsReceived_(0), rejected_(0) {
+}
+
+void HeartbeatTable::begin() {
+    memset(slots_, 0, capacity_ * sizeof(HeartbeatSource));
+    beatsReceived_ = 0;
+    rejected_ = 0;
+}
+
+void HeartbeatTable::resume(uint32_t nowMs) {
+    for (uint16_t i = 0; i < capacity_; i++) {
+        if (slots_[i].name[0] != '\0' && slots_[i].state == HEARTBEAT_ALIVE) {
+            slots_[i].lastBeatMs = nowMs;
+        }
+    }
+}
+
+HeartbeatChange HeartbeatTable::beat(const HeartbeatBeat& beat, uint32_t nowMs) {
+    beatsReceived_++;
+    uint32_t periodMs = beat.periodMs > 0 ? beat.periodMs : config_.defaultPeriodMs;
+
+    int32_t index = find(beat.name);
+    if (index >= 0) {
+        HeartbeatSource& source = slots_[index];
+        HeartbeatChange change = source.state == HEARTBEAT_SILENT ? HEARTBEAT_RESUMED : HEARTBEAT_UNCHANGED;
+        source.periodMs = periodMs;
+        source.lastBeatMs = nowMs;
+        source.beats++;
+        source.state = HEARTBEAT_ALIVE;
+        return change;
+    }
+
+    index = freeSlot(nowMs);
+    if (index < 0) {
+        rejected_++;
+        return HEARTBEAT_REJECTED;
+    }
+    HeartbeatSource& source = slots_[index];
+    memcpy(source.name, beat.name, sizeof(source.name));
+    source.name[sizeof(source.name) - 1] = '\0';
+    source.periodMs = periodMs;
+    source.lastBeatMs = nowMs;
+    source.beats = 1;
+    source.state = HEARTBEAT_ALIVE;
+    return HEARTBEAT_NEW;
+}
+
+uint16_t HeartbeatTable::collectSilent(uint32_t nowMs, uint16_t* out, uint16_t max) {
+    uint16_t collected = 0;
+    for (uint16_t i = 0; i < capacity_ && collected < max; i++) {
+        HeartbeatSource& source = slots_[i];
+        if (source.name[0] == '\0' || source.state != HEARTBEAT_ALIVE || !timeReached(nowMs, deadline(source))) {
+            continue;
+        }
+        source.state = HEARTBEAT_SILENT;
+        out[collected++] = i;
+    }
+    return collected;
+}
+
+uint32_t HeartbeatTable::msUntilNextDeadline(uint32_t nowMs) const {
+    uint32_t waitMs = UINT32_MAX;
+    for (uint16_t i = 0; i < capacity_; i++) {
+        const HeartbeatSource& source = slots_[i];
+        if (source.name[0] == '\0' || source.state != HEARTBEAT_ALIVE) {
+            continue;
+        }
+        uint32_t untilMs = timeUntil(nowMs, deadline(source));
+        waitMs = untilMs < waitMs ? untilMs : waitMs;
+    }
+    return waitMs;
+}
+
+size_t HeartbeatTable::formatSummary(char* out, size_t size) const {
+    // Room kept for "&more=65535"
+    const size_t MORE_BYTES = 12;
+
+    uint16_t sources = sourceCount();
+    uint16_t silent = silentCount();
+    int written = snprintf(out, size, "sources=%u&alive=%u&silent=%u&beats=%lu", sources, sources - silent, silent,
+                           (unsigned long)beatsReceived_);
+    if (written < 0 || (size_t)written >= size) {
+        return size > 0 ? strlen(out) : 0;
+    }
+    size_t length = (size_t)written;
+
+    uint16_t listed = 0;
+    for (uint16_t i = 0; i < capacity_ && listed < silent; i++) {
+        const HeartbeatSource& source = slots_[i];
+        if (source.name[0] == '\0' || source.state != HEARTBEAT_SILENT) {
+            continue;
+        }
+        const char* separator = listed == 0 ? "&down=" : ",";
+        size_t needed = strlen(separator) + strlen(source.name);
+        if (length + needed + MORE_BYTES >= size) {
+            break;
+        }
+        length += (size_t)snprintf(out + length, size - length, "%s%s", separator, source.name);
+        listed++;
+    }
+    if (listed < silent && length + MORE_BYTES < size) {
+        length += (size_t)snprintf(out + length, size - length, "&more=%u", silent - listed);
+    }
+    return length;
+}
+
+uint16_t HeartbeatTable::sourceCount() const {
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < capacity_; i++) {
+        if (slots_[i].name[0] != '\0') {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint16_t HeartbeatTable::silentCount() const {
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < capacity_; i++) {
+        if (slots_[i].name[0] != '\0' && slots_[i].state == HEARTBEAT_SILENT) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int32_t HeartbeatTable::find(const char* name) const {
+    for (uint16_t i = 0; i < capacity_; i++) {
+        if (slots_[i].name[0] != '\0' && strncmp(slots_[i].name, name, HEARTBEAT_NAME_BYTES) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A free slot, otherwise the one of the source silent longest
+int32_t HeartbeatTable::freeSlot(uint32_t nowMs) const {
+    int32_t found = -1;
+    uint32_t foundAgeMs = 0;
+    for (uint16_t i = 0; i < capacity_; i++) {
+        const HeartbeatSource& source = slots_[i];
+        if (source.name[0] == '\0') {
+            return i;
+        }
+        uint32_t ageMs = nowMs - source.lastBeatMs;
+        if (source.state == HEARTBEAT_SILENT && (found < 0 || ageMs > foundAgeMs)) {
+            found = i;
+            foundAgeMs = ageMs;
+        }
+    }
+    return found;
+}
+
+uint32_t HeartbeatTable::deadline(const HeartbeatSource& source) const {
+    return source.lastBeatMs + source.periodMs * config_.missedBeats + source.periodMs / 2;
+}
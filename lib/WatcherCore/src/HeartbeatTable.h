@@ -0,0 +1,133 @@
+// ============================================================================
+// HEARTBEAT TABLE
+// ============================================================================
+//
+// Passive monitoring of LAN gadgets that cannot afford a TLS handshake of
+// their own: each one sends a plain heartbeat (a UDP datagram or an HTTP
+// request, see lib/Watcher/src/heartbeat_listener.cpp) every periodMs, and
+// the watcher relays a summary of all of them upstream in one HTTPS request
+// (lib/Watcher/src/HeartbeatRelay.cpp).
+//
+// - A source is known by its name. Its first beat adds it to the table;
+//   the beat may announce its period, otherwise defaultPeriodMs applies.
+// - A source that misses missedBeats beats in a row goes SILENT: its
+//   deadline is lastBeat + (missedBeats + 1/2) * period, the half period
+//   leaving room for a beat that is late rather than lost. The next beat
+//   makes it ALIVE again.
+// - The table has a fixed number of slots. When all are taken, a new name
+//   replaces the source that has been silent longest; with none silent it
+//   is turned away.
+//
+// Every transition (new, silent, back) is returned to the caller, which
+// reports it upstream right away instead of waiting for the next summary.
+//
+// The caller provides one slot per gadget it can track.
+//
+
+#ifndef HEARTBEAT_TABLE_H
+#define HEARTBEAT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <WatcherTime.h>
+
+// Names: 1..HEARTBEAT_NAME_BYTES-1 characters of [A-Za-z0-9._-], so they go
+// into a URL query as they are
+const size_t HEARTBEAT_NAME_BYTES = 20;
+
+// Announced periods are clamped to this range
+const uint32_t HEARTBEAT_MIN_PERIOD_MS = 1000;
+const uint32_t HEARTBEAT_MAX_PERIOD_MS = 86400000;
+
+struct HeartbeatConfig {
+    uint32_t defaultPeriodMs;     // For beats that do not announce a period
+    uint8_t missedBeats;          // Beats missed in a row before a source is SILENT
+};
+
+enum HeartbeatState : uint8_t {
+    HEARTBEAT_ALIVE = 0,
+    HEARTBEAT_SILENT,
+};
+
+enum HeartbeatChange : uint8_t {
+    HEARTBEAT_UNCHANGED = 0,
+    HEARTBEAT_NEW,                // First beat of a name (or a replaced slot)
+    HEARTBEAT_RESUMED,            // A SILENT source beat again
+    HEARTBEAT_WENT_SILENT,        // From collectSilent()
+    HEARTBEAT_REJECTED,           // Table full, no silent source to replace
+};
+
+// One received heartbeat
+struct HeartbeatBeat {
+    char name[HEARTBEAT_NAME_BYTES];
+    uint32_t periodMs;            // 0: the default
+};
+
+// One tracked source (about 36 bytes); an empty name marks a free slot
+struct HeartbeatSource {
+    char name[HEARTBEAT_NAME_BYTES];
+    uint32_t periodMs;
+    uint32_t lastBeatMs;
+    uint32_t beats;               // Since the source was added
+    uint8_t state;                // HeartbeatState
+};
+
+// "<name>" or "<name> <period_s>", optionally ending in a newline. False for
+// anything else.
+bool heartbeatParseDatagram(const char* data, size_t size, HeartbeatBeat* beat);
+
+// HTTP request line "GET /hb/<name>[?period=<s>] HTTP/1.x" (POST works the
+// same). False for anything else.
+bool heartbeatParseRequestLine(const char* line, size_t size, HeartbeatBeat* beat);
+
+class HeartbeatTable {
+public:
+    HeartbeatTable(HeartbeatSource* slots, uint16_t capacity, const HeartbeatConfig& config);
+
+    // Forget every source
+    void begin();
+
+    // The caller could not hear any beats for a while (its network was
+    // down): count every ALIVE source's deadline from nowMs instead
+    void resume(uint32_t nowMs);
+
+    // A beat arrived at nowMs
+    HeartbeatChange beat(const HeartbeatBeat& beat, uint32_t nowMs);
+
+    // Mark the ALIVE sources whose deadline has passed SILENT and collect
+    // up to max of their slot indices. Returns the number collected; call
+    // again while it returns max.
+    uint16_t collectSilent(uint32_t nowMs, uint16_t* out, uint16_t max);
+
+    // Time until the next ALIVE source's deadline (UINT32_MAX: none)
+    uint32_t msUntilNextDeadline(uint32_t nowMs) const;
+
+    // The state as a URL query (no leading '?'):
+    //   sources=<n>&alive=<n>&silent=<n>&beats=<n>[&down=<name>,<name>...]
+    // down lists the SILENT sources; when they do not all fit, the list is
+    // cut short and "&more=<n>" says how many are missing. Returns the
+    // length written (the output is always terminated).
+    size_t formatSummary(char* out, size_t size) const;
+
+    uint16_t capacity() const { return capacity_; }
+    uint16_t sourceCount() const;
+    uint16_t silentCount() const;
+    const HeartbeatSource& source(uint16_t index) const { return slots_[index]; }   // Empty name: free
+    uint32_t beatsReceived() const { return beatsReceived_; }    // Since begin(), rejected ones included
+    uint32_t rejected() const { return rejected_; }
+
+private:
+    int32_t find(const char* name) const;
+    int32_t freeSlot(uint32_t nowMs) const;
+    uint32_t deadline(const HeartbeatSource& source) const;
+
+    HeartbeatSource* slots_;
+    uint16_t capacity_;
+    HeartbeatConfig config_;
+    uint32_t beatsReceived_;
+    uint32_t rejected_;
+};
+
+const char* heartbeatStateName(uint8_t state);
+
+#endif // HEARTBEAT_TABLE_H
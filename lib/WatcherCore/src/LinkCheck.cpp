@@ -0,0 +1,72 @@
+#include <LinkCheck.h>
+
+LinkCheck::LinkCheck(const LinkCheckConfig& config)
+    : config_(config), nextDueMs_(0), startedMs_(0), lastConnectMs_(0), checks_(0), failures_(0), losses_(0),
+      consecutiveFailures_(0), inFlight_(false), lost_(false) {
+}
+
+void LinkCheck::begin(uint32_t nowMs) {
+    nextDueMs_ = nowMs + config_.intervalMs;
+    startedMs_ = nowMs;
+    lastConnectMs_ = 0;
+    checks_ = 0;
+    failures_ = 0;
+    losses_ = 0;
+    consecutiveFailures_ = 0;
+    inFlight_ = false;
+    lost_ = false;
+}
+
+bool LinkCheck::due(uint32_t nowMs) const {
+    return enabled() && !inFlight_ && timeReached(nowMs, nextDueMs_);
+}
+
+void LinkCheck::start(uint32_t nowMs) {
+    inFlight_ = true;
+    startedMs_ = nowMs;
+    nextDueMs_ = nowMs + config_.intervalMs;
+}
+
+void LinkCheck::cancel() {
+    inFlight_ = false;
+}
+
+bool LinkCheck::timedOut(uint32_t nowMs) const {
+    return inFlight_ && timeReached(nowMs, startedMs_ + config_.timeoutMs);
+}
+
+LinkCheckVerdict LinkCheck::record(bool reachable, uint32_t nowMs) {
+    inFlight_ = false;
+    checks_++;
+
+    if (reachable) {
+        lastConnectMs_ = nowMs - startedMs_;
+        consecutiveFailures_ = 0;
+        if (lost_) {
+            lost_ = false;
+            return LINK_CHECK_RESTORED;
+        }
+        return LINK_CHECK_UNCHANGED;
+    }
+
+    failures_++;
+    if (consecutiveFailures_ < UINT8_MAX) {
+        consecutiveFailures_++;
+    }
+    if (!lost_ && consecutiveFailures_ >= config_.failThreshold) {
+        lost_ = true;
+        losses_++;
+        return LINK_CHECK_LOST;
+    }
+    return LINK_CHECK_UNCHANGED;
+}
+
+uint32_t LinkCheck::msUntilNextTimer(uint32_t nowMs) const {
+    if (!enabled()) {
+        return UINT32_MAX;
+    }
+    if (inFlight_) {
+        return timeUntil(nowMs, startedMs_ + config_.timeoutMs);
+    }
+    return timeUntil(nowMs, nextDueMs_);
+}
@@ -0,0 +1,96 @@
+// ============================================================================
+// LINK CHECK
+// ============================================================================
+//
+// A cheap reachability check between the regular polls: every intervalMs a
+// plain TCP connect (no TLS, no request) to one target, by default the
+// gateway. Without it an outage shows only at the next HTTPS poll, up to a
+// whole poll interval later.
+//
+// - A check fails when it has not connected within timeoutMs.
+// - failThreshold consecutive failures declare the link lost: the caller
+//   then polls every healthy endpoint right away, and while the link stays
+//   lost retries a failed poll after retryMs instead of the regular retry
+//   delay, so health flips within a few request timeouts instead of
+//   waiting for the poll interval.
+// - The first success after that declares it restored, and the endpoints
+//   that went DOWN are polled right away.
+//
+// A check never changes health state itself; the endpoints' own requests
+// do. A target that drops the connect (a firewalled port) costs expedited
+// polls, nothing more.
+//
+// The connect itself is the caller's (lib/Watcher/src/link_probe.cpp).
+//
+
+#ifndef LINK_CHECK_H
+#define LINK_CHECK_H
+
+#include <stdint.h>
+#include <WatcherTime.h>
+
+struct LinkCheckConfig {
+    uint32_t intervalMs;         // Between the starts of two checks, 0: no checks
+    uint32_t timeoutMs;          // A check not connected by then failed
+    uint8_t failThreshold;       // Consecutive failures before the link counts as lost
+    uint32_t retryMs;            // Retry of a failed poll while lost, until DOWN
+};
+
+enum LinkCheckVerdict : uint8_t {
+    LINK_CHECK_UNCHANGED = 0,
+    LINK_CHECK_LOST,
+    LINK_CHECK_RESTORED,
+};
+
+class LinkCheck {
+public:
+    explicit LinkCheck(const LinkCheckConfig& config);
+
+    // Clear state and counters; the first check is due one interval after
+    // nowMs (the endpoints are being polled anyway)
+    void begin(uint32_t nowMs);
+
+    bool enabled() const { return config_.intervalMs > 0; }
+    uint32_t intervalMs() const { return config_.intervalMs; }
+    bool inFlight() const { return inFlight_; }
+
+    // A check should start now
+    bool due(uint32_t nowMs) const;
+
+    // A check was started at nowMs
+    void start(uint32_t nowMs);
+
+    // The started check could not be made (no socket): try again at the
+    // next interval, without a verdict
+    void cancel();
+
+    // The check in flight is past its timeout
+    bool timedOut(uint32_t nowMs) const;
+
+    // Outcome of the check in flight
+    LinkCheckVerdict record(bool reachable, uint32_t nowMs);
+
+    // Time until the next check is due or the one in flight times out
+    // (UINT32_MAX while disabled)
+    uint32_t msUntilNextTimer(uint32_t nowMs) const;
+
+    bool lost() const { return lost_; }
+    uint32_t checks() const { return checks_; }
+    uint32_t failures() const { return failures_; }
+    uint32_t losses() const { return losses_; }
+    uint32_t lastConnectMs() const { return lastConnectMs_; }   // Of the last successful check
+
+private:
+    LinkCheckConfig config_;
+    uint32_t nextDueMs_;
+    uint32_t startedMs_;
+    uint32_t lastConnectMs_;
+    uint32_t checks_;
+    uint32_t failures_;            // Since boot
+    uint32_t losses_;              // Times the link was declared lost
+    uint8_t consecutiveFailures_;
+    bool inFlight_;
+    bool lost_;
+};
+
+#endif // LINK_CHECK_H
@@ -0,0 +1,407 @@
+#include <MqttSession.h>
+#include <string.h>
+
+static const char* const CONNACK_NAMES[] = {
+    "accepted", "unacceptable protocol", "identifier rejected", "server unavailable", "bad user name or password",
+    "not authorized",
+};
+
+const char* mqttConnackName(uint8_t code) {
+    return code <= 5 ? CONNACK_NAMES[code] : "?";
+}
+
+// CONNECT flags
+const uint8_t CONNECT_USERNAME = 0x80;
+const uint8_t CONNECT_PASSWORD = 0x40;
+const uint8_t CONNECT_WILL_RETAIN = 0x20;
+const uint8_t CONNECT_WILL_QOS1 = 0x08;
+const uint8_t CONNECT_WILL = 0x04;
+
+// PUBLISH flags
+const uint8_t PUBLISH_DUP = 0x08;
+const uint8_t PUBLISH_QOS1 = 0x02;
+const uint8_t PUBLISH_RETAIN = 0x01;
+
+// ============================================================================
+// ENCODING
+// ============================================================================
+
+size_t mqttEncodeLength(uint32_t length, uint8_t* out) {
+    if (length > MQTT_MAX_LENGTH) {
+        return 0;
+    }
+    size_t used = 0;
+    do {
+        uint8_t digit = length & 0x7F;
+        length >>= 7;
+        out[used++] = length > 0 ? (uint8_t)(digit | 0x80) : digit;
+    } while (length > 0);
+    return used;
+}
+
+// Appends to a packet buffer; once something did not fit, every later
+// call is a no-op and used() returns 0
+class PacketWriter {
+public:
+    PacketWriter(uint8_t* out, size_t size) : out_(out), size_(size), used_(0), ok_(true) {}
+
+    void byte(uint8_t value) { bytes(&value, 1); }
+
+    void bytes(const void* data, size_t size) {
+        if (!ok_ || size > size_ - used_) {
+            ok_ = false;
+            return;
+        }
+        memcpy(out_ + used_, data, size);
+        used_ += size;
+    }
+
+    void word(uint16_t value) {
+        byte((uint8_t)(value >> 8));
+        byte((uint8_t)value);
+    }
+
+    void string(const char* text) {
+        size_t length = strlen(text);
+        if (length > 0xFFFF) {
+            ok_ = false;
+            return;
+        }
+        word((uint16_t)length);
+        bytes(text, length);
+    }
+
+    // Fixed header for a body of bodyLength bytes
+    void header(uint8_t first, uint32_t bodyLength) {
+        uint8_t length[4];
+        size_t lengthBytes = mqttEncodeLength(bodyLength, length);
+        ok_ = ok_ && lengthBytes > 0;
+        byte(first);
+        bytes(length, lengthBytes);
+    }
+
+    size_t used() const { return ok_ ? used_ : 0; }
+
+private:
+    uint8_t* out_;
+    size_t size_;
+    size_t used_;
+    bool ok_;
+};
+
+static size_t stringBytes(const char* text) {
+    return 2 + strlen(text);
+}
+
+// ============================================================================
+// PACKET READER
+// ============================================================================
+
+MqttReader::MqttReader(uint8_t* body, size_t bodyCapacity) : body_(body), capacity_(bodyCapacity) {
+    reset();
+}
+
+void MqttReader::reset() {
+    stage_ = STAGE_HEADER;
+    header_ = 0;
+    lengthBytes_ = 0;
+    length_ = 0;
+    received_ = 0;
+}
+
+size_t MqttReader::feed(const uint8_t* data, size_t size) {
+    if (stage_ == STAGE_DONE) {
+        reset();
+    }
+    size_t taken = 0;
+    while (taken < size && stage_ != STAGE_DONE && stage_ != STAGE_MALFORMED) {
+        uint8_t value = data[taken];
+        if (stage_ == STAGE_HEADER) {
+            header_ = value;
+            stage_ = STAGE_LENGTH;
+            taken++;
+        } else if (stage_ == STAGE_LENGTH) {
+            length_ |= (uint32_t)(value & 0x7F) << (7 * lengthBytes_);
+            lengthBytes_++;
+            taken++;
+            if ((value & 0x80) == 0) {
+                stage_ = length_ > 0 ? STAGE_BODY : STAGE_DONE;
+            } else if (lengthBytes_ == 4) {
+                stage_ = STAGE_MALFORMED;
+            }
+        } else {
+            size_t chunk = size - taken < length_ - received_ ? size - taken : length_ - received_;
+            if (received_ < capacity_) {
+                size_t kept = capacity_ - received_ < chunk ? capacity_ - received_ : chunk;
+                memcpy(body_ + received_, data + taken, kept);
+            }
+            received_ += (uint32_t)chunk;
+            taken += chunk;
+            if (received_ == length_) {
+                stage_ = STAGE_DONE;
+            }
+        }
+    }
+    return taken;
+}
+
+// ============================================================================
+// SESSION
+// ============================================================================
+
+MqttSession::MqttSession(MqttMessage* slots, uint8_t capacity, const MqttConfig& config)
+    : slots_(slots), capacity_(capacity), config_(config), reader_(readBody_, sizeof(readBody_)) {
+    begin();
+}
+
+void MqttSession::begin() {
+    memset(slots_, 0, capacity_ * sizeof(MqttMessage));
+    reader_.reset();
+    state_ = MQTT_DISCONNECTED;
+    refusedCode_ = 0;
+    sessionPresent_ = false;
+    onlinePending_ = false;
+    pingPending_ = false;
+    lastPacketId_ = 0;
+    sequence_ = 0;
+    lastWriteMs_ = 0;
+    awaitSinceMs_ = 0;
+    connects_ = 0;
+    resumed_ = 0;
+    published_ = 0;
+    acked_ = 0;
+    resent_ = 0;
+    pings_ = 0;
+}
+
+uint8_t MqttSession::window() const {
+    uint8_t window = config_.window < MQTT_MAX_WINDOW ? config_.window : MQTT_MAX_WINDOW;
+    window = window < capacity_ ? window : capacity_;
+    return window > 0 ? window : 1;
+}
+
+size_t MqttSession::connect(uint8_t* out, size_t size, uint32_t nowMs) {
+    static const uint8_t PROTOCOL[] = {0, 4, 'M', 'Q', 'T', 'T', 4};
+
+    bool will = config_.statusTopic != NULL && config_.willMessage != NULL;
+    bool username = config_.username != NULL;
+    bool password = username && config_.password != NULL;
+    uint8_t flags = (username ? CONNECT_USERNAME : 0) | (password ? CONNECT_PASSWORD : 0) |
+                    (will ? CONNECT_WILL | CONNECT_WILL_QOS1 | CONNECT_WILL_RETAIN : 0);
+
+    uint32_t bodyLength = sizeof(PROTOCOL) + 1 + 2 + stringBytes(config_.clientId);
+    bodyLength += will ? stringBytes(config_.statusTopic) + stringBytes(config_.willMessage) : 0;
+    bodyLength += username ? stringBytes(config_.username) : 0;
+    bodyLength += password ? stringBytes(config_.password) : 0;
+
+    PacketWriter packet(out, size);
+    packet.header(MQTT_CONNECT << 4, bodyLength);
+    packet.bytes(PROTOCOL, sizeof(PROTOCOL));
+    packet.byte(flags);   // Clean Session stays clear: the session persists
+    packet.word(config_.keepAliveS);
+    packet.string(config_.clientId);
+    if (will) {
+        packet.string(config_.statusTopic);
+        packet.string(config_.willMessage);
+    }
+    if (username) {
+        packet.string(config_.username);
+    }
+    if (password) {
+        packet.string(config_.password);
+    }
+    if (packet.used() == 0) {
+        return 0;
+    }
+
+    // Whatever was written on an earlier connection goes again
+    connectionLost();
+    state_ = MQTT_CONNECTING;
+    lastWriteMs_ = nowMs;
+    awaitSinceMs_ = nowMs;
+    return packet.used();
+}
+
+size_t MqttSession::disconnect(uint8_t* out, size_t size) {
+    PacketWriter packet(out, size);
+    packet.header(MQTT_DISCONNECT << 4, 0);
+    connectionLost();
+    return packet.used();
+}
+
+void MqttSession::connectionLost() {
+    for (uint8_t i = 0; i < capacity_; i++) {
+        if (slots_[i].packetId != 0 && slots_[i].written) {
+            slots_[i].written = false;
+            slots_[i].dup = true;
+        }
+    }
+    reader_.reset();
+    state_ = MQTT_DISCONNECTED;
+    onlinePending_ = false;
+    pingPending_ = false;
+}
+
+void MqttSession::receive(const uint8_t* data, size_t size) {
+    while (size > 0 && state_ != MQTT_DISCONNECTED) {
+        size_t taken = reader_.feed(data, size);
+        data += taken;
+        size -= taken;
+        if (reader_.malformed()) {
+            connectionLost();
+            return;
+        }
+        if (reader_.complete()) {
+            handlePacket();
+        }
+    }
+}
+
+// Anything but CONNACK, PUBACK and PINGRESP is skipped: nothing is
+// subscribed, so the broker has nothing else to send
+void MqttSession::handlePacket() {
+    const uint8_t* body = reader_.body();
+    bool twoBytes = reader_.length() == 2;
+
+    if (reader_.type() == MQTT_CONNACK && twoBytes && state_ == MQTT_CONNECTING) {
+        refusedCode_ = body[1];
+        if (refusedCode_ != 0) {
+            state_ = MQTT_REFUSED;
+            return;
+        }
+        state_ = MQTT_CONNECTED;
+        sessionPresent_ = (body[0] & 0x01) != 0;
+        connects_++;
+        resumed_ += sessionPresent_ ? 1 : 0;
+        onlinePending_ = config_.statusTopic != NULL && config_.onlineMessage != NULL;
+    } else if (reader_.type() == MQTT_PUBACK && twoBytes) {
+        uint16_t packetId = (uint16_t)(body[0] << 8 | body[1]);
+        for (uint8_t i = 0; i < capacity_; i++) {
+            if (slots_[i].packetId == packetId && slots_[i].written) {
+                slots_[i].packetId = 0;
+                acked_++;
+                break;
+            }
+        }
+    } else if (reader_.type() == MQTT_PINGRESP) {
+        pingPending_ = false;
+    }
+}
+
+uint16_t MqttSession::publish(const char* topic, const uint8_t* payload, size_t size, bool retain) {
+    size_t topicLength = strlen(topic);
+    if (windowFull() || topicLength == 0 || topicLength >= MQTT_TOPIC_BYTES || size > MQTT_PAYLOAD_BYTES) {
+        return 0;
+    }
+
+    // Ids in flight are skipped; with the window far below 65535 one is
+    // always free
+    uint16_t packetId = lastPacketId_;
+    do {
+        packetId = packetId == 0xFFFF ? 1 : packetId + 1;
+    } while (inFlight(packetId));
+    lastPacketId_ = packetId;
+
+    MqttMessage* message = NULL;
+    for (uint8_t i = 0; i < capacity_ && message == NULL; i++) {
+        message = slots_[i].packetId == 0 ? &slots_[i] : NULL;
+    }
+    message->packetId = packetId;
+    message->sequence = sequence_++;
+    message->written = false;
+    message->dup = false;
+    message->retain = retain;
+    message->payloadBytes = (uint16_t)size;
+    memcpy(message->topic, topic, topicLength + 1);
+    memcpy(message->payload, payload, size);
+    published_++;
+    return packetId;
+}
+
+MqttMessage* MqttSession::nextUnwritten() {
+    MqttMessage* oldest = NULL;
+    for (uint8_t i = 0; i < capacity_; i++) {
+        MqttMessage& message = slots_[i];
+        if (message.packetId != 0 && !message.written &&
+            (oldest == NULL || (int32_t)(message.sequence - oldest->sequence) < 0)) {
+            oldest = &message;
+        }
+    }
+    return oldest;
+}
+
+size_t MqttSession::encodePublish(const MqttMessage& message, uint8_t* out, size_t size) {
+    uint8_t flags = PUBLISH_QOS1 | (message.dup ? PUBLISH_DUP : 0) | (message.retain ? PUBLISH_RETAIN : 0);
+    PacketWriter packet(out, size);
+    packet.header(MQTT_PUBLISH << 4 | flags, (uint32_t)(stringBytes(message.topic) + 2 + message.payloadBytes));
+    packet.string(message.topic);
+    packet.word(message.packetId);
+    packet.bytes(message.payload, message.payloadBytes);
+    return packet.used();
+}
+
+size_t MqttSession::nextPacket(uint8_t* out, size_t size, uint32_t nowMs) {
+    if (state_ != MQTT_CONNECTED) {
+        return 0;
+    }
+
+    PacketWriter packet(out, size);
+    if (onlinePending_) {
+        // QoS 0: if it is lost, so is the connection, and the will goes out
+        uint32_t bodyLength = (uint32_t)(stringBytes(config_.statusTopic) + strlen(config_.onlineMessage));
+        packet.header(MQTT_PUBLISH << 4 | PUBLISH_RETAIN, bodyLength);
+        packet.string(config_.statusTopic);
+        packet.bytes(config_.onlineMessage, strlen(config_.onlineMessage));
+        onlinePending_ = false;
+    } else if (MqttMessage* message = nextUnwritten()) {
+        size_t used = encodePublish(*message, out, size);
+        if (used == 0) {
+            return 0;
+        }
+        resent_ += message->dup ? 1 : 0;
+        message->written = true;
+        lastWriteMs_ = nowMs;
+        return used;
+    } else if (!pingPending_ && msUntilNextTimer(nowMs) == 0) {
+        packet.header(MQTT_PINGREQ << 4, 0);
+        pingPending_ = true;
+        awaitSinceMs_ = nowMs;
+        pings_++;
+    } else {
+        return 0;
+    }
+    lastWriteMs_ = nowMs;
+    return packet.used();
+}
+
+bool MqttSession::inFlight(uint16_t packetId) const {
+    for (uint8_t i = 0; i < capacity_; i++) {
+        if (slots_[i].packetId == packetId && packetId != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t MqttSession::inFlightCount() const {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < capacity_; i++) {
+        count += slots_[i].packetId != 0 ? 1 : 0;
+    }
+    return count;
+}
+
+bool MqttSession::responseOverdue(uint32_t nowMs) const {
+    bool awaiting = state_ == MQTT_CONNECTING || (state_ == MQTT_CONNECTED && pingPending_);
+    return awaiting && timeReached(nowMs, awaitSinceMs_ + config_.responseTimeoutMs);
+}
+
+uint32_t MqttSession::msUntilNextTimer(uint32_t nowMs) const {
+    if (state_ == MQTT_CONNECTING || (state_ == MQTT_CONNECTED && pingPending_)) {
+        return timeUntil(nowMs, awaitSinceMs_ + config_.responseTimeoutMs);
+    }
+    if (state_ != MQTT_CONNECTED || config_.keepAliveS == 0) {
+        return UINT32_MAX;
+    }
+    return timeUntil(nowMs, lastWriteMs_ + (uint32_t)config_.keepAliveS * 750);
+}
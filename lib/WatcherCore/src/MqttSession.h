@@ -0,0 +1,216 @@
+// ============================================================================
+// MQTT SESSION
+// ============================================================================
+//
+// The publishing side of an MQTT 3.1.1 client, without the socket: the
+// session encodes the packets to write and decodes what the broker sends,
+// and the caller moves the bytes (lib/Watcher/src/MqttProbe.cpp over one
+// long-lived secure connection; src/host/mqtt.cpp's broker stand-in uses
+// MqttReader on the other end).
+//
+// - The session is persistent: CONNECT goes without Clean Session, and
+//   QoS 1 publishes the broker has not acknowledged keep their slots across
+//   connections. After the next CONNACK they are written again, DUP set,
+//   before anything new.
+// - At most config.window publishes are in flight; publish() refuses more
+//   until PUBACKs free a slot.
+// - Every CONNECT registers a will on config.statusTopic, so the broker
+//   announces the device offline as soon as the connection drops without a
+//   DISCONNECT, or after one and a half keep-alive periods of silence. The
+//   online message replaces it (retained, QoS 0) after each CONNACK.
+// - Keep-alive: a PINGREQ is due once nothing was written for three
+//   quarters of the period. responseOverdue() tells when a CONNACK or
+//   PINGRESP is later than config.responseTimeoutMs, at which point the
+//   connection should be given up.
+//
+// The caller provides the slots of the messages awaiting an acknowledgement.
+//
+
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <WatcherTime.h>
+
+const size_t MQTT_TOPIC_BYTES = 96;
+const size_t MQTT_PAYLOAD_BYTES = 128;   // A heartbeat relay summary fits
+const uint8_t MQTT_MAX_WINDOW = 8;
+
+// Largest packet the session writes: a PUBLISH with both at their limit
+const size_t MQTT_PACKET_BYTES = 5 + 2 + MQTT_TOPIC_BYTES + 2 + MQTT_PAYLOAD_BYTES;
+
+enum MqttPacketType : uint8_t {
+    MQTT_CONNECT = 1,
+    MQTT_CONNACK = 2,
+    MQTT_PUBLISH = 3,
+    MQTT_PUBACK = 4,
+    MQTT_PINGREQ = 12,
+    MQTT_PINGRESP = 13,
+    MQTT_DISCONNECT = 14,
+};
+
+enum MqttSessionState : uint8_t {
+    MQTT_DISCONNECTED = 0,
+    MQTT_CONNECTING,              // CONNECT written, CONNACK pending
+    MQTT_CONNECTED,
+    MQTT_REFUSED,                 // CONNACK with a return code (refusedCode())
+};
+
+struct MqttConfig {
+    const char* clientId;         // Also the key of the session on the broker
+    const char* username;         // NULL: none
+    const char* password;         // NULL: none (needs a username)
+    uint16_t keepAliveS;
+    const char* statusTopic;      // NULL: no will and no online message
+    const char* willMessage;      // Retained, published by the broker for us
+    const char* onlineMessage;    // Retained, published after every CONNACK
+    uint8_t window;               // QoS 1 publishes in flight, 1..MQTT_MAX_WINDOW
+    uint32_t responseTimeoutMs;   // For CONNACK and PINGRESP
+};
+
+// One QoS 1 publish not acknowledged yet (about 240 bytes); packet id 0
+// marks a free slot
+struct MqttMessage {
+    uint16_t packetId;
+    uint32_t sequence;            // Written in this order
+    bool written;                 // On the current connection
+    bool dup;                     // On an earlier one: DUP on the next write
+    bool retain;
+    uint16_t payloadBytes;
+    char topic[MQTT_TOPIC_BYTES];
+    uint8_t payload[MQTT_PAYLOAD_BYTES];
+};
+
+// ============================================================================
+// PACKET READER
+// ============================================================================
+
+// Splits a byte stream into packets. The first bodyCapacity bytes of each
+// body are kept in the caller's buffer, the rest is only counted.
+class MqttReader {
+public:
+    MqttReader(uint8_t* body, size_t bodyCapacity);
+
+    void reset();
+
+    // Takes bytes up to the end of one packet; returns how many it took.
+    // Check complete() afterwards, and hand the rest in again.
+    size_t feed(const uint8_t* data, size_t size);
+
+    bool complete() const { return stage_ == STAGE_DONE; }
+    bool malformed() const { return stage_ == STAGE_MALFORMED; }
+    uint8_t type() const { return header_ >> 4; }
+    uint8_t flags() const { return header_ & 0x0F; }
+    uint32_t length() const { return length_; }           // Of the body
+    const uint8_t* body() const { return body_; }
+    size_t bodyKept() const { return length_ < capacity_ ? length_ : capacity_; }
+
+private:
+    enum Stage : uint8_t { STAGE_HEADER, STAGE_LENGTH, STAGE_BODY, STAGE_DONE, STAGE_MALFORMED };
+
+    uint8_t* body_;
+    size_t capacity_;
+    uint8_t stage_;
+    uint8_t header_;
+    uint8_t lengthBytes_;
+    uint32_t length_;
+    uint32_t received_;
+};
+
+// Largest Remaining Length: four bytes of seven bits
+const uint32_t MQTT_MAX_LENGTH = 0x0FFFFFFF;
+
+// Remaining Length field into out (up to 4 bytes); returns its size, 0
+// when length is over MQTT_MAX_LENGTH
+size_t mqttEncodeLength(uint32_t length, uint8_t* out);
+
+// ============================================================================
+// SESSION
+// ============================================================================
+
+class MqttSession {
+public:
+    MqttSession(MqttMessage* slots, uint8_t capacity, const MqttConfig& config);
+
+    // Forget every message (a clean start)
+    void begin();
+
+    // A new connection is up: CONNECT into out. Returns its size, 0 when it
+    // does not fit (MQTT_PACKET_BYTES always does for short credentials).
+    size_t connect(uint8_t* out, size_t size, uint32_t nowMs);
+
+    // DISCONNECT into out (2 bytes): the broker drops the will. The
+    // connection is taken to be closed afterwards.
+    size_t disconnect(uint8_t* out, size_t size);
+
+    // The connection is gone: publishes written on it go again on the next
+    // one
+    void connectionLost();
+
+    // Bytes read from the connection
+    void receive(const uint8_t* data, size_t size);
+
+    // Queue a QoS 1 publish. Returns its packet id, 0 when the window is
+    // full or topic and payload do not fit a slot.
+    uint16_t publish(const char* topic, const uint8_t* payload, size_t size, bool retain);
+
+    // Next packet to write while CONNECTED: the online message, publishes
+    // not written on this connection yet (oldest first), then a due
+    // PINGREQ. Returns its size, 0 for nothing to write.
+    size_t nextPacket(uint8_t* out, size_t size, uint32_t nowMs);
+
+    // Whether packetId is still waiting for its PUBACK
+    bool inFlight(uint16_t packetId) const;
+    uint8_t inFlightCount() const;
+    bool windowFull() const { return inFlightCount() >= window(); }
+
+    // CONNACK or PINGRESP later than the response timeout
+    bool responseOverdue(uint32_t nowMs) const;
+
+    // Time until nextPacket() has a PINGREQ to write or, with a CONNACK or
+    // PINGRESP outstanding, until it is overdue (UINT32_MAX: neither)
+    uint32_t msUntilNextTimer(uint32_t nowMs) const;
+
+    MqttSessionState state() const { return (MqttSessionState)state_; }
+    uint8_t refusedCode() const { return refusedCode_; }     // CONNACK return code
+    bool sessionPresent() const { return sessionPresent_; }  // Of the last CONNACK
+
+    uint32_t connects() const { return connects_; }      // Accepted CONNACKs
+    uint32_t resumed() const { return resumed_; }        // ... with the session present
+    uint32_t published() const { return published_; }    // Accepted by publish()
+    uint32_t acked() const { return acked_; }
+    uint32_t resent() const { return resent_; }          // Writes with DUP set
+    uint32_t pings() const { return pings_; }
+
+private:
+    uint8_t window() const;
+    MqttMessage* nextUnwritten();
+    size_t encodePublish(const MqttMessage& message, uint8_t* out, size_t size);
+    void handlePacket();
+
+    MqttMessage* slots_;
+    uint8_t capacity_;
+    MqttConfig config_;
+    MqttReader reader_;
+    uint8_t readBody_[4];         // CONNACK and PUBACK bodies are 2 bytes
+    uint8_t state_;
+    uint8_t refusedCode_;
+    bool sessionPresent_;
+    bool onlinePending_;
+    bool pingPending_;
+    uint16_t lastPacketId_;
+    uint32_t sequence_;
+    uint32_t lastWriteMs_;
+    uint32_t awaitSinceMs_;       // CONNECT or PINGREQ written
+    uint32_t connects_;
+    uint32_t resumed_;
+    uint32_t published_;
+    uint32_t acked_;
+    uint32_t resent_;
+    uint32_t pings_;
+};
+
+const char* mqttConnackName(uint8_t code);
+
+#endif // MQTT_SESSION_H
@@ -0,0 +1,114 @@
+// ============================================================================
+// NETWORK TIMING TRACE
+// ============================================================================
+//
+// Compact per-request records of phase timings and outcomes. The firmware
+// keeps the most recent ones in a ring buffer and dumps them over serial;
+// scripts/trace_extract.py turns the dump into a .svtr file, which the
+// native replay tool (src/host/replay.cpp) feeds back to the stand-in server.
+//
+// File layout (.svtr, little-endian like both the ESP32 and x86 hosts):
+//   TraceFileHeader, then header.count TraceRecord entries, oldest first.
+//
+
+#ifndef NET_TRACE_H
+#define NET_TRACE_H
+
+#include <stdint.h>
+
+const uint32_t TRACE_MAGIC = 0x52545653;   // "SVTR"
+const uint16_t TRACE_VERSION = 1;
+
+enum TraceOutcome : uint8_t {
+    TRACE_OK = 0,             // HTTP 200
+    TRACE_HTTP_ERROR,         // Any other HTTP status
+    TRACE_CONNECT_FAILED,     // DNS/TCP/TLS setup failed
+    TRACE_SEND_FAILED,        // Request could not be written
+    TRACE_CONNECTION_LOST,    // Peer closed before the response was complete
+    TRACE_TIMEOUT,            // No (complete) response within the timeout
+    TRACE_OTHER_ERROR,
+    TRACE_HUNG,               // Still running at the watchdog's hard deadline
+    TRACE_RATE_LIMITED,       // HTTP 429: deferred, not counted as a failure
+};
+
+// One request. Phase times are in milliseconds, saturated at 65535.
+// Phases the HTTP path cannot observe are left at 0.
+struct TraceRecord {
+    uint32_t startMs;         // millis() when the request was dispatched
+    uint16_t connectMs;       // connect(): DNS + TCP + TLS handshake
+    uint16_t firstByteMs;     // Request sent until the status line arrived
+    uint16_t transferMs;      // Headers and body
+    int16_t status;           // HTTP status, or negative client error code
+    uint16_t bodyBytes;       // Saturated at 65535
+    uint8_t endpoint;         // 1-based endpoint index, saturated at 255
+    uint8_t outcome;          // TraceOutcome
+};
+
+struct TraceFileHeader {
+    uint32_t magic;           // TRACE_MAGIC
+    uint16_t version;         // TRACE_VERSION
+    uint16_t recordSize;      // sizeof(TraceRecord)
+    uint32_t count;           // Number of records that follow
+    uint32_t dropped;         // Records overwritten before the dump
+};
+
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord layout is part of the file format");
+static_assert(sizeof(TraceFileHeader) == 16, "TraceFileHeader layout is part of the file format");
+
+inline uint16_t traceSaturate(uint32_t value) {
+    return value > 0xFFFF ? 0xFFFF : (uint16_t)value;
+}
+
+// Nothing came back at all: no connection, or a connection that went
+// silent. Points at the radio link or the path beyond it, unlike an HTTP
+// error or a client-side failure.
+inline bool traceUnanswered(uint8_t outcome) {
+    return outcome == TRACE_CONNECT_FAILED || outcome == TRACE_SEND_FAILED || outcome == TRACE_CONNECTION_LOST ||
+           outcome == TRACE_TIMEOUT || outcome == TRACE_HUNG;
+}
+
+// Trace number of a 0-based endpoint index. Endpoints past the 255th (from
+// a large endpoint table) all share 255 in traces.
+inline uint8_t traceEndpoint(uint16_t index) {
+    return index < 0xFF ? (uint8_t)(index + 1) : 0xFF;
+}
+
+// Fixed-size ring buffer over caller-provided storage; the oldest record is
+// overwritten when full. Not thread-safe: append from one task only.
+class TraceBuffer {
+public:
+    TraceBuffer(TraceRecord* storage, uint16_t capacity)
+        : storage_(storage), capacity_(capacity), head_(0), count_(0), dropped_(0) {}
+
+    void append(const TraceRecord& record) {
+        storage_[head_] = record;
+        head_ = (uint16_t)((head_ + 1) % capacity_);
+        if (count_ < capacity_) {
+            count_++;
+        } else {
+            dropped_++;
+        }
+    }
+
+    // index 0 is the oldest record still held
+    const TraceRecord& at(uint16_t index) const {
+        return storage_[(head_ + capacity_ - count_ + index) % capacity_];
+    }
+
+    uint16_t count() const { return count_; }
+    uint32_t dropped() const { return dropped_; }
+
+    void clear() {
+        count_ = 0;
+        dropped_ = 0;
+    }
+
+private:
+    TraceRecord* storage_;
+    uint16_t capacity_;
+    uint16_t head_;
+    uint16_t count_;
+    uint32_t dropped_;
+};
+
+#endif // NET_TRACE_H
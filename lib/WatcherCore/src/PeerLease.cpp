@@ -0,0 +1,206 @@
+#include <PeerLease.h>
+
+static const uint8_t PEER_MAGIC[4] = { 'S', 'V', 'P', 'L' };
+static const uint8_t PEER_VERSION = 1;
+
+static const char* const ROLE_NAMES[] = {"alone", "candidate", "follower", "leader"};
+
+const char* peerRoleName(uint8_t role) {
+    return role <= PEER_LEADER ? ROLE_NAMES[role] : "?";
+}
+
+// ============================================================================
+// WIRE FORMAT
+// ============================================================================
+
+static uint8_t* put16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    return out + 2;
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t value) {
+    return put16(put16(out, (uint16_t)value), (uint16_t)(value >> 16));
+}
+
+static uint16_t get16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* in) {
+    return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+// magic[4] version role group node term endpoints down
+size_t peerEncode(const PeerMessage& message, uint8_t* buffer) {
+    uint8_t* out = buffer;
+    for (uint8_t i = 0; i < sizeof(PEER_MAGIC); i++) {
+        *out++ = PEER_MAGIC[i];
+    }
+    *out++ = PEER_VERSION;
+    *out++ = message.role;
+    out = put32(out, message.group);
+    out = put32(out, message.node);
+    out = put32(out, message.term);
+    out = put16(out, message.endpoints);
+    out = put16(out, message.down);
+    return (size_t)(out - buffer);
+}
+
+bool peerDecode(const uint8_t* data, size_t size, PeerMessage* message) {
+    if (size != PEER_MESSAGE_BYTES || data[4] != PEER_VERSION) {
+        return false;
+    }
+    for (uint8_t i = 0; i < sizeof(PEER_MAGIC); i++) {
+        if (data[i] != PEER_MAGIC[i]) {
+            return false;
+        }
+    }
+    message->role = data[5];
+    message->group = get32(data + 6);
+    message->node = get32(data + 10);
+    message->term = get32(data + 14);
+    message->endpoints = get16(data + 18);
+    message->down = get16(data + 20);
+    return message->role >= PEER_CANDIDATE && message->role <= PEER_LEADER && message->node != 0;
+}
+
+// ============================================================================
+// ELECTION
+// ============================================================================
+
+PeerLease::PeerLease(const PeerConfig& config)
+    : config_(config), node_(0), group_(0), role_(PEER_ALONE), term_(0), leader_(0), leaderHeardMs_(0),
+      leaderDown_(0), listenUntilMs_(0), candidacyEndMs_(0), lowerHeardMs_(0), lowerHeard_(false),
+      nextHeartbeatMs_(0), takeovers_(0), received_(0) {
+}
+
+void PeerLease::begin(uint32_t node, uint32_t group, uint32_t nowMs) {
+    node_ = node;
+    group_ = group;
+    term_ = 0;
+    takeovers_ = 0;
+    received_ = 0;
+    role_ = PEER_ALONE;
+    if (enabled()) {
+        rejoin(nowMs);
+    }
+}
+
+void PeerLease::rejoin(uint32_t nowMs) {
+    if (!enabled()) {
+        return;
+    }
+    role_ = PEER_CANDIDATE;
+    leader_ = 0;
+    leaderDown_ = 0;
+    lowerHeard_ = false;
+    listenUntilMs_ = nowMs + config_.leaseMs;
+    candidacyEndMs_ = listenUntilMs_;
+    nextHeartbeatMs_ = nowMs;
+}
+
+bool PeerLease::heartbeatDue(uint32_t nowMs) const {
+    return enabled() && timeReached(nowMs, nextHeartbeatMs_);
+}
+
+PeerMessage PeerLease::heartbeat(uint16_t endpoints, uint16_t down, uint32_t nowMs) {
+    nextHeartbeatMs_ = nowMs + config_.heartbeatMs;
+    PeerMessage message = { group_, node_, term_, role_, endpoints, down };
+    return message;
+}
+
+PeerChange PeerLease::receive(const PeerMessage& message, uint32_t nowMs) {
+    if (!enabled() || message.group != group_ || message.node == node_) {
+        return PEER_UNCHANGED;
+    }
+    received_++;
+    if (message.node < node_) {
+        lowerHeard_ = true;
+        lowerHeardMs_ = nowMs;
+    }
+    if (message.role != PEER_LEADER) {
+        // A candidate that knows a later term must not claim an earlier one
+        if (role_ != PEER_LEADER && role_ != PEER_FOLLOWER && message.term > term_) {
+            term_ = message.term;
+        }
+        return PEER_UNCHANGED;
+    }
+
+    if (role_ == PEER_FOLLOWER && message.node == leader_) {
+        leaderHeardMs_ = nowMs;
+        leaderDown_ = message.down;
+        return PEER_UNCHANGED;
+    }
+
+    // Another leader: the higher term wins, then the lower node id
+    bool wins = message.term > term_ || (message.term == term_ && (leader_ == 0 || message.node < leader_));
+    if (role_ == PEER_CANDIDATE || wins) {
+        return follow(message, nowMs);
+    }
+    if (role_ == PEER_LEADER) {
+        // Let the loser hear about this leader right away
+        nextHeartbeatMs_ = nowMs;
+    }
+    return PEER_UNCHANGED;
+}
+
+PeerChange PeerLease::update(uint32_t nowMs) {
+    if (role_ == PEER_FOLLOWER && timeReached(nowMs, leaderHeardMs_ + config_.leaseMs)) {
+        role_ = PEER_CANDIDATE;
+        candidacyEndMs_ = nowMs + config_.leaseMs;
+        return PEER_LEADER_LOST;
+    }
+    if (role_ == PEER_CANDIDATE && timeReached(nowMs, listenUntilMs_) &&
+        (!lowerPeerAlive(nowMs) || timeReached(nowMs, candidacyEndMs_))) {
+        return claim(nowMs);
+    }
+    return PEER_UNCHANGED;
+}
+
+// A follower whose leader's lease runs out reports that first and claims
+// (when it may) on the next update, which is due right away
+uint32_t PeerLease::msUntilNextTimer(uint32_t nowMs) const {
+    if (!enabled()) {
+        return UINT32_MAX;
+    }
+    uint32_t waitMs = timeUntil(nowMs, nextHeartbeatMs_);
+    uint32_t timeoutMs = UINT32_MAX;
+    if (role_ == PEER_FOLLOWER) {
+        timeoutMs = timeUntil(nowMs, leaderHeardMs_ + config_.leaseMs);
+    } else if (role_ == PEER_CANDIDATE && !timeReached(nowMs, listenUntilMs_)) {
+        timeoutMs = timeUntil(nowMs, listenUntilMs_);
+    } else if (role_ == PEER_CANDIDATE) {
+        timeoutMs = timeUntil(nowMs, candidacyEndMs_);
+        if (lowerPeerAlive(nowMs)) {
+            uint32_t lowerMs = timeUntil(nowMs, lowerHeardMs_ + config_.leaseMs);
+            timeoutMs = lowerMs < timeoutMs ? lowerMs : timeoutMs;
+        } else {
+            timeoutMs = 0;
+        }
+    }
+    return waitMs < timeoutMs ? waitMs : timeoutMs;
+}
+
+PeerChange PeerLease::claim(uint32_t nowMs) {
+    role_ = PEER_LEADER;
+    term_++;
+    leader_ = node_;
+    leaderDown_ = 0;
+    takeovers_++;
+    nextHeartbeatMs_ = nowMs;   // Tell the others at once
+    return PEER_LEADING;
+}
+
+PeerChange PeerLease::follow(const PeerMessage& message, uint32_t nowMs) {
+    role_ = PEER_FOLLOWER;
+    term_ = message.term;
+    leader_ = message.node;
+    leaderHeardMs_ = nowMs;
+    leaderDown_ = message.down;
+    return PEER_FOLLOWING;
+}
+
+bool PeerLease::lowerPeerAlive(uint32_t nowMs) const {
+    return lowerHeard_ && !timeReached(nowMs, lowerHeardMs_ + config_.leaseMs);
+}
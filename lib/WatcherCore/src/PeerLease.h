@@ -0,0 +1,138 @@
+// ============================================================================
+// PEER LEASE
+// ============================================================================
+//
+// Lease-based leader election among watchers on one LAN that poll the same
+// endpoints, so that only one of them sends the upstream pings. Every
+// watcher announces itself every heartbeatMs (over UDP multicast, see
+// lib/Watcher/src/peer_link.cpp); the leader's announcement doubles as its
+// lease:
+//
+// - A watcher starts as a candidate and listens for one lease before it
+//   may claim anything, so a reboot never takes the lead from a live
+//   leader.
+// - A candidate claims the lead when it has heard no peer with a lower
+//   node id within the last lease, or when its candidacy has lasted a lease
+//   without any leader showing up. A claim takes the next term.
+// - Followers hold off polling while the leader's heartbeats keep coming.
+//   A leader not heard from for leaseMs has lost its lease: its followers
+//   become candidates again, and the lowest of them claims at once. With a
+//   lease shorter than the poll interval, the lead changes hands within one
+//   interval.
+// - Two leaders (simultaneous claims, a healed partition) settle on the
+//   higher term, then on the lower node id; the other steps down.
+//
+// Messages of another group (a different endpoint set) are ignored, and so
+// are a watcher's own, which multicast may loop back.
+//
+// The caller sends and receives the messages.
+//
+
+#ifndef PEER_LEASE_H
+#define PEER_LEASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <WatcherTime.h>
+
+struct PeerConfig {
+    uint32_t heartbeatMs;     // Between two announcements, 0: no peers (the watcher polls alone)
+    uint32_t leaseMs;         // A leader silent this long has lost the lead
+};
+
+enum PeerRole : uint8_t {
+    PEER_ALONE = 0,           // Coordination off: polls
+    PEER_CANDIDATE,           // No leader known: waits for one or claims
+    PEER_FOLLOWER,            // Leaves the polling to the leader
+    PEER_LEADER,              // Polls for the group
+};
+
+enum PeerChange : uint8_t {
+    PEER_UNCHANGED = 0,
+    PEER_LEADING,             // This watcher took the lead
+    PEER_FOLLOWING,           // It follows a (new) leader
+    PEER_LEADER_LOST,         // The leader's lease ran out
+};
+
+// One announcement, as it goes over the wire in PEER_MESSAGE_BYTES
+// (little-endian, see peerEncode())
+struct PeerMessage {
+    uint32_t group;           // Hash of the endpoint set
+    uint32_t node;            // Sender, unique on the LAN (from its MAC)
+    uint32_t term;            // Leader: its term; others: the highest term seen
+    uint8_t role;             // PeerRole of the sender
+    uint16_t endpoints;
+    uint16_t down;            // Leader: its endpoints currently DOWN
+};
+
+const size_t PEER_MESSAGE_BYTES = 22;
+
+size_t peerEncode(const PeerMessage& message, uint8_t* buffer);
+
+// False for anything that is not a well-formed announcement
+bool peerDecode(const uint8_t* data, size_t size, PeerMessage* message);
+
+class PeerLease {
+public:
+    explicit PeerLease(const PeerConfig& config);
+
+    // Start as a candidate (or alone, when disabled) and listen for one
+    // lease before claiming
+    void begin(uint32_t node, uint32_t group, uint32_t nowMs);
+
+    // The caller lost its network: forget the leader and listen for a
+    // whole lease again once it is back
+    void rejoin(uint32_t nowMs);
+
+    bool enabled() const { return config_.heartbeatMs > 0; }
+    PeerRole role() const { return role_; }
+
+    // Whether this watcher should poll upstream
+    bool polls() const { return role_ == PEER_ALONE || role_ == PEER_LEADER; }
+
+    // An announcement is due; heartbeat() builds it and schedules the next
+    bool heartbeatDue(uint32_t nowMs) const;
+    PeerMessage heartbeat(uint16_t endpoints, uint16_t down, uint32_t nowMs);
+
+    // A message arrived
+    PeerChange receive(const PeerMessage& message, uint32_t nowMs);
+
+    // Lease and candidacy timeouts
+    PeerChange update(uint32_t nowMs);
+
+    // Time until the next announcement or timeout (UINT32_MAX while disabled)
+    uint32_t msUntilNextTimer(uint32_t nowMs) const;
+
+    uint32_t node() const { return node_; }
+    uint32_t group() const { return group_; }
+    uint32_t leader() const { return leader_; }            // 0: none known
+    uint32_t term() const { return term_; }
+    uint16_t leaderDown() const { return leaderDown_; }    // As last announced by the leader
+    uint32_t takeovers() const { return takeovers_; }      // Leads taken since begin()
+    uint32_t received() const { return received_; }        // Messages of the group from others
+
+private:
+    PeerChange claim(uint32_t nowMs);
+    PeerChange follow(const PeerMessage& message, uint32_t nowMs);
+    bool lowerPeerAlive(uint32_t nowMs) const;
+
+    PeerConfig config_;
+    uint32_t node_;
+    uint32_t group_;
+    PeerRole role_;
+    uint32_t term_;                // Of the current leader, or the highest seen
+    uint32_t leader_;
+    uint32_t leaderHeardMs_;
+    uint16_t leaderDown_;
+    uint32_t listenUntilMs_;       // No claims before this
+    uint32_t candidacyEndMs_;      // Claim regardless of lower peers from then on
+    uint32_t lowerHeardMs_;        // Last message from a lower node id
+    bool lowerHeard_;
+    uint32_t nextHeartbeatMs_;
+    uint32_t takeovers_;
+    uint32_t received_;
+};
+
+const char* peerRoleName(uint8_t role);
+
+#endif // PEER_LEASE_H
@@ -0,0 +1,159 @@
+#include <PollScheduler.h>
+
+PollScheduler::PollScheduler(EndpointRuntime* endpoints, uint16_t count, const SchedulerConfig& config)
+    : endpoints_(endpoints), count_(count), config_(config), cursor_(0) {
+}
+
+void PollScheduler::begin(uint32_t nowMs) {
+    for (uint16_t i = 0; i < count_; i++) {
+        EndpointRuntime& endpoint = endpoints_[i];
+        endpoint.nextDueMs = nowMs;
+        endpoint.lastDispatchMs = nowMs;
+        endpoint.lastChangeMs = nowMs;
+        endpoint.consecutiveFailures = 0;
+        endpoint.intervalScale = 1;
+        endpoint.health = HEALTH_UNKNOWN;
+        endpoint.inFlight = false;
+    }
+    cursor_ = 0;
+}
+
+// The scan starts where the previous one stopped, so when more endpoints
+// are due than fit into due[], every one of them gets its turn
+uint16_t PollScheduler::collectDue(uint32_t nowMs, uint16_t* due, uint16_t maxDue) {
+    uint16_t collected = 0;
+    for (uint16_t scanned = 0; scanned < count_ && collected < maxDue; scanned++) {
+        uint16_t i = cursor_;
+        cursor_ = cursor_ + 1 < count_ ? cursor_ + 1 : 0;
+
+        EndpointRuntime& endpoint = endpoints_[i];
+        if (!endpoint.inFlight && timeReached(nowMs, endpoint.nextDueMs)) {
+            endpoint.inFlight = true;
+            endpoint.lastDispatchMs = nowMs;
+            due[collected++] = i;
+        }
+    }
+    return collected;
+}
+
+uint32_t PollScheduler::msUntilNextDue(uint32_t nowMs) const {
+    uint32_t soonest = UINT32_MAX;
+    for (uint16_t i = 0; i < count_; i++) {
+        const EndpointRuntime& endpoint = endpoints_[i];
+        if (endpoint.inFlight) {
+            continue;
+        }
+        uint32_t wait = timeUntil(nowMs, endpoint.nextDueMs);
+        if (wait < soonest) {
+            soonest = wait;
+        }
+    }
+    return soonest;
+}
+
+HealthChange PollScheduler::recordResult(uint16_t index, bool success, uint32_t nowMs) {
+    EndpointRuntime& endpoint = endpoints_[index];
+    endpoint.inFlight = false;
+
+    if (success) {
+        endpoint.consecutiveFailures = 0;
+        endpoint.nextDueMs = endpoint.lastDispatchMs + config_.pollIntervalMs * endpoint.intervalScale;
+
+        uint8_t previous = endpoint.health;
+        endpoint.health = HEALTH_UP;
+        if (previous == HEALTH_DOWN) {
+            endpoint.lastChangeMs = nowMs;
+            return HEALTH_WENT_UP;
+        }
+        if (previous == HEALTH_UNKNOWN) {
+            endpoint.lastChangeMs = nowMs;
+        }
+        return HEALTH_UNCHANGED;
+    }
+
+    if (endpoint.consecutiveFailures < UINT16_MAX) {
+        endpoint.consecutiveFailures++;
+    }
+    endpoint.nextDueMs = nowMs + retryDelayMs(endpoint.consecutiveFailures);
+
+    if (endpoint.health != HEALTH_DOWN && endpoint.consecutiveFailures >= config_.failThreshold) {
+        endpoint.health = HEALTH_DOWN;
+        endpoint.lastChangeMs = nowMs;
+        return HEALTH_WENT_DOWN;
+    }
+    return HEALTH_UNCHANGED;
+}
+
+void PollScheduler::recordDeferred(uint16_t index, uint32_t nowMs, uint32_t delayMs) {
+    EndpointRuntime& endpoint = endpoints_[index];
+    endpoint.inFlight = false;
+    endpoint.nextDueMs = nowMs + delayMs;
+}
+
+void PollScheduler::setIntervalScale(uint16_t index, uint8_t scale) {
+    EndpointRuntime& endpoint = endpoints_[index];
+    if (scale == endpoint.intervalScale) {
+        return;
+    }
+    endpoint.intervalScale = scale;
+    if (!endpoint.inFlight && endpoint.health == HEALTH_UP && endpoint.consecutiveFailures == 0) {
+        endpoint.nextDueMs = endpoint.lastDispatchMs + config_.pollIntervalMs * scale;
+    }
+}
+
+uint16_t PollScheduler::expedite(uint8_t health, uint32_t nowMs) {
+    uint16_t expedited = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        EndpointRuntime& endpoint = endpoints_[i];
+        uint8_t state = endpoint.health == HEALTH_UNKNOWN ? (uint8_t)HEALTH_UP : endpoint.health;
+        if (endpoint.inFlight || state != health || timeReached(nowMs, endpoint.nextDueMs)) {
+            continue;
+        }
+        endpoint.nextDueMs = nowMs;
+        expedited++;
+    }
+    return expedited;
+}
+
+bool PollScheduler::pollNow(uint16_t index, uint32_t nowMs) {
+    EndpointRuntime& endpoint = endpoints_[index];
+    if (endpoint.inFlight) {
+        return false;
+    }
+    if (!timeReached(nowMs, endpoint.nextDueMs)) {
+        endpoint.nextDueMs = nowMs;
+    }
+    return true;
+}
+
+bool PollScheduler::retrySooner(uint16_t index, uint32_t nowMs, uint32_t delayMs) {
+    EndpointRuntime& endpoint = endpoints_[index];
+    if (endpoint.inFlight || endpoint.consecutiveFailures == 0) {
+        return false;
+    }
+    if (timeUntil(nowMs, endpoint.nextDueMs) > delayMs) {
+        endpoint.nextDueMs = nowMs + delayMs;
+    }
+    return true;
+}
+
+uint32_t PollScheduler::retryDelayMs(uint16_t failures) const {
+    if (failures == 0) {
+        return config_.pollIntervalMs;
+    }
+    uint32_t delay = config_.retryBaseMs;
+    for (uint16_t i = 1; i < failures && delay < config_.pollIntervalMs; i++) {
+        delay *= 2;
+    }
+    return delay < config_.pollIntervalMs ? delay : config_.pollIntervalMs;
+}
+
+uint16_t PollScheduler::downCount() const {
+    uint16_t down = 0;
+    for (uint16_t i = 0; i < count_; i++) {
+        if (endpoints_[i].health == HEALTH_DOWN) {
+            down++;
+        }
+    }
+    return down;
+}
@@ -0,0 +1,112 @@
+// ============================================================================
+// POLL SCHEDULER
+// ============================================================================
+//
+// Decides when each endpoint is polled and tracks its health state.
+//
+// - Every endpoint is polled once per pollIntervalMs, measured from the start
+//   of its previous request (the same cadence as the original loop()). The
+//   interval can be stretched per endpoint (see DataBudget).
+// - A failed request is retried after retryBaseMs, doubling with each
+//   consecutive failure, capped at the poll interval.
+// - An endpoint turns DOWN after failThreshold consecutive failures and back
+//   UP on its next success.
+//
+// The scheduler never reads a clock and never allocates: the caller passes
+// the current time into every call and provides the per-endpoint storage.
+// That keeps it usable from the firmware (millis()) and the host-side
+// simulator (virtual time) alike.
+//
+
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include <stdint.h>
+#include <WatcherTime.h>
+
+enum HealthState : uint8_t {
+    HEALTH_UNKNOWN = 0,   // No result yet
+    HEALTH_UP,
+    HEALTH_DOWN,
+};
+
+enum HealthChange : uint8_t {
+    HEALTH_UNCHANGED = 0,
+    HEALTH_WENT_DOWN,
+    HEALTH_WENT_UP,
+};
+
+struct SchedulerConfig {
+    uint32_t pollIntervalMs;   // Regular cadence per endpoint
+    uint32_t retryBaseMs;      // First retry delay after a failure
+    uint8_t failThreshold;     // Consecutive failures before DOWN
+};
+
+// Mutable per-endpoint state (owned by the caller, one entry per endpoint)
+struct EndpointRuntime {
+    uint32_t nextDueMs;             // When the endpoint should be polled next
+    uint32_t lastDispatchMs;        // Start of the most recent request
+    uint32_t lastChangeMs;          // Time of the last health transition
+    uint16_t consecutiveFailures;
+    uint8_t intervalScale;          // Poll interval multiple, 1 normally
+    uint8_t health;                 // HealthState
+    bool inFlight;                  // Dispatched, result not yet recorded
+};
+
+class PollScheduler {
+public:
+    PollScheduler(EndpointRuntime* endpoints, uint16_t count, const SchedulerConfig& config);
+
+    // Reset all endpoints and make them due immediately
+    void begin(uint32_t nowMs);
+
+    // Collect up to maxDue endpoints that are due at nowMs into due[] and
+    // mark them in flight, round-robin across calls. Returns the number
+    // collected.
+    uint16_t collectDue(uint32_t nowMs, uint16_t* due, uint16_t maxDue);
+
+    // Milliseconds until the next endpoint becomes due (0 if one is due now,
+    // UINT32_MAX if every endpoint is in flight)
+    uint32_t msUntilNextDue(uint32_t nowMs) const;
+
+    // Record the outcome of a dispatched request
+    HealthChange recordResult(uint16_t index, bool success, uint32_t nowMs);
+
+    // Give a dispatched endpoint back without a result (e.g. no WiFi):
+    // it is retried after delayMs and its health is left untouched
+    void recordDeferred(uint16_t index, uint32_t nowMs, uint32_t delayMs);
+
+    // Poll a healthy endpoint every scale * pollIntervalMs from now on
+    // (scale >= 1); its pending due time is moved to match. Retries after a
+    // failure are not stretched.
+    void setIntervalScale(uint16_t index, uint8_t scale);
+
+    // Make every endpoint in the given health state (UNKNOWN counts as UP)
+    // that is not in flight due at nowMs, e.g. when a cheaper check says
+    // the link changed. Returns the number of endpoints brought forward.
+    uint16_t expedite(uint8_t health, uint32_t nowMs);
+
+    // Make one endpoint due at nowMs, whatever its health (it may already
+    // be). False while it is in flight: its next due time is set when the
+    // result comes in.
+    bool pollNow(uint16_t index, uint32_t nowMs);
+
+    // Bring the retry of an endpoint that has failed forward to at most
+    // delayMs from nowMs. False while it is in flight or has not failed.
+    bool retrySooner(uint16_t index, uint32_t nowMs, uint32_t delayMs);
+
+    // Delay before the next attempt after the given number of failures
+    uint32_t retryDelayMs(uint16_t failures) const;
+
+    uint16_t count() const { return count_; }
+    uint16_t downCount() const;
+    const EndpointRuntime& endpoint(uint16_t index) const { return endpoints_[index]; }
+
+private:
+    EndpointRuntime* endpoints_;
+    uint16_t count_;
+    SchedulerConfig config_;
+    uint16_t cursor_;               // Where the next collectDue() scan starts
+};
+
+#endif // POLL_SCHEDULER_H
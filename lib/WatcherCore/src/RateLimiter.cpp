@@ -0,0 +1,154 @@
+#include <RateLimiter.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t MILLI_TOKENS = 1000;   // One token
+
+// ============================================================================
+// RETRY-AFTER
+// ============================================================================
+
+// Seconds since 1970 (negative before it) of an IMF-fixdate
+// ("Sun, 06 Nov 1994 08:49:37 GMT"); false if value is not one. The
+// obsolete RFC 850 and asctime forms are not accepted; servers must not
+// send them.
+static bool parseHttpDate(const char* value, int64_t* seconds) {
+    static const char* const MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char* comma = strchr(value, ',');
+    if (comma == NULL) {
+        return false;
+    }
+    char month[4];
+    int day, year, hour, minute, second;
+    if (sscanf(comma + 1, " %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6) {
+        return false;
+    }
+    const char* found = strstr(MONTHS, month);
+    if (found == NULL || strlen(month) != 3 || (found - MONTHS) % 3 != 0) {
+        return false;
+    }
+    int monthIndex = (int)(found - MONTHS) / 3 + 1;
+
+    // Days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's days_from_civil)
+    int y = monthIndex <= 2 ? year - 1 : year;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yearOfEra = y - era * 400;
+    int dayOfYear = (153 * (monthIndex + (monthIndex > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    int64_t days = (int64_t)era * 146097 + dayOfEra - 719468;
+    *seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+uint32_t httpRetryAfterMs(const char* retryAfter, const char* date) {
+    if (retryAfter == NULL) {
+        return 0;
+    }
+    while (*retryAfter == ' ') {
+        retryAfter++;
+    }
+
+    int64_t seconds;
+    if (isdigit((unsigned char)*retryAfter)) {
+        seconds = strtoll(retryAfter, NULL, 10);
+    } else {
+        int64_t until, now;
+        if (!parseHttpDate(retryAfter, &until) || date == NULL || !parseHttpDate(date, &now)) {
+            return 0;
+        }
+        seconds = until - now;
+    }
+    if (seconds <= 0) {
+        return 0;
+    }
+    return seconds > UINT32_MAX / 1000 ? UINT32_MAX : (uint32_t)seconds * 1000;
+}
+
+// ============================================================================
+// TOKEN BUCKETS
+// ============================================================================
+
+RateLimiter::RateLimiter(HostBucket* buckets, uint16_t count, const RateLimitConfig& config)
+    : buckets_(buckets), count_(count), config_(config) {
+}
+
+void RateLimiter::begin(uint32_t nowMs) {
+    for (uint16_t i = 0; i < count_; i++) {
+        HostBucket& bucket = buckets_[i];
+        bucket.milliTokens = (uint32_t)config_.burst * MILLI_TOKENS;
+        bucket.refilledMs = nowMs;
+        bucket.pausedUntilMs = nowMs;
+        bucket.paused = false;
+        bucket.deferrals = 0;
+        bucket.throttled = 0;
+    }
+}
+
+void RateLimiter::refill(HostBucket& bucket, uint32_t nowMs) {
+    if (bucket.paused) {
+        if (!timeReached(nowMs, bucket.pausedUntilMs)) {
+            return;
+        }
+        // One request may go out as soon as the pause ends
+        bucket.paused = false;
+        bucket.milliTokens = MILLI_TOKENS;
+        bucket.refilledMs = bucket.pausedUntilMs;
+    }
+
+    uint32_t capacity = (uint32_t)config_.burst * MILLI_TOKENS;
+    uint64_t added = (uint64_t)(nowMs - bucket.refilledMs) * config_.requestsPerMinute / 60;
+    bucket.milliTokens = added >= capacity - bucket.milliTokens ? capacity : bucket.milliTokens + (uint32_t)added;
+    bucket.refilledMs = nowMs;
+}
+
+bool RateLimiter::tryAcquire(uint16_t host, uint32_t nowMs) {
+    HostBucket& bucket = buckets_[host];
+    refill(bucket, nowMs);
+    if (bucket.paused || (enabled() && bucket.milliTokens < MILLI_TOKENS)) {
+        bucket.deferrals++;
+        return false;
+    }
+    if (enabled()) {
+        bucket.milliTokens -= MILLI_TOKENS;
+    }
+    return true;
+}
+
+uint32_t RateLimiter::msUntilAvailable(uint16_t host, uint32_t nowMs) {
+    HostBucket& bucket = buckets_[host];
+    refill(bucket, nowMs);
+    if (bucket.paused) {
+        return timeUntil(nowMs, bucket.pausedUntilMs);
+    }
+    if (!enabled() || bucket.milliTokens >= MILLI_TOKENS) {
+        return 0;
+    }
+    uint32_t missing = MILLI_TOKENS - bucket.milliTokens;
+    return (missing * 60 + config_.requestsPerMinute - 1) / config_.requestsPerMinute;
+}
+
+void RateLimiter::pause(uint16_t host, uint32_t pauseMs, uint32_t nowMs) {
+    HostBucket& bucket = buckets_[host];
+    if (pauseMs == 0) {
+        pauseMs = config_.defaultPauseMs;
+    }
+    if (pauseMs > config_.maxPauseMs) {
+        pauseMs = config_.maxPauseMs;
+    }
+
+    // A shorter pause never cuts a longer one short
+    uint32_t until = nowMs + pauseMs;
+    if (!bucket.paused || timeReached(until, bucket.pausedUntilMs)) {
+        bucket.pausedUntilMs = until;
+    }
+    bucket.paused = true;
+    bucket.milliTokens = 0;
+    bucket.throttled++;
+}
+
+bool RateLimiter::paused(uint16_t host, uint32_t nowMs) const {
+    return buckets_[host].paused && !timeReached(nowMs, buckets_[host].pausedUntilMs);
+}
@@ -0,0 +1,80 @@
+// ============================================================================
+// PER-HOST RATE LIMITER
+// ============================================================================
+//
+// A token bucket per host, shared by every endpoint on that host, so that
+// regular polls and retries together stay within the provider's rate limit
+// instead of running into 429 responses that read as failures.
+//
+// - Each bucket holds up to burst tokens and refills at requestsPerMinute.
+//   A request takes one token; without one it is deferred (not failed) until
+//   the next token is due.
+// - A 429 response, or any response carrying Retry-After, pauses the host:
+//   its bucket is emptied and stays closed for the Retry-After time
+//   (defaultPauseMs without a usable value), capped at maxPauseMs.
+//
+// The caller provides one HostBucket per host.
+//
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stdint.h>
+#include <WatcherTime.h>
+
+struct RateLimitConfig {
+    uint16_t burst;              // Bucket size: requests allowed back to back
+    uint16_t requestsPerMinute;  // Refill rate; 0 disables the limiter
+    uint32_t defaultPauseMs;     // After a 429 without a usable Retry-After
+    uint32_t maxPauseMs;         // Longest pause a server can ask for
+};
+
+// Per-host state (owned by the caller, one entry per host)
+struct HostBucket {
+    uint32_t milliTokens;        // Thousandths of a token
+    uint32_t refilledMs;         // Time milliTokens was last brought up to date
+    uint32_t pausedUntilMs;      // Valid while paused
+    bool paused;
+    uint32_t deferrals;          // Requests held back for lack of a token
+    uint32_t throttled;          // Rate-limit responses (429 / Retry-After)
+};
+
+// Milliseconds a response asks the client to wait, from its Retry-After
+// header: delta-seconds, or an HTTP-date taken relative to the response's
+// Date header (the device has no wall clock). Either may be NULL or empty.
+// Returns 0 when there is no usable value.
+uint32_t httpRetryAfterMs(const char* retryAfter, const char* date);
+
+class RateLimiter {
+public:
+    RateLimiter(HostBucket* buckets, uint16_t count, const RateLimitConfig& config);
+
+    // Fill every bucket and clear pauses and counters
+    void begin(uint32_t nowMs);
+
+    // Take a token for a request to host. Returns false (and counts a
+    // deferral) when none is available.
+    bool tryAcquire(uint16_t host, uint32_t nowMs);
+
+    // Time until host has a token again (0: one is available now)
+    uint32_t msUntilAvailable(uint16_t host, uint32_t nowMs);
+
+    // The host answered with a rate limit: hold its requests for pauseMs
+    // (0: the configured default)
+    void pause(uint16_t host, uint32_t pauseMs, uint32_t nowMs);
+
+    bool enabled() const { return config_.requestsPerMinute > 0; }
+    bool paused(uint16_t host, uint32_t nowMs) const;
+    const HostBucket& bucket(uint16_t host) const { return buckets_[host]; }
+    uint16_t count() const { return count_; }
+
+private:
+    // Bring host's tokens up to nowMs and end an expired pause
+    void refill(HostBucket& bucket, uint32_t nowMs);
+
+    HostBucket* buckets_;
+    uint16_t count_;
+    RateLimitConfig config_;
+};
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,71 @@
+#include <RequestWatchdog.h>
+
+RequestWatchdog::RequestWatchdog(WatchSlot* slots, uint16_t count, const WatchdogConfig& config)
+    : slots_(slots), count_(count), config_(config), hungCount_(0), reclaimedCount_(0) {
+    for (uint16_t i = 0; i < count_; i++) {
+        slots_[i].generation = 0;
+        slots_[i].deadlineMs = 0;
+        slots_[i].state = WATCH_IDLE;
+    }
+}
+
+uint32_t RequestWatchdog::start(uint16_t index, uint32_t nowMs) {
+    WatchSlot& slot = slots_[index];
+    slot.generation++;
+    slot.deadlineMs = nowMs + config_.hardDeadlineMs;
+    slot.state = WATCH_RUNNING;
+    return slot.generation;
+}
+
+bool RequestWatchdog::finish(uint16_t index, uint32_t generation) {
+    WatchSlot& slot = slots_[index];
+    if (slot.generation != generation || slot.state == WATCH_IDLE) {
+        return false;
+    }
+
+    bool current = slot.state == WATCH_RUNNING;
+    slot.state = WATCH_IDLE;
+    return current;
+}
+
+uint16_t RequestWatchdog::collectHung(uint32_t nowMs, uint16_t* hung, uint16_t maxHung) {
+    uint16_t collected = 0;
+    for (uint16_t i = 0; i < count_ && collected < maxHung; i++) {
+        WatchSlot& slot = slots_[i];
+        if (slot.state == WATCH_RUNNING && timeReached(nowMs, slot.deadlineMs)) {
+            slot.state = WATCH_ABANDONED;
+            slot.deadlineMs = nowMs + config_.graceMs;
+            hungCount_++;
+            hung[collected++] = i;
+        }
+    }
+    return collected;
+}
+
+uint16_t RequestWatchdog::collectReclaim(uint32_t nowMs, uint16_t* reclaim, uint16_t maxReclaim) {
+    uint16_t collected = 0;
+    for (uint16_t i = 0; i < count_ && collected < maxReclaim; i++) {
+        WatchSlot& slot = slots_[i];
+        if (slot.state == WATCH_ABANDONED && timeReached(nowMs, slot.deadlineMs)) {
+            slot.state = WATCH_IDLE;
+            reclaimedCount_++;
+            reclaim[collected++] = i;
+        }
+    }
+    return collected;
+}
+
+uint32_t RequestWatchdog::msUntilNextDeadline(uint32_t nowMs) const {
+    uint32_t soonest = UINT32_MAX;
+    for (uint16_t i = 0; i < count_; i++) {
+        const WatchSlot& slot = slots_[i];
+        if (slot.state == WATCH_IDLE) {
+            continue;
+        }
+        uint32_t wait = timeUntil(nowMs, slot.deadlineMs);
+        if (wait < soonest) {
+            soonest = wait;
+        }
+    }
+    return soonest;
+}
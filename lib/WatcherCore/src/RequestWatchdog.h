@@ -0,0 +1,80 @@
+// ============================================================================
+// REQUEST WATCHDOG
+// ============================================================================
+//
+// Software supervisor for request workers. Every dispatched request gets a
+// hard deadline and a generation number:
+//
+// - A request still running at its deadline is declared hung: the caller
+//   closes its socket, reports the endpoint as failed and frees the slot
+//   for accounting purposes. The worker is left graceMs to notice the
+//   closed socket and exit on its own.
+// - A worker that has not exited after the grace period is reclaimed: the
+//   caller deletes the task and resets the client.
+// - Results carry the generation they were dispatched with; a late result
+//   from an abandoned worker is recognised and dropped.
+//
+// The caller provides one WatchSlot per endpoint.
+//
+
+#ifndef REQUEST_WATCHDOG_H
+#define REQUEST_WATCHDOG_H
+
+#include <stdint.h>
+#include <WatcherTime.h>
+
+enum WatchState : uint8_t {
+    WATCH_IDLE = 0,       // No worker
+    WATCH_RUNNING,        // Worker busy, deadlineMs is the hard deadline
+    WATCH_ABANDONED,      // Declared hung, deadlineMs ends the grace period
+};
+
+struct WatchdogConfig {
+    uint32_t hardDeadlineMs;   // Longest a request may run
+    uint32_t graceMs;          // Time a hung worker gets to exit by itself
+};
+
+struct WatchSlot {
+    uint32_t generation;       // Of the most recent dispatch
+    uint32_t deadlineMs;
+    uint8_t state;             // WatchState
+};
+
+class RequestWatchdog {
+public:
+    RequestWatchdog(WatchSlot* slots, uint16_t count, const WatchdogConfig& config);
+
+    // A worker for index is dispatched (slot must be idle); returns the
+    // generation the worker has to report its result with
+    uint32_t start(uint16_t index, uint32_t nowMs);
+
+    // A worker reported its result. Returns true if the result is current;
+    // false for a late result from an abandoned worker (which has now
+    // exited, so its slot becomes idle) or an unknown generation.
+    bool finish(uint16_t index, uint32_t generation);
+
+    // Running requests past their hard deadline: moved to abandoned and
+    // collected into hung[]. Returns the number collected.
+    uint16_t collectHung(uint32_t nowMs, uint16_t* hung, uint16_t maxHung);
+
+    // Abandoned workers past their grace period: slot made idle and
+    // collected into reclaim[] for the caller to delete.
+    uint16_t collectReclaim(uint32_t nowMs, uint16_t* reclaim, uint16_t maxReclaim);
+
+    // Milliseconds until the next deadline or grace period ends
+    // (UINT32_MAX if nothing is being watched)
+    uint32_t msUntilNextDeadline(uint32_t nowMs) const;
+
+    bool idle(uint16_t index) const { return slots_[index].state == WATCH_IDLE; }
+    uint32_t hungCount() const { return hungCount_; }
+    uint32_t reclaimedCount() const { return reclaimedCount_; }
+
+private:
+    WatchSlot* slots_;
+    uint16_t count_;
+    WatchdogConfig config_;
+    uint32_t hungCount_;
+    uint32_t reclaimedCount_;
+};
+
+#endif // REQUEST_WATCHDOG_H
@@ -0,0 +1,114 @@
+// ============================================================================
+// REQUEST RESULT QUEUE
+// ============================================================================
+//
+// Bounded lock-free multi-producer / single-consumer queue of fixed-size
+// result records. Request tasks push the result of their request; one
+// aggregator (the firmware's loop task) pops them and is the only code that
+// touches health state, counters and the LEDs.
+//
+// Each slot carries a sequence number (Vyukov's bounded queue): producers
+// claim a slot with a compare-and-swap on the tail and publish it by
+// advancing the slot's sequence; the single consumer needs no atomics on
+// the head at all. No locks, no allocation, no kernel calls, so a push is
+// safe from any task.
+//
+
+#ifndef RESULT_QUEUE_H
+#define RESULT_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "NetTrace.h"
+#include "TrafficMeter.h"
+#include "ContentHash.h"
+#include "Failover.h"
+
+// One finished request: its trace record, the bytes it moved, when and
+// how long its socket was active (energy accounting), the wait a
+// Retry-After header asked for (0: none), the generation it was dispatched
+// with (see RequestWatchdog), so late results can be told apart, for endpoints
+// watched for content what the body and its validators looked like, and for
+// endpoints with alternates the destinations it tried
+struct RequestResult {
+    uint16_t endpoint;        // 0-based (trace.endpoint saturates)
+    TraceRecord trace;
+    TrafficRecord traffic;
+    int64_t radioStartUs;     // esp_timer clock
+    uint32_t radioUs;
+    uint32_t retryAfterMs;
+    uint32_t generation;
+    uint64_t contentDigest;   // Body hash, valid with contentHashed
+    uint32_t contentBytes;    // Size of the hashed body
+    bool contentHashed;       // A watched endpoint's body arrived complete
+    bool notModified;         // 304 to a conditional request
+    HttpValidators validators;   // Of the response, valid with contentHashed
+    FailoverAttempts failover;   // count 0: the endpoint has no alternates
+};
+
+struct ResultSlot {
+    std::atomic<uint32_t> sequence;
+    RequestResult record;
+};
+
+class ResultQueue {
+public:
+    // capacity must be a power of two (sequence numbers wrap at 2^32)
+    ResultQueue(ResultSlot* slots, uint32_t capacity)
+        : slots_(slots), mask_(capacity - 1), head_(0), tail_(0), dropped_(0) {
+        for (uint32_t i = 0; i < capacity; i++) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any task. Returns false (and counts a drop) when the queue is full.
+    bool push(const RequestResult& record) {
+        uint32_t position = tail_.load(std::memory_order_relaxed);
+        ResultSlot* slot;
+        for (;;) {
+            slot = &slots_[position & mask_];
+            uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int32_t difference = (int32_t)(sequence - position);
+            if (difference == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record = record;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer task only. Returns false when nothing is ready.
+    bool pop(RequestResult* record) {
+        ResultSlot* slot = &slots_[head_ & mask_];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if ((int32_t)(sequence - (head_ + 1)) < 0) {
+            return false;
+        }
+
+        *record = slot->record;
+        slot->sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        head_++;
+        return true;
+    }
+
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    ResultSlot* slots_;
+    uint32_t mask_;
+    uint32_t head_;                    // Consumer only
+    std::atomic<uint32_t> tail_;
+    std::atomic<uint32_t> dropped_;
+};
+
+#endif // RESULT_QUEUE_H
@@ -0,0 +1,139 @@
+#include <TrafficMeter.h>
+
+#include <string.h>
+
+const uint32_t TCP_MSS = 1436;            // lwIP default on the ESP32
+const uint32_t UDP_IP_HEADER_BYTES = 28;  // IPv4 + UDP
+const uint32_t DNS_HEADER_BYTES = 12;
+const uint32_t DNS_A_ANSWER_BYTES = 16;   // Compressed name, type, class, TTL, address
+
+static const char* const PHASE_NAMES[TRAFFIC_PHASES] = {
+    "DNS", "TCP", "Handshake", "Request", "Response",
+};
+
+const char* trafficPhaseName(uint8_t phase) {
+    return phase < TRAFFIC_PHASES ? PHASE_NAMES[phase] : "?";
+}
+
+uint32_t trafficPhaseTotal(const TrafficRecord& record, uint8_t phase) {
+    return record.sent[phase] + record.received[phase];
+}
+
+uint32_t trafficTotal(const TrafficRecord& record) {
+    uint32_t total = 0;
+    for (uint8_t phase = 0; phase < TRAFFIC_PHASES; phase++) {
+        total += trafficPhaseTotal(record, phase);
+    }
+    return total;
+}
+
+uint8_t trafficHandshakePercent(const TrafficRecord& record) {
+    uint32_t total = trafficTotal(record);
+    if (total == 0) {
+        return 0;
+    }
+    uint32_t setup = trafficPhaseTotal(record, TRAFFIC_DNS) + trafficPhaseTotal(record, TRAFFIC_TCP) +
+                     trafficPhaseTotal(record, TRAFFIC_HANDSHAKE);
+    return (uint8_t)((uint64_t)setup * 100 / total);
+}
+
+void trafficAdd(TrafficRecord* total, const TrafficRecord& record) {
+    for (uint8_t phase = 0; phase < TRAFFIC_PHASES; phase++) {
+        total->sent[phase] += record.sent[phase];
+        total->received[phase] += record.received[phase];
+    }
+    total->connections += record.connections;
+    total->requests += record.requests;
+}
+
+void trafficEstimateDns(TrafficRecord* record, uint16_t hostLength) {
+    if (record->connections == 0) {
+        return;
+    }
+    // Question: length-prefixed labels (host length + 2), type and class
+    uint32_t query = UDP_IP_HEADER_BYTES + DNS_HEADER_BYTES + hostLength + 2 + 4;
+    record->sent[TRAFFIC_DNS] += query * record->connections;
+    record->received[TRAFFIC_DNS] += (query + DNS_A_ANSWER_BYTES) * record->connections;
+}
+
+static uint32_t segmentsFor(uint32_t bytes) {
+    return (bytes + TCP_MSS - 1) / TCP_MSS;
+}
+
+void trafficEstimateTcp(TrafficRecord* record) {
+    uint32_t payloadSent = 0;
+    uint32_t payloadReceived = 0;
+    for (uint8_t phase = TRAFFIC_HANDSHAKE; phase < TRAFFIC_PHASES; phase++) {
+        payloadSent += record->sent[phase];
+        payloadReceived += record->received[phase];
+    }
+
+    uint32_t dataOut = segmentsFor(payloadSent);
+    uint32_t dataIn = segmentsFor(payloadReceived);
+    // SYN, ACK, FIN (+ final ACK) out; SYN-ACK, FIN in; delayed ACKs both ways
+    uint32_t segmentsOut = dataOut + 3 * record->connections + (dataIn + 1) / 2;
+    uint32_t segmentsIn = dataIn + 2 * record->connections + (dataOut + 1) / 2;
+
+    record->sent[TRAFFIC_TCP] += segmentsOut * TRAFFIC_SEGMENT_HEADER_BYTES;
+    record->received[TRAFFIC_TCP] += segmentsIn * TRAFFIC_SEGMENT_HEADER_BYTES;
+}
+
+// ============================================================================
+// LEDGER
+// ============================================================================
+
+TrafficLedger::TrafficLedger(TrafficRecord* today, uint16_t endpointCount, TrafficRecord* history,
+                             uint8_t historyDays)
+    : today_(today), endpointCount_(endpointCount), history_(history), historyDays_(historyDays),
+      historyHead_(0), historyCount_(0), dayStartMs_(0), day_(0), lifetimeBytes_(0),
+      lifetimeMeasuredBytes_(0) {
+}
+
+void TrafficLedger::begin(uint32_t nowMs) {
+    memset(today_, 0, sizeof(TrafficRecord) * endpointCount_);
+    lifetimeBytes_ = 0;
+    lifetimeMeasuredBytes_ = 0;
+    historyHead_ = 0;
+    historyCount_ = 0;
+    dayStartMs_ = nowMs;
+    day_ = 0;
+}
+
+bool TrafficLedger::rollDays(uint32_t nowMs) {
+    bool rolled = false;
+    while (nowMs - dayStartMs_ >= TRAFFIC_DAY_MS) {
+        history_[historyHead_] = todayTotal();
+        historyHead_ = (uint8_t)((historyHead_ + 1) % historyDays_);
+        if (historyCount_ < historyDays_) {
+            historyCount_++;
+        }
+        memset(today_, 0, sizeof(TrafficRecord) * endpointCount_);
+        dayStartMs_ += TRAFFIC_DAY_MS;
+        day_++;
+        rolled = true;
+    }
+    return rolled;
+}
+
+bool TrafficLedger::add(uint16_t endpoint, const TrafficRecord& record, uint32_t nowMs) {
+    bool rolled = rollDays(nowMs);
+    trafficAdd(&today_[endpoint], record);
+    lifetimeBytes_ += trafficTotal(record);
+    lifetimeMeasuredBytes_ += trafficPhaseTotal(record, TRAFFIC_HANDSHAKE) +
+                              trafficPhaseTotal(record, TRAFFIC_REQUEST) +
+                              trafficPhaseTotal(record, TRAFFIC_RESPONSE);
+    return rolled;
+}
+
+TrafficRecord TrafficLedger::todayTotal() const {
+    TrafficRecord total;
+    memset(&total, 0, sizeof(total));
+    for (uint16_t i = 0; i < endpointCount_; i++) {
+        trafficAdd(&total, today_[i]);
+    }
+    return total;
+}
+
+const TrafficRecord& TrafficLedger::historyDay(uint8_t ago) const {
+    return history_[(historyHead_ + historyDays_ - 1 - ago) % historyDays_];
+}
@@ -0,0 +1,106 @@
+// ============================================================================
+// TRAFFIC ACCOUNTING
+// ============================================================================
+//
+// Bytes each request costs on the wire, split by phase:
+//
+//   TRAFFIC_DNS        A-record lookup (estimated, see trafficEstimateDns)
+//   TRAFFIC_TCP        IPv4 + TCP headers, connection setup/teardown and
+//                      ACKs (estimated, see trafficEstimateTcp)
+//   TRAFFIC_HANDSHAKE  TLS handshake, measured at the socket
+//   TRAFFIC_REQUEST    TLS records carrying the HTTP request, measured
+//   TRAFFIC_RESPONSE   TLS records carrying the response and the closing
+//                      alerts, measured
+//
+// The Watcher measures the socket payload per request (lib/Watcher, net_meter)
+// and TrafficLedger adds the records up into per-endpoint totals for the
+// current day and a short history of whole days. Days are counted from
+// boot: the device has no wall clock.
+//
+
+#ifndef TRAFFIC_METER_H
+#define TRAFFIC_METER_H
+
+#include <stdint.h>
+
+enum TrafficPhase : uint8_t {
+    TRAFFIC_DNS = 0,
+    TRAFFIC_TCP,
+    TRAFFIC_HANDSHAKE,
+    TRAFFIC_REQUEST,
+    TRAFFIC_RESPONSE,
+    TRAFFIC_PHASES,
+};
+
+const uint32_t TRAFFIC_DAY_MS = 24UL * 60UL * 60UL * 1000UL;
+
+// IPv4 + TCP headers, no options: the TCP estimate books this per segment
+const uint32_t TRAFFIC_SEGMENT_HEADER_BYTES = 40;
+
+// Bytes of one request, or a sum of many
+struct TrafficRecord {
+    uint32_t sent[TRAFFIC_PHASES];
+    uint32_t received[TRAFFIC_PHASES];
+    uint32_t connections;     // TCP connections opened
+    uint32_t requests;
+};
+
+const char* trafficPhaseName(uint8_t phase);
+
+uint32_t trafficTotal(const TrafficRecord& record);
+uint32_t trafficPhaseTotal(const TrafficRecord& record, uint8_t phase);
+
+// Handshake (DNS + TCP + TLS handshake) share of all bytes, in percent
+uint8_t trafficHandshakePercent(const TrafficRecord& record);
+
+void trafficAdd(TrafficRecord* total, const TrafficRecord& record);
+
+// Fill in the estimated phases of a measured request: one DNS
+// query/response per new connection for hostLength (an upper bound, since
+// lwIP caches lookups), and 40 header bytes per TCP segment at the lwIP
+// MSS, plus SYN/FIN exchanges per new connection and one ACK for every two
+// data segments. A request over a reused connection has connections == 0.
+void trafficEstimateDns(TrafficRecord* record, uint16_t hostLength);
+void trafficEstimateTcp(TrafficRecord* record);
+
+// Per-endpoint totals for the current day plus the last few whole days.
+// Storage is provided by the caller; single owner, no locking.
+class TrafficLedger {
+public:
+    TrafficLedger(TrafficRecord* today, uint16_t endpointCount, TrafficRecord* history, uint8_t historyDays);
+
+    void begin(uint32_t nowMs);
+
+    // Add one request; returns true if a day ended first (see lastDay())
+    bool add(uint16_t endpoint, const TrafficRecord& record, uint32_t nowMs);
+
+    // Roll over any days that have ended; returns true if one did
+    bool rollDays(uint32_t nowMs);
+
+    uint32_t day() const { return day_; }                       // Days since boot
+    const TrafficRecord& today(uint16_t endpoint) const { return today_[endpoint]; }
+    TrafficRecord todayTotal() const;
+
+    // Completed days, 0 = most recent; historyCount() of them are valid
+    uint8_t historyCount() const { return historyCount_; }
+    const TrafficRecord& historyDay(uint8_t ago) const;
+    const TrafficRecord& lastDay() const { return historyDay(0); }
+
+    // Everything since boot (64-bit: months of traffic overflow 32 bits)
+    uint64_t lifetimeBytes() const { return lifetimeBytes_; }
+    uint64_t lifetimeMeasuredBytes() const { return lifetimeMeasuredBytes_; }   // Without estimates
+
+private:
+    TrafficRecord* today_;
+    uint16_t endpointCount_;
+    TrafficRecord* history_;
+    uint8_t historyDays_;
+    uint8_t historyHead_;
+    uint8_t historyCount_;
+    uint32_t dayStartMs_;
+    uint32_t day_;
+    uint64_t lifetimeBytes_;
+    uint64_t lifetimeMeasuredBytes_;
+};
+
+#endif // TRAFFIC_METER_H
@@ -0,0 +1,75 @@
+#include <TxPower.h>
+
+TxPowerControl::TxPowerControl(const TxPowerConfig& config)
+    : config_(config), level_(config.maxQuarterDbm), lowestLevel_(config.maxQuarterDbm), cleanCycles_(0),
+      requiredCycles_(config.solidCycles), cycles_(0), lowered_(0), raised_(0), troubledCycles_(0) {
+}
+
+void TxPowerControl::reset() {
+    level_ = config_.maxQuarterDbm;
+    cleanCycles_ = 0;
+    requiredCycles_ = config_.solidCycles;
+}
+
+int16_t TxPowerControl::uplinkRssiDbm(int8_t rssiDbm) const {
+    return rssiDbm - (config_.maxQuarterDbm - level_) / 4;
+}
+
+TxPowerChange TxPowerControl::set(int16_t level) {
+    if (level > config_.maxQuarterDbm) {
+        level = config_.maxQuarterDbm;
+    }
+    if (level < config_.minQuarterDbm) {
+        level = config_.minQuarterDbm;
+    }
+    if (level == level_) {
+        return TX_POWER_UNCHANGED;
+    }
+    TxPowerChange change = level < level_ ? TX_POWER_LOWERED : TX_POWER_RAISED;
+    level_ = (int8_t)level;
+    if (change == TX_POWER_LOWERED) {
+        lowered_++;
+        if (level_ < lowestLevel_) {
+            lowestLevel_ = level_;
+        }
+    } else {
+        raised_++;
+    }
+    return change;
+}
+
+TxPowerChange TxPowerControl::update(int8_t rssiDbm, uint32_t attempts, uint32_t unanswered) {
+    if (!enabled()) {
+        return TX_POWER_UNCHANGED;
+    }
+    cycles_++;
+
+    if (unanswered > 0) {
+        troubledCycles_++;
+        cleanCycles_ = 0;
+        requiredCycles_ = config_.holdCycles;
+        if (unanswered * 2 >= attempts) {
+            return set(config_.maxQuarterDbm);
+        }
+        return set(level_ + config_.stepQuarterDbm);
+    }
+    if (rssiDbm == 0) {
+        return TX_POWER_UNCHANGED;
+    }
+
+    int16_t uplink = uplinkRssiDbm(rssiDbm);
+    if (uplink < config_.targetRssiDbm) {
+        cleanCycles_ = 0;
+        return set(level_ + config_.stepQuarterDbm);
+    }
+    if (cleanCycles_ < UINT8_MAX) {
+        cleanCycles_++;
+    }
+    if (cleanCycles_ < requiredCycles_ || level_ <= config_.minQuarterDbm ||
+        uplink - config_.stepQuarterDbm / 4 < config_.targetRssiDbm) {
+        return TX_POWER_UNCHANGED;
+    }
+    cleanCycles_ = 0;
+    requiredCycles_ = config_.solidCycles;
+    return set(level_ - config_.stepQuarterDbm);
+}
@@ -0,0 +1,86 @@
+// ============================================================================
+// ADAPTIVE TX POWER
+// ============================================================================
+//
+// The station transmits at the driver's maximum however close the AP is.
+// This controller steps the TX power down while the link is solid and back
+// up when it is not, once per poll cycle:
+//
+// - A cycle in which attempts went unanswered (no connect, lost connection,
+//   timeout) raises the level by one step, or straight to the maximum when
+//   at least half of them did, and holds off the next step down for
+//   holdCycles clean cycles.
+// - Otherwise the signal decides. The path is taken as symmetric and the AP
+//   as sending at the station's maximum, so at a level below it the AP
+//   hears the station about that much weaker than the station hears the AP
+//   (RSSI). An estimate below targetRssiDbm raises the level one step.
+// - After solidCycles clean cycles in a row, one step down is taken if the
+//   estimate stays at or above the target afterwards.
+//
+// A new association starts at the maximum again (reset()).
+//
+// Levels are in 0.25 dBm, as the ESP32 driver takes them
+// (esp_wifi_set_max_tx_power, WiFi.setTxPower()). The caller reads the
+// RSSI and applies level().
+//
+
+#ifndef TX_POWER_H
+#define TX_POWER_H
+
+#include <stdint.h>
+
+struct TxPowerConfig {
+    int8_t minQuarterDbm;        // Lowest level
+    int8_t maxQuarterDbm;        // Highest, and the level after reset(); 0: no control
+    uint8_t stepQuarterDbm;      // One step down or up
+    int8_t targetRssiDbm;        // How well the AP should still hear the station
+    uint8_t solidCycles;         // Clean cycles in a row before a step down
+    uint8_t holdCycles;          // ... after unanswered attempts raised the level
+};
+
+enum TxPowerChange : uint8_t {
+    TX_POWER_UNCHANGED = 0,
+    TX_POWER_LOWERED,
+    TX_POWER_RAISED,
+};
+
+class TxPowerControl {
+public:
+    explicit TxPowerControl(const TxPowerConfig& config);
+
+    bool enabled() const { return config_.maxQuarterDbm > 0; }
+
+    // Back to the maximum, counters kept
+    void reset();
+
+    // One poll cycle: rssiDbm is the AP's signal now (0: unknown), attempts
+    // the requests and link checks sent, unanswered how many of them got
+    // no answer at all
+    TxPowerChange update(int8_t rssiDbm, uint32_t attempts, uint32_t unanswered);
+
+    int8_t level() const { return level_; }
+
+    // How well the AP hears the station at the current level
+    int16_t uplinkRssiDbm(int8_t rssiDbm) const;
+
+    uint32_t cycles() const { return cycles_; }
+    uint32_t lowered() const { return lowered_; }
+    uint32_t raised() const { return raised_; }
+    uint32_t troubledCycles() const { return troubledCycles_; }   // With unanswered attempts
+    int8_t lowestLevel() const { return lowestLevel_; }           // Since boot
+
+private:
+    TxPowerChange set(int16_t level);
+
+    TxPowerConfig config_;
+    int8_t level_;
+    int8_t lowestLevel_;
+    uint8_t cleanCycles_;
+    uint8_t requiredCycles_;       // Clean cycles the next step down waits for
+    uint32_t cycles_;
+    uint32_t lowered_;
+    uint32_t raised_;
+    uint32_t troubledCycles_;
+};
+
+#endif // TX_POWER_H
@@ -0,0 +1,26 @@
+// ============================================================================
+// WRAP-SAFE TIME HELPERS
+// ============================================================================
+//
+// All core logic works on 32-bit millisecond timestamps (millis() on the
+// device, a virtual clock on the host). These helpers compare timestamps by
+// signed difference so they stay correct across the 49.7-day wraparound as
+// long as the compared points are less than ~24.8 days apart.
+//
+
+#ifndef WATCHER_TIME_H
+#define WATCHER_TIME_H
+
+#include <stdint.h>
+
+// True once nowMs has reached (or passed) deadlineMs
+inline bool timeReached(uint32_t nowMs, uint32_t deadlineMs) {
+    return (int32_t)(nowMs - deadlineMs) >= 0;
+}
+
+// Milliseconds remaining until deadlineMs, or 0 if it has already passed
+inline uint32_t timeUntil(uint32_t nowMs, uint32_t deadlineMs) {
+    return timeReached(nowMs, deadlineMs) ? 0 : deadlineMs - nowMs;
+}
+
+#endif // WATCHER_TIME_H
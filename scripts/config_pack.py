@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+# ============================================================================
+# ENDPOINT CONFIG PACKER
+# ============================================================================
+#
+# Builds the endpoint table the firmware reads from its "config" flash
+# partition, from a text file with one endpoint per line:
+#
+#   # [priority] [head | range=BYTES] [content] URL
+#   high        https://hc-ping.com/first-uuid
+#   https://hc-ping.com/second-uuid
+#   low content https://example.com/status.json
+#   low range=1024 https://example.com/big-report.html
+#
+# The priority is high, normal, low or optional (normal if left out).
+# "content" reports every change of the endpoint's body (hashed whole).
+# "head" checks with HEAD, by status and headers only; "range=BYTES" asks
+# for the first BYTES of the body only (what is hashed with "content").
+#
+#   scripts/config_pack.py endpoints.txt -o endpoints.bin
+#   esptool.py write_flash <config offset> endpoints.bin
+#
+# The offset and the size limit come from partitions.csv.
+#
+# Blob layout: lib/WatcherCore/src/EndpointTable.h
+
+import argparse
+import csv
+import struct
+import sys
+
+TABLE_MAGIC = 0x50455653
+TABLE_VERSION = 1
+HEADER = struct.Struct("<IHHHHII12x")
+RECORD = struct.Struct("<IHHBBBBI")
+
+PRIORITIES = ["high", "normal", "low", "optional"]
+FLAG_CONTENT = 0x01
+FLAG_HEAD = 0x02
+FLAG_RANGE = 0x04
+MAX_RANGE_BYTES = 0xFFFFFFFF
+MAX_ENDPOINTS = 0xFFFF
+
+
+def fnv1a32(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def url_host(url):
+    """Start and length of the host name, as the firmware's urlHost()."""
+    scheme = url.find("://")
+    start = scheme + 3 if scheme >= 0 else 0
+    end = start
+    while end < len(url) and url[end] not in ":/":
+        end += 1
+    return start, end - start
+
+
+def parse(lines):
+    endpoints = []
+    for number, line in enumerate(lines, 1):
+        fields = line.split("#", 1)[0].split()
+        if not fields:
+            continue
+        url = fields.pop()
+        flags = 0
+        range_bytes = 0
+        if fields and fields[-1].lower() == "content":
+            flags |= FLAG_CONTENT
+            fields.pop()
+        if fields and fields[-1].lower() == "head":
+            flags |= FLAG_HEAD
+            fields.pop()
+        elif fields and fields[-1].lower().startswith("range="):
+            size = fields.pop()[6:]
+            if not size.isdigit() or not 0 < int(size) <= MAX_RANGE_BYTES:
+                sys.exit("line %d: range needs a size in bytes, such as range=1024" % number)
+            flags |= FLAG_RANGE
+            range_bytes = int(size)
+        priority = fields.pop().lower() if fields else "normal"
+        if fields:
+            sys.exit("line %d: expected '[priority] [head | range=BYTES] [content] URL'" % number)
+        if flags & FLAG_HEAD and flags & FLAG_CONTENT:
+            sys.exit("line %d: a HEAD request has no body to watch for content" % number)
+        if priority not in PRIORITIES:
+            sys.exit("line %d: unknown priority '%s'" % (number, priority))
+        if not url.isascii() or len(url) > 0xFFFF:
+            sys.exit("line %d: URL must be ASCII and shorter than 64 KiB" % number)
+        start, length = url_host(url)
+        if length == 0 or start > 0xFF or length > 0xFF:
+            sys.exit("line %d: no usable host name in '%s'" % (number, url))
+        endpoints.append((PRIORITIES.index(priority), flags, range_bytes, url, start, length))
+    return endpoints
+
+
+def pack(endpoints):
+    hosts = {}
+    records = b""
+    pool = b""
+    for priority, flags, range_bytes, url, start, length in endpoints:
+        host = hosts.setdefault(url[start:start + length].lower(), len(hosts))
+        records += RECORD.pack(len(pool), len(url), host, start, length, priority, flags, range_bytes)
+        pool += url.encode("ascii") + b"\0"
+
+    body = records + pool
+    header = HEADER.pack(TABLE_MAGIC, TABLE_VERSION, RECORD.size, len(endpoints), len(hosts),
+                         len(pool), fnv1a32(body))
+    return header + body, len(hosts)
+
+
+def config_partition(path):
+    """(offset, size) of the config partition in partitions.csv, or None."""
+    try:
+        with open(path) as table:
+            for row in csv.reader(table):
+                fields = [field.strip() for field in row]
+                if fields and fields[0] == "config" and len(fields) >= 5:
+                    return int(fields[3], 0), int(fields[4], 0)
+    except OSError:
+        pass
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("endpoints", help="endpoint list ('-' for stdin)")
+    parser.add_argument("-o", "--output", required=True, help="write the table to this file")
+    parser.add_argument("--partitions", default="partitions.csv", help="partition table with the 'config' partition")
+    args = parser.parse_args()
+
+    source = sys.stdin if args.endpoints == "-" else open(args.endpoints)
+    endpoints = parse(source)
+    if not endpoints:
+        sys.exit("No endpoints found")
+    if len(endpoints) > MAX_ENDPOINTS:
+        sys.exit("%d endpoints; the table holds at most %d" % (len(endpoints), MAX_ENDPOINTS))
+
+    blob, host_count = pack(endpoints)
+    partition = config_partition(args.partitions)
+    if partition is not None and len(blob) > partition[1]:
+        sys.exit("Table is %d bytes; the config partition holds %d" % (len(blob), partition[1]))
+
+    with open(args.output, "wb") as output:
+        output.write(blob)
+    print("Packed %d endpoint(s) on %d host(s): %d bytes" % (len(endpoints), host_count, len(blob)))
+    if partition is not None:
+        print("Flash with: esptool.py write_flash 0x%x %s" % (partition[0], args.output))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,11 @@
+# ============================================================================
+# LEAN PROFILE LINK OPTIONS
+# ============================================================================
+#
+# PlatformIO pre-build script for env:esp32dev_lean. build_flags only reach
+# the compiler, so link-time optimization and section garbage collection are
+# added to the linker command line here.
+
+Import("env")
+
+env.Append(LINKFLAGS=["-flto", "-Wl,--gc-sections"])
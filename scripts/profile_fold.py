@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# ============================================================================
+# PROFILE FOLDER
+# ============================================================================
+#
+# Symbolizes the sampling profiler's histogram (send 'f' on the console of
+# an esp32dev_profile build to make the firmware dump it) against the
+# firmware ELF and writes folded stacks, one "task;group;function count"
+# line each, for flamegraph.pl, speedscope or inferno. Several dumps in one
+# log are added up.
+#
+#   scripts/profile_fold.py monitor.log -o poll.folded
+#   scripts/profile_fold.py monitor.log --summary
+#
+# The groups answer where a poll cycle goes: mbedTLS bignum arithmetic, the
+# rest of mbedTLS, lwIP, HTTPClient and String handling, Serial and printf
+# formatting, the WiFi driver, FreeRTOS and the heap.
+#
+# Dump layout: lib/Watcher/src/profiler.cpp
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+PROFILE_VERSION = 1
+DEFAULT_ELF = ".pio/build/esp32dev_profile/firmware.elf"
+ADDR2LINE = "xtensa-esp32-elf-addr2line"
+ADDR2LINE_BATCH = 500
+
+BEGIN = re.compile(r"=== PROFILE BEGIN v(\d+) hz=(\d+) cores=(\d+) samples=(\d+) idle=(\d+) lost=(\d+) ===")
+END = "=== PROFILE END ==="
+TASK = re.compile(r"^T (\d+) (.*)$")
+SAMPLE = re.compile(r"^S ([0-9a-f]{8}) (\d+) (\d+)$")
+
+# First match wins: (group, function pattern, source path pattern)
+GROUPS = [
+    ("mbedtls-bignum", r"^(mbedtls_mpi_|mpi_|esp_mpi_)", r"bignum"),
+    ("mbedtls", r"^mbedtls_", r"/mbedtls/"),
+    ("lwip", r"^(lwip_|tcp_|tcpip_|ip_|ip4_|pbuf_|netconn_|netbuf_|udp_|etharp_|inet_chksum|sys_arch_|sys_mbox_|sys_sem_)",
+     r"/lwip/"),
+    ("httpclient-string", r"^(HTTPClient|String|StringSumHelper)::", r"(HTTPClient|WString)\.cpp"),
+    ("serial-format", r"^(_?v?s?n?printf|_svfprintf_r|_vfprintf_r|_vfiprintf_r|__ssputs_r|__sfputs_r|_printf_i"
+                      r"|_printf_common|_printf_float|_dtoa_r|__sprint_r|Print::|HardwareSerial::|uart)",
+     r"(Print|HardwareSerial|esp32-hal-uart)\.c"),
+    ("wifi-driver", r"^(ieee80211|pp[A-Z_]|lmac|wdev|esf_|hal_mac|wifi_|esp_wifi_)", None),
+    ("freertos", r"^(vTask|xTask|uxTask|xQueue|vQueue|vPort|xPort|pvPort|vList|prv|_xt_|_frxt|spinlock|vApplication)",
+     r"/freertos/"),
+    ("heap", r"^(heap_caps_|multi_heap_|tlsf_|malloc|free|calloc|realloc|_malloc_r|_free_r|_calloc_r|_realloc_r)",
+     r"/heap/"),
+]
+GROUP_PATTERNS = [(name, re.compile(function), re.compile(path) if path else None) for name, function, path in GROUPS]
+
+
+def extract(lines):
+    samples = {}
+    totals = {"samples": 0, "idle": 0, "lost": 0}
+    hz = None
+    tasks = {}
+    inside = False
+    for line in lines:
+        line = line.strip()
+        match = BEGIN.search(line)
+        if match:
+            if int(match.group(1)) != PROFILE_VERSION:
+                sys.exit("Unsupported profile version %s" % match.group(1))
+            hz = int(match.group(2))
+            totals["samples"] += int(match.group(4))
+            totals["idle"] += int(match.group(5))
+            totals["lost"] += int(match.group(6))
+            tasks = {}
+            inside = True
+        elif line == END:
+            inside = False
+        elif inside:
+            task = TASK.match(line)
+            sample = SAMPLE.match(line)
+            if task:
+                tasks[int(task.group(1))] = task.group(2).strip()
+            elif sample:
+                key = (tasks.get(int(sample.group(2)), "?"), int(sample.group(1), 16))
+                samples[key] = samples.get(key, 0) + int(sample.group(3))
+    return samples, totals, hz
+
+
+def find_addr2line(path):
+    if path:
+        return path
+    found = shutil.which(ADDR2LINE)
+    if found:
+        return found
+    bundled = os.path.expanduser("~/.platformio/packages/toolchain-xtensa-esp32/bin/" + ADDR2LINE)
+    if os.path.exists(bundled):
+        return bundled
+    sys.exit("%s not found; pass --addr2line" % ADDR2LINE)
+
+
+# Address -> (function, source path)
+def symbolize(addresses, elf, addr2line):
+    symbols = {}
+    addresses = sorted(addresses)
+    for start in range(0, len(addresses), ADDR2LINE_BATCH):
+        batch = addresses[start:start + ADDR2LINE_BATCH]
+        output = subprocess.check_output([addr2line, "-f", "-C", "-e", elf] + ["0x%08x" % a for a in batch])
+        lines = output.decode(errors="replace").splitlines()
+        for i, address in enumerate(batch):
+            function = lines[2 * i].strip() if 2 * i < len(lines) else "??"
+            source = lines[2 * i + 1].strip() if 2 * i + 1 < len(lines) else "??"
+            symbols[address] = (function, source)
+    return symbols
+
+
+def group_of(function, source):
+    for name, function_pattern, path_pattern in GROUP_PATTERNS:
+        if function_pattern.search(function) or (path_pattern and path_pattern.search(source)):
+            return name
+    return "other"
+
+
+def fold(samples, symbols):
+    folded = {}
+    for (task, address), count in samples.items():
+        function, source = symbols.get(address, ("??", "??"))
+        if function == "??":
+            function = "0x%08x" % address
+        # A semicolon would split the frame
+        key = "%s;%s;%s" % (task, group_of(function, source), function.replace(";", ":"))
+        folded[key] = folded.get(key, 0) + count
+    return folded
+
+
+def summarize(folded, totals, hz):
+    busy = totals["samples"] - totals["idle"]
+    if hz:
+        print("%d sample(s) at %d Hz per core: %.1f core-seconds busy, %.1f idle, %d sample(s) lost"
+              % (totals["samples"], hz, busy / float(hz), totals["idle"] / float(hz), totals["lost"]))
+    recorded = sum(folded.values())
+    if recorded == 0:
+        return
+
+    for label, position in (("Group", 1), ("Task", 0)):
+        shares = {}
+        for key, count in folded.items():
+            name = key.split(";")[position]
+            shares[name] = shares.get(name, 0) + count
+        print("%-20s %9s %7s %7s" % (label, "Samples", "Busy", "All"))
+        for name, count in sorted(shares.items(), key=lambda item: -item[1]):
+            print("%-20s %9d %6.1f%% %6.1f%%"
+                  % (name, count, 100.0 * count / recorded, 100.0 * count / max(1, totals["samples"])))
+
+    print("Hottest functions")
+    for key, count in sorted(folded.items(), key=lambda item: -item[1])[:15]:
+        print("  %6.1f%%  %s" % (100.0 * count / recorded, key))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("log", help="serial monitor log ('-' for stdin)")
+    parser.add_argument("-e", "--elf", default=DEFAULT_ELF, help="firmware ELF (default: %(default)s)")
+    parser.add_argument("--addr2line", help="path to %s" % ADDR2LINE)
+    parser.add_argument("--raw", action="store_true", help="leave addresses unsymbolized (no ELF needed)")
+    parser.add_argument("-o", "--output", help="write folded stacks to this file ('-' for stdout)")
+    parser.add_argument("--summary", action="store_true", help="print the share of each group, task and function")
+    args = parser.parse_args()
+
+    source = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+    samples, totals, hz = extract(source)
+    if not samples:
+        sys.exit("No profile samples found")
+
+    symbols = {}
+    if not args.raw:
+        if not os.path.exists(args.elf):
+            sys.exit("%s not found; build with -e esp32dev_profile, pass --elf, or use --raw" % args.elf)
+        symbols = symbolize({address for _, address in samples}, args.elf, find_addr2line(args.addr2line))
+    folded = fold(samples, symbols)
+
+    if args.output:
+        output = sys.stdout if args.output == "-" else open(args.output, "w")
+        for key, count in sorted(folded.items()):
+            output.write("%s %d\n" % (key, count))
+        if output is not sys.stdout:
+            output.close()
+    if args.summary or not args.output:
+        summarize(folded, totals, hz)
+
+
+if __name__ == "__main__":
+    main()
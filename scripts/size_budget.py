@@ -0,0 +1,61 @@
+# ============================================================================
+# FIRMWARE SIZE BUDGET
+# ============================================================================
+#
+# PlatformIO post-build script: fails the build when the application image or
+# the static RAM usage grows beyond the budget configured for the environment.
+#
+#   custom_flash_budget = <bytes>   ; size limit for firmware.bin
+#   custom_ram_budget   = <bytes>   ; limit for .dram0.data + .dram0.bss
+#
+# A budget of 0 (or a missing option) disables that check.
+
+import os
+import subprocess
+
+Import("env")
+
+RAM_SECTIONS = (".dram0.data", ".dram0.bss")
+
+
+def read_budget(name):
+    value = env.GetProjectOption(name, "0")
+    return int(str(value).replace("_", ""), 0)
+
+
+def static_ram_usage(elf_path):
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-A", elf_path])
+    total = 0
+    for line in output.decode().splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] in RAM_SECTIONS:
+            total += int(fields[1])
+    return total
+
+
+def report(label, used, budget):
+    print("Size budget: %-5s %8d / %8d bytes (%.1f%%)"
+          % (label, used, budget, 100.0 * used / budget))
+    return used <= budget
+
+
+def check_size_budget(source, target, env):
+    ok = True
+
+    flash_budget = read_budget("custom_flash_budget")
+    if flash_budget > 0:
+        image_size = os.path.getsize(target[0].get_abspath())
+        ok = report("flash", image_size, flash_budget) and ok
+
+    ram_budget = read_budget("custom_ram_budget")
+    if ram_budget > 0:
+        elf_path = env.subst("$BUILD_DIR/${PROGNAME}.elf")
+        ok = report("ram", static_ram_usage(elf_path), ram_budget) and ok
+
+    if not ok:
+        print("*** Firmware exceeds its size budget (see platformio.ini) ***")
+        return 1
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", check_size_budget)
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# ============================================================================
+# TRACE EXTRACTOR
+# ============================================================================
+#
+# Pulls the request timing trace out of a serial monitor log (send 't' on the
+# console to make the firmware dump it) and writes a .svtr file for the
+# native replay tool. Several dumps in one log are concatenated in order.
+#
+#   scripts/trace_extract.py monitor.log -o field.svtr
+#   scripts/trace_extract.py monitor.log --summary
+#
+# Record layout: lib/WatcherCore/src/NetTrace.h
+
+import argparse
+import re
+import struct
+import sys
+
+TRACE_MAGIC = 0x52545653
+TRACE_VERSION = 1
+HEADER = struct.Struct("<IHHII")
+RECORD = struct.Struct("<IHHHhHBB")
+
+OUTCOMES = ["ok", "http error", "connect failed", "send failed",
+            "connection lost", "timeout", "other error", "hung", "rate limited"]
+
+BEGIN = re.compile(r"=== TRACE BEGIN v(\d+) count=(\d+) dropped=(\d+) ===")
+END = "=== TRACE END ==="
+
+
+def extract(lines):
+    records = []
+    dropped = 0
+    inside = False
+    for line in lines:
+        line = line.strip()
+        match = BEGIN.search(line)
+        if match:
+            if int(match.group(1)) != TRACE_VERSION:
+                sys.exit("Unsupported trace version %s" % match.group(1))
+            dropped += int(match.group(3))
+            inside = True
+        elif line == END:
+            inside = False
+        elif inside and len(line) == 2 * RECORD.size:
+            records.append(bytes.fromhex(line))
+    return records, dropped
+
+
+def percentile(values, q):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+
+def summarize(records):
+    by_endpoint = {}
+    for raw in records:
+        fields = RECORD.unpack(raw)
+        by_endpoint.setdefault(fields[6], []).append(fields)
+
+    for endpoint in sorted(by_endpoint):
+        entries = by_endpoint[endpoint]
+        print("Endpoint %d: %d request(s)" % (endpoint, len(entries)))
+        outcomes = {}
+        for entry in entries:
+            outcomes[entry[7]] = outcomes.get(entry[7], 0) + 1
+        for outcome, count in sorted(outcomes.items()):
+            name = OUTCOMES[outcome] if outcome < len(OUTCOMES) else str(outcome)
+            print("  %-16s %d" % (name + ":", count))
+        for label, index in (("connect", 1), ("first byte", 2), ("transfer", 3)):
+            values = [entry[index] for entry in entries]
+            print("  %-16s p50 %5d ms  p90 %5d ms  max %5d ms"
+                  % (label + ":", percentile(values, 0.5), percentile(values, 0.9), max(values)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("log", help="serial monitor log ('-' for stdin)")
+    parser.add_argument("-o", "--output", help="write records to this .svtr file")
+    parser.add_argument("--summary", action="store_true", help="print per-endpoint statistics")
+    args = parser.parse_args()
+
+    source = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+    records, dropped = extract(source)
+    if not records:
+        sys.exit("No trace records found")
+
+    print("Extracted %d record(s), %d dropped on the device" % (len(records), dropped))
+    if args.output:
+        with open(args.output, "wb") as output:
+            output.write(HEADER.pack(TRACE_MAGIC, TRACE_VERSION, RECORD.size, len(records), dropped))
+            for record in records:
+                output.write(record)
+    if args.summary:
+        summarize(records)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,453 @@
+// ============================================================================
+// COAP TRANSPORT HARNESS (host build: pio run -e native_coap)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp) against the native shim with a CoAP
+// server stand-in: endpoint 1 is a coaps:// URL on it, endpoint 2 stays an
+// HTTPS GET on the stand-in server, so both transports ping side by side
+// over the same simulated path (platformio.ini, env native_coap).
+//
+// Every round trip takes 20-200 ms. HTTPS pays 3 of them to connect (TCP,
+// then a full TLS 1.2 handshake) and one for the request; DTLS pays 3 for
+// a full handshake (with the cookie exchange) and 2 to resume a session.
+// The server answers a confirmable POST with a piggybacked 2.04, or now
+// and then with an empty ACK and a separate confirmable 2.04 that it
+// repeats until acknowledged. It answers a repeated message id with the
+// same response, without counting the request twice. Faults:
+//   --loss         share of CoAP datagrams lost, each way (handshakes are
+//                  retransmitted by the DTLS layer and only take longer)
+//   --separate     share of requests answered separately
+//   --rebind-rate  NAT rebindings per hour: the server loses the
+//                  association, and the client only notices the silence
+//   --evict-rate   server session cache evictions per hour: the next
+//                  resumption attempt becomes a full handshake
+//
+// Reports bytes (the traffic meter's, as the device would count them) and
+// round trips per check for both transports, the DTLS handshakes and the
+// CoAP retransmissions. Exits non-zero when the firmware counts a CoAP
+// check as answered that the server never received, when a CoAP check
+// costs as many bytes or round trips as an HTTPS one, or when fewer CoAP
+// checks succeed than --min-success.
+//
+// Usage:
+//   coap [--hours H] [--loss L] [--separate S] [--rebind-rate R] [--evict-rate R]
+//        [--min-success M] [--seed S]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+#include <CoapProbe.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+// Firmware entry points and objects (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+extern CoapProbe coapProbe;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const char* const COAP_HOST = "coap.standin.local";
+const uint16_t COAP_ENDPOINT = 0;
+const uint16_t HTTPS_ENDPOINT = 1;
+const uint64_t EPOCH_MS = 1000;
+const uint64_t TALLY_MS = 60000;          // Trace records are counted this often
+
+// Round trips of a connection setup
+const uint32_t TLS_CONNECT_RTTS = 3;      // TCP, then a full TLS 1.2 handshake
+const uint32_t DTLS_FULL_RTTS = 3;        // Cookie exchange, then the full handshake
+const uint32_t DTLS_RESUMED_RTTS = 2;     // Cookie exchange, then the abbreviated one
+
+// The server repeats a separate response this often, at most this many times
+const uint32_t SEPARATE_TIMEOUT_MS = 2000;
+const uint8_t SEPARATE_RETRANSMIT = 4;
+
+struct CoapOptions {
+    double hours = 6;
+    double loss = 0.05;
+    double separate = 0.1;
+    double rebindRate = 1;
+    double evictRate = 0.5;
+    double minSuccess = 0.99;
+    uint64_t seed = 1;
+};
+
+// ============================================================================
+// COAP SERVER STAND-IN
+// ============================================================================
+
+class StandInCoapServer : public StandInStream {
+public:
+    StandInCoapServer(std::mt19937_64& random, const CoapOptions& options) : random_(random), options_(options) {}
+
+    // ---- StandInStream: datagrams of the client's association ----
+
+    void opened() override {
+        associated_ = true;
+        sessionKnown_ = true;
+        outgoing_.clear();
+        separate_.clear();
+    }
+
+    void received(const uint8_t* data, size_t size) override {
+        datagramsIn++;
+        if (lost()) {
+            lostIn++;
+            return;
+        }
+        CoapReader reader;
+        if (!reader.parse(data, size)) {
+            return;
+        }
+        const CoapHeader& header = reader.header();
+        if (header.type == COAP_ACK || header.type == COAP_RST) {
+            separate_.erase(header.messageId);           // Separate response acknowledged
+            return;
+        }
+        if (header.type != COAP_CON || header.code != COAP_POST) {
+            return;
+        }
+
+        // A repeated message id gets the same answer again
+        auto seen = answers_.find(header.messageId);
+        if (seen != answers_.end()) {
+            duplicates++;
+            queue(seen->second, roundTripMs());
+            return;
+        }
+        requests++;
+        std::vector<uint8_t> datagram(16);
+        std::bernoulli_distribution separately(options_.separate);
+        if (separately(random_)) {
+            separateAnswers++;
+            datagram.resize(coapEncodeEmpty(COAP_ACK, header.messageId, datagram.data(), datagram.size()));
+            queue(datagram, roundTripMs());
+
+            CoapHeader response = header;
+            response.type = COAP_CON;
+            response.code = COAP_CHANGED;
+            response.messageId = nextMessageId_++;
+            std::vector<uint8_t> late(16);
+            late.resize(coapEncodeResponse(response, NULL, 0, late.data(), late.size()));
+            std::uniform_int_distribution<uint64_t> work(500, 2000);
+            Separate pending = { late, nativeClockNowMs() + roundTripMs() + work(random_), 0 };
+            separate_[response.messageId] = pending;
+        } else {
+            CoapHeader ack = header;
+            ack.type = COAP_ACK;
+            ack.code = COAP_CHANGED;
+            datagram.resize(coapEncodeResponse(ack, NULL, 0, datagram.data(), datagram.size()));
+            queue(datagram, roundTripMs());
+        }
+        answers_[header.messageId] = datagram;
+    }
+
+    size_t ready() override {
+        uint64_t now = nativeClockNowMs();
+        for (auto entry = separate_.begin(); entry != separate_.end();) {
+            Separate& pending = entry->second;
+            if (now >= pending.atMs) {
+                queue(pending.datagram, 0);
+                pending.sends++;
+                pending.atMs = now + ((uint64_t)SEPARATE_TIMEOUT_MS << pending.sends);
+            }
+            entry = pending.sends > SEPARATE_RETRANSMIT ? separate_.erase(entry) : std::next(entry);
+        }
+        while (!outgoing_.empty() && outgoing_.front().atMs <= now) {
+            if (!outgoing_.front().lost) {
+                return outgoing_.front().datagram.size();
+            }
+            outgoing_.pop_front();
+        }
+        return 0;
+    }
+
+    size_t take(uint8_t* out, size_t size) override {
+        if (ready() == 0) {
+            return 0;
+        }
+        const std::vector<uint8_t>& datagram = outgoing_.front().datagram;
+        size_t taken = std::min(size, datagram.size());
+        memcpy(out, datagram.data(), taken);
+        outgoing_.pop_front();
+        return taken;
+    }
+
+    bool open() override { return associated_; }
+
+    void closed() override { associated_ = false; }
+
+    // ---- Faults ----
+
+    // The client's address changed under a NAT: its datagrams reach no
+    // association, and the server's go nowhere
+    void rebind() {
+        associated_ = false;
+        outgoing_.clear();
+        separate_.clear();
+    }
+
+    void evict() { sessionKnown_ = false; }
+    bool sessionKnown() const { return sessionKnown_; }
+
+    uint32_t roundTripMs() {
+        std::uniform_int_distribution<uint32_t> latency(20, 200);
+        return latency(random_);
+    }
+
+    // ---- Results ----
+
+    uint32_t requests = 0;               // Distinct requests received
+    uint32_t duplicates = 0;             // Repeats of one already received
+    uint32_t separateAnswers = 0;
+    uint32_t datagramsIn = 0;
+    uint32_t lostIn = 0;
+    uint32_t datagramsOut = 0;
+    uint32_t lostOut = 0;
+
+private:
+    struct Pending {
+        uint64_t atMs;
+        std::vector<uint8_t> datagram;
+        bool lost;
+    };
+
+    struct Separate {
+        std::vector<uint8_t> datagram;
+        uint64_t atMs;                   // Next (re)transmission
+        uint8_t sends;
+    };
+
+    bool lost() {
+        std::bernoulli_distribution lose(options_.loss);
+        return lose(random_);
+    }
+
+    // Datagrams may overtake each other
+    void queue(const std::vector<uint8_t>& datagram, uint32_t delayMs) {
+        bool dropped = lost();
+        datagramsOut++;
+        lostOut += dropped ? 1 : 0;
+        Pending pending = { nativeClockNowMs() + delayMs, datagram, dropped };
+        auto at = std::upper_bound(outgoing_.begin(), outgoing_.end(), pending,
+                                   [](const Pending& a, const Pending& b) { return a.atMs < b.atMs; });
+        outgoing_.insert(at, pending);
+    }
+
+    std::mt19937_64& random_;
+    const CoapOptions& options_;
+    std::deque<Pending> outgoing_;
+    std::map<uint16_t, Separate> separate_;           // By the response's message id
+    std::map<uint16_t, std::vector<uint8_t>> answers_;   // By the request's message id
+    uint16_t nextMessageId_ = 0x4000;
+    bool associated_ = false;
+    bool sessionKnown_ = false;
+};
+
+struct CoapState {
+    CoapOptions options;
+    std::mt19937_64 random;
+    StandInCoapServer* server = NULL;
+};
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    CoapState& state = *(CoapState*)context;
+    StandInCoapServer& server = *state.server;
+    if (request.path != NULL) {
+        exchange->responseMs = server.roundTripMs();
+        return;
+    }
+    if (strcmp(request.host, COAP_HOST) != 0) {
+        exchange->connectMs = TLS_CONNECT_RTTS * server.roundTripMs();
+        return;
+    }
+    exchange->stream = &server;
+    exchange->sessionUnknown = !server.sessionKnown();
+    bool resumes = request.resuming && server.sessionKnown();
+    exchange->connectMs = (resumes ? DTLS_RESUMED_RTTS : DTLS_FULL_RTTS) * server.roundTripMs();
+}
+
+// ============================================================================
+// RUNNING
+// ============================================================================
+
+static uint64_t nextEvent(CoapState& state, double perHour) {
+    if (perHour <= 0) {
+        return UINT64_MAX;
+    }
+    std::exponential_distribution<double> gap(perHour / 3600000.0);
+    return nativeClockNowMs() + (uint64_t)gap(state.random);
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+struct Tally {
+    uint32_t checks = 0;
+    uint32_t succeeded = 0;
+    std::vector<uint64_t> checkMs;       // Connect and answer, of the successful ones
+};
+
+// Count the trace records appended since the last call
+static void tally(uint32_t* seen, Tally* tallies) {
+    const TraceBuffer& trace = watcher.traceBuffer();
+    uint32_t appended = trace.count() + trace.dropped();
+    uint16_t fresh = (uint16_t)std::min<uint32_t>(appended - *seen, trace.count());
+    for (uint16_t i = trace.count() - fresh; i < trace.count(); i++) {
+        const TraceRecord& record = trace.at(i);
+        if (record.endpoint != traceEndpoint(COAP_ENDPOINT) && record.endpoint != traceEndpoint(HTTPS_ENDPOINT)) {
+            continue;
+        }
+        Tally& tally = tallies[record.endpoint == traceEndpoint(COAP_ENDPOINT) ? COAP_ENDPOINT : HTTPS_ENDPOINT];
+        tally.checks++;
+        if (record.outcome == TRACE_OK) {
+            tally.succeeded++;
+            tally.checkMs.push_back((uint64_t)record.connectMs + record.firstByteMs);
+        }
+    }
+    *seen = appended;
+}
+
+static uint64_t median(std::vector<uint64_t> values) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static double perCheck(double value, uint32_t checks) {
+    return checks > 0 ? value / checks : 0.0;
+}
+
+static void printTransport(const char* name, const TrafficRecord& traffic, const Tally& tally, double roundTrips) {
+    printf("%-12s %5u check(s), %5.1f%% answered, %6.0f bytes/check (%2u%% handshake), %4.2f round trips/check, "
+           "median %4llu ms\n", name, tally.checks, perCheck(100.0 * tally.succeeded, tally.checks),
+           perCheck(trafficTotal(traffic), traffic.requests), trafficHandshakePercent(traffic),
+           perCheck(roundTrips, traffic.requests), (unsigned long long)median(tally.checkMs));
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, CoapOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--hours") == 0) options->hours = atof(value);
+        else if (strcmp(name, "--loss") == 0) options->loss = atof(value);
+        else if (strcmp(name, "--separate") == 0) options->separate = atof(value);
+        else if (strcmp(name, "--rebind-rate") == 0) options->rebindRate = atof(value);
+        else if (strcmp(name, "--evict-rate") == 0) options->evictRate = atof(value);
+        else if (strcmp(name, "--min-success") == 0) options->minSuccess = atof(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else return false;
+    }
+    // Per-endpoint traffic is only kept for the current day
+    return options->hours > 0 && options->hours <= 23 && options->loss >= 0 && options->loss < 1 &&
+           options->separate >= 0 && options->separate <= 1;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    CoapState coap;
+    CoapState* state = &coap;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: coap [--hours H] [--loss L] [--separate S] [--rebind-rate R] [--evict-rate R]\n"
+               "            [--min-success M] [--seed S]   (H up to 23)\n");
+        return 1;
+    }
+    const CoapOptions& options = state->options;
+    state->random.seed(options.seed);
+    StandInCoapServer server(state->random, options);
+    state->server = &server;
+
+    nativeClockSetMs(EPOCH_MS);
+    standInServerSet(handleExchange, state);
+    setup();
+
+    uint64_t endMs = EPOCH_MS + (uint64_t)(options.hours * 3600000);
+    uint64_t rebindMs = nextEvent(*state, options.rebindRate);
+    uint64_t evictMs = nextEvent(*state, options.evictRate);
+    uint32_t rebinds = 0;
+    uint32_t evictions = 0;
+    uint32_t seen = 0;
+    Tally tallies[2];
+
+    while (nativeClockNowMs() < endMs) {
+        nativeRunUntil(std::min({rebindMs, evictMs, nativeClockNowMs() + TALLY_MS, endMs}), loop);
+        tally(&seen, tallies);
+        uint64_t now = nativeClockNowMs();
+        if (now >= rebindMs) {
+            server.rebind();
+            rebinds++;
+            rebindMs = nextEvent(*state, options.rebindRate);
+        }
+        if (now >= evictMs) {
+            server.evict();
+            evictions++;
+            evictMs = nextEvent(*state, options.evictRate);
+        }
+    }
+
+    TrafficRecord coapTraffic = watcher.trafficLedger().today(COAP_ENDPOINT);
+    TrafficRecord httpsTraffic = watcher.trafficLedger().today(HTTPS_ENDPOINT);
+    const Tally& coapTally = tallies[COAP_ENDPOINT];
+    const Tally& httpsTally = tallies[HTTPS_ENDPOINT];
+    uint32_t full = nativeDtlsHandshakes() - nativeDtlsResumptions();
+    uint32_t resumed = nativeDtlsResumptions();
+    double coapRoundTrips = full * DTLS_FULL_RTTS + resumed * DTLS_RESUMED_RTTS + coapProbe.transmissions();
+    double httpsRoundTrips = httpsTraffic.connections * TLS_CONNECT_RTTS + httpsTraffic.requests;
+
+    bool falseSuccess = coapTally.succeeded > server.requests;
+    bool dearer = perCheck(trafficTotal(coapTraffic), coapTraffic.requests) >=
+                      perCheck(trafficTotal(httpsTraffic), httpsTraffic.requests) ||
+                  perCheck(coapRoundTrips, coapTraffic.requests) >= perCheck(httpsRoundTrips, httpsTraffic.requests);
+    bool unreliable = coapTally.checks == 0 || coapTally.succeeded < options.minSuccess * coapTally.checks;
+    bool failed = falseSuccess || dearer || unreliable;
+
+    printf("\n========================================\n");
+    printf("CoAP transport: %.1f h, %.1f%% datagram loss each way, %.0f%% separate responses, %u NAT "
+           "rebinding(s), %u session eviction(s)\n", options.hours, options.loss * 100, options.separate * 100,
+           rebinds, evictions);
+    printf("========================================\n");
+    printTransport("CoAP (1):", coapTraffic, coapTally, coapRoundTrips);
+    printTransport("HTTPS (2):", httpsTraffic, httpsTally, httpsRoundTrips);
+    printf("----------------------------------------\n");
+    printf("DTLS:        %u full handshake(s), %u resumed\n", full, resumed);
+    printf("Requests:    %u sent by the firmware, %u of them retransmissions\n", coapProbe.transmissions(),
+           coapProbe.retransmissions());
+    printf("Server:      %u request(s) received, %u duplicate(s), %u answered separately\n", server.requests,
+           server.duplicates, server.separateAnswers);
+    printf("Datagrams:   %u in (%u lost), %u out (%u lost)\n", server.datagramsIn, server.lostIn,
+           server.datagramsOut, server.lostOut);
+    printf("========================================\n");
+    if (falseSuccess) {
+        printf("The firmware counted %u CoAP check(s) answered, the server received %u\n", coapTally.succeeded,
+               server.requests);
+    }
+    printf("%s\n", failed ? "CoAP FAILED" : "CoAP PASSED");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+// ============================================================================
+// OUTAGE TIME-TO-DETECT HARNESS (host build: pio run -e native_detect)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp, lean HTTP path) against the native
+// shim and measures how long an outage takes to show: after the endpoints
+// have settled UP, an outage starts at a random moment and the virtual
+// clock runs until the watcher's health state flips. Then the outage ends
+// and the clock runs until every endpoint is UP again.
+//
+// Outages (--cut):
+//
+//   server   the stand-in server stops answering (remote power or WAN
+//            outage); the gateway still answers the link check
+//   uplink   nothing past the station answers, gateway included (the
+//            router lost power behind an access point that did not)
+//
+// For each trial it records the time from the cut to the first endpoint
+// DOWN and to every endpoint DOWN, and from the restore to every endpoint
+// UP, each taken when the deciding request would have ended on the device
+// (see requestEndMs()). The summary gives min / median / p90 / max of
+// each, plus what the watching cost while healthy: HTTPS requests and bare
+// link check connects per hour. Build with -DLINK_CHECK_INTERVAL_MS=0 to
+// compare against polling alone.
+//
+// Exits non-zero when a trial does not detect its outage within
+// --give-up-ms.
+//
+// Usage:
+//   detect [--trials N] [--cut server|uplink] [--seed S] [--max-latency-ms L]
+//          [--give-up-ms G]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Firmware entry points and the watcher (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint32_t POLL_INTERVAL_MS = 30000;    // Must match src/main.cpp
+const uint64_t SETTLE_MS = 2 * POLL_INTERVAL_MS;   // Healthy time before each cut
+
+enum CutKind {
+    CUT_SERVER,
+    CUT_UPLINK,
+};
+
+struct DetectOptions {
+    uint32_t trials = 200;
+    CutKind cut = CUT_SERVER;
+    uint64_t seed = 1;
+    uint32_t maxLatencyMs = 400;
+    uint64_t giveUpMs = 10 * POLL_INTERVAL_MS;
+};
+
+// ============================================================================
+// STAND-IN SERVER
+// ============================================================================
+
+struct DetectState {
+    DetectOptions options;
+    std::mt19937_64 random;
+    bool serverUp = true;
+    uint64_t requests = 0;
+};
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    DetectState& state = *(DetectState*)context;
+    std::uniform_int_distribution<uint32_t> latency(0, state.options.maxLatencyMs / 2);
+
+    if (request.path == NULL) {
+        exchange->reachable = state.serverUp;
+        exchange->connectMs = state.serverUp ? latency(state.random) : 0;   // 0: the client times out
+        return;
+    }
+    exchange->responseMs = latency(state.random);
+    exchange->status = 200;
+    exchange->bodyBytes = 2;
+    state.requests++;
+}
+
+static void setOutage(DetectState& state, bool out) {
+    state.serverUp = !out;
+    if (state.options.cut == CUT_UPLINK) {
+        nativeNetworkSet(!out, !out);
+    }
+}
+
+// ============================================================================
+// RUNNING
+// ============================================================================
+
+// When the request that just set endpoint's health would have ended on the
+// device. The shim runs request tasks one after another, so a result
+// arrives late by the other requests of its batch (a timeout each while
+// the server is cut); on the device they all run at once from the batch's
+// dispatch.
+static uint64_t requestEndMs(uint16_t endpoint) {
+    const EndpointRuntime& runtime = watcher.scheduler().endpoint(endpoint);
+    uint64_t dispatchMs = nativeClockNowMs() - (uint32_t)(millis() - runtime.lastDispatchMs);
+
+    const TraceBuffer& trace = watcher.traceBuffer();
+    for (uint16_t i = trace.count(); i > 0; i--) {
+        const TraceRecord& record = trace.at(i - 1);
+        if (record.endpoint == traceEndpoint(endpoint)) {
+            return dispatchMs + record.connectMs + record.firstByteMs + record.transferMs;
+        }
+    }
+    return nativeClockNowMs();
+}
+
+// Run loop() until every endpoint is in the given health state, noting
+// when each got there. Returns false when limitMs passes first.
+static bool runUntilHealth(uint8_t health, uint64_t limitMs, std::vector<uint64_t>* reachedMs) {
+    uint16_t count = watcher.endpointCount();
+    uint64_t startMs = nativeClockNowMs();
+    reachedMs->assign(count, UINT64_MAX);
+    uint16_t reached = 0;
+    for (;;) {
+        for (uint16_t i = 0; i < count; i++) {
+            if ((*reachedMs)[i] == UINT64_MAX && watcher.scheduler().endpoint(i).health == health) {
+                (*reachedMs)[i] = requestEndMs(i);
+                reached++;
+            }
+        }
+        if (reached == count) {
+            return true;
+        }
+        if (nativeClockNowMs() - startMs > limitMs) {
+            return false;
+        }
+        loop();
+    }
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+static uint64_t percentile(std::vector<uint64_t> values, double share) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(share * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void printFigure(const char* name, const std::vector<uint64_t>& values) {
+    printf("%-22s %7.1f %7.1f %7.1f %7.1f\n", name, percentile(values, 0.0) / 1000.0,
+           percentile(values, 0.5) / 1000.0, percentile(values, 0.9) / 1000.0, percentile(values, 1.0) / 1000.0);
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, DetectOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--trials") == 0) options->trials = (uint32_t)atol(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else if (strcmp(name, "--max-latency-ms") == 0) options->maxLatencyMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--give-up-ms") == 0) options->giveUpMs = strtoull(value, NULL, 10);
+        else if (strcmp(name, "--cut") == 0 && strcmp(value, "server") == 0) options->cut = CUT_SERVER;
+        else if (strcmp(name, "--cut") == 0 && strcmp(value, "uplink") == 0) options->cut = CUT_UPLINK;
+        else return false;
+    }
+    return options->trials > 0;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    DetectState detect;
+    DetectState* state = &detect;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: detect [--trials N] [--cut server|uplink] [--seed S] [--max-latency-ms L]\n"
+               "              [--give-up-ms G]\n");
+        return 1;
+    }
+    state->random.seed(state->options.seed);
+
+    nativeClockSetMs(1000);
+    standInServerSet(handleExchange, state);
+    setup();
+
+    const uint16_t endpoints = watcher.endpointCount();
+    const DetectOptions& options = state->options;
+    std::vector<uint64_t> firstDown;
+    std::vector<uint64_t> allDown;
+    std::vector<uint64_t> allUp;
+    std::vector<uint64_t> reachedMs;
+    uint32_t missed = 0;
+    uint64_t healthyMs = 0;
+    uint64_t healthyRequests = 0;
+    uint64_t healthyConnects = 0;
+
+    for (uint32_t trial = 0; trial < options.trials; trial++) {
+        // Healthy stretch of random length, so the cut lands anywhere in
+        // the poll and link check cadence
+        uint64_t healthyStartMs = nativeClockNowMs();
+        uint64_t requestsBefore = state->requests;
+        uint32_t connectsBefore = nativeLinkConnects();
+        std::uniform_int_distribution<uint64_t> offset(0, POLL_INTERVAL_MS - 1);
+        nativeRunUntil(nativeClockNowMs() + SETTLE_MS + offset(state->random), loop);
+        healthyMs += nativeClockNowMs() - healthyStartMs;
+        healthyRequests += state->requests - requestsBefore;
+        healthyConnects += nativeLinkConnects() - connectsBefore;
+
+        setOutage(*state, true);
+        uint64_t cutMs = nativeClockNowMs();
+        if (runUntilHealth(HEALTH_DOWN, options.giveUpMs, &reachedMs)) {
+            firstDown.push_back(*std::min_element(reachedMs.begin(), reachedMs.end()) - cutMs);
+            allDown.push_back(*std::max_element(reachedMs.begin(), reachedMs.end()) - cutMs);
+        } else {
+            missed++;
+        }
+
+        setOutage(*state, false);
+        uint64_t restoreMs = nativeClockNowMs();
+        if (runUntilHealth(HEALTH_UP, options.giveUpMs, &reachedMs)) {
+            allUp.push_back(*std::max_element(reachedMs.begin(), reachedMs.end()) - restoreMs);
+        } else {
+            missed++;
+        }
+    }
+
+    const LinkCheck& linkCheck = watcher.linkCheck();
+    double hours = healthyMs / 3600000.0;
+
+    printf("\n========================================\n");
+    printf("Time to detect: %s outage, %u trial(s), %u endpoint(s)\n",
+           options.cut == CUT_SERVER ? "server" : "uplink", options.trials, endpoints);
+    printf("Link check:     %s\n", linkCheck.enabled() ? "on" : "off (polling only)");
+    if (linkCheck.enabled()) {
+        printf("                every %lu ms, %lu check(s), %lu failed, link lost %lu time(s)\n",
+               (unsigned long)linkCheck.intervalMs(), (unsigned long)linkCheck.checks(),
+               (unsigned long)linkCheck.failures(), (unsigned long)linkCheck.losses());
+    }
+    printf("========================================\n");
+    printf("Seconds                    min  median     p90     max\n");
+    printFigure("Cut to first DOWN", firstDown);
+    printFigure("Cut to all DOWN", allDown);
+    printFigure("Restore to all UP", allUp);
+    printf("----------------------------------------\n");
+    printf("While healthy:  %.1f HTTPS request(s)/h, %.1f link connect(s)/h\n",
+           hours > 0 ? healthyRequests / hours : 0.0, hours > 0 ? healthyConnects / hours : 0.0);
+    printf("Missed:         %u (not detected within %llu ms)\n", missed, (unsigned long long)options.giveUpMs);
+    printf("========================================\n");
+
+    return missed == 0 ? 0 : 1;
+}
@@ -0,0 +1,292 @@
+// ============================================================================
+// FLEET HARNESS (host build: pio run -e native_fleet)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp, sized like the esp32dev_fleet
+// environment: 512 endpoints through 4 request tasks) against the native
+// shim, with an endpoint table packed by scripts/config_pack.py served as
+// the config partition. A share of connections hangs until the watchdog
+// deletes its worker, so, as on a busy device, some request is nearly
+// always in flight.
+//
+// Checks that the poll cycles still close: onCycleComplete() (which steps
+// the TX power, counted by TxPowerControl::cycles()) must fire at least
+// once every two poll intervals, and the cycles must book energy.
+//
+// With --list (the text file the table was packed from), it first checks
+// the blob format through configPartitionMap(): the endpoint count, each
+// URL, hosts numbered in order of first appearance (case-insensitive), and
+// that a table with one byte changed is rejected by its checksum.
+//
+// Exits non-zero when a check fails.
+//
+// Usage:
+//   fleet <table.bin> [--list endpoints.txt] [--minutes M] [--hang-rate P]
+//         [--seed S] [--max-latency-ms L]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <TxPower.h>
+#include <Watcher.h>
+#include <config_partition.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Firmware entry points and state (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+extern TxPowerControl txPower;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint32_t POLL_INTERVAL_MS = 30000;    // Must match src/main.cpp
+const uint64_t MAX_CYCLE_GAP_MS = 2 * POLL_INTERVAL_MS;
+
+struct FleetOptions {
+    const char* tablePath = NULL;
+    const char* listPath = NULL;
+    double minutes = 30.0;
+    double hangRate = 0.01;
+    uint64_t seed = 1;
+    uint32_t maxLatencyMs = 400;
+};
+
+// ============================================================================
+// STAND-IN SERVER
+// ============================================================================
+
+struct FleetState {
+    FleetOptions options;
+    std::mt19937_64 random;
+    uint64_t requests = 0;
+    uint64_t hangs = 0;
+};
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    FleetState& state = *(FleetState*)context;
+    std::uniform_int_distribution<uint32_t> latency(0, state.options.maxLatencyMs / 2);
+
+    if (request.path == NULL) {
+        exchange->reachable = true;
+        exchange->connectMs = latency(state.random);
+        if (std::bernoulli_distribution(state.options.hangRate)(state.random)) {
+            exchange->hang = true;
+            state.hangs++;
+        }
+        return;
+    }
+    exchange->responseMs = latency(state.random);
+    exchange->status = 200;
+    exchange->bodyBytes = 2;
+    state.requests++;
+}
+
+// ============================================================================
+// TABLE FORMAT
+// ============================================================================
+
+// URLs of an endpoint list as scripts/config_pack.py reads it: the last
+// field of every line that is not blank or a comment
+static bool readList(const char* path, std::vector<std::string>* urls) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        std::string url;
+        for (char* field = strtok(line, " \t\r\n"); field != NULL; field = strtok(NULL, " \t\r\n")) {
+            url = field;
+        }
+        if (!url.empty()) {
+            urls->push_back(url);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// Host name of "scheme://host[:port]/path", lower case
+static std::string urlHost(const std::string& url) {
+    size_t scheme = url.find("://");
+    size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+    size_t end = url.find_first_of(":/", start);
+    std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    for (char& c : host) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return host;
+}
+
+static bool checkTable(const std::vector<uint8_t>& blob, const std::vector<std::string>& urls) {
+    bool passed = true;
+
+    // One character of the last URL changed: only the checksum can tell
+    std::vector<uint8_t> corrupt = blob;
+    corrupt[corrupt.size() - 2] ^= 0x01;
+    EndpointTable rejected;
+    nativePartitionSet("config", CONFIG_PARTITION_SUBTYPE, corrupt.data(), corrupt.size());
+    if (configPartitionMap("config", &rejected)) {
+        printf("Table check: a corrupted table was accepted\n");
+        passed = false;
+    }
+
+    EndpointTable table;
+    nativePartitionSet("config", CONFIG_PARTITION_SUBTYPE, blob.data(), blob.size());
+    if (!configPartitionMap("config", &table)) {
+        printf("Table check: the table was rejected\n");
+        return false;
+    }
+    if (table.count() != urls.size()) {
+        printf("Table check: %u endpoint(s), the list has %zu\n", table.count(), urls.size());
+        return false;
+    }
+
+    std::map<std::string, uint16_t> hosts;
+    for (uint16_t i = 0; i < table.count(); i++) {
+        uint16_t expected = hosts.emplace(urlHost(urls[i]), (uint16_t)hosts.size()).first->second;
+        if (urls[i] != table.url(i)) {
+            printf("Table check: endpoint %u is %s, the list says %s\n", i + 1, table.url(i), urls[i].c_str());
+            passed = false;
+        }
+        if (table.record(i).host != expected) {
+            printf("Table check: endpoint %u on host %u, expected %u\n", i + 1, table.record(i).host, expected);
+            passed = false;
+        }
+    }
+    if (table.hostCount() != hosts.size()) {
+        printf("Table check: %u host(s), the list has %zu\n", table.hostCount(), hosts.size());
+        passed = false;
+    }
+    printf("Table check: %u endpoint(s) on %u host(s), corrupted copy rejected: %s\n", table.count(),
+           table.hostCount(), passed ? "PASSED" : "FAILED");
+    return passed;
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, FleetOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (name[0] != '-' && options->tablePath == NULL) {
+            options->tablePath = name;
+            continue;
+        }
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--list") == 0) options->listPath = value;
+        else if (strcmp(name, "--minutes") == 0) options->minutes = atof(value);
+        else if (strcmp(name, "--hang-rate") == 0) options->hangRate = atof(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else if (strcmp(name, "--max-latency-ms") == 0) options->maxLatencyMs = (uint32_t)atol(value);
+        else return false;
+    }
+    return options->tablePath != NULL && options->minutes > 0;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->insert(data->end(), buffer, buffer + got);
+    }
+    fclose(file);
+    return true;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    FleetState fleet;
+    FleetState* state = &fleet;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: fleet <table.bin> [--list endpoints.txt] [--minutes M] [--hang-rate P]\n"
+               "             [--seed S] [--max-latency-ms L]\n");
+        return 1;
+    }
+    state->random.seed(state->options.seed);
+
+    std::vector<uint8_t> blob;
+    if (!readFile(state->options.tablePath, &blob)) {
+        printf("Cannot read %s\n", state->options.tablePath);
+        return 1;
+    }
+    bool tableChecked = true;
+    if (state->options.listPath != NULL) {
+        std::vector<std::string> urls;
+        if (!readList(state->options.listPath, &urls)) {
+            printf("Cannot read %s\n", state->options.listPath);
+            return 1;
+        }
+        tableChecked = checkTable(blob, urls);
+    }
+    nativePartitionSet("config", CONFIG_PARTITION_SUBTYPE, blob.data(), blob.size());
+
+    nativeClockSetMs(1000);
+    standInServerSet(handleExchange, state);
+    setup();
+
+    const uint64_t startMs = nativeClockNowMs();
+    const uint64_t endMs = startMs + (uint64_t)(state->options.minutes * 60000.0);
+    uint64_t lastCycleMs = startMs;
+    uint64_t longestGapMs = 0;
+    uint32_t cycles = txPower.cycles();
+    while (nativeClockNowMs() < endMs) {
+        loop();
+        if (txPower.cycles() != cycles) {
+            cycles = txPower.cycles();
+            longestGapMs = std::max(longestGapMs, nativeClockNowMs() - lastCycleMs);
+            lastCycleMs = nativeClockNowMs();
+        }
+    }
+    longestGapMs = std::max(longestGapMs, nativeClockNowMs() - lastCycleMs);
+
+    EnergyRecord energy = watcher.energyLedger().grandTotal();
+    bool closing = cycles > 0 && longestGapMs <= MAX_CYCLE_GAP_MS;
+    bool booked = energy.requests > 0;
+
+    printf("\n========================================\n");
+    printf("Fleet: %u endpoint(s), %.1f virtual minute(s), hang rate %.4f\n", watcher.endpointCount(),
+           state->options.minutes, state->options.hangRate);
+    printf("========================================\n");
+    printf("Requests:             %llu (%llu hung)\n", (unsigned long long)state->requests,
+           (unsigned long long)state->hangs);
+    printf("Poll cycles closed:   %lu\n", (unsigned long)cycles);
+    printf("Longest gap:          %.1f s (limit %.1f s)\n", longestGapMs / 1000.0, MAX_CYCLE_GAP_MS / 1000.0);
+    printf("Energy booked for:    %lu request(s)\n", (unsigned long)energy.requests);
+    printf("========================================\n");
+
+    if (!tableChecked || watcher.endpointCount() == 0 || !closing || !booked) {
+        printf("Fleet FAILED\n");
+        return 1;
+    }
+    printf("Fleet PASSED\n");
+    return 0;
+}
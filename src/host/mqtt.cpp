@@ -0,0 +1,541 @@
+// ============================================================================
+// MQTT PUBLISHER HARNESS (host build: pio run -e native_mqtt)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp) against the native shim with a
+// broker stand-in: endpoint 1 and the heartbeat relay's collector are
+// mqtts:// URLs on it, endpoint 2 stays an HTTPS GET on the stand-in
+// server, so both transports run side by side (platformio.ini, env
+// native_mqtt).
+//
+// The broker speaks enough MQTT 3.1.1 for a publisher: CONNECT with a will
+// and a persistent session, QoS 1 PUBLISH / PUBACK, QoS 0 retained status,
+// PINGREQ, DISCONNECT. Every answer comes 20-200 ms late. Faults:
+//   --ack-loss     share of PUBACKs the broker never sends
+//   --drop-rate    broker-side connection drops per hour
+//   --outage-rate  WiFi outages (1 to 5 minutes) per hour: the connection
+//                  goes half-open, and the broker only learns from the
+//                  missing keep-alive
+// The broker publishes the will itself like a real one: when the
+// connection closes without DISCONNECT while the network is up, when the
+// keep-alive runs out (1.5 periods without a packet), or when a new
+// connection takes the session over. After the run, ten minutes without
+// faults let the device settle, then it loses power, and the time until
+// the broker publishes it offline is measured.
+//
+// Exits non-zero when a publish the firmware made is neither received by
+// the broker nor still in flight, when the will goes out while the device
+// is up and its link is fine, when the status topic does not read "online"
+// at the end, or when the power cut is not announced within one and a half
+// keep-alive periods.
+//
+// Usage:
+//   mqtt [--hours H] [--ack-loss L] [--drop-rate R] [--outage-rate R] [--seed S]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+#include <MqttProbe.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Firmware entry points and objects (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+extern MqttProbe mqttProbe;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint16_t KEEPALIVE_S = 30;            // Must match platformio.ini
+const char* const BROKER_HOST = "broker.standin.local";
+const uint16_t MQTT_ENDPOINT = 0;
+const uint16_t HTTPS_ENDPOINT = 1;
+const uint64_t EPOCH_MS = 1000;
+const uint64_t SETTLE_MS = 10 * 60000;    // Without faults, before the power cut
+
+struct MqttOptions {
+    double hours = 6;
+    double ackLoss = 0.01;
+    double dropRate = 0.5;
+    double outageRate = 0.5;
+    uint64_t seed = 1;
+};
+
+// ============================================================================
+// BROKER STAND-IN
+// ============================================================================
+
+enum WillCause : uint8_t {
+    WILL_CLOSED,        // Connection closed without DISCONNECT
+    WILL_KEEPALIVE,     // 1.5 keep-alive periods without a packet
+    WILL_TAKEOVER,      // A new connection took the session over
+    WILL_BROKER,        // The broker dropped the connection itself
+};
+
+static const char* const WILL_CAUSES[] = {"closed", "keep-alive", "takeover", "broker drop"};
+
+struct WillEvent {
+    uint64_t atMs;
+    uint8_t cause;
+    bool deviceUp;      // Powered, with the network up
+};
+
+class StandInBroker : public StandInStream {
+public:
+    StandInBroker(std::mt19937_64& random, double ackLoss)
+        : random_(random), ackLoss_(ackLoss), reader_(body_, sizeof(body_)) {}
+
+    // ---- StandInStream: the client's side of the connection ----
+
+    void opened() override {
+        if (sessionConnected_) {
+            will(WILL_TAKEOVER);
+        }
+        tcpOpen_ = true;
+        outgoing_.clear();
+        reader_.reset();
+    }
+
+    void received(const uint8_t* data, size_t size) override {
+        while (size > 0) {
+            size_t taken = reader_.feed(data, size);
+            data += taken;
+            size -= taken;
+            if (reader_.complete()) {
+                handlePacket();
+            }
+        }
+    }
+
+    size_t ready() override {
+        uint64_t now = nativeClockNowMs();
+        size_t bytes = 0;
+        for (const Pending& pending : outgoing_) {
+            if (pending.atMs > now) {
+                break;
+            }
+            bytes += pending.bytes.size() - pending.taken;
+        }
+        return bytes;
+    }
+
+    size_t take(uint8_t* out, size_t size) override {
+        uint64_t now = nativeClockNowMs();
+        size_t copied = 0;
+        while (copied < size && !outgoing_.empty() && outgoing_.front().atMs <= now) {
+            Pending& pending = outgoing_.front();
+            size_t chunk = std::min(size - copied, pending.bytes.size() - pending.taken);
+            memcpy(out + copied, pending.bytes.data() + pending.taken, chunk);
+            pending.taken += chunk;
+            copied += chunk;
+            if (pending.taken == pending.bytes.size()) {
+                outgoing_.pop_front();
+            }
+        }
+        return copied;
+    }
+
+    bool open() override { return tcpOpen_ && networkUp_; }
+
+    // The FIN only reaches the broker while the network is up
+    void closed() override {
+        tcpOpen_ = false;
+        if (networkUp_ && sessionConnected_) {
+            will(WILL_CLOSED);
+        }
+    }
+
+    // ---- Faults and time ----
+
+    // A dead network leaves the broker's end of the connection half-open
+    void setNetwork(bool up) {
+        networkUp_ = up;
+        tcpOpen_ = tcpOpen_ && up;
+    }
+
+    void setPowered(bool powered) { powered_ = powered; }
+
+    void dropConnection() {
+        if (sessionConnected_) {
+            will(WILL_BROKER);
+            tcpOpen_ = false;
+        }
+    }
+
+    // When the keep-alive runs out (UINT64_MAX: not connected)
+    uint64_t expiryMs() const {
+        return sessionConnected_ ? lastPacketMs_ + KEEPALIVE_S * 1500ULL : UINT64_MAX;
+    }
+
+    // A firmware turn may run past the expiry; the will is dated to it
+    void tick() {
+        if (sessionConnected_ && nativeClockNowMs() >= expiryMs()) {
+            will(WILL_KEEPALIVE, expiryMs());
+        }
+    }
+
+    // ---- Results ----
+
+    std::vector<WillEvent> wills;
+    std::string status;                  // Retained on the status topic
+    uint32_t connects = 0;
+    uint32_t resumed = 0;                // Sessions found present
+    uint32_t publishes = 0;              // QoS 1 PUBLISH packets
+    uint32_t duplicates = 0;             // Of a packet id already received
+    uint32_t dupFlagged = 0;
+    uint32_t acksDropped = 0;
+    uint32_t pings = 0;
+    uint32_t disconnects = 0;
+    std::set<uint16_t> receivedIds;
+    std::vector<uint64_t> relayPublishes;
+
+private:
+    struct Pending {
+        uint64_t atMs;
+        std::vector<uint8_t> bytes;
+        size_t taken = 0;
+    };
+
+    // Answers keep their order
+    void send(std::initializer_list<uint8_t> bytes) {
+        std::uniform_int_distribution<uint32_t> latency(20, 200);
+        uint64_t atMs = nativeClockNowMs() + latency(random_);
+        if (!outgoing_.empty()) {
+            atMs = std::max(atMs, outgoing_.back().atMs);
+        }
+        outgoing_.push_back(Pending{atMs, std::vector<uint8_t>(bytes), 0});
+    }
+
+    void will(uint8_t cause, uint64_t atMs = 0) {
+        wills.push_back(WillEvent{atMs != 0 ? atMs : nativeClockNowMs(), cause, powered_ && networkUp_});
+        status = "offline";
+        sessionConnected_ = false;
+    }
+
+    // Length-prefixed string at body[*at]
+    std::string string(size_t* at) {
+        const uint8_t* body = reader_.body();
+        size_t length = (size_t)body[*at] << 8 | body[*at + 1];
+        std::string text((const char*)body + *at + 2, length);
+        *at += 2 + length;
+        return text;
+    }
+
+    void handlePacket() {
+        const uint8_t* body = reader_.body();
+        lastPacketMs_ = nativeClockNowMs();
+        uint8_t type = reader_.type();
+
+        if (type == MQTT_CONNECT) {
+            size_t at = 0;
+            string(&at);                                 // "MQTT"
+            uint8_t flags = body[at + 1];
+            at += 2;
+            keepAliveS_ = (uint16_t)(body[at] << 8 | body[at + 1]);
+            at += 2;
+            std::string clientId = string(&at);
+            bool present = (flags & 0x02) == 0 && clientId == sessionId_;
+            if ((flags & 0x02) != 0 || clientId != sessionId_) {
+                receivedIds.clear();
+            }
+            sessionId_ = clientId;
+            sessionConnected_ = true;
+            connects++;
+            resumed += present ? 1 : 0;
+            send({MQTT_CONNACK << 4, 2, (uint8_t)(present ? 1 : 0), 0});
+        } else if (!sessionConnected_) {
+            return;                                      // Nothing before CONNECT
+        } else if (type == MQTT_PUBLISH) {
+            size_t at = 0;
+            std::string topic = string(&at);
+            uint8_t qos = (reader_.flags() >> 1) & 3;
+            std::string payload;
+            if (qos == 0) {
+                payload.assign((const char*)body + at, reader_.length() - at);
+                if (topic.find("/status") != std::string::npos) {
+                    status = payload;
+                }
+                return;
+            }
+            uint16_t packetId = (uint16_t)(body[at] << 8 | body[at + 1]);
+            publishes++;
+            dupFlagged += (reader_.flags() & 0x08) != 0 ? 1 : 0;
+            duplicates += receivedIds.insert(packetId).second ? 0 : 1;
+            if (topic.find("relay") != std::string::npos) {
+                relayPublishes.push_back(lastPacketMs_);
+            }
+            std::bernoulli_distribution lost(ackLoss_);
+            if (lost(random_)) {
+                acksDropped++;
+                return;
+            }
+            send({MQTT_PUBACK << 4, 2, (uint8_t)(packetId >> 8), (uint8_t)packetId});
+        } else if (type == MQTT_PINGREQ) {
+            pings++;
+            send({MQTT_PINGRESP << 4, 0});
+        } else if (type == MQTT_DISCONNECT) {
+            disconnects++;
+            sessionConnected_ = false;                   // No will
+        }
+    }
+
+    std::mt19937_64& random_;
+    double ackLoss_;
+    uint8_t body_[512];
+    MqttReader reader_;
+    std::deque<Pending> outgoing_;
+    std::string sessionId_;
+    bool tcpOpen_ = false;
+    bool networkUp_ = true;
+    bool powered_ = true;
+    bool sessionConnected_ = false;      // The broker's view of the connection
+    uint16_t keepAliveS_ = 0;
+    uint64_t lastPacketMs_ = 0;
+};
+
+struct Outage {
+    uint64_t startMs;
+    bool connected;     // The broker had a connection when it began
+    size_t willsBefore;
+};
+
+struct MqttState {
+    MqttOptions options;
+    std::mt19937_64 random;
+    StandInBroker* broker = NULL;
+    bool networkUp = true;
+    uint32_t brokerConnects = 0;
+};
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    MqttState& state = *(MqttState*)context;
+    std::uniform_int_distribution<uint32_t> latency(20, 200);
+    if (request.path != NULL) {
+        exchange->responseMs = latency(state.random);
+        return;
+    }
+    exchange->reachable = state.networkUp;
+    exchange->connectMs = latency(state.random);
+    if (strcmp(request.host, BROKER_HOST) == 0) {
+        exchange->stream = state.broker;
+        state.brokerConnects += state.networkUp ? 1 : 0;
+    }
+}
+
+// ============================================================================
+// RUNNING
+// ============================================================================
+
+static uint64_t nextEvent(MqttState& state, double perHour) {
+    if (perHour <= 0) {
+        return UINT64_MAX;
+    }
+    std::exponential_distribution<double> gap(perHour / 3600000.0);
+    return nativeClockNowMs() + (uint64_t)gap(state.random);
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+static uint64_t percentile(std::vector<uint64_t> values, double share) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(share * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void printFigure(const char* name, const std::vector<uint64_t>& values) {
+    printf("%-30s %7.1f %7.1f %7.1f %7.1f\n", name, percentile(values, 0.0) / 1000.0,
+           percentile(values, 0.5) / 1000.0, percentile(values, 0.9) / 1000.0, percentile(values, 1.0) / 1000.0);
+}
+
+static void printTransport(const char* name, const TrafficRecord& traffic) {
+    printf("%-16s %5u check(s), %4u TLS connect(s), %5.0f bytes/check (%2u%% handshake)\n", name,
+           (unsigned)traffic.requests, (unsigned)traffic.connections,
+           traffic.requests > 0 ? (double)trafficTotal(traffic) / traffic.requests : 0.0,
+           trafficHandshakePercent(traffic));
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, MqttOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--hours") == 0) options->hours = atof(value);
+        else if (strcmp(name, "--ack-loss") == 0) options->ackLoss = atof(value);
+        else if (strcmp(name, "--drop-rate") == 0) options->dropRate = atof(value);
+        else if (strcmp(name, "--outage-rate") == 0) options->outageRate = atof(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else return false;
+    }
+    // Per-endpoint traffic is only kept for the current day
+    return options->hours > 0 && options->hours <= 23 && options->ackLoss >= 0 && options->ackLoss < 1;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    MqttState mqtt;
+    MqttState* state = &mqtt;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: mqtt [--hours H] [--ack-loss L] [--drop-rate R] [--outage-rate R] [--seed S]\n"
+               "       (H up to 23)\n");
+        return 1;
+    }
+    const MqttOptions& options = state->options;
+    state->random.seed(options.seed);
+    StandInBroker broker(state->random, options.ackLoss);
+    state->broker = &broker;
+
+    nativeClockSetMs(EPOCH_MS);
+    standInServerSet(handleExchange, state);
+    setup();
+
+    uint64_t endMs = EPOCH_MS + (uint64_t)(options.hours * 3600000);
+    uint64_t dropMs = nextEvent(*state, options.dropRate);
+    uint64_t outageMs = nextEvent(*state, options.outageRate);
+    uint64_t outageEndMs = UINT64_MAX;
+    std::vector<Outage> outages;
+
+    for (;;) {
+        uint64_t next = std::min({dropMs, outageMs, outageEndMs, broker.expiryMs(), endMs});
+        if (next == endMs && nativeClockNowMs() >= endMs) {
+            next = std::min(broker.expiryMs(), endMs + SETTLE_MS);
+        }
+        nativeRunUntil(next, loop);
+        broker.tick();
+        uint64_t now = nativeClockNowMs();
+        if (now >= endMs + SETTLE_MS) {
+            break;
+        }
+        if (now >= endMs) {
+            // Settling: no new faults, the current outage ends
+            dropMs = UINT64_MAX;
+            outageMs = UINT64_MAX;
+            outageEndMs = std::min(outageEndMs, now);
+        }
+        if (now >= dropMs) {
+            broker.dropConnection();
+            dropMs = nextEvent(*state, options.dropRate);
+        }
+        if (now >= outageMs && state->networkUp) {
+            std::uniform_int_distribution<uint64_t> duration(60000, 5 * 60000);
+            outages.push_back(Outage{now, broker.expiryMs() != UINT64_MAX, broker.wills.size()});
+            state->networkUp = false;
+            broker.setNetwork(false);
+            nativeWiFiSetConnected(false);
+            outageEndMs = now + duration(state->random);
+            outageMs = UINT64_MAX;
+        }
+        if (now >= outageEndMs) {
+            state->networkUp = true;
+            broker.setNetwork(true);
+            nativeWiFiSetConnected(true);
+            outageEndMs = UINT64_MAX;
+            outageMs = nextEvent(*state, options.outageRate);
+        }
+    }
+
+    // The state of the run, before the power cut
+    const MqttSession& session = mqttProbe.session();
+    std::string statusAtEnd = broker.status;
+    uint32_t published = session.published();
+    uint32_t inFlight = session.inFlightCount();
+    uint32_t received = (uint32_t)broker.receivedIds.size();
+    TrafficRecord mqttTraffic = watcher.trafficLedger().today(MQTT_ENDPOINT);
+    TrafficRecord httpsTraffic = watcher.trafficLedger().today(HTTPS_ENDPOINT);
+
+    // Power cut: the firmware stops, the broker is left waiting
+    broker.setPowered(false);
+    uint64_t cutMs = nativeClockNowMs();
+    size_t willsBefore = broker.wills.size();
+    if (broker.expiryMs() != UINT64_MAX) {
+        nativeClockSetMs(broker.expiryMs());
+        broker.tick();
+    }
+    bool cutAnnounced = broker.wills.size() > willsBefore;
+    uint64_t cutLatencyMs = cutAnnounced ? broker.wills.back().atMs - cutMs : 0;
+
+    // Wills while the device was up: only the faults may cause them
+    uint32_t causes[4] = {0, 0, 0, 0};
+    uint32_t falseWills = 0;
+    for (size_t i = 0; i < willsBefore; i++) {
+        const WillEvent& event = broker.wills[i];
+        causes[event.cause]++;
+        if (event.deviceUp && (event.cause == WILL_CLOSED || event.cause == WILL_KEEPALIVE)) {
+            falseWills++;
+        }
+    }
+    // The first will after an outage began and before the next one is its
+    // announcement (a broker drop does not count; nothing to announce
+    // without a connection)
+    std::vector<uint64_t> offlineLatency;
+    for (size_t k = 0; k < outages.size(); k++) {
+        const Outage& outage = outages[k];
+        size_t willsEnd = k + 1 < outages.size() ? outages[k + 1].willsBefore : willsBefore;
+        for (size_t i = outage.willsBefore; outage.connected && i < willsEnd; i++) {
+            if (broker.wills[i].cause != WILL_BROKER) {
+                offlineLatency.push_back(broker.wills[i].atMs - outage.startMs);
+                break;
+            }
+        }
+    }
+
+    bool lost = received + inFlight < published;
+    bool cutLate = !cutAnnounced || cutLatencyMs > KEEPALIVE_S * 1500ULL;
+    bool failed = lost || falseWills > 0 || statusAtEnd != "online" || cutLate;
+    double hours = options.hours;
+
+    printf("\n========================================\n");
+    printf("MQTT publisher: %.1f h, keep-alive %u s, %.1f%% PUBACKs lost, %.1f broker drop(s)/h, "
+           "%zu WiFi outage(s)\n", hours, KEEPALIVE_S, options.ackLoss * 100, options.dropRate, outages.size());
+    printf("========================================\n");
+    printTransport("MQTT (1):", mqttTraffic);
+    printTransport("HTTPS (2):", httpsTraffic);
+    printf("Broker:          %u TLS connect(s) for endpoint 1 and the relay, %u CONNACK(s), %u with the "
+           "session resumed\n", state->brokerConnects, broker.connects, broker.resumed);
+    printf("Publishes:       %u by the firmware, %u received, %u in flight at the end, %u sent again (DUP)\n",
+           published, received, inFlight, session.resent());
+    printf("Broker saw:      %u QoS 1 publish(es), %u duplicate(s), %u PUBACK(s) withheld, %u ping(s), "
+           "%u DISCONNECT(s)\n", broker.publishes, broker.duplicates, broker.acksDropped, broker.pings,
+           broker.disconnects);
+    printf("Relay:           %zu summary publish(es)\n", broker.relayPublishes.size());
+    printf("Wills:           %u closed, %u keep-alive, %u takeover, %u broker drop; %u while the device was up\n",
+           causes[WILL_CLOSED], causes[WILL_KEEPALIVE], causes[WILL_TAKEOVER], causes[WILL_BROKER], falseWills);
+    printf("----------------------------------------\n");
+    printf("Seconds                            min  median     p90     max\n");
+    printFigure("WiFi outage to offline", offlineLatency);
+    printFigure("Power cut to offline", std::vector<uint64_t>(1, cutLatencyMs));
+    printf("----------------------------------------\n");
+    printf("Status topic:    \"%s\" before the power cut, then \"%s\" (%s)\n", statusAtEnd.c_str(),
+           broker.status.c_str(), cutAnnounced ? WILL_CAUSES[broker.wills.back().cause] : "never");
+    printf("========================================\n");
+    printf("%s\n", failed ? "MQTT FAILED" : "MQTT PASSED");
+
+    return failed ? 1 : 0;
+}
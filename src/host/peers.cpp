@@ -0,0 +1,379 @@
+// ============================================================================
+// LAN PEER HARNESS (host build: pio run -e native_peers)
+// ============================================================================
+//
+// Runs several instances of the real firmware (src/main.cpp, built with
+// PEER_HEARTBEAT_MS set) as separate processes on one host, talking to each
+// other over real loopback multicast (nativeHostUdpSet()). Each instance
+// has its own MAC, so its own node id, and its own stand-in server that
+// reports every upstream ping.
+//
+// The shim's clock is virtual; here every instance paces it against the
+// host's monotonic clock, --speed times faster than real time, so all of
+// them share one timeline. An instance only runs loop() when its next timer
+// is due on that timeline, as on the device; incoming announcements are
+// read when it wakes.
+//
+// Script (virtual time):
+//
+//   0             all peers boot; one of them must take the lead
+//   --kill-at     the leader is killed (SIGKILL: no goodbye)
+//   --rejoin-at   the killed peer boots again and must follow, not lead
+//   --minutes     end
+//
+// Reports upstream pings per hour against what a single watcher sends, the
+// longest gap between two pings of an endpoint, how long the group went
+// without a leader after the kill, and for how long two leaders overlapped.
+// Exits non-zero when the pings are not deduplicated, when no new leader
+// took over within one poll interval, or when the rejoined peer took the
+// lead.
+//
+// Instances on one host share the multicast channel of src/main.cpp: run one
+// harness at a time.
+//
+// Usage:
+//   peers [--peers N] [--speed S] [--minutes M] [--kill-at MIN] [--rejoin-at MIN]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// Firmware entry points, the watcher and the loop task's wake-ups (src/main.cpp)
+void setup();
+void loop();
+TickType_t ticksUntilNextTimer();
+extern Watcher watcher;
+extern QueueHandle_t controlQueue;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint32_t POLL_INTERVAL_MS = 30000;    // Must match src/main.cpp
+const uint64_t EPOCH_MS = 1000;             // Virtual time at the start
+const int MAX_PEERS = 16;
+
+struct PeersOptions {
+    int peers = 3;
+    uint32_t speed = 20;
+    double minutes = 10;
+    double killAt = 4;
+    double rejoinAt = 7;
+};
+
+// ============================================================================
+// SHARED TIMELINE
+// ============================================================================
+
+static uint64_t startUs;
+static uint32_t speed;
+
+static uint64_t monotonicUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint64_t timelineMs() {
+    return EPOCH_MS + (monotonicUs() - startUs) * speed / 1000;
+}
+
+static uint64_t minutesMs(double minutes) {
+    return EPOCH_MS + (uint64_t)(minutes * 60000);
+}
+
+// ============================================================================
+// PEER PROCESS
+// ============================================================================
+
+static int reportFd = -1;
+static int peerIndex = 0;
+
+// One line per event; lines below PIPE_BUF reach the parent whole
+static void report(const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    ssize_t written = write(reportFd, line, strlen(line));
+    (void)written;
+}
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    (void)exchange;
+    (void)context;
+    if (request.path != NULL) {
+        report("ping %llu %d %s%s\n", (unsigned long long)nativeClockNowMs(), peerIndex, request.host, request.path);
+    }
+}
+
+static void runPeer(int index, uint64_t endMs) {
+    peerIndex = index;
+    uint8_t mac[6] = { 0x24, 0x6F, 0x28, 0x00, 0x00, (uint8_t)(index + 1) };
+    nativeWiFiSetMac(mac);
+    nativeHostUdpSet(true);
+    nativeClockSetMs(timelineMs());
+    standInServerSet(handleExchange, NULL);
+    setup();
+
+    uint8_t role = PEER_ALONE;
+    while (nativeClockNowMs() < endMs) {
+        // Events and timers due on the shared timeline, then idle until it
+        // moves on
+        uint64_t targetMs = timelineMs();
+        while (uxQueueMessagesWaiting(controlQueue) > 0 || nativeClockNowMs() + ticksUntilNextTimer() <= targetMs) {
+            loop();
+            if (watcher.peerLease().role() != role) {
+                role = watcher.peerLease().role();
+                report("role %llu %d %u\n", (unsigned long long)nativeClockNowMs(), index, role);
+            }
+        }
+        if (nativeClockNowMs() < targetMs) {
+            nativeClockSetMs(targetMs);
+        }
+        usleep(500);
+    }
+    _exit(0);
+}
+
+static pid_t spawnPeer(int index, uint64_t endMs) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        runPeer(index, endMs);
+    }
+    return pid;
+}
+
+// ============================================================================
+// EVENTS
+// ============================================================================
+
+struct PeersResults {
+    uint64_t pings = 0;
+    std::map<std::string, uint64_t> lastPingMs;   // Per endpoint
+    uint64_t longestGapMs = 0;
+    int leaders[MAX_PEERS] = {};                   // 1 while the peer leads
+    int leaderCount = 0;
+    uint64_t overlapStartMs = 0;
+    uint64_t overlapMs = 0;
+    uint64_t leaderlessSinceMs = 0;                // 0: there is a leader
+    uint64_t lastLeaderlessMs = 0;                 // Until the latest lead was taken
+    uint64_t firstLeadMs = 0;
+    uint32_t takeovers = 0;
+    bool rejoinedLed = false;
+};
+
+static void setLeading(PeersResults& results, int index, bool leading, uint64_t atMs) {
+    if (results.leaders[index] == (int)leading) {
+        return;
+    }
+    results.leaders[index] = leading;
+    int before = results.leaderCount;
+    results.leaderCount += leading ? 1 : -1;
+
+    if (before < 2 && results.leaderCount >= 2) {
+        results.overlapStartMs = atMs;
+    } else if (before >= 2 && results.leaderCount < 2) {
+        results.overlapMs += atMs - results.overlapStartMs;
+    }
+    if (results.leaderCount == 0) {
+        results.leaderlessSinceMs = atMs;
+    } else if (results.leaderlessSinceMs != 0) {
+        results.lastLeaderlessMs = atMs - results.leaderlessSinceMs;
+        results.leaderlessSinceMs = 0;
+    }
+}
+
+static void handleLine(PeersResults& results, const char* line, bool rejoined, int killed) {
+    unsigned long long atMs;
+    int index;
+    unsigned role;
+    char endpoint[128];
+
+    if (sscanf(line, "ping %llu %d %127s", &atMs, &index, endpoint) == 3) {
+        results.pings++;
+        std::map<std::string, uint64_t>::iterator last = results.lastPingMs.find(endpoint);
+        if (last != results.lastPingMs.end() && atMs - last->second > results.longestGapMs) {
+            results.longestGapMs = atMs - last->second;
+        }
+        results.lastPingMs[endpoint] = atMs;
+    } else if (sscanf(line, "role %llu %d %u", &atMs, &index, &role) == 3 && index < MAX_PEERS) {
+        bool leading = role == PEER_LEADER;
+        if (leading) {
+            results.takeovers++;
+            if (results.firstLeadMs == 0) {
+                results.firstLeadMs = atMs;
+            }
+            if (rejoined && index == killed) {
+                results.rejoinedLed = true;
+            }
+        }
+        setLeading(results, index, leading, atMs);
+    }
+}
+
+// Split what arrived into lines; a partial line waits for the rest
+static void drainReports(int fd, std::string* pending, PeersResults& results, bool rejoined, int killed) {
+    char buffer[4096];
+    ssize_t size;
+    while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+        pending->append(buffer, (size_t)size);
+    }
+    size_t start = 0;
+    size_t end;
+    while ((end = pending->find('\n', start)) != std::string::npos) {
+        handleLine(results, pending->substr(start, end - start).c_str(), rejoined, killed);
+        start = end + 1;
+    }
+    pending->erase(0, start);
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, PeersOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--peers") == 0) options->peers = atoi(value);
+        else if (strcmp(name, "--speed") == 0) options->speed = (uint32_t)atol(value);
+        else if (strcmp(name, "--minutes") == 0) options->minutes = atof(value);
+        else if (strcmp(name, "--kill-at") == 0) options->killAt = atof(value);
+        else if (strcmp(name, "--rejoin-at") == 0) options->rejoinAt = atof(value);
+        else return false;
+    }
+    return options->peers >= 2 && options->peers <= MAX_PEERS && options->speed > 0 &&
+           options->killAt < options->rejoinAt && options->rejoinAt < options->minutes;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    PeersOptions options;
+    if (!parseOptions(argc, argv, &options)) {
+        printf("Usage: peers [--peers N] [--speed S] [--minutes M] [--kill-at MIN] [--rejoin-at MIN]\n"
+               "       (2 <= N <= %d, kill-at < rejoin-at < minutes)\n", MAX_PEERS);
+        return 1;
+    }
+    if (!watcher.peerLease().enabled()) {
+        printf("Build with -DPEER_HEARTBEAT_MS=<ms> (see platformio.ini, env native_peers)\n");
+        return 1;
+    }
+
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    reportFd = pipeFds[1];
+    fcntl(pipeFds[0], F_SETFL, O_NONBLOCK);
+
+    speed = options.speed;
+    startUs = monotonicUs();
+    uint64_t endMs = minutesMs(options.minutes);
+    uint64_t killMs = minutesMs(options.killAt);
+    uint64_t rejoinMs = minutesMs(options.rejoinAt);
+
+    std::vector<pid_t> pids(options.peers);
+    for (int i = 0; i < options.peers; i++) {
+        pids[i] = spawnPeer(i, endMs);
+    }
+
+    PeersResults results;
+    std::string pending;
+    int killed = -1;
+    bool rejoined = false;
+    uint64_t takeoverMs = UINT64_MAX;
+
+    while (timelineMs() < endMs + 2000) {
+        struct pollfd readable = { pipeFds[0], POLLIN, 0 };
+        poll(&readable, 1, 5);
+        drainReports(pipeFds[0], &pending, results, rejoined, killed);
+
+        uint64_t nowMs = timelineMs();
+        if (killed < 0 && nowMs >= killMs) {
+            for (int i = 0; i < options.peers && killed < 0; i++) {
+                if (results.leaders[i]) {
+                    killed = i;
+                }
+            }
+            if (killed < 0) {
+                printf("No leader at the kill time\n");
+                break;
+            }
+            kill(pids[killed], SIGKILL);
+            waitpid(pids[killed], NULL, 0);
+            setLeading(results, killed, false, nowMs);
+        }
+        if (killed >= 0 && takeoverMs == UINT64_MAX && results.leaderCount > 0) {
+            takeoverMs = results.lastLeaderlessMs;
+        }
+        if (killed >= 0 && !rejoined && nowMs >= rejoinMs) {
+            pids[killed] = spawnPeer(killed, endMs);
+            rejoined = true;
+        }
+    }
+
+    for (int i = 0; i < options.peers; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    drainReports(pipeFds[0], &pending, results, rejoined, killed);
+
+    // A single watcher pings every endpoint once per poll interval
+    uint16_t endpoints = (uint16_t)results.lastPingMs.size();
+    double hours = (endMs - EPOCH_MS) / 3600000.0;
+    double alonePerHour = endpoints * 3600000.0 / POLL_INTERVAL_MS;
+    double perHour = results.pings / hours;
+    bool deduplicated = perHour < 1.5 * alonePerHour;
+    bool tookOver = takeoverMs <= POLL_INTERVAL_MS;
+    double firstLeadS = results.firstLeadMs > 0 ? (results.firstLeadMs - EPOCH_MS) / 1000.0 : -1.0;
+
+    printf("\n========================================\n");
+    printf("LAN peers: %d watcher(s), %u endpoint(s), %.1f virtual minute(s) at %ux\n", options.peers, endpoints,
+           options.minutes, options.speed);
+    printf("========================================\n");
+    printf("First leader after:   %.1f s\n", firstLeadS);
+    printf("Upstream pings:       %llu (%.1f/h; alone %.1f/h, without peers %.1f/h)\n",
+           (unsigned long long)results.pings, perHour, alonePerHour, options.peers * alonePerHour);
+    printf("Longest ping gap:     %.1f s (poll interval %.1f s)\n", results.longestGapMs / 1000.0,
+           POLL_INTERVAL_MS / 1000.0);
+    if (takeoverMs != UINT64_MAX) {
+        printf("Leader killed:        peer %d, new leader after %.1f s\n", killed, takeoverMs / 1000.0);
+    } else {
+        printf("Leader killed:        peer %d, no new leader\n", killed);
+    }
+    printf("Leads taken:          %lu\n", (unsigned long)results.takeovers);
+    printf("Two leaders for:      %.1f s\n", results.overlapMs / 1000.0);
+    printf("Rejoined peer:        %s\n", results.rejoinedLed ? "took the lead (wrong)" : "followed");
+    printf("----------------------------------------\n");
+
+    bool passed = deduplicated && tookOver && !results.rejoinedLed;
+    printf("Peers %s\n", passed ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,380 @@
+// ============================================================================
+// HEARTBEAT RELAY HARNESS (host build: pio run -e native_relay)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp, built with HEARTBEAT_RELAY_URL)
+// against the native shim with a population of LAN gadgets beating into it:
+// even-numbered ones send UDP datagrams, odd-numbered ones plain HTTP
+// requests (nativeUdpDeliver() / nativeTcpDeliver()). Every beat comes
+// --jitter-ms early or late, and a share of the datagrams is lost.
+// Now and then a gadget stops beating for a few minutes (--outage-rate per
+// gadget and hour).
+//
+// The stand-in server reads the relay's reports and measures, per outage,
+// the time from the gadget's deadline (its last beat plus two and a half
+// periods, see HeartbeatTable.h) to the first report that lists it as
+// down, and from its first beat afterwards to the first report that no
+// longer does. It also
+// counts reports that list a gadget that is beating (false alarms, from
+// lost datagrams) and compares the upstream cost with every gadget sending
+// its own HTTPS request per beat.
+//
+// Exits non-zero when an outage is not reported within one poll interval
+// of its deadline, a recovery not within one poll interval, or an HTTP
+// beat was not answered 204.
+//
+// Usage:
+//   relay [--gadgets N] [--hours H] [--period-ms P] [--jitter-ms J] [--loss L]
+//         [--outage-rate R] [--seed S]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+#include <HeartbeatRelay.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Firmware entry points and the relay (src/main.cpp)
+void setup();
+void loop();
+extern HeartbeatRelay heartbeatRelay;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint32_t POLL_INTERVAL_MS = 30000;    // Must match src/main.cpp
+const uint8_t MISSED_BEATS = 2;             // Must match src/main.cpp
+const uint16_t UDP_PORT = 47884;            // Must match src/main.cpp
+const uint16_t HTTP_PORT = 8080;
+const uint64_t EPOCH_MS = 1000;
+const uint64_t WARMUP_MS = 5 * 60000;       // No outages before every gadget is known
+
+struct RelayOptions {
+    uint32_t gadgets = 24;
+    double hours = 12;
+    uint32_t periodMs = 60000;
+    uint32_t jitterMs = 2000;
+    double loss = 0.01;
+    double outageRate = 0.2;
+    uint64_t seed = 1;
+};
+
+// ============================================================================
+// GADGETS
+// ============================================================================
+
+struct Outage {
+    uint64_t startMs;
+    uint64_t endMs;
+    uint64_t lastBeatMs;         // Delivered before the outage
+    uint64_t firstBeatMs = 0;    // Delivered after it
+    uint64_t reportedDownMs = 0;
+    uint64_t reportedUpMs = 0;
+};
+
+struct Gadget {
+    std::string name;
+    bool http;
+    uint64_t nextBeatMs;
+    uint64_t lastBeatMs = 0;     // Delivered
+    std::vector<Outage> outages;
+    bool out = false;            // In the latest outage
+};
+
+struct RelayState {
+    RelayOptions options;
+    std::mt19937_64 random;
+    std::vector<Gadget> gadgets;
+    uint64_t reports = 0;
+    uint64_t connects = 0;
+    uint64_t falseAlarms = 0;
+    uint64_t beatsSent = 0;
+    uint64_t beatsLost = 0;
+    uint64_t httpBeats = 0;
+    uint64_t httpRejected = 0;
+};
+
+static bool isRelay(const char* host) {
+    return strcmp(host, "relay.standin.local") == 0;
+}
+
+// ============================================================================
+// STAND-IN SERVER
+// ============================================================================
+
+// Names in the report's down= list
+static std::vector<std::string> downList(const char* path) {
+    std::vector<std::string> names;
+    const char* list = strstr(path, "down=");
+    if (list == NULL) {
+        return names;
+    }
+    list += 5;
+    while (*list != '\0' && *list != '&') {
+        size_t length = strcspn(list, ",&");
+        names.push_back(std::string(list, length));
+        list += length;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return names;
+}
+
+// An outage lasts, as far as the reports go, from its start until its
+// recovery was reported
+static void handleReport(RelayState& state, const char* path) {
+    uint64_t now = nativeClockNowMs();
+    std::vector<std::string> down = downList(path);
+    state.reports++;
+    for (Gadget& gadget : state.gadgets) {
+        bool listed = std::find(down.begin(), down.end(), gadget.name) != down.end();
+        Outage* outage = gadget.outages.empty() ? NULL : &gadget.outages.back();
+        bool inOutage = outage != NULL && outage->reportedUpMs == 0;
+        if (listed && !inOutage) {
+            state.falseAlarms++;
+        } else if (listed && outage->firstBeatMs == 0 && outage->reportedDownMs == 0) {
+            outage->reportedDownMs = now;
+        } else if (!listed && inOutage && outage->firstBeatMs != 0) {
+            outage->reportedUpMs = now;
+        }
+    }
+}
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    RelayState& state = *(RelayState*)context;
+    std::uniform_int_distribution<uint32_t> latency(20, 200);
+    if (request.path == NULL) {
+        exchange->connectMs = latency(state.random);
+        state.connects += isRelay(request.host) ? 1 : 0;
+        return;
+    }
+    exchange->responseMs = latency(state.random);
+    exchange->status = 200;
+    exchange->bodyBytes = 2;
+    if (isRelay(request.host)) {
+        handleReport(state, request.path);
+    }
+}
+
+// ============================================================================
+// RUNNING
+// ============================================================================
+
+static void sendBeat(RelayState& state, Gadget& gadget) {
+    state.beatsSent++;
+    std::bernoulli_distribution lost(state.options.loss);
+    if (!gadget.http && lost(state.random)) {
+        state.beatsLost++;
+        return;
+    }
+
+    // The ground truth moves first: the relay may report the beat before
+    // this returns
+    gadget.lastBeatMs = nativeClockNowMs();
+    if (!gadget.outages.empty() && gadget.outages.back().firstBeatMs == 0 &&
+        gadget.lastBeatMs >= gadget.outages.back().endMs) {
+        gadget.outages.back().firstBeatMs = gadget.lastBeatMs;
+    }
+
+    char beat[64];
+    uint32_t periodS = state.options.periodMs / 1000;
+    if (!gadget.http) {
+        int length = snprintf(beat, sizeof(beat), "%s %u\n", gadget.name.c_str(), periodS);
+        nativeUdpDeliver(UDP_PORT, beat, (size_t)length);
+        return;
+    }
+    snprintf(beat, sizeof(beat), "GET /hb/%s?period=%u HTTP/1.1\r\nHost: watcher\r\n\r\n", gadget.name.c_str(),
+             periodS);
+    uint32_t answered = nativeTcpResponses();
+    nativeTcpDeliver(HTTP_PORT, beat);
+    // The listener task woke the loop task, which answers right away
+    nativeRunUntil(nativeClockNowMs(), loop);
+    state.httpBeats++;
+    if (nativeTcpResponses() == answered || strncmp(nativeTcpLastResponse(), "HTTP/1.1 204", 12) != 0) {
+        state.httpRejected++;
+    }
+}
+
+// Each gadget beats once per period, jittered; at each beat it may start an
+// outage that lasts 3 to 15 minutes, at least 15 minutes after its last one
+static void scheduleBeat(RelayState& state, Gadget& gadget, uint64_t endMs) {
+    const RelayOptions& options = state.options;
+    std::uniform_int_distribution<int64_t> jitter(-(int64_t)options.jitterMs, options.jitterMs);
+    uint64_t now = nativeClockNowMs();
+    gadget.nextBeatMs = now + options.periodMs + jitter(state.random);
+
+    double chance = options.outageRate * options.periodMs / 3600000.0;
+    std::bernoulli_distribution starts(chance);
+    bool settled = gadget.outages.empty() || now >= gadget.outages.back().endMs + 15 * 60000;
+    if (gadget.out || !settled || now < EPOCH_MS + WARMUP_MS || !starts(state.random)) {
+        return;
+    }
+    std::uniform_int_distribution<uint64_t> duration(3 * 60000, 15 * 60000);
+    Outage outage;
+    outage.startMs = now;
+    outage.endMs = std::min(now + duration(state.random), endMs);
+    outage.lastBeatMs = gadget.lastBeatMs;
+    gadget.outages.push_back(outage);
+    gadget.out = true;
+    gadget.nextBeatMs = outage.endMs;
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+static uint64_t percentile(std::vector<uint64_t> values, double share) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(share * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void printFigure(const char* name, const std::vector<uint64_t>& values) {
+    printf("%-26s %7.1f %7.1f %7.1f %7.1f\n", name, percentile(values, 0.0) / 1000.0,
+           percentile(values, 0.5) / 1000.0, percentile(values, 0.9) / 1000.0, percentile(values, 1.0) / 1000.0);
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, RelayOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--gadgets") == 0) options->gadgets = (uint32_t)atol(value);
+        else if (strcmp(name, "--hours") == 0) options->hours = atof(value);
+        else if (strcmp(name, "--period-ms") == 0) options->periodMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--jitter-ms") == 0) options->jitterMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--loss") == 0) options->loss = atof(value);
+        else if (strcmp(name, "--outage-rate") == 0) options->outageRate = atof(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else return false;
+    }
+    return options->gadgets > 0 && options->hours > 0 && options->periodMs >= 1000 &&
+           options->jitterMs < options->periodMs / 2;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    RelayState relay;
+    RelayState* state = &relay;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: relay [--gadgets N] [--hours H] [--period-ms P] [--jitter-ms J] [--loss L]\n"
+               "             [--outage-rate R] [--seed S]\n");
+        return 1;
+    }
+    const RelayOptions& options = state->options;
+    state->random.seed(options.seed);
+
+    nativeClockSetMs(EPOCH_MS);
+    standInServerSet(handleExchange, state);
+    setup();
+    nativeRunUntil(EPOCH_MS + 1000, loop);   // WiFi up, listeners open
+
+    uint64_t endMs = EPOCH_MS + (uint64_t)(options.hours * 3600000);
+    std::uniform_int_distribution<uint64_t> phase(0, options.periodMs - 1);
+    for (uint32_t i = 0; i < options.gadgets; i++) {
+        Gadget gadget;
+        char name[24];
+        snprintf(name, sizeof(name), "gadget-%02u", i + 1);
+        gadget.name = name;
+        gadget.http = i % 2 == 1;
+        gadget.nextBeatMs = nativeClockNowMs() + phase(state->random);
+        state->gadgets.push_back(gadget);
+    }
+
+    for (;;) {
+        Gadget* next = &state->gadgets[0];
+        for (Gadget& gadget : state->gadgets) {
+            next = gadget.nextBeatMs < next->nextBeatMs ? &gadget : next;
+        }
+        if (next->nextBeatMs >= endMs) {
+            break;
+        }
+        nativeRunUntil(next->nextBeatMs, loop);
+        if (next->out && nativeClockNowMs() >= next->outages.back().endMs) {
+            next->out = false;
+        }
+        sendBeat(*state, *next);
+        scheduleBeat(*state, *next, endMs);
+    }
+    nativeRunUntil(endMs, loop);
+
+    // Outages whose deadline and recovery both fell within the run
+    std::vector<uint64_t> downLatency;
+    std::vector<uint64_t> upLatency;
+    uint32_t outages = 0;
+    uint32_t missed = 0;
+    uint64_t deadlineMs = (uint64_t)MISSED_BEATS * options.periodMs + options.periodMs / 2;
+    for (const Gadget& gadget : state->gadgets) {
+        for (const Outage& outage : gadget.outages) {
+            uint64_t silentMs = outage.lastBeatMs + deadlineMs;
+            if (outage.firstBeatMs == 0 || outage.firstBeatMs < silentMs ||
+                outage.firstBeatMs + POLL_INTERVAL_MS > endMs) {
+                continue;   // Too short to be noticed, or cut off by the end of the run
+            }
+            outages++;
+            if (outage.reportedDownMs == 0 || outage.reportedDownMs > silentMs + POLL_INTERVAL_MS ||
+                outage.reportedUpMs == 0 || outage.reportedUpMs > outage.firstBeatMs + POLL_INTERVAL_MS) {
+                missed++;
+            }
+            if (outage.reportedDownMs != 0) {
+                downLatency.push_back(outage.reportedDownMs - silentMs);
+            }
+            if (outage.reportedUpMs != 0) {
+                upLatency.push_back(outage.reportedUpMs - outage.firstBeatMs);
+            }
+        }
+    }
+
+    double hours = options.hours;
+    const HeartbeatTable& table = heartbeatRelay.table();
+    bool failed = missed > 0 || state->httpRejected > 0;
+
+    printf("\n========================================\n");
+    printf("Heartbeat relay: %u gadget(s) beating every %.0f s (+/- %.1f s), %.1f%% datagrams lost\n",
+           options.gadgets, options.periodMs / 1000.0, options.jitterMs / 1000.0, options.loss * 100);
+    printf("Run:             %.1f h, %u outage(s) long enough to report\n", hours, outages);
+    printf("Table:           %u source(s), %lu beat(s) taken in, %lu turned away, %lu transition(s)\n",
+           table.sourceCount(), (unsigned long)table.beatsReceived(), (unsigned long)table.rejected(),
+           (unsigned long)heartbeatRelay.transitions());
+    printf("========================================\n");
+    printf("Seconds                        min  median     p90     max\n");
+    printFigure("Deadline to reported down", downLatency);
+    printFigure("Beat to reported back", upLatency);
+    printf("----------------------------------------\n");
+    printf("Upstream:        %.1f relay report(s)/h over %.1f TLS connect(s)/h\n", state->reports / hours,
+           state->connects / hours);
+    printf("Direct:          %.1f HTTPS request(s)/h, one TLS handshake each, if every gadget pinged itself\n",
+           options.gadgets * 3600000.0 / options.periodMs);
+    printf("Beats:           %llu sent, %llu lost, %llu over HTTP (%llu not answered 204)\n",
+           (unsigned long long)state->beatsSent, (unsigned long long)state->beatsLost,
+           (unsigned long long)state->httpBeats, (unsigned long long)state->httpRejected);
+    printf("False alarms:    %llu report(s) listing a beating gadget\n", (unsigned long long)state->falseAlarms);
+    printf("Missed:          %u (not reported within one poll interval)\n", missed);
+    printf("========================================\n");
+    printf("%s\n", failed ? "Relay FAILED" : "Relay PASSED");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+// ============================================================================
+// NETWORK TRACE REPLAY (host build: pio run -e native_replay)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp, lean HTTP path) on the native shim
+// while the stand-in server answers every request exactly as recorded on a
+// device: same connect time, same time to first byte, same status code or
+// failure. Each endpoint replays its own recorded sequence in order, so a
+// changed poll engine sees the production network behaviour even when it
+// schedules requests differently.
+//
+// Record a trace by sending 't' over the serial console, then:
+//   scripts/trace_extract.py monitor.log -o field.svtr
+//   .pio/build/native_replay/program field.svtr [--loops N]
+//
+// Requests beyond the recorded sequence of an endpoint are answered with an
+// instant 200 and counted as unscripted.
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <NetTrace.h>
+#include <Watcher.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Firmware entry points and the watcher (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+
+const uint32_t NEVER_MS = 0x7FFFFFFF;       // Response that never arrives
+const uint64_t IDLE_LIMIT_MS = 3600000;     // Stop if nothing was replayed for an hour
+
+// ============================================================================
+// REPLAY STATE
+// ============================================================================
+
+struct EndpointReplay {
+    std::vector<TraceRecord> records;
+    size_t cursor = 0;
+    uint32_t loopsDone = 0;
+    TraceRecord current;
+    uint64_t replayed = 0;
+    uint64_t recordedFailures = 0;
+    uint64_t unscripted = 0;
+    uint64_t downEvents = 0;
+    uint64_t downMs = 0;
+};
+
+struct ReplayState {
+    std::vector<EndpointReplay> endpoints;   // Index 0 unused (1-based like the trace)
+    uint32_t loops = 1;
+    uint64_t lastReplayMs = 0;
+};
+
+static bool loadTrace(const char* path, ReplayState* state) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("✗ Cannot open %s\n", path);
+        return false;
+    }
+
+    TraceFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == TRACE_MAGIC && header.version == TRACE_VERSION &&
+              header.recordSize == sizeof(TraceRecord);
+    if (!ok) {
+        printf("✗ %s is not a version %u trace file\n", path, TRACE_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        TraceRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1) {
+            printf("✗ %s is truncated after %u record(s)\n", path, i);
+            fclose(file);
+            return false;
+        }
+        if (record.endpoint >= state->endpoints.size()) {
+            state->endpoints.resize(record.endpoint + 1);
+        }
+        EndpointReplay& endpoint = state->endpoints[record.endpoint];
+        endpoint.records.push_back(record);
+        if (record.outcome != TRACE_OK && record.outcome != TRACE_RATE_LIMITED) {
+            endpoint.recordedFailures++;
+        }
+    }
+
+    fclose(file);
+    printf("Loaded %u record(s) from %s (%u dropped on the device)\n",
+           header.count, path, header.dropped);
+    return true;
+}
+
+// The firmware names its request tasks "HTTPTask_<endpoint>"
+static int currentEndpoint() {
+    const char* name = pcTaskGetName(NULL);
+    const char* prefix = "HTTPTask_";
+    if (strncmp(name, prefix, strlen(prefix)) != 0) {
+        return -1;
+    }
+    return atoi(name + strlen(prefix));
+}
+
+static bool exhausted(const EndpointReplay& endpoint, uint32_t loops) {
+    return endpoint.records.empty() || endpoint.loopsDone >= loops;
+}
+
+// ============================================================================
+// STAND-IN SERVER
+// ============================================================================
+
+static void scriptConnect(const TraceRecord& record, StandInExchange* exchange) {
+    exchange->reachable = record.outcome != TRACE_CONNECT_FAILED;
+    exchange->connectMs = record.connectMs;
+    exchange->closeEarly = false;
+    exchange->hang = record.outcome == TRACE_HUNG;   // Wedged until the watchdog steps in
+}
+
+static void scriptResponse(const TraceRecord& record, StandInExchange* exchange) {
+    switch (record.outcome) {
+        case TRACE_OK:
+        case TRACE_HTTP_ERROR:
+        case TRACE_RATE_LIMITED:
+            exchange->status = record.status;
+            exchange->responseMs = (uint32_t)record.firstByteMs + record.transferMs;
+            exchange->bodyBytes = record.bodyBytes;
+            break;
+        case TRACE_TIMEOUT:
+            exchange->responseMs = NEVER_MS;
+            break;
+        default:
+            // Send failures and lost connections: the peer goes away
+            exchange->closeEarly = true;
+            exchange->responseMs = record.firstByteMs;
+            break;
+    }
+}
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    ReplayState& state = *(ReplayState*)context;
+    int index = currentEndpoint();
+    if (index <= 0 || index >= (int)state.endpoints.size() ||
+        exhausted(state.endpoints[index], state.loops)) {
+        if (request.path == NULL && index > 0 && index < (int)state.endpoints.size()) {
+            state.endpoints[index].unscripted++;
+        }
+        return;  // Default exchange: instant 200
+    }
+
+    EndpointReplay& endpoint = state.endpoints[index];
+    if (request.path == NULL) {
+        endpoint.current = endpoint.records[endpoint.cursor];
+        if (++endpoint.cursor == endpoint.records.size()) {
+            endpoint.cursor = 0;
+            endpoint.loopsDone++;
+        }
+        endpoint.replayed++;
+        state.lastReplayMs = nativeClockNowMs();
+        scriptConnect(endpoint.current, exchange);
+    } else {
+        scriptResponse(endpoint.current, exchange);
+    }
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    ReplayState state;
+    const char* tracePath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            state.loops = (uint32_t)atol(argv[++i]);
+        } else if (argv[i][0] != '-' && tracePath == NULL) {
+            tracePath = argv[i];
+        } else {
+            tracePath = NULL;
+            break;
+        }
+    }
+    if (tracePath == NULL || state.loops == 0) {
+        printf("Usage: replay <trace.svtr> [--loops N]\n");
+        return 1;
+    }
+    if (!loadTrace(tracePath, &state)) {
+        return 1;
+    }
+
+    const uint64_t startMs = nativeClockNowMs();
+    standInServerSet(handleExchange, &state);
+    setup();
+
+    std::vector<uint8_t> previousHealth(watcher.scheduler().count(), HEALTH_UNKNOWN);
+    for (;;) {
+        uint64_t before = nativeClockNowMs();
+        loop();
+        uint64_t elapsed = nativeClockNowMs() - before;
+
+        // Health as the firmware sees it (scheduler index + 1 == trace endpoint)
+        for (uint16_t i = 0; i < watcher.scheduler().count() && i + 1u < state.endpoints.size(); i++) {
+            EndpointReplay& endpoint = state.endpoints[i + 1];
+            uint8_t health = watcher.scheduler().endpoint(i).health;
+            if (health == HEALTH_DOWN) {
+                endpoint.downMs += elapsed;
+                if (previousHealth[i] != HEALTH_DOWN) {
+                    endpoint.downEvents++;
+                }
+            }
+            previousHealth[i] = health;
+        }
+
+        bool done = true;
+        for (size_t i = 1; i < state.endpoints.size(); i++) {
+            done = done && exhausted(state.endpoints[i], state.loops);
+        }
+        if (done || nativeClockNowMs() - state.lastReplayMs > IDLE_LIMIT_MS) {
+            break;
+        }
+    }
+
+    const double durationS = (nativeClockNowMs() - startMs) / 1000.0;
+    printf("\n========================================\n");
+    printf("Replay complete: %.1f s of virtual time, %u loop(s)\n", durationS, state.loops);
+    printf("========================================\n");
+    printf("Endpoint  Recorded  Failed  Replayed  Unscripted  DOWN events  Downtime\n");
+    for (size_t i = 1; i < state.endpoints.size(); i++) {
+        const EndpointReplay& endpoint = state.endpoints[i];
+        printf("%8zu  %8zu  %6llu  %8llu  %10llu  %11llu  %7.1f%%\n",
+               i, endpoint.records.size(), (unsigned long long)endpoint.recordedFailures,
+               (unsigned long long)endpoint.replayed, (unsigned long long)endpoint.unscripted,
+               (unsigned long long)endpoint.downEvents,
+               durationS > 0 ? 100.0 * endpoint.downMs / 1000.0 / durationS : 0.0);
+    }
+    printf("========================================\n");
+    return 0;
+}
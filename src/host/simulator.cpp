@@ -0,0 +1,482 @@
+// ============================================================================
+// DISCRETE-EVENT POLL SIMULATOR (host build: pio run -e native_sim)
+// ============================================================================
+//
+// Runs the firmware's real PollScheduler (interval, retry/backoff and health
+// state), RateLimiter and DataBudget on a virtual clock against modelled
+// endpoints, so scheduling changes can be judged before they reach hardware.
+//
+// The dispatch loop mirrors Watcher::pollDueEndpoints(): a fixed number of
+// workers (MAX_REQUEST_TASKS), each due endpoint taken as soon as one is
+// free, a request without a token for its host deferred until the next one
+// is due, and each result recorded when its own request completes. With a
+// data budget, every request's bytes are booked and the plan stretches the
+// poll intervals as on the device. Time jumps straight from one event to
+// the next, so weeks of operation take seconds.
+//
+// Unlike the firmware, which wakes exactly when the next endpoint is due,
+// due endpoints are collected on a grid of --tick-ms (1 s by default):
+// every collection scans all endpoints, and once retries have spread the
+// due times that would be one scan per request. Endpoints already waiting
+// for a worker still take it as soon as it is free. --tick-ms 1 is exact.
+//
+// Endpoint model:
+//   - latency: log-normal around a configurable median; anything slower than
+//     the HTTP timeout fails after the timeout
+//   - transient failures: independent per request
+//   - outages: alternating up/down periods with exponential durations; every
+//     request during an outage times out
+//
+// Usage:
+//   simulator [--endpoints N] [--days D] [--seed S] [--latency-ms M]
+//             [--latency-sigma S] [--failure-rate P] [--mtbf-hours H]
+//             [--mttr-minutes M] [--interval-ms I] [--retry-base-ms R]
+//             [--fail-threshold F] [--timeout-ms T] [--tasks W]
+//             [--hosts H] [--burst B] [--requests-per-minute R]
+//             [--budget-bytes B] [--budget-days D] [--request-bytes N]
+//             [--tick-ms T]
+//
+
+#include <DataBudget.h>
+#include <PollScheduler.h>
+#include <RateLimiter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// CONFIGURATION (defaults mirror the firmware)
+// ============================================================================
+
+const uint64_t MS_PER_HOUR = 3600ULL * 1000ULL;
+
+struct SimOptions {
+    uint32_t endpoints = 1000;
+    double days = 7.0;
+    uint64_t seed = 1;
+    double latencyMedianMs = 300.0;
+    double latencySigma = 0.5;
+    double failureRate = 0.01;
+    double mtbfHours = 72.0;
+    double mttrMinutes = 20.0;
+    uint32_t intervalMs = 30000;
+    uint32_t retryBaseMs = 30000;
+    uint32_t failThreshold = 2;
+    uint32_t timeoutMs = 5000;
+    uint32_t tasks = 0;               // Workers; 0: one per endpoint
+    uint32_t hosts = 0;               // Endpoints spread over this many hosts; 0: one each
+    uint32_t burst = 6;
+    uint32_t requestsPerMinute = 30;  // 0 turns the rate limit off
+    uint32_t budgetBytes = 0;         // 0: unmetered
+    uint32_t budgetDays = 30;
+    uint32_t requestBytes = 6000;     // Traffic of one request, TLS handshake included
+    uint32_t tickMs = 1000;           // Due endpoints are collected on this grid
+};
+
+// ============================================================================
+// ENDPOINT MODEL
+// ============================================================================
+
+struct EndpointModel {
+    uint64_t nextTransitionMs;   // Next outage start or end
+    uint64_t outageStartMs;
+    uint64_t outageEndMs;
+    bool inOutage;
+    bool outageDetected;         // DOWN reported during the current outage
+    bool awaitingRecovery;       // Outage over, waiting for the UP transition
+};
+
+// A request in flight, done at doneMs
+struct PendingRequest {
+    uint64_t doneMs;
+    uint16_t endpoint;
+    bool ok;
+
+    bool operator>(const PendingRequest& other) const { return doneMs > other.doneMs; }
+};
+
+struct SimStats {
+    uint64_t requests = 0;
+    uint64_t retries = 0;
+    uint64_t failures = 0;
+    uint64_t deferrals = 0;
+    uint64_t inFlightMs = 0;     // Sum over time of the requests in flight
+    uint32_t maxInFlight = 0;
+    uint64_t bytes = 0;
+    uint64_t outages = 0;
+    uint64_t missedOutages = 0;
+    uint64_t falseAlarms = 0;
+    std::vector<double> detectionDelayMs;
+    std::vector<double> recoveryDelayMs;
+};
+
+class Simulation {
+public:
+    explicit Simulation(const SimOptions& options)
+        : options_(options),
+          random_(options.seed),
+          latency_(std::log(options.latencyMedianMs), options.latencySigma),
+          transient_(options.failureRate),
+          upPeriod_(1.0 / (options.mtbfHours * MS_PER_HOUR)),
+          downPeriod_(1.0 / (options.mttrMinutes * 60000.0)),
+          runtime_(options.endpoints),
+          models_(options.endpoints),
+          buckets_(options.hosts),
+          budgetEndpoints_(options.endpoints),
+          scheduler_(runtime_.data(), (uint16_t)options.endpoints, schedulerConfig(options)),
+          rateLimiter_(buckets_.data(), (uint16_t)options.hosts, rateLimitConfig(options)),
+          dataBudget_(budgetEndpoints_.data(), (uint16_t)options.endpoints, options.intervalMs,
+                      dataBudgetConfig(options)) {
+    }
+
+    void run() {
+        const uint64_t endMs = (uint64_t)(options_.days * 24.0 * MS_PER_HOUR);
+
+        for (EndpointModel& model : models_) {
+            model = EndpointModel();
+            model.nextTransitionMs = sample(upPeriod_);
+        }
+
+        std::vector<uint16_t> due(options_.tasks);
+
+        uint64_t now = 0;
+        scheduler_.begin(0);
+        rateLimiter_.begin(0);
+        dataBudget_.begin(0, NULL);
+
+        while (now < endMs) {
+            // Results first, so their workers are free for the due endpoints
+            while (!inFlight_.empty() && inFlight_.top().doneMs <= now) {
+                PendingRequest request = inFlight_.top();
+                inFlight_.pop();
+                finishRequest(request);
+            }
+            // Endpoints left waiting for a worker take the next free one
+            if (now >= nextDueMs_ && (waiting_ || now % options_.tickMs == 0) && inFlight_.size() < options_.tasks) {
+                pollDueEndpoints(now, due.data());
+                updateNextDue(now);
+                waiting_ = nextDueMs_ <= now;
+            }
+
+            // Sleep until the next request completes or, with a worker free,
+            // the next endpoint is due
+            uint64_t next = endMs;
+            if (!inFlight_.empty()) {
+                next = std::min(next, inFlight_.top().doneMs);
+            }
+            if (inFlight_.size() < options_.tasks) {
+                uint64_t dueMs = std::max(nextDueMs_, now + 1);
+                next = std::min(next, (dueMs + options_.tickMs - 1) / options_.tickMs * options_.tickMs);
+            }
+            stats_.inFlightMs += inFlight_.size() * (next - now);
+            now = next;
+        }
+
+        for (uint32_t i = 0; i < options_.endpoints; i++) {
+            advanceModel(i, endMs);
+        }
+        simulatedMs_ = endMs;
+    }
+
+    void report(double wallSeconds) {
+        const double hours = simulatedMs_ / (double)MS_PER_HOUR;
+
+        printf("\n========================================\n");
+        printf("Poll simulation: %u endpoint(s), %.1f day(s)\n", options_.endpoints, options_.days);
+        printf("========================================\n");
+        printf("Requests:            %llu (%.1f/h total, %.2f/h per endpoint)\n",
+               (unsigned long long)stats_.requests, stats_.requests / hours,
+               stats_.requests / hours / options_.endpoints);
+        printf("Retries:             %llu (%.2f%% of requests)\n",
+               (unsigned long long)stats_.retries, percent(stats_.retries, stats_.requests));
+        printf("Failed requests:     %llu (%.2f%%)\n",
+               (unsigned long long)stats_.failures, percent(stats_.failures, stats_.requests));
+        printf("Deferred:            %llu (no token for the host)\n", (unsigned long long)stats_.deferrals);
+        printf("Concurrency:         max %u of %u worker(s), avg %.2f in flight\n", stats_.maxInFlight,
+               options_.tasks, simulatedMs_ ? (double)stats_.inFlightMs / simulatedMs_ : 0.0);
+        if (dataBudget_.metered()) {
+            printf("Data:                %.1f MB (%.1f MB/day), budget %s\n", stats_.bytes / 1e6,
+                   stats_.bytes / 1e6 / options_.days, budgetPressureName(dataBudget_.pressure()));
+        }
+        printf("Outages:             %llu (%llu missed, %llu false alarm(s))\n",
+               (unsigned long long)stats_.outages, (unsigned long long)stats_.missedOutages,
+               (unsigned long long)stats_.falseAlarms);
+        printDistribution("Detection delay", stats_.detectionDelayMs);
+        printDistribution("Recovery delay", stats_.recoveryDelayMs);
+        printf("Wall clock:          %.2f s (%.0fx real time)\n",
+               wallSeconds, wallSeconds > 0 ? simulatedMs_ / 1000.0 / wallSeconds : 0.0);
+        printf("========================================\n");
+    }
+
+private:
+    static SchedulerConfig schedulerConfig(const SimOptions& options) {
+        SchedulerConfig config;
+        config.pollIntervalMs = options.intervalMs;
+        config.retryBaseMs = options.retryBaseMs;
+        config.failThreshold = (uint8_t)options.failThreshold;
+        return config;
+    }
+
+    static RateLimitConfig rateLimitConfig(const SimOptions& options) {
+        RateLimitConfig config = { (uint16_t)options.burst, (uint16_t)options.requestsPerMinute, 60000, 900000 };
+        return config;
+    }
+
+    static DataBudgetConfig dataBudgetConfig(const SimOptions& options) {
+        DataBudgetConfig config = { options.budgetBytes, (uint16_t)options.budgetDays, 8 };
+        return config;
+    }
+
+    static double percent(uint64_t part, uint64_t total) {
+        return total ? 100.0 * part / total : 0.0;
+    }
+
+    uint64_t sample(std::exponential_distribution<double>& distribution) {
+        return (uint64_t)distribution(random_) + 1;
+    }
+
+    // Apply all outage transitions up to timeMs
+    void advanceModel(uint32_t index, uint64_t timeMs) {
+        EndpointModel& model = models_[index];
+        while (model.nextTransitionMs <= timeMs) {
+            if (model.inOutage) {
+                model.inOutage = false;
+                model.outageEndMs = model.nextTransitionMs;
+                if (model.outageDetected) {
+                    model.awaitingRecovery = true;
+                } else {
+                    stats_.missedOutages++;
+                }
+                model.nextTransitionMs += sample(upPeriod_);
+            } else {
+                model.inOutage = true;
+                model.outageDetected = false;
+                model.awaitingRecovery = false;
+                model.outageStartMs = model.nextTransitionMs;
+                stats_.outages++;
+                model.nextTransitionMs += sample(downPeriod_);
+            }
+        }
+    }
+
+    // Due endpoints, as many at a time as there are free workers, as in
+    // Watcher::pollDueEndpoints()
+    void pollDueEndpoints(uint64_t now, uint16_t* due) {
+        while (inFlight_.size() < options_.tasks) {
+            uint16_t free = (uint16_t)(options_.tasks - inFlight_.size());
+            uint16_t dueCount = scheduler_.collectDue((uint32_t)now, due, free);
+            uint16_t started = 0;
+            for (uint16_t i = 0; i < dueCount; i++) {
+                if (startRequest(due[i], now)) {
+                    started++;
+                }
+            }
+            // Fewer than asked for: nothing else is due
+            if (started == 0 || dueCount < free) {
+                break;
+            }
+        }
+        stats_.maxInFlight = std::max<uint32_t>(stats_.maxInFlight, (uint32_t)inFlight_.size());
+    }
+
+    // Launch a request to endpoint at startMs, or defer it like
+    // Watcher::pollEndpoints() does. Returns true if it was launched.
+    bool startRequest(uint16_t endpoint, uint64_t startMs) {
+        if (dataBudget_.suspended(endpoint)) {
+            scheduler_.recordDeferred(endpoint, (uint32_t)startMs, options_.intervalMs);
+            return false;
+        }
+        uint16_t host = (uint16_t)(endpoint % options_.hosts);
+        uint32_t nowMs = (uint32_t)startMs;
+        if (!rateLimiter_.tryAcquire(host, nowMs)) {
+            scheduler_.recordDeferred(endpoint, nowMs, rateLimiter_.msUntilAvailable(host, nowMs));
+            stats_.deferrals++;
+            return false;
+        }
+
+        advanceModel(endpoint, startMs);
+        stats_.requests++;
+        if (scheduler_.endpoint(endpoint).consecutiveFailures > 0) {
+            stats_.retries++;
+        }
+
+        uint64_t duration = (uint64_t)latency_(random_);
+        bool ok = true;
+        if (models_[endpoint].inOutage || duration >= options_.timeoutMs) {
+            duration = options_.timeoutMs;
+            ok = false;
+        } else if (transient_(random_)) {
+            ok = false;
+        }
+        if (!ok) {
+            stats_.failures++;
+        }
+
+        PendingRequest request = { startMs + duration, endpoint, ok };
+        inFlight_.push(request);
+        return true;
+    }
+
+    // The scheduler scans every endpoint, so the earliest due time is kept
+    // here: it only moves earlier when a result comes in or the budget plan
+    // changes the intervals
+    void updateNextDue(uint64_t now) {
+        uint32_t wait = scheduler_.msUntilNextDue((uint32_t)now);
+        nextDueMs_ = wait == UINT32_MAX ? UINT64_MAX : now + wait;
+    }
+
+    // Feed a completed request into the scheduler (and the data budget)
+    void finishRequest(const PendingRequest& request) {
+        uint16_t endpoint = request.endpoint;
+        uint64_t doneMs = request.doneMs;
+        HealthChange change = scheduler_.recordResult(endpoint, request.ok, (uint32_t)doneMs);
+        EndpointModel& model = models_[endpoint];
+
+        if (change == HEALTH_WENT_DOWN) {
+            if (model.inOutage && !model.outageDetected) {
+                model.outageDetected = true;
+                stats_.detectionDelayMs.push_back((double)(doneMs - model.outageStartMs));
+            } else if (!model.inOutage) {
+                stats_.falseAlarms++;
+            }
+        } else if (change == HEALTH_WENT_UP && model.awaitingRecovery) {
+            model.awaitingRecovery = false;
+            stats_.recoveryDelayMs.push_back((double)(doneMs - model.outageEndMs));
+        }
+
+        uint32_t waitMs = scheduler_.endpoint(endpoint).nextDueMs - (uint32_t)doneMs;
+        nextDueMs_ = std::min(nextDueMs_, doneMs + waitMs);
+
+        // The firmware plans after every request; once per poll interval
+        // is as good for a budget that spans days, and much faster here
+        stats_.bytes += options_.requestBytes;
+        if (dataBudget_.metered()) {
+            dataBudget_.record(endpoint, options_.requestBytes, (uint32_t)doneMs);
+            if (doneMs >= nextPlanMs_) {
+                nextPlanMs_ = doneMs + options_.intervalMs;
+                dataBudget_.plan((uint32_t)doneMs);
+                for (uint32_t i = 0; i < options_.endpoints; i++) {
+                    uint8_t stretch = dataBudget_.stretch((uint16_t)i);
+                    scheduler_.setIntervalScale((uint16_t)i, stretch > 0 ? stretch : 1);
+                }
+                updateNextDue(doneMs);
+            }
+        }
+    }
+
+    static void printDistribution(const char* label, std::vector<double>& values) {
+        if (values.empty()) {
+            printf("%-20s n/a\n", (std::string(label) + ":").c_str());
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        auto at = [&values](double q) {
+            return values[std::min(values.size() - 1, (size_t)(q * values.size()))] / 1000.0;
+        };
+        double sum = 0;
+        for (double value : values) {
+            sum += value;
+        }
+        printf("%-20s mean %.1f s, p50 %.1f s, p90 %.1f s, p99 %.1f s, max %.1f s\n",
+               (std::string(label) + ":").c_str(), sum / values.size() / 1000.0,
+               at(0.50), at(0.90), at(0.99), values.back() / 1000.0);
+    }
+
+    SimOptions options_;
+    std::mt19937_64 random_;
+    std::lognormal_distribution<double> latency_;
+    std::bernoulli_distribution transient_;
+    std::exponential_distribution<double> upPeriod_;
+    std::exponential_distribution<double> downPeriod_;
+    std::vector<EndpointRuntime> runtime_;
+    std::vector<EndpointModel> models_;
+    std::vector<HostBucket> buckets_;
+    std::vector<BudgetEndpoint> budgetEndpoints_;
+    std::priority_queue<PendingRequest, std::vector<PendingRequest>, std::greater<PendingRequest>> inFlight_;
+    PollScheduler scheduler_;
+    RateLimiter rateLimiter_;
+    DataBudget dataBudget_;
+    SimStats stats_;
+    uint64_t nextDueMs_ = 0;     // No endpoint is due before this
+    bool waiting_ = false;       // Due endpoints are waiting for a worker
+    uint64_t nextPlanMs_ = 0;
+    uint64_t simulatedMs_ = 0;
+};
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static void printUsage() {
+    printf("Usage: simulator [--endpoints N] [--days D] [--seed S] [--latency-ms M]\n"
+           "                 [--latency-sigma S] [--failure-rate P] [--mtbf-hours H]\n"
+           "                 [--mttr-minutes M] [--interval-ms I] [--retry-base-ms R]\n"
+           "                 [--fail-threshold F] [--timeout-ms T] [--tasks W]\n"
+           "                 [--hosts H] [--burst B] [--requests-per-minute R]\n"
+           "                 [--budget-bytes B] [--budget-days D] [--request-bytes N]\n"
+           "                 [--tick-ms T]\n");
+}
+
+static bool parseOptions(int argc, char** argv, SimOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--endpoints") == 0) options->endpoints = (uint32_t)atol(value);
+        else if (strcmp(name, "--days") == 0) options->days = atof(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else if (strcmp(name, "--latency-ms") == 0) options->latencyMedianMs = atof(value);
+        else if (strcmp(name, "--latency-sigma") == 0) options->latencySigma = atof(value);
+        else if (strcmp(name, "--failure-rate") == 0) options->failureRate = atof(value);
+        else if (strcmp(name, "--mtbf-hours") == 0) options->mtbfHours = atof(value);
+        else if (strcmp(name, "--mttr-minutes") == 0) options->mttrMinutes = atof(value);
+        else if (strcmp(name, "--interval-ms") == 0) options->intervalMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--retry-base-ms") == 0) options->retryBaseMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--fail-threshold") == 0) options->failThreshold = (uint32_t)atol(value);
+        else if (strcmp(name, "--timeout-ms") == 0) options->timeoutMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--tasks") == 0) options->tasks = (uint32_t)atol(value);
+        else if (strcmp(name, "--hosts") == 0) options->hosts = (uint32_t)atol(value);
+        else if (strcmp(name, "--burst") == 0) options->burst = (uint32_t)atol(value);
+        else if (strcmp(name, "--requests-per-minute") == 0) options->requestsPerMinute = (uint32_t)atol(value);
+        else if (strcmp(name, "--budget-bytes") == 0) options->budgetBytes = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(name, "--budget-days") == 0) options->budgetDays = (uint32_t)atol(value);
+        else if (strcmp(name, "--request-bytes") == 0) options->requestBytes = (uint32_t)atol(value);
+        else if (strcmp(name, "--tick-ms") == 0) options->tickMs = (uint32_t)atol(value);
+        else return false;
+    }
+    // As in src/main.cpp: one worker and one host per endpoint by default
+    if (options->tasks == 0 || options->tasks > options->endpoints) options->tasks = options->endpoints;
+    if (options->hosts == 0 || options->hosts > options->endpoints) options->hosts = options->endpoints;
+    return options->endpoints > 0 && options->endpoints <= UINT16_MAX &&
+           options->days > 0 && options->failThreshold > 0 && options->failThreshold <= 255 &&
+           options->tickMs > 0 && options->burst > 0 && options->burst <= UINT16_MAX &&
+           options->requestsPerMinute <= UINT16_MAX;
+}
+
+int main(int argc, char** argv) {
+    SimOptions options;
+    if (!parseOptions(argc, argv, &options)) {
+        printUsage();
+        return 1;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    Simulation simulation(options);
+    simulation.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    simulation.report(elapsed.count());
+    return 0;
+}
@@ -0,0 +1,372 @@
+// ============================================================================
+// LONG-UPTIME SOAK HARNESS (host build: pio run -e native_soak)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp, lean HTTP path) against the native
+// shim with a virtual clock that starts just before the 32-bit millis()
+// wrap and fast-forwards through several wraps. Every loop() iteration is
+// checked for:
+//
+//   - cadence anomalies: the gap between two requests to the same endpoint
+//     must match the poll interval (after a success) or the scheduler's
+//     retry delay (after a failure), within the batch latency
+//   - stalls: no request at all for longer than the poll interval allows
+//   - memory growth: live heap must return to the same baseline after
+//     every iteration (global new/delete are counted here)
+//   - leaked tasks or secure clients (shim counters must return to their
+//     baseline; hung tasks are allowed until the watchdog reclaims them)
+//
+// At the end, every byte the shim's secure client put through the lwIP
+// stand-ins must show up in the firmware's traffic ledger.
+//
+// With --hang-rate, that share of connections wedges forever (the shim
+// parks the task). Every hang must be reported by the firmware's watchdog
+// and its task deleted within the hard deadline plus grace period. Cadence
+// and stalls are not checked while a hang holds up the poll cycle.
+//
+// With --rate-limit-rate, that share of responses is a 429 with Retry-After.
+// Every one must pause the host in the firmware's rate limiter; cadence and
+// stalls are not checked until the pause is over.
+//
+// Exits non-zero when any anomaly was found.
+//
+// Usage:
+//   soak [--wraps N] [--failure-rate P] [--max-latency-ms L] [--seed S]
+//        [--start-before-wrap-ms M] [--hang-rate P] [--rate-limit-rate P]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+
+// Firmware entry points and the watcher (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+
+// ============================================================================
+// HEAP ACCOUNTING
+// ============================================================================
+
+static size_t liveHeapBytes = 0;
+static size_t liveHeapBlocks = 0;
+
+// Kept out of line: once inlined, GCC pairs the malloc()/free() inside with
+// the callers' new/delete and reports a bogus mismatch.
+__attribute__((noinline)) void* operator new(size_t size) {
+    size_t* block = (size_t*)malloc(size + sizeof(size_t));
+    if (block == NULL) {
+        throw std::bad_alloc();
+    }
+    block[0] = size;
+    liveHeapBytes += size;
+    liveHeapBlocks++;
+    return block + 1;
+}
+
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    if (pointer == NULL) {
+        return;
+    }
+    size_t* block = (size_t*)pointer - 1;
+    liveHeapBytes -= block[0];
+    liveHeapBlocks--;
+    free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint64_t WRAP_MS = 1ULL << 32;
+const uint64_t TIMER_SLACK_MS = 1;          // loop() wakeups round to whole ticks
+const uint32_t POLL_INTERVAL_MS = 30000;    // Must match src/main.cpp
+const uint32_t HARD_DEADLINE_MS = 20000;    // Must match WATCHDOG_CONFIG in src/main.cpp
+const uint32_t GRACE_MS = 2000;             // Must match WATCHDOG_CONFIG in src/main.cpp
+const uint32_t RETRY_AFTER_S = 60;          // Sent with every injected 429
+const int MAX_REPORTED_ANOMALIES = 20;
+
+struct SoakOptions {
+    uint32_t wraps = 3;
+    double failureRate = 0.05;
+    uint32_t maxLatencyMs = 400;
+    uint64_t seed = 1;
+    uint64_t startBeforeWrapMs = 60000;
+    double hangRate = 0.0;
+    double rateLimitRate = 0.0;
+};
+
+// ============================================================================
+// STAND-IN SERVER
+// ============================================================================
+
+struct EndpointTrack {
+    uint64_t lastRequestMs = 0;
+    uint64_t requests = 0;
+    bool lastSucceeded = true;
+    uint16_t consecutiveFailures = 0;
+};
+
+struct SoakState {
+    SoakOptions options;
+    std::mt19937_64 random;
+    std::map<std::string, EndpointTrack> endpoints;   // By request task name
+    uint64_t requests = 0;
+    uint64_t lastAnyRequestMs = 0;
+    uint64_t anomalies = 0;
+    uint64_t hangs = 0;
+    uint64_t lastHangMs = 0;
+    uint64_t rateLimited = 0;      // 429 responses sent
+    uint64_t quietUntilMs = 0;     // No cadence checks before this (hang or rate-limit pause)
+};
+
+static void reportAnomaly(SoakState& state, const char* what, const char* path, uint64_t gapMs) {
+    state.anomalies++;
+    if (state.anomalies <= MAX_REPORTED_ANOMALIES) {
+        uint64_t now = nativeClockNowMs();
+        printf("✗ %s on %s: gap %llu ms at t=%llu ms (millis()=%lu, wrap #%llu)\n",
+               what, path, (unsigned long long)gapMs, (unsigned long long)now,
+               millis(), (unsigned long long)(now / WRAP_MS));
+    }
+}
+
+static void checkCadence(SoakState& state, EndpointTrack& track, const char* path, uint64_t now) {
+    // Requests of one batch run back to back in the shim, so each one may be
+    // shifted by the latency of the batch that launched it.
+    const uint64_t batchSkew = 2ULL * state.options.maxLatencyMs * state.endpoints.size();
+
+    uint64_t expected = track.lastSucceeded ? POLL_INTERVAL_MS
+                                            : watcher.scheduler().retryDelayMs(track.consecutiveFailures);
+    uint64_t gap = now - track.lastRequestMs;
+    uint64_t lowest = expected > batchSkew ? expected - batchSkew : 0;
+    uint64_t highest = expected + TIMER_SLACK_MS + batchSkew;
+
+    if (gap < lowest) {
+        reportAnomaly(state, "Early request", path, gap);
+    } else if (gap > highest) {
+        reportAnomaly(state, "Late request", path, gap);
+    }
+}
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    SoakState& state = *(SoakState*)context;
+    std::uniform_int_distribution<uint32_t> latency(0, state.options.maxLatencyMs / 2);
+    uint64_t now = nativeClockNowMs();
+    EndpointTrack& track = state.endpoints[pcTaskGetName(NULL)];
+
+    if (request.path == NULL) {
+        exchange->reachable = true;
+        exchange->connectMs = latency(state.random);
+        if (state.options.hangRate > 0 && std::bernoulli_distribution(state.options.hangRate)(state.random)) {
+            exchange->hang = true;
+            state.hangs++;
+            state.lastHangMs = now;
+            state.quietUntilMs = now + HARD_DEADLINE_MS + GRACE_MS + 2 * POLL_INTERVAL_MS;
+            track.requests = 0;   // Restart cadence tracking for this endpoint
+            track.lastSucceeded = false;   // The firmware records the hang as a failure
+            track.consecutiveFailures++;
+        }
+        return;
+    }
+
+    if (track.requests > 0 && now >= state.quietUntilMs) {
+        checkCadence(state, track, request.path, now);
+    }
+
+    exchange->responseMs = latency(state.random);
+    exchange->bodyBytes = 2;
+    exchange->retryAfterS = 0;
+
+    if (state.options.rateLimitRate > 0 && std::bernoulli_distribution(state.options.rateLimitRate)(state.random)) {
+        // The whole host pauses: restart cadence tracking everywhere
+        exchange->status = 429;
+        exchange->retryAfterS = RETRY_AFTER_S;
+        state.rateLimited++;
+        state.quietUntilMs = now + RETRY_AFTER_S * 1000ULL + 2 * POLL_INTERVAL_MS;
+        for (auto& entry : state.endpoints) {
+            entry.second.requests = 0;
+        }
+        state.lastAnyRequestMs = now;
+        return;
+    }
+
+    bool succeeded = std::bernoulli_distribution(state.options.failureRate)(state.random) == false;
+    exchange->status = succeeded ? 200 : 500;
+
+    track.lastRequestMs = now;
+    track.requests++;
+    track.lastSucceeded = succeeded;
+    track.consecutiveFailures = succeeded ? 0 : track.consecutiveFailures + 1;
+    state.requests++;
+    state.lastAnyRequestMs = now;
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, SoakOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--wraps") == 0) options->wraps = (uint32_t)atol(value);
+        else if (strcmp(name, "--failure-rate") == 0) options->failureRate = atof(value);
+        else if (strcmp(name, "--max-latency-ms") == 0) options->maxLatencyMs = (uint32_t)atol(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else if (strcmp(name, "--start-before-wrap-ms") == 0) options->startBeforeWrapMs = strtoull(value, NULL, 10);
+        else if (strcmp(name, "--hang-rate") == 0) options->hangRate = atof(value);
+        else if (strcmp(name, "--rate-limit-rate") == 0) options->rateLimitRate = atof(value);
+        else return false;
+    }
+    return options->wraps > 0 && options->startBeforeWrapMs < WRAP_MS;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    SoakState soak;
+    SoakState* state = &soak;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: soak [--wraps N] [--failure-rate P] [--max-latency-ms L] [--seed S]\n"
+               "            [--start-before-wrap-ms M] [--hang-rate P] [--rate-limit-rate P]\n");
+        return 1;
+    }
+    state->random.seed(state->options.seed);
+
+    const uint64_t startMs = WRAP_MS - state->options.startBeforeWrapMs;
+    const uint64_t endMs = startMs + state->options.wraps * WRAP_MS + 2 * POLL_INTERVAL_MS;
+    const uint64_t stallLimitMs = POLL_INTERVAL_MS + TIMER_SLACK_MS + 4ULL * state->options.maxLatencyMs;
+
+    nativeClockSetMs(startMs);
+    standInServerSet(handleExchange, state);
+
+    setup();
+    loop();  // First iteration creates every lazily allocated object
+
+    // Inline request tasks of a new batch may run past the grace period
+    const uint64_t reclaimLimitMs = HARD_DEADLINE_MS + GRACE_MS + TIMER_SLACK_MS +
+                                    2ULL * state->options.maxLatencyMs * state->endpoints.size();
+
+    const size_t baselineBytes = liveHeapBytes;
+    const size_t baselineBlocks = liveHeapBlocks;
+    const int baselineClients = nativeLiveClients();   // The firmware keeps one per request worker
+    uint64_t iterations = 1;
+    uint64_t heapViolations = 0;
+    uint64_t leakViolations = 0;
+    size_t peakHeapBytes = baselineBytes;
+
+    printf("Soak: %u wrap(s) from t=%llu ms (millis()=%lu), %.1f simulated days\n",
+           state->options.wraps, (unsigned long long)startMs, millis(),
+           (endMs - startMs) / 86400000.0);
+
+    while (nativeClockNowMs() < endMs) {
+        loop();
+        iterations++;
+
+        if (liveHeapBytes != baselineBytes || liveHeapBlocks != baselineBlocks) {
+            if (heapViolations++ < MAX_REPORTED_ANOMALIES) {
+                printf("✗ Heap changed: %zu bytes in %zu blocks (baseline %zu in %zu) at t=%llu ms\n",
+                       liveHeapBytes, liveHeapBlocks, baselineBytes, baselineBlocks,
+                       (unsigned long long)nativeClockNowMs());
+            }
+        }
+        if (liveHeapBytes > peakHeapBytes) {
+            peakHeapBytes = liveHeapBytes;
+        }
+        if (nativeLiveTasks() != nativeHungTasks() || nativeLiveClients() != baselineClients) {
+            if (leakViolations++ < MAX_REPORTED_ANOMALIES) {
+                printf("✗ Leak: %d task(s), %d client(s) alive after loop() at t=%llu ms\n",
+                       nativeLiveTasks(), nativeLiveClients(), (unsigned long long)nativeClockNowMs());
+            }
+        }
+        if (nativeHungTasks() > 0 && nativeClockNowMs() - state->lastHangMs > reclaimLimitMs) {
+            if (leakViolations++ < MAX_REPORTED_ANOMALIES) {
+                printf("✗ Hung task not reclaimed %llu ms after the last hang at t=%llu ms\n",
+                       (unsigned long long)(nativeClockNowMs() - state->lastHangMs),
+                       (unsigned long long)nativeClockNowMs());
+            }
+        }
+        // A hang holds the poll cycle up until the watchdog steps in
+        if (nativeClockNowMs() >= state->quietUntilMs &&
+            nativeClockNowMs() - state->lastAnyRequestMs > stallLimitMs) {
+            reportAnomaly(*state, "Stall", "all endpoints", nativeClockNowMs() - state->lastAnyRequestMs);
+            state->lastAnyRequestMs = nativeClockNowMs();
+        }
+    }
+
+    // Let the watchdog finish with hangs injected near the end
+    state->options.hangRate = 0;
+    while (nativeHungTasks() > 0 && nativeClockNowMs() - state->lastHangMs <= reclaimLimitMs) {
+        loop();
+        iterations++;
+    }
+
+    // Aggregate the results of the last batch
+    while (watcher.activeRequests() > 0) {
+        loop();
+        iterations++;
+    }
+
+    const RequestWatchdog& watchdog = watcher.watchdog();
+    const TrafficLedger& trafficLedger = watcher.trafficLedger();
+    const RateLimiter& rateLimiter = watcher.rateLimiter();
+
+    // Every injected hang has been reported and its task deleted by now
+    bool hangsHandled = watchdog.hungCount() == state->hangs && watchdog.reclaimedCount() == state->hangs &&
+                        nativeHungTasks() == 0;
+    bool trafficCounted = trafficLedger.lifetimeMeasuredBytes() == nativeSocketBytes();
+
+    // Every 429 paused the host (all stand-in endpoints share one)
+    uint64_t throttled = 0;
+    uint64_t deferrals = 0;
+    for (uint16_t i = 0; i < rateLimiter.count(); i++) {
+        throttled += rateLimiter.bucket(i).throttled;
+        deferrals += rateLimiter.bucket(i).deferrals;
+    }
+    bool rateLimitsHonoured = throttled == state->rateLimited;
+
+    bool passed = state->anomalies == 0 && heapViolations == 0 && leakViolations == 0 && hangsHandled &&
+                  trafficCounted && rateLimitsHonoured;
+
+    printf("\n========================================\n");
+    printf("Soak %s\n", passed ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    printf("loop() iterations:   %llu\n", (unsigned long long)iterations);
+    printf("Requests:            %llu across %zu endpoint(s)\n",
+           (unsigned long long)state->requests, state->endpoints.size());
+    printf("Tasks created:       %u (%d alive)\n", nativeTasksCreated(), nativeLiveTasks());
+    printf("Cadence anomalies:   %llu\n", (unsigned long long)state->anomalies);
+    printf("Heap violations:     %llu (baseline %zu bytes, peak %zu bytes)\n",
+           (unsigned long long)heapViolations, baselineBytes, peakHeapBytes);
+    printf("Leak violations:     %llu\n", (unsigned long long)leakViolations);
+    printf("Hangs:               %llu injected, %lu reported, %lu task(s) deleted, %u socket shutdown(s)\n",
+           (unsigned long long)state->hangs, (unsigned long)watchdog.hungCount(),
+           (unsigned long)watchdog.reclaimedCount(), nativeSocketShutdowns());
+    printf("Rate limits:         %llu 429(s) sent, %llu host pause(s), %llu deferral(s)\n",
+           (unsigned long long)state->rateLimited, (unsigned long long)throttled, (unsigned long long)deferrals);
+    printf("Traffic:             %llu bytes metered (%llu on the sockets), %llu with estimates\n",
+           (unsigned long long)trafficLedger.lifetimeMeasuredBytes(), (unsigned long long)nativeSocketBytes(),
+           (unsigned long long)trafficLedger.lifetimeBytes());
+    printf("========================================\n");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,381 @@
+// ============================================================================
+// WIFI RECONNECT HARNESS (host build: pio run -e native_wifi)
+// ============================================================================
+//
+// Runs the real firmware (src/main.cpp) against the native shim's WiFi
+// driver model (lib/NativeShim/src/NativeShim.h, WIFI DRIVER MODEL):
+// association and DHCP take time, some attempts fail, the signal wanders,
+// and the driver raises its events when the virtual clock reaches them.
+// Both endpoints are HTTPS GETs on the stand-in server, 20-200 ms a round
+// trip. A seeded script disturbs the link, one disturbance at a time; the
+// shim plays it on the virtual clock, so a kick can land in the middle of
+// a request:
+//   --deauth-rate   the AP kicks the station off, per hour
+//   --outage-rate   the AP goes away for 10 s to 3 minutes
+//   --flap-rate     bursts of 3 to 6 kicks, 1 to 4 s apart
+//   --fade-rate     the signal drops 20 to 30 dB for 30 s to 3 minutes
+//   --join-fail     share of association attempts the AP turns down
+//
+// For each disturbance it measures the time from its end (the kick, the
+// AP back, the signal back) until the firmware has its link again, and
+// reports the requests it cost: responses lost to a drop, connects
+// refused without a link, and failed checks. The firmware's adaptive TX
+// power shows as its mean level while linked and the connects the AP did
+// not hear at it; build with -DTX_POWER_MAX_QUARTER_DBM=0 to compare
+// against the driver's fixed maximum.
+//
+// Exits non-zero when the firmware has not recovered 60 s after a
+// disturbance ended, or when the firmware's idea of the link (its WiFi
+// state machine, seen through watcher.linkUp()) and the driver's disagree
+// for longer than DESYNC_LIMIT_MS.
+//
+// Usage:
+//   wifi [--hours H] [--deauth-rate R] [--outage-rate R] [--flap-rate R] [--fade-rate R]
+//        [--join-fail F] [--seed S]
+//
+
+#include <Arduino.h>
+#include <NativeShim.h>
+#include <Watcher.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Firmware entry points and objects (src/main.cpp)
+void setup();
+void loop();
+extern Watcher watcher;
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+const uint64_t EPOCH_MS = 1000;
+const uint64_t RECOVERY_LIMIT_MS = 60000;   // After a disturbance ends
+const uint64_t DESYNC_LIMIT_MS = 30000;     // A wedged request task may hold the loop up to its watchdog
+const uint64_t QUIET_MS = 30000;            // At least this long between disturbances
+const int8_t SIGNAL_DBM = -62;
+
+// ESP32 station behind a home AP: scan and association, then DHCP
+const NativeWiFiModel WIFI_MODEL = {
+    300,        // associateMinMs
+    1500,       // associateMaxMs
+    150,        // dhcpMinMs
+    2500,       // dhcpMaxMs
+    0,          // joinFailPermille: --join-fail
+    2000,       // retryMs: auto-reconnect after a failed attempt
+    SIGNAL_DBM, // rssiDbm
+    3,          // rssiSwingDb
+    -88,        // lossDbm
+    6000,       // beaconTimeoutMs
+    0,          // seed: --seed
+};
+
+struct WiFiOptions {
+    double hours = 6;
+    double deauthRate = 2;
+    double outageRate = 1;
+    double flapRate = 0.5;
+    double fadeRate = 0.5;
+    double joinFail = 0.1;
+    uint64_t seed = 1;
+};
+
+// ============================================================================
+// DISTURBANCES
+// ============================================================================
+
+enum DisturbanceKind : uint8_t {
+    DISTURB_DEAUTH,
+    DISTURB_OUTAGE,
+    DISTURB_FLAP,
+    DISTURB_FADE,
+    DISTURB_KINDS,
+};
+
+static const char* const KIND_NAMES[] = {"Kick", "AP outage", "Flap burst", "Signal fade"};
+
+struct Disturbance {
+    uint8_t kind;
+    uint64_t startMs;
+    uint64_t endMs;             // The cause is gone
+    uint64_t recoveredMs = 0;   // Firmware and driver up again (0: not yet)
+    bool dropped = false;       // The firmware saw the link go
+    std::vector<NativeWiFiStep> steps;
+};
+
+static Disturbance makeDisturbance(std::mt19937_64& random, uint8_t kind, uint64_t startMs) {
+    Disturbance disturbance;
+    disturbance.kind = kind;
+    disturbance.startMs = startMs;
+    disturbance.endMs = startMs;
+    if (kind == DISTURB_DEAUTH) {
+        disturbance.steps.push_back(NativeWiFiStep{startMs, NATIVE_WIFI_DEAUTH, 0});
+    } else if (kind == DISTURB_OUTAGE) {
+        std::uniform_int_distribution<uint64_t> duration(10000, 180000);
+        disturbance.endMs = startMs + duration(random);
+        disturbance.steps.push_back(NativeWiFiStep{startMs, NATIVE_WIFI_AP_DOWN, 0});
+        disturbance.steps.push_back(NativeWiFiStep{disturbance.endMs, NATIVE_WIFI_AP_UP, 0});
+    } else if (kind == DISTURB_FLAP) {
+        std::uniform_int_distribution<int> kicks(3, 6);
+        std::uniform_int_distribution<uint64_t> gap(1000, 4000);
+        uint64_t atMs = startMs;
+        for (int i = kicks(random); i > 0; i--) {
+            disturbance.steps.push_back(NativeWiFiStep{atMs, NATIVE_WIFI_DEAUTH, 0});
+            disturbance.endMs = atMs;
+            atMs += gap(random);
+        }
+    } else {
+        std::uniform_int_distribution<int> depth(20, 30);
+        std::uniform_int_distribution<uint64_t> duration(30000, 180000);
+        disturbance.endMs = startMs + duration(random);
+        disturbance.steps.push_back(NativeWiFiStep{startMs, NATIVE_WIFI_SIGNAL, (int8_t)(SIGNAL_DBM - depth(random))});
+        disturbance.steps.push_back(NativeWiFiStep{disturbance.endMs, NATIVE_WIFI_SIGNAL, SIGNAL_DBM});
+    }
+    return disturbance;
+}
+
+// ============================================================================
+// RUNNING
+// ============================================================================
+
+struct WiFiState {
+    WiFiOptions options;
+    std::mt19937_64 random;
+    Disturbance* current = NULL;     // Until it has recovered
+    bool firmwareUp = false;
+    uint64_t disagreeSinceMs = UINT64_MAX;
+    uint64_t longestDesyncMs = 0;
+    uint32_t firmwareDrops = 0;      // Link up -> down, seen by the firmware
+    uint32_t traceSeen = 0;          // Trace records appended so far
+    uint32_t checks = 0;
+    uint32_t failedChecks = 0;
+    uint64_t observedMs = 0;         // Time of the last observe()
+    uint64_t linkedMs = 0;           // Driver link up, summed
+    double txPowerDbmMs = 0;         // TX power over linkedMs
+};
+
+// Checks the trace gained since the last call, and how many failed
+static void tallyChecks(WiFiState& state) {
+    const TraceBuffer& trace = watcher.traceBuffer();
+    uint32_t appended = trace.count() + trace.dropped();
+    uint16_t fresh = (uint16_t)std::min<uint32_t>(appended - state.traceSeen, trace.count());
+    for (uint16_t i = trace.count() - fresh; i < trace.count(); i++) {
+        state.checks++;
+        state.failedChecks += trace.at(i).outcome == TRACE_OK ? 0 : 1;
+    }
+    state.traceSeen = appended;
+}
+
+// After every step: follow the firmware's link state and compare it with
+// the driver's
+static void observe(WiFiState& state) {
+    uint64_t now = nativeClockNowMs();
+    bool firmwareUp = watcher.linkUp();
+    bool driverUp = nativeWiFiLinkUp();
+    if (driverUp) {
+        state.linkedMs += now - state.observedMs;
+        state.txPowerDbmMs += nativeWiFiTxPower() / 4.0 * (now - state.observedMs);
+    }
+    state.observedMs = now;
+    if (state.firmwareUp && !firmwareUp) {
+        state.firmwareDrops++;
+        if (state.current != NULL) {
+            state.current->dropped = true;
+        }
+    }
+    state.firmwareUp = firmwareUp;
+
+    if (firmwareUp != driverUp) {
+        state.disagreeSinceMs = std::min(state.disagreeSinceMs, now);
+        state.longestDesyncMs = std::max(state.longestDesyncMs, now - state.disagreeSinceMs);
+    } else {
+        state.disagreeSinceMs = UINT64_MAX;
+    }
+
+    tallyChecks(state);
+
+    Disturbance* current = state.current;
+    if (current != NULL && now > current->endMs && firmwareUp && driverUp) {
+        current->recoveredMs = now;
+        state.current = NULL;
+    }
+}
+
+static WiFiState* observed;   // For step()
+
+// One pass of loop(); the driver's events fire while it sleeps, and each
+// that reaches the loop task ends the pass
+static void step() {
+    loop();
+    observe(*observed);
+}
+
+static void runUntil(WiFiState& state, uint64_t endMs) {
+    observed = &state;
+    observe(state);
+    nativeRunUntil(endMs, step);
+    observe(state);
+}
+
+static void handleExchange(const StandInRequest& request, StandInExchange* exchange, void* context) {
+    WiFiState& state = *(WiFiState*)context;
+    std::uniform_int_distribution<uint32_t> latency(20, 200);
+    if (request.path != NULL) {
+        exchange->responseMs = latency(state.random);
+        return;
+    }
+    exchange->connectMs = 3 * latency(state.random);   // TCP, then TLS
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+static uint64_t percentile(std::vector<uint64_t> values, double share) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(share * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void printFigure(const char* name, size_t count, const std::vector<uint64_t>& values) {
+    char label[48];
+    snprintf(label, sizeof(label), "%s (%zu/%zu)", name, values.size(), count);
+    printf("%-28s %7.1f %7.1f %7.1f %7.1f\n", label, percentile(values, 0.0) / 1000.0,
+           percentile(values, 0.5) / 1000.0, percentile(values, 0.9) / 1000.0, percentile(values, 1.0) / 1000.0);
+}
+
+// ============================================================================
+// COMMAND LINE
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, WiFiOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--hours") == 0) options->hours = atof(value);
+        else if (strcmp(name, "--deauth-rate") == 0) options->deauthRate = atof(value);
+        else if (strcmp(name, "--outage-rate") == 0) options->outageRate = atof(value);
+        else if (strcmp(name, "--flap-rate") == 0) options->flapRate = atof(value);
+        else if (strcmp(name, "--fade-rate") == 0) options->fadeRate = atof(value);
+        else if (strcmp(name, "--join-fail") == 0) options->joinFail = atof(value);
+        else if (strcmp(name, "--seed") == 0) options->seed = strtoull(value, NULL, 10);
+        else return false;
+    }
+    double rates = options->deauthRate + options->outageRate + options->flapRate + options->fadeRate;
+    return options->hours > 0 && options->joinFail >= 0 && options->joinFail < 1 && options->deauthRate >= 0 &&
+           options->outageRate >= 0 && options->flapRate >= 0 && options->fadeRate >= 0 && rates > 0;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    WiFiState wifi;
+    WiFiState* state = &wifi;
+    if (!parseOptions(argc, argv, &state->options)) {
+        printf("Usage: wifi [--hours H] [--deauth-rate R] [--outage-rate R] [--flap-rate R] [--fade-rate R]\n"
+               "            [--join-fail F] [--seed S]\n");
+        return 1;
+    }
+    const WiFiOptions& options = state->options;
+    state->random.seed(options.seed);
+
+    NativeWiFiModel model = WIFI_MODEL;
+    model.joinFailPermille = (uint16_t)(options.joinFail * 1000);
+    model.seed = (uint32_t)options.seed;
+    nativeClockSetMs(EPOCH_MS);
+    nativeWiFiModelSet(&model);
+    standInServerSet(handleExchange, state);
+    setup();
+
+    // Boot: the first join
+    runUntil(*state, EPOCH_MS + RECOVERY_LIMIT_MS);
+    uint64_t bootMs = state->firmwareUp ? 0 : UINT64_MAX;
+
+    const double rates[DISTURB_KINDS] = {options.deauthRate, options.outageRate, options.flapRate, options.fadeRate};
+    double perHour = rates[0] + rates[1] + rates[2] + rates[3];
+    std::exponential_distribution<double> gap(perHour / 3600000.0);
+    std::discrete_distribution<int> kind(rates, rates + DISTURB_KINDS);
+    uint64_t endMs = EPOCH_MS + (uint64_t)(options.hours * 3600000);
+    std::vector<Disturbance> disturbances;
+    bool unrecovered = false;
+
+    for (;;) {
+        uint64_t startMs = nativeClockNowMs() + QUIET_MS + (uint64_t)gap(state->random);
+        if (startMs >= endMs) {
+            break;
+        }
+        disturbances.push_back(makeDisturbance(state->random, (uint8_t)kind(state->random), startMs));
+        Disturbance& disturbance = disturbances.back();
+        state->current = &disturbance;
+        nativeWiFiScript(disturbance.steps.data(), disturbance.steps.size());
+        runUntil(*state, disturbance.endMs + RECOVERY_LIMIT_MS);
+        if (state->current != NULL) {
+            unrecovered = true;
+            state->current = NULL;
+        }
+    }
+    runUntil(*state, endMs);
+
+    // Recovery per kind, of the disturbances that took the link
+    std::vector<uint64_t> recovery[DISTURB_KINDS];
+    size_t counts[DISTURB_KINDS] = {0, 0, 0, 0};
+    uint32_t missed = 0;
+    for (const Disturbance& disturbance : disturbances) {
+        counts[disturbance.kind]++;
+        if (disturbance.recoveredMs == 0) {
+            missed++;
+        } else if (disturbance.dropped) {
+            recovery[disturbance.kind].push_back(disturbance.recoveredMs - disturbance.endMs);
+        }
+    }
+
+    const NativeWiFiStats& stats = nativeWiFiStats();
+    bool desync = state->longestDesyncMs > DESYNC_LIMIT_MS;
+    bool failed = unrecovered || missed > 0 || bootMs != 0 || desync;
+
+    printf("\n========================================\n");
+    printf("WiFi reconnects: %.1f h, %zu disturbance(s), %.0f%% of joins turned down\n", options.hours,
+           disturbances.size(), options.joinFail * 100);
+    printf("========================================\n");
+    printf("Driver:          %u association attempt(s), %u failed, %u link drop(s)\n", stats.attempts,
+           stats.failedAttempts, stats.drops);
+    printf("Firmware:        %u link loss(es) seen, longest disagreement with the driver %.1f s\n",
+           state->firmwareDrops, state->longestDesyncMs / 1000.0);
+    printf("Requests:        %u response(s) lost to a drop, %u connect(s) refused without a link\n",
+           stats.cutRequests, stats.refusedConnects);
+    printf("Checks:          %u, %u failed (%.1f%%)\n", state->checks, state->failedChecks,
+           state->checks > 0 ? 100.0 * state->failedChecks / state->checks : 0.0);
+    printf("Radio:           mean TX power %.1f dBm while linked, %u connect(s) the AP did not hear\n",
+           state->linkedMs > 0 ? state->txPowerDbmMs / state->linkedMs : 0.0, stats.unheardConnects);
+    printf("----------------------------------------\n");
+    printf("Seconds to link back (dropped/all) min  median     p90     max\n");
+    for (int i = 0; i < DISTURB_KINDS; i++) {
+        printFigure(KIND_NAMES[i], counts[i], recovery[i]);
+    }
+    printf("----------------------------------------\n");
+    if (missed > 0 || unrecovered) {
+        printf("%u disturbance(s) not recovered within %llu s\n", missed,
+               (unsigned long long)(RECOVERY_LIMIT_MS / 1000));
+    }
+    if (bootMs != 0) {
+        printf("No link within %llu s of boot\n", (unsigned long long)(RECOVERY_LIMIT_MS / 1000));
+    }
+    printf("%s\n", failed ? "WiFi FAILED" : "WiFi PASSED");
+
+    return failed ? 1 : 0;
+}
@@ -1,8 +1,15 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
-#include <HTTPClient.h>
 #include <secrets.h>
+#include <Watcher.h>
+#include <HeartbeatRelay.h>
+#include <MqttProbe.h>
+#include <CoapProbe.h>
+#include <config_partition.h>
+#include <log.h>
+#include <profiler.h>
+#include <TxPower.h>
+#include <atomic>
 
 // ============================================================================
 // CONFIGURATION
@@ -13,45 +20,472 @@
 const int BLUE_LED_PIN = 2;   // Blue LED (success indicator)
 const int RED_LED_PIN = 13;   // Red LED (error indicator) - common on ESP32 dev boards
 
-// API endpoints to poll (defined in secrets.h)
-const char* API_ENDPOINTS[] = {
-    API_ENDPOINT_1,
-    API_ENDPOINT_2,
+// API endpoints to poll (defined in secrets.h) and their priority. Under
+// data budget pressure, LOW endpoints are stretched first, HIGH ones last,
+// and OPTIONAL ones (telemetry) are not polled at all. A NULL probe picks
+// the transport by URL: an HTTPS GET, for mqtts:// URLs a publish to the
+// MQTT broker, for coaps:// URLs a CoAP request over DTLS (see TRANSPORTS
+// below). A table flashed to the config partition (scripts/config_pack.py)
+// takes the place of this list.
+//
+// An endpoint whose content matters, not just its availability, names a
+// ContentWatch: its body is hashed as it streams in and every change is
+// logged. Masks keep volatile parts out of the hash, for example:
+//
+//   const ContentMask STATUS_MASKS[] = {
+//       { CONTENT_MASK_BETWEEN, 0, 0, "\"updated_at\":\"", "\"" },
+//   };
+//   const ContentWatch STATUS_PAGE = { STATUS_MASKS, 1 };
+//   ...
+//   { API_ENDPOINT_3, PRIORITY_LOW, NULL, &STATUS_PAGE, NULL, NULL },
+//
+// A check that any of several equivalent servers can take names them as
+// alternates. Each request goes to the destination with the best record of
+// answers and latency, and fails over to the next one when it gets no
+// answer (see FAILOVER_CONFIG below), for example:
+//
+//   const char* const COLLECTOR_BACKUPS[] = { "https://backup.example.net/ping" };
+//   const EndpointAlternates COLLECTOR_ALTERNATES = { COLLECTOR_BACKUPS, 1 };
+//   ...
+//   { API_ENDPOINT_1, PRIORITY_HIGH, NULL, NULL, &COLLECTOR_ALTERNATES, NULL },
+//
+// A large page need not come whole to show that its server is up. HEAD
+// judges it by status and headers alone; a range takes only its first
+// bytes (and a server that ignores the range is cut off after them), for
+// example:
+//
+//   const HttpRequestMode HEADERS_ONLY = { HTTP_REQUEST_HEAD, 0 };
+//   const HttpRequestMode FIRST_KB = { HTTP_REQUEST_RANGE, 1024 };
+//   ...
+//   { API_ENDPOINT_4, PRIORITY_LOW, NULL, NULL, NULL, &FIRST_KB },
+//
+// With HEARTBEAT_RELAY_URL in secrets.h, the last endpoint relays the LAN
+// gadgets' heartbeats (see HEARTBEAT RELAY below).
+#ifdef HEARTBEAT_RELAY_URL
+extern HeartbeatRelay heartbeatRelay;
+#endif
+const EndpointConfig ENDPOINTS[] = {
+    { API_ENDPOINT_1, PRIORITY_HIGH, NULL, NULL, NULL, NULL },
+    { API_ENDPOINT_2, PRIORITY_NORMAL, NULL, NULL, NULL, NULL },
+#ifdef HEARTBEAT_RELAY_URL
+    { HEARTBEAT_RELAY_URL, PRIORITY_HIGH, &heartbeatRelay, NULL, NULL, NULL },
+#endif
 };
-const int NUM_ENDPOINTS = sizeof(API_ENDPOINTS) / sizeof(API_ENDPOINTS[0]);
+const int NUM_ENDPOINTS = sizeof(ENDPOINTS) / sizeof(ENDPOINTS[0]);
 
-// Timing configuration
-const unsigned long POLL_INTERVAL_MS = 30000;  // Poll every 30 seconds
+// Flash partition with an endpoint table, the most endpoints the watcher
+// keeps state for (about 180 bytes of RAM each), how many of them may be
+// watched for content (about 130 bytes more each) and how many may have
+// alternates (about 100 bytes more each; only the built-in list has them)
+#define CONFIG_PARTITION_LABEL "config"
+#ifndef MAX_ENDPOINTS
+#define MAX_ENDPOINTS NUM_ENDPOINTS
+#endif
+#ifndef MAX_CONTENT_ENDPOINTS
+#define MAX_CONTENT_ENDPOINTS MAX_ENDPOINTS
+#endif
+#ifndef MAX_FAILOVER_ENDPOINTS
+#define MAX_FAILOVER_ENDPOINTS NUM_ENDPOINTS
+#endif
+
+// Timing configuration (uint32_t like millis() on the ESP32, so wraparound
+// arithmetic is identical on the device and in native builds)
+const uint32_t POLL_INTERVAL_MS = 30000;       // Poll every 30 seconds
 const int HTTP_TIMEOUT_MS = 5000;              // 5 second timeout for HTTP requests
 const int WIFI_RECONNECT_DELAY_MS = 5000;      // Wait 5 seconds before WiFi reconnect
+const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000; // Give up on a connection attempt after 15 s
+
+// Destination failover (see lib/WatcherCore/src/Failover.h): a timeout costs
+// HTTP_TIMEOUT_MS before the next destination can be tried, and a second
+// attempt starts only within 2 * HTTP_TIMEOUT_MS of the first, so the last
+// one still ends before the watchdog's deadline
+const FailoverConfig FAILOVER_CONFIG = {
+    128,                   // weight: a new sample counts half
+    HTTP_TIMEOUT_MS,       // failurePenaltyMs
+    1000,                  // priorLatencyMs: until a destination has answered
+    50,                    // orderBiasMs: the list's order breaks near-ties
+    60000,                 // probeIntervalMs: try a demoted destination every minute
+    2 * HTTP_TIMEOUT_MS,   // attemptWindowMs
+};
+
+// Adaptive TX power (see lib/WatcherCore/src/TxPower.h): after each poll
+// cycle, one step down while the link is solid and the AP should still hear
+// the station at -66 dBm, back up on unanswered requests or link checks.
+// 0 keeps the driver's maximum.
+#ifndef TX_POWER_MAX_QUARTER_DBM
+#define TX_POWER_MAX_QUARTER_DBM WIFI_POWER_19_5dBm
+#endif
+const TxPowerConfig TX_POWER_CONFIG = {
+    WIFI_POWER_8_5dBm,          // minQuarterDbm
+    TX_POWER_MAX_QUARTER_DBM,   // maxQuarterDbm: also after every (re)connect
+    8,                          // stepQuarterDbm: 2 dB
+    -66,                        // targetRssiDbm: about 20 dB above what the AP can still decode
+    3,                          // solidCycles
+    10,                         // holdCycles: after unanswered requests
+};
+
+// Retry and health configuration (see lib/WatcherCore/src/PollScheduler.h)
+const SchedulerConfig SCHEDULER_CONFIG = {
+    POLL_INTERVAL_MS,   // pollIntervalMs
+    POLL_INTERVAL_MS,   // retryBaseMs: a failed endpoint keeps the regular cadence
+    2,                  // failThreshold: one lost request is not an outage
+};
+
+// Hung-request watchdog (see lib/WatcherCore/src/RequestWatchdog.h)
+const WatchdogConfig WATCHDOG_CONFIG = {
+    4 * HTTP_TIMEOUT_MS,   // hardDeadlineMs: well past the connect and read timeouts
+    2000,                  // graceMs: time to exit after the socket was shut down
+};
+
+// Per-host rate limit (see lib/WatcherCore/src/RateLimiter.h): endpoints on
+// the same host share one bucket, retries included
+const RateLimitConfig RATE_LIMIT_CONFIG = {
+    6,                  // burst
+    30,                 // requestsPerMinute (0 turns the bucket off; 429 pauses still apply)
+    60000,              // defaultPauseMs: after a 429 without a usable Retry-After
+    900000,             // maxPauseMs: 15 minutes
+};
+
+// Link check between the polls (see lib/WatcherCore/src/LinkCheck.h): a bare
+// TCP connect every few seconds; 0 turns it off
+#ifndef LINK_CHECK_INTERVAL_MS
+#define LINK_CHECK_INTERVAL_MS 5000
+#endif
+const LinkCheckConfig LINK_CHECK_CONFIG = {
+    LINK_CHECK_INTERVAL_MS,   // intervalMs
+    2000,                     // timeoutMs: a LAN connect takes milliseconds
+    2,                        // failThreshold: one lost SYN does not bring the polls forward
+    2000,                     // retryMs: confirm a lost link within seconds, not a poll interval
+};
+
+// Whom the link check connects to: 0.0.0.0 is the gateway. Port 53 (DNS
+// over TCP) is open on most routers, and a refused connect counts as an
+// answer too. A host past the gateway would catch WAN outages as well.
+const LinkProbeTarget LINK_CHECK_TARGET = { { 0, 0, 0, 0 }, 53 };
+
+// LAN peers (see lib/WatcherCore/src/PeerLease.h): watchers on one site
+// with the same endpoint list elect a leader over UDP multicast, and only
+// the leader pings upstream. The lease of three heartbeats hands the lead
+// over well within one poll interval. 0 turns it off: the watcher polls
+// on its own.
+#ifndef PEER_HEARTBEAT_MS
+#define PEER_HEARTBEAT_MS 0
+#endif
+const PeerConfig PEER_CONFIG = {
+    PEER_HEARTBEAT_MS,       // heartbeatMs
+    3 * PEER_HEARTBEAT_MS,   // leaseMs
+};
+
+// Multicast group and port the peers announce on (sent with TTL 1)
+const PeerChannel PEER_CHANNEL = { { 239, 255, 83, 87 }, 47883 };
+
+// Heartbeat relay (see lib/Watcher/src/HeartbeatRelay.h): LAN gadgets too
+// weak for TLS send "<name> [period_s]" datagrams to the UDP port, or
+// "GET /hb/<name>[?period=<s>]" to the HTTP port, and the watcher reports
+// all of them to HEARTBEAT_RELAY_URL in one HTTPS request per poll
+// interval, plus one right away whenever a gadget goes silent (two beats
+// missed) or comes back. Only while HEARTBEAT_RELAY_URL is defined; a
+// flashed endpoint table has no relay entry.
+#ifndef HEARTBEAT_UDP_PORT
+#define HEARTBEAT_UDP_PORT 47884
+#endif
+#ifndef HEARTBEAT_HTTP_PORT
+#define HEARTBEAT_HTTP_PORT 8080
+#endif
+#ifndef MAX_HEARTBEAT_SOURCES
+#ifdef HEARTBEAT_RELAY_URL
+#define MAX_HEARTBEAT_SOURCES 32               // About 36 bytes of RAM each
+#else
+#define MAX_HEARTBEAT_SOURCES 1
+#endif
+#endif
+const HeartbeatRelayConfig HEARTBEAT_RELAY_CONFIG = {
+    {
+        60000,          // defaultPeriodMs: for gadgets that do not say
+        2,              // missedBeats: one lost datagram is not an outage
+    },
+    { HEARTBEAT_UDP_PORT, HEARTBEAT_HTTP_PORT },
+};
+
+// MQTT publisher (see lib/Watcher/src/MqttProbe.h): endpoints with an
+// mqtts://<broker>/<topic>[?<payload>] URL, the heartbeat relay's included,
+// publish with QoS 1 over one TLS connection kept open between polls
+// instead of an HTTPS request each. The broker keeps the session and holds
+// a will: it publishes "offline" (retained) to MQTT_STATUS_TOPIC as soon as
+// the connection drops, or after 1.5 keep-alive periods without a word
+// from the watcher; "online" replaces it on every connect.
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S 60
+#endif
+#ifndef MQTT_STATUS_TOPIC
+#define MQTT_STATUS_TOPIC "svitlo/" DEVICE_HOSTNAME "/status"
+#endif
+#ifndef MQTT_USERNAME
+#define MQTT_USERNAME NULL
+#endif
+#ifndef MQTT_PASSWORD
+#define MQTT_PASSWORD NULL
+#endif
+#ifndef MQTT_WINDOW
+#define MQTT_WINDOW 4                          // About 240 bytes of RAM each
+#endif
+
+// Data budget of a metered uplink (see lib/WatcherCore/src/DataBudget.h);
+// 0 bytes leaves the uplink unmetered
+#ifndef DATA_BUDGET_BYTES
+#define DATA_BUDGET_BYTES 0
+#endif
+#ifndef DATA_BUDGET_PERIOD_DAYS
+#define DATA_BUDGET_PERIOD_DAYS 30             // 30: monthly, 1: daily
+#endif
+static_assert(DATA_BUDGET_PERIOD_DAYS >= 1 && DATA_BUDGET_PERIOD_DAYS <= 31, "budget period is 1 to 31 days");
+const DataBudgetConfig DATA_BUDGET_CONFIG = {
+    DATA_BUDGET_BYTES,         // budgetBytes
+    DATA_BUDGET_PERIOD_DAYS,   // periodDays
+    8,                         // maxStretch: poll every 4 minutes at the least
+};
+const char* const BUDGET_NVS_NAMESPACE = "budget";
+
+// Current model for the energy estimate (see lib/WatcherCore/src/EnergyMeter.h).
+// Defaults from the ESP32 datasheet at 240 MHz, 802.11n, 13 dBm TX power;
+// measure the actual board for battery planning.
+const EnergyModel ENERGY_MODEL = {
+    3300,    // supplyMv
+    40,      // cpuMa: CPU running, above modem sleep
+    80,      // radioMa: receiving / listening
+    110,     // txMa: extra while transmitting
+    24000,   // phyRateKbps
+    150,     // frameOverheadUs: preamble, DIFS, average backoff, ACK
+    100,     // radioTailMs: awake after the last packet before modem sleep
+};
+
+// Task configuration: request tasks alive at once (each with its own secure
+// client), one per endpoint unless there are many
+#ifndef MAX_REQUEST_TASKS
+#define MAX_REQUEST_TASKS NUM_ENDPOINTS
+#endif
+#ifndef HTTP_TASK_STACK_SIZE
+#define HTTP_TASK_STACK_SIZE 8192              // Stack size per HTTP task (bytes)
+#endif
+
+// Control event queue: WiFi events, plus at most one pending wake-up each
+// for results, heartbeats and console input
+const int CONTROL_QUEUE_LENGTH = 8;
+
+// Whole days of traffic totals kept for the console report
+const uint8_t TRAFFIC_HISTORY_DAYS = 7;
+
+// Number of recent requests kept for the timing trace (16 bytes each)
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY 256
+#endif
+
+// User-Agent sent with every request
+#define USER_AGENT DEVICE_HOSTNAME "/1.0"
+
+const WatcherConfig WATCHER_CONFIG = {
+    SCHEDULER_CONFIG,
+    WATCHDOG_CONFIG,
+    DATA_BUDGET_CONFIG,
+    BUDGET_NVS_NAMESPACE,
+    ENERGY_MODEL,
+    RATE_LIMIT_CONFIG,
+    LINK_CHECK_CONFIG,
+    LINK_CHECK_TARGET,
+    PEER_CONFIG,
+    PEER_CHANNEL,
+    FAILOVER_CONFIG,
+};
+
+const MqttProbeConfig MQTT_PROBE_CONFIG = {
+    {
+        DEVICE_HOSTNAME,    // clientId: names the session on the broker
+        MQTT_USERNAME,      // username
+        MQTT_PASSWORD,      // password
+        MQTT_KEEPALIVE_S,   // keepAliveS
+        MQTT_STATUS_TOPIC,  // statusTopic
+        "offline",          // willMessage
+        "online",           // onlineMessage
+        MQTT_WINDOW,        // window: publishes in flight at once
+        HTTP_TIMEOUT_MS,    // responseTimeoutMs: CONNACK, PINGRESP
+    },
+    HTTP_TIMEOUT_MS,        // timeoutMs: connect, and each PUBACK
+};
+
+// CoAP over DTLS (see lib/Watcher/src/CoapProbe.h): endpoints with a
+// coaps://<server>/<path>[?<query>] URL send a confirmable POST of a few
+// dozen bytes instead of an HTTPS request, over one DTLS association that
+// resumes its cached session after a break. A lost request goes again
+// after 1 to 1.5 s, then 2 to 3 s; with two retransmissions a check gives
+// up within 10.5 s.
+const CoapProbeConfig COAP_PROBE_CONFIG = {
+    {
+        1000,               // ackTimeoutMs (RFC 7252: 2000; a ping is cheap to repeat)
+        1500,               // randomPermille: ACK_RANDOM_FACTOR 1.5
+        2,                  // maxRetransmit
+    },
+    HTTP_TIMEOUT_MS,        // handshakeTimeoutMs
+    60000,                  // idleMs: NAT bindings of home routers outlast a minute
+};
+
+const WatcherBudget WATCHER_BUDGET = {
+    MAX_REQUEST_TASKS,      // maxTasks
+    HTTP_TASK_STACK_SIZE,   // taskStackBytes
+    1,                      // taskPriority
+};
 
 // ============================================================================
-// GLOBAL VARIABLES
+// CONTROL EVENTS
 // ============================================================================
+//
+// loop() sleeps on a single queue and only wakes for an event or for the
+// next timer deadline (endpoint due, hung request, WiFi connect timeout or
+// retry, heartbeat deadline, MQTT keep-alive). Everything else (WiFi
+// driver callbacks, request tasks, the heartbeat listener, serial input)
+// only posts events, so state is changed by the loop task alone.
+// Request tasks hand over their result through the watcher's lock-free
+// result queue and post EVENT_RESULT_READY only to wake the loop task up;
+// the heartbeat listener task posts EVENT_HEARTBEAT_READY the same way
+// when a beat is waiting on its sockets.
+//
+// Wake-ups (results, heartbeats, console input) carry no data, so one of
+// each waiting in the queue is enough: further posts are dropped until the
+// loop task takes it, and no poster ever blocks. The queue thus always has
+// room for the WiFi events, so the driver's event task cannot block on it
+// while the loop task waits for that same task inside WiFi.begin() or
+// WiFi.mode().
+//
 
-unsigned long lastPollTime = 0;
-SemaphoreHandle_t ledMutex;  // Mutex for thread-safe LED control
-int activeRequests = 0;       // Counter for active HTTP requests
-int failedRequests = 0;       // Counter for failed requests
+enum ControlEventType : uint8_t {
+    EVENT_WIFI_CONNECTED,      // Station got an IP address
+    EVENT_WIFI_DISCONNECTED,   // Station lost (or could not join) the AP
+    EVENT_RESULT_READY,        // A request task handed over its result
+    EVENT_CONSOLE_INPUT,       // Bytes arrived on Serial
+    EVENT_HEARTBEAT_READY,     // A heartbeat is waiting on the listener sockets
+};
+
+struct ControlEvent {
+    uint8_t type;        // ControlEventType
+};
+
+enum WiFiLinkState : uint8_t {
+    WIFI_LINK_DOWN,          // Waiting until wifiDeadlineMs to retry
+    WIFI_LINK_CONNECTING,    // WiFi.begin() issued, times out at wifiDeadlineMs
+    WIFI_LINK_UP,
+};
 
 // ============================================================================
-// TASK PARAMETER STRUCTURE
+// LED OBSERVER
 // ============================================================================
 
-struct RequestTaskParams {
-    const char* url;
-    int index;
+void adjustTxPower(const CycleSummary& summary);
+
+// Red LED on as soon as a request fails; after each poll cycle it follows
+// overall health, including endpoints not polled this cycle. A follower
+// shows the health its leader announces. The cycle also steps the TX power.
+class LedObserver : public ResultObserver {
+public:
+    void onResult(uint16_t endpoint, const TraceRecord& result, HealthChange change) override {
+        if (result.outcome != TRACE_OK && result.outcome != TRACE_RATE_LIMITED) {
+            digitalWrite(RED_LED_PIN, HIGH);
+        }
+    }
+    
+    void onCycleComplete(const CycleSummary& summary) override {
+        digitalWrite(RED_LED_PIN, summary.downCount > 0 ? HIGH : LOW);
+        adjustTxPower(summary);
+    }
+    
+    void onLeaderReport(uint32_t leader, uint16_t downCount) override {
+        digitalWrite(RED_LED_PIN, downCount > 0 ? HIGH : LOW);
+    }
+};
+
+// ============================================================================
+// TRANSPORTS
+// ============================================================================
+
+// The probe of endpoints that do not name one, and the heartbeat relay's
+// upstream: mqtts:// URLs go to the MQTT publisher, coaps:// URLs to the
+// CoAP probe, everything else is an HTTPS GET
+class TransportProbe : public Probe {
+public:
+    TransportProbe(Probe& http, MqttProbe& mqtt, CoapProbe& coap) : http_(http), mqtt_(mqtt), coap_(coap) {}
+    
+    void prepare(uint16_t endpoint, const char* url) override {
+        select(url).prepare(endpoint, url);
+    }
+    
+    void run(WiFiClientSecure& client, const ProbeRequest& request, RequestResult* result) override {
+        select(request.url).run(client, request, result);
+    }
+    
+    // Only the publisher and the CoAP probe have connections of their own
+    void abandon(uint16_t endpoint) override {
+        mqtt_.abandon(endpoint);
+        coap_.abandon(endpoint);
+    }
+    
+private:
+    Probe& select(const char* url) {
+        if (mqttUrl(url)) {
+            return mqtt_;
+        }
+        return coapUrl(url) ? (Probe&)coap_ : http_;
+    }
+    
+    Probe& http_;
+    MqttProbe& mqtt_;
+    CoapProbe& coap_;
 };
 
+// ============================================================================
+// GLOBAL VARIABLES
+// ============================================================================
+
+// Everything the watcher keeps, sized at compile time (lib/Watcher/src/Watcher.h)
+WatcherStorage<MAX_ENDPOINTS, MAX_REQUEST_TASKS, TRACE_CAPACITY, TRAFFIC_HISTORY_DAYS, MAX_CONTENT_ENDPOINTS,
+               MAX_FAILOVER_ENDPOINTS>
+    watcherStorage;
+HttpGetProbe httpProbe(USER_AGENT, HTTP_TIMEOUT_MS);
+MqttMessage mqttMessages[MQTT_WINDOW];
+MqttProbe mqttProbe(mqttMessages, MQTT_WINDOW, MQTT_PROBE_CONFIG);
+CoapProbe coapProbe(COAP_PROBE_CONFIG);
+TransportProbe transportProbe(httpProbe, mqttProbe, coapProbe);
+Watcher watcher(watcherStorage.memory(), WATCHER_CONFIG, WATCHER_BUDGET, transportProbe);
+HeartbeatSource heartbeatSources[MAX_HEARTBEAT_SOURCES];
+HeartbeatRelay heartbeatRelay(heartbeatSources, MAX_HEARTBEAT_SOURCES, HEARTBEAT_RELAY_CONFIG, transportProbe);
+EndpointTable endpointTable;   // Mapped from the config partition, if flashed
+LedObserver ledObserver;
+TxPowerControl txPower(TX_POWER_CONFIG);
+uint32_t txPowerLinkChecks = 0;          // Link check counters at the last adjustment
+uint32_t txPowerLinkCheckFailures = 0;
+
+QueueHandle_t controlQueue;   // ControlEvent, consumed by loop() only
+std::atomic<uint8_t> pendingWakes(0);   // Bit per wake-up event type waiting in controlQueue
+WiFiLinkState wifiState = WIFI_LINK_DOWN;
+uint32_t wifiDeadlineMs = 0;
+bool wifiEverConnected = false;
+
 // ============================================================================
 // FUNCTION DECLARATIONS
 // ============================================================================
 
-void connectToWiFi();
-void checkWiFiConnection();
-void pollEndpoints();
-void sendGetRequestTask(void* parameter);
-void sendGetRequest(const char* url, int index);
+void postControlEvent(uint8_t type);
+void postWakeEvent(uint8_t type);
+void wakeLoop(void* context);
+void wakeHeartbeats(void* context);
+void handleControlEvent(const ControlEvent& event);
+TickType_t ticksUntilNextTimer();
+void onWiFiEvent(arduino_event_id_t event);
+void onConsoleReceive();
+void startWiFiConnection();
+void handleWiFiConnected();
+void handleWiFiDisconnected();
+void checkWiFiDeadline();
+void applyTxPower();
+void printRadio(Print& out);
+void checkConsoleInput();
 void blinkBlueLED(int times, int delayMs);
 
 // ============================================================================
@@ -68,12 +502,12 @@ void setup() {
     digitalWrite(BLUE_LED_PIN, LOW);   // Turn off blue LED
     digitalWrite(RED_LED_PIN, LOW);    // Turn off red LED
     
-    // Create mutex for thread-safe LED control
-    ledMutex = xSemaphoreCreateMutex();
+    // Everything after setup() is driven by this queue
+    controlQueue = xQueueCreate(CONTROL_QUEUE_LENGTH, sizeof(ControlEvent));
     
-    Serial.println("\n\n========================================");
-    Serial.println("ESP32 WiFi API Poller");
-    Serial.println("========================================");
+    LOG_INFO("\n\n========================================\n");
+    LOG_INFO("ESP32 WiFi API Poller\n");
+    LOG_INFO("========================================\n");
     
     // Configure WiFi - explicitly disable AP and ensure Station mode only
     WiFi.disconnect(true);  // Disconnect and clear saved WiFi config
@@ -82,24 +516,36 @@ void setup() {
     WiFi.mode(WIFI_STA);    // Set to Station mode only (no AP)
     WiFi.setAutoReconnect(true);
     
-    Serial.println("WiFi configured: Station mode only (AP disabled)");
+    LOG_INFO("WiFi configured: Station mode only (AP disabled)\n");
     
     // Set device hostname for network identification (must be before WiFi.begin)
     WiFi.setHostname(DEVICE_HOSTNAME);
-    Serial.print("Device hostname set to: ");
-    Serial.println(DEVICE_HOSTNAME);
+    LOG_INFO("Device hostname set to: %s\n", DEVICE_HOSTNAME);
     
-    Serial.println("SSL/TLS: Using insecure mode (certificate validation disabled)");
-    Serial.println("Each HTTP task will create its own secure client");
+    LOG_INFO("SSL/TLS: Using insecure mode (certificate validation disabled)\n");
+    LOG_INFO("Each HTTP task will use its own secure client\n");
     
-    // Initial WiFi connection
-    connectToWiFi();
+    // Event sources: WiFi driver and serial console
+    WiFi.onEvent(onWiFiEvent);
+    Serial.onReceive(onConsoleReceive);
     
-    // Poll endpoints immediately after boot
-    if (WiFi.status() == WL_CONNECTED) {
-        pollEndpoints();
-        lastPollTime = millis();  // Reset timer for next poll
+    // Every endpoint is due as soon as WiFi is up. A flashed endpoint
+    // table replaces the built-in list.
+    mqttProbe.begin();
+    coapProbe.begin();
+    if (configPartitionMap(CONFIG_PARTITION_LABEL, &endpointTable)) {
+        watcher.begin(endpointTable, wakeLoop, NULL, &ledObserver);
+    } else {
+        watcher.begin(ENDPOINTS, NUM_ENDPOINTS, wakeLoop, NULL, &ledObserver);
+#ifdef HEARTBEAT_RELAY_URL
+        heartbeatRelay.begin(watcher, NUM_ENDPOINTS - 1, wakeHeartbeats, NULL);
+        LOG_INFO("Heartbeat relay: UDP port %u, HTTP port %u, up to %u gadgets\n",
+                 HEARTBEAT_UDP_PORT, HEARTBEAT_HTTP_PORT, MAX_HEARTBEAT_SOURCES);
+#endif
     }
+    
+    // Initial WiFi connection (completion arrives as an event)
+    startWiFiConnection();
 }
 
 // ============================================================================
@@ -107,280 +553,265 @@ void setup() {
 // ============================================================================
 
 void loop() {
-    // Check WiFi connection status
-    checkWiFiConnection();
-    
-    // Check if it's time to poll endpoints
-    unsigned long currentTime = millis();
-    if (currentTime - lastPollTime >= POLL_INTERVAL_MS) {
-        lastPollTime = currentTime;
-        pollEndpoints();
+    // Sleep until an event arrives or the next timer deadline passes
+    ControlEvent event;
+    if (xQueueReceive(controlQueue, &event, ticksUntilNextTimer()) == pdTRUE) {
+        pendingWakes.fetch_and((uint8_t)~(1u << event.type));   // A wake-up from now on queues again
+        handleControlEvent(event);
     }
     
-    delay(100);  // Small delay to prevent watchdog issues
+    // Timers: WiFi connect timeout / retry, heartbeats, MQTT keep-alive,
+    // then results, hung requests and due endpoints
+    checkWiFiDeadline();
+    heartbeatRelay.service();
+    mqttProbe.service();
+    watcher.service();
 }
 
 // ============================================================================
-// WIFI FUNCTIONS
+// CONTROL EVENT FUNCTIONS
 // ============================================================================
 
-void connectToWiFi() {
-    Serial.print("Connecting to WiFi: ");
-    Serial.println(WIFI_SSID);
-    
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    
-    int attempts = 0;
-    const int MAX_ATTEMPTS = 30;  // 15 seconds total
-    
-    while (WiFi.status() != WL_CONNECTED && attempts < MAX_ATTEMPTS) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+void postControlEvent(uint8_t type) {
+    ControlEvent event = { type };
+    xQueueSend(controlQueue, &event, portMAX_DELAY);
+}
+
+// Wake-ups only need to be queued once; never blocks
+void postWakeEvent(uint8_t type) {
+    uint8_t bit = 1u << type;
+    if ((pendingWakes.fetch_or(bit) & bit) != 0) {
+        return;   // Already waiting in the queue
     }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("\n✓ WiFi connected successfully!");
-        Serial.print("Hostname: ");
-        Serial.println(WiFi.getHostname());
-        Serial.print("IP Address: ");
-        Serial.println(WiFi.localIP());
-        Serial.print("MAC Address: ");
-        Serial.println(WiFi.macAddress());
-        Serial.print("Signal Strength (RSSI): ");
-        Serial.print(WiFi.RSSI());
-        Serial.println(" dBm");
-        
-        // Turn off error LED and blink blue LED to indicate successful connection
-        digitalWrite(RED_LED_PIN, LOW);   // Turn off red LED
-        blinkBlueLED(3, 200);             // Blink blue LED 3 times
-    } else {
-        Serial.println("\n✗ WiFi connection failed!");
-        Serial.println("Will retry in next cycle...");
-        
-        // Turn on red LED to indicate WiFi error
-        digitalWrite(RED_LED_PIN, HIGH);
+    ControlEvent event = { type };
+    if (xQueueSend(controlQueue, &event, 0) != pdTRUE) {
+        pendingWakes.fetch_and((uint8_t)~bit);
     }
 }
 
-void checkWiFiConnection() {
-    static unsigned long lastCheckTime = 0;
-    static bool wasConnected = false;
-    unsigned long currentTime = millis();
+// Watcher wake hook, called on request tasks
+void wakeLoop(void* context) {
+    postWakeEvent(EVENT_RESULT_READY);
+}
+
+// Heartbeat relay wake hook, called on the listener task
+void wakeHeartbeats(void* context) {
+    postWakeEvent(EVENT_HEARTBEAT_READY);
+}
+
+void handleControlEvent(const ControlEvent& event) {
+    switch (event.type) {
+        case EVENT_WIFI_CONNECTED:
+            handleWiFiConnected();
+            break;
+        case EVENT_WIFI_DISCONNECTED:
+            handleWiFiDisconnected();
+            break;
+        case EVENT_RESULT_READY:
+            break;   // watcher.service() in loop() takes the result in
+        case EVENT_CONSOLE_INPUT:
+            checkConsoleInput();
+            break;
+        case EVENT_HEARTBEAT_READY:
+            break;   // heartbeatRelay.service() in loop() reads the beats
+    }
+}
+
+// Time until the earliest pending deadline; portMAX_DELAY when nothing is
+// scheduled
+TickType_t ticksUntilNextTimer() {
+    uint32_t waitMs = UINT32_MAX;
     
-    // Check WiFi status every second
-    if (currentTime - lastCheckTime >= 1000) {
-        lastCheckTime = currentTime;
-        
-        if (WiFi.status() != WL_CONNECTED) {
-            if (wasConnected) {
-                Serial.println("\n⚠ WiFi connection lost! Attempting to reconnect...");
-                wasConnected = false;
-                
-                // Turn on red LED to indicate WiFi error
-                digitalWrite(RED_LED_PIN, HIGH);
-            }
-            
-            connectToWiFi();
-        } else {
-            if (!wasConnected) {
-                wasConnected = true;
-                Serial.println("WiFi reconnected successfully!");
-                
-                // Turn off red LED on successful reconnection
-                digitalWrite(RED_LED_PIN, LOW);
-            }
-        }
+    if (wifiState != WIFI_LINK_UP) {
+        waitMs = timeUntil(millis(), wifiDeadlineMs);
     }
+    waitMs = min(waitMs, watcher.msUntilNextTimer());
+    waitMs = min(waitMs, heartbeatRelay.msUntilNextTimer());
+    waitMs = min(waitMs, mqttProbe.msUntilNextTimer());
+    
+    return waitMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(waitMs);
+}
+
+// Runs in the WiFi driver's event task: forward to the loop task only
+void onWiFiEvent(arduino_event_id_t event) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        postControlEvent(EVENT_WIFI_CONNECTED);
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+        postControlEvent(EVENT_WIFI_DISCONNECTED);
+    }
+}
+
+// Runs in the UART driver's event task
+void onConsoleReceive() {
+    postWakeEvent(EVENT_CONSOLE_INPUT);
 }
 
 // ============================================================================
-// API POLLING FUNCTIONS
+// WIFI FUNCTIONS
 // ============================================================================
 
-void pollEndpoints() {
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("⚠ Cannot poll endpoints - WiFi not connected");
-        
-        // Turn on red LED to indicate error
-        if (xSemaphoreTake(ledMutex, portMAX_DELAY)) {
-            digitalWrite(RED_LED_PIN, HIGH);
-            xSemaphoreGive(ledMutex);
-        }
+void startWiFiConnection() {
+    LOG_INFO("Connecting to WiFi: %s\n", WIFI_SSID);
+    
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    wifiState = WIFI_LINK_CONNECTING;
+    wifiDeadlineMs = millis() + WIFI_CONNECT_TIMEOUT_MS;
+}
+
+void handleWiFiConnected() {
+    if (wifiState == WIFI_LINK_UP) {
         return;
     }
+    wifiState = WIFI_LINK_UP;
+    watcher.setLinkUp(true);
+    heartbeatRelay.setLinkUp(true);
+    mqttProbe.setLinkUp(true);
     
-    Serial.println("\n========================================");
-    Serial.println("Starting PARALLEL API poll cycle");
-    Serial.println("========================================");
+    if (wifiEverConnected) {
+        LOG_INFO("WiFi reconnected successfully!\n");
+    }
+    wifiEverConnected = true;
     
-    // Reset counters
-    activeRequests = NUM_ENDPOINTS;
-    failedRequests = 0;
+    LOG_INFO("\n✓ WiFi connected successfully!\n");
+    LOG_INFO("Hostname: %s\n", WiFi.getHostname());
     
-    // Create tasks for parallel HTTP requests
-    for (int i = 0; i < NUM_ENDPOINTS; i++) {
-        RequestTaskParams* params = new RequestTaskParams();
-        params->url = API_ENDPOINTS[i];
-        params->index = i + 1;
-        
-        // Create a FreeRTOS task for each endpoint
-        char taskName[32];
-        snprintf(taskName, sizeof(taskName), "HTTPTask_%d", i + 1);
-        
-        xTaskCreate(
-            sendGetRequestTask,   // Task function
-            taskName,             // Task name
-            8192,                 // Stack size (bytes)
-            (void*)params,        // Task parameters
-            1,                    // Priority
-            NULL                  // Task handle (not needed)
-        );
-        
-        Serial.print("[");
-        Serial.print(i + 1);
-        Serial.print("/");
-        Serial.print(NUM_ENDPOINTS);
-        Serial.print("] Launched task for: ");
-        Serial.println(API_ENDPOINTS[i]);
-    }
+    IPAddress ip = WiFi.localIP();
+    LOG_INFO("IP Address: %u.%u.%u.%u\n", ip[0], ip[1], ip[2], ip[3]);
     
-    // Wait for all tasks to complete
-    while (activeRequests > 0) {
-        delay(50);
-    }
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    LOG_INFO("MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    LOG_INFO("Signal Strength (RSSI): %d dBm\n", WiFi.RSSI());
     
-    Serial.println("\n========================================");
-    Serial.print("Poll cycle complete - ");
-    if (failedRequests > 0) {
-        Serial.print(failedRequests);
-        Serial.println(" request(s) failed");
-    } else {
-        Serial.println("All requests successful");
-    }
-    Serial.println("========================================\n");
+    // A new association starts at full power
+    txPower.reset();
+    applyTxPower();
+    
+    // Red LED off unless an endpoint is still DOWN; blink blue LED on connect
+    digitalWrite(RED_LED_PIN, watcher.scheduler().downCount() > 0 ? HIGH : LOW);
+    blinkBlueLED(3, 200);             // Blink blue LED 3 times
 }
 
-// Task wrapper for FreeRTOS
-void sendGetRequestTask(void* parameter) {
-    RequestTaskParams* params = (RequestTaskParams*)parameter;
-    sendGetRequest(params->url, params->index);
-    delete params;
+void handleWiFiDisconnected() {
+    // While connecting, the driver keeps retrying until the attempt times out
+    if (wifiState != WIFI_LINK_UP) {
+        return;
+    }
+    
+    LOG_ERROR("\n⚠ WiFi connection lost! Attempting to reconnect...\n");
     
-    // Decrement active request counter
-    activeRequests--;
+    // Turn on red LED to indicate WiFi error
+    digitalWrite(RED_LED_PIN, HIGH);
     
-    // Delete this task
-    vTaskDelete(NULL);
+    watcher.setLinkUp(false);
+    heartbeatRelay.setLinkUp(false);
+    mqttProbe.setLinkUp(false);
+    startWiFiConnection();
 }
 
-void sendGetRequest(const char* url, int index) {
-    // Create a dedicated WiFiClientSecure for this task
-    WiFiClientSecure* wifiClient = new WiFiClientSecure();
-    wifiClient->setInsecure();
-    
-    HTTPClient http;
-    
-    // Configure HTTP client
-    http.setTimeout(HTTP_TIMEOUT_MS);
-    http.setConnectTimeout(HTTP_TIMEOUT_MS);
+void checkWiFiDeadline() {
+    if (wifiState == WIFI_LINK_UP || !timeReached(millis(), wifiDeadlineMs)) {
+        return;
+    }
     
-    // Begin HTTP request
-    if (!http.begin(*wifiClient, url)) {
-        Serial.print("[");
-        Serial.print(index);
-        Serial.println("] ✗ Failed to initialize HTTP client");
+    if (wifiState == WIFI_LINK_CONNECTING) {
+        LOG_ERROR("\n✗ WiFi connection failed!\n");
+        LOG_INFO("Will retry in %d ms...\n", WIFI_RECONNECT_DELAY_MS);
         
-        // Turn on red LED to indicate error
-        if (xSemaphoreTake(ledMutex, portMAX_DELAY)) {
-            digitalWrite(RED_LED_PIN, HIGH);
-            xSemaphoreGive(ledMutex);
-        }
-        failedRequests++;
+        // Turn on red LED to indicate WiFi error
+        digitalWrite(RED_LED_PIN, HIGH);
         
-        http.end();
-        delete wifiClient;
+        wifiState = WIFI_LINK_DOWN;
+        wifiDeadlineMs = millis() + WIFI_RECONNECT_DELAY_MS;
+    } else {
+        startWiFiConnection();
+    }
+}
+
+void applyTxPower() {
+    if (txPower.enabled()) {
+        WiFi.setTxPower((wifi_power_t)txPower.level());
+    }
+}
+
+// After each poll cycle: the cycle's requests and the link checks since the
+// last one tell whether the AP still hears the station
+void adjustTxPower(const CycleSummary& summary) {
+    if (!txPower.enabled() || wifiState != WIFI_LINK_UP) {
         return;
     }
+    const LinkCheck& linkCheck = watcher.linkCheck();
+    uint32_t attempts = summary.attempts + (linkCheck.checks() - txPowerLinkChecks);
+    uint32_t unanswered = summary.unanswered + (linkCheck.failures() - txPowerLinkCheckFailures);
+    txPowerLinkChecks = linkCheck.checks();
+    txPowerLinkCheckFailures = linkCheck.failures();
     
-    // Set custom User-Agent (must use setUserAgent, not addHeader)
-    String userAgent = String(DEVICE_HOSTNAME) + "/1.0";
-    http.setUserAgent(userAgent.c_str());
-    http.addHeader("Accept", "application/json");
-    
-    // Send GET request
-    Serial.print("[");
-    Serial.print(index);
-    Serial.print("] Sending GET request... ");
-    int httpCode = http.GET();
-    
-    // Handle response
-    if (httpCode > 0) {
-        Serial.print("[");
-        Serial.print(index);
-        Serial.print("] Response code: ");
-        Serial.println(httpCode);
-        
-        if (httpCode == HTTP_CODE_OK) {
-            String payload = http.getString();
-            Serial.print("[");
-            Serial.print(index);
-            Serial.print("] ✓ Success! Response length: ");
-            Serial.print(payload.length());
-            Serial.println(" bytes");
-            
-            // Turn off red LED on successful request (if all requests succeed)
-            if (xSemaphoreTake(ledMutex, portMAX_DELAY)) {
-                if (failedRequests == 0) {
-                    digitalWrite(RED_LED_PIN, LOW);
-                }
-                xSemaphoreGive(ledMutex);
-            }
-        } else {
-            Serial.print("[");
-            Serial.print(index);
-            Serial.print("] ⚠ HTTP error code: ");
-            Serial.println(httpCode);
-            
-            // Turn on red LED for HTTP errors
-            if (xSemaphoreTake(ledMutex, portMAX_DELAY)) {
-                digitalWrite(RED_LED_PIN, HIGH);
-                xSemaphoreGive(ledMutex);
-            }
-            failedRequests++;
-        }
-    } else {
-        Serial.print("[");
-        Serial.print(index);
-        Serial.print("] ✗ Request failed: ");
-        Serial.println(http.errorToString(httpCode).c_str());
-        
-        // Turn on red LED for request failures
-        if (xSemaphoreTake(ledMutex, portMAX_DELAY)) {
-            digitalWrite(RED_LED_PIN, HIGH);
-            xSemaphoreGive(ledMutex);
-        }
-        failedRequests++;
-        
-        // Common error codes
-        if (httpCode == HTTPC_ERROR_CONNECTION_REFUSED) {
-            Serial.print("[");
-            Serial.print(index);
-            Serial.println("]   → Connection refused by server");
-        } else if (httpCode == HTTPC_ERROR_CONNECTION_LOST) {
-            Serial.print("[");
-            Serial.print(index);
-            Serial.println("]   → Connection lost during request");
-        } else if (httpCode == HTTPC_ERROR_READ_TIMEOUT) {
-            Serial.print("[");
-            Serial.print(index);
-            Serial.println("]   → Read timeout exceeded");
+    int8_t rssi = WiFi.RSSI();
+    TxPowerChange change = txPower.update(rssi, attempts, unanswered);
+    if (change != TX_POWER_UNCHANGED) {
+        applyTxPower();
+    }
+    int level = WiFi.getTxPower();
+    LOG_INFO("Radio: TX power %d.%02d dBm%s, RSSI %d dBm, AP hears ~%d dBm, %lu of %lu attempt(s) unanswered\n",
+             level / 4, level % 4 * 25,
+             change == TX_POWER_LOWERED ? " (lowered)" : change == TX_POWER_RAISED ? " (raised)" : "",
+             rssi, txPower.uplinkRssiDbm(rssi), (unsigned long)unanswered, (unsigned long)attempts);
+}
+
+// ============================================================================
+// CONSOLE FUNCTIONS
+// ============================================================================
+
+// Single-character serial commands (reports are not affected by WATCHER_LOG_LEVEL):
+//   t - dump the request timing trace (see scripts/trace_extract.py) and clear it
+//   b - print traffic (bytes) per endpoint and phase, daily totals and the data budget
+//   e - print estimated energy per endpoint since boot
+//   c - print body digests and change counts of endpoints watched for content
+//   h - print the LAN gadgets the heartbeat relay knows
+//   m - print the MQTT publisher's connection and session
+//   k - print the CoAP probe's DTLS association and retransmissions
+//   o - print the failover destinations' success, latency and score
+//   w - print the WiFi signal and the TX power control
+//   f - dump the sampling profiler's histogram (see scripts/profile_fold.py) and clear it
+void checkConsoleInput() {
+    while (Serial.available() > 0) {
+        int command = Serial.read();
+        if (command == 't') {
+            watcher.printTrace(Serial);
+        } else if (command == 'b') {
+            watcher.printTraffic(Serial);
+        } else if (command == 'e') {
+            watcher.printEnergy(Serial);
+        } else if (command == 'c') {
+            watcher.printContent(Serial);
+        } else if (command == 'h') {
+            heartbeatRelay.printSources(Serial);
+        } else if (command == 'm') {
+            mqttProbe.printStatus(Serial);
+        } else if (command == 'k') {
+            coapProbe.printStatus(Serial);
+        } else if (command == 'o') {
+            watcher.printFailover(Serial);
+        } else if (command == 'w') {
+            printRadio(Serial);
+        } else if (command == 'f') {
+            profilerPrint(Serial);
         }
     }
-    
-    // Clean up
-    http.end();
-    delete wifiClient;
+}
+
+void printRadio(Print& out) {
+    int level = WiFi.getTxPower();
+    int lowest = txPower.lowestLevel();
+    out.printf("=== RADIO ===\n");
+    out.printf("RSSI: %d dBm, TX power: %d.%02d dBm (%s)\n", WiFi.RSSI(), level / 4, level % 4 * 25,
+               txPower.enabled() ? "adaptive" : "fixed");
+    out.printf("Cycles: %lu, lowered %lu time(s), raised %lu time(s), %lu cycle(s) with unanswered attempts\n",
+               (unsigned long)txPower.cycles(), (unsigned long)txPower.lowered(), (unsigned long)txPower.raised(),
+               (unsigned long)txPower.troubledCycles());
+    out.printf("Lowest level since boot: %d.%02d dBm\n", lowest / 4, lowest % 4 * 25);
+    out.printf("=== RADIO END ===\n");
 }
 
 // ============================================================================
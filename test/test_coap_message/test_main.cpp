@@ -0,0 +1,255 @@
+// CoAP encoding, decoding and retransmission timing
+// (lib/WatcherCore/src/CoapMessage.cpp)
+
+#include <CoapMessage.h>
+#include <string.h>
+#include <unity.h>
+
+static const CoapHeader REQUEST = {COAP_CON, COAP_GET, 0x1234, 2, {0xA1, 0xB2}};
+
+static uint8_t datagram[512];
+
+void setUp(void) {
+    memset(datagram, 0, sizeof(datagram));
+}
+
+void tearDown(void) {
+}
+
+// Header of REQUEST followed by extra, parsed from datagram (the reader
+// points into it)
+static bool parseWith(CoapReader* reader, const uint8_t* extra, size_t size) {
+    static const uint8_t HEADER[] = {0x42, COAP_GET, 0x12, 0x34, 0xA1, 0xB2};
+    memcpy(datagram, HEADER, sizeof(HEADER));
+    memcpy(datagram + sizeof(HEADER), extra, size);
+    return reader->parse(datagram, sizeof(HEADER) + size);
+}
+
+// ============================================================================
+// ENCODING
+// ============================================================================
+
+static void test_encode_request(void) {
+    size_t size = coapEncodeRequest(REQUEST, "watcher/ping", "id=7", NULL, 0, datagram, sizeof(datagram));
+    static const uint8_t EXPECTED[] = {
+        0x42, 0x01, 0x12, 0x34, 0xA1, 0xB2,
+        0xB7, 'w', 'a', 't', 'c', 'h', 'e', 'r',   // Uri-Path (11)
+        0x04, 'p', 'i', 'n', 'g',                  // Uri-Path, delta 0
+        0x44, 'i', 'd', '=', '7',                  // Uri-Query (15)
+    };
+    TEST_ASSERT_EQUAL_size_t(sizeof(EXPECTED), size);
+    TEST_ASSERT_EQUAL_MEMORY(EXPECTED, datagram, sizeof(EXPECTED));
+
+    // Empty segments are skipped; a payload follows the marker
+    const uint8_t payload[] = {'h', 'i'};
+    size = coapEncodeRequest(REQUEST, "/ping/", NULL, payload, 2, datagram, sizeof(datagram));
+    static const uint8_t WITH_PAYLOAD[] = {
+        0x42, 0x01, 0x12, 0x34, 0xA1, 0xB2, 0xB4, 'p', 'i', 'n', 'g', 0xFF, 'h', 'i',
+    };
+    TEST_ASSERT_EQUAL_size_t(sizeof(WITH_PAYLOAD), size);
+    TEST_ASSERT_EQUAL_MEMORY(WITH_PAYLOAD, datagram, sizeof(WITH_PAYLOAD));
+}
+
+static void test_encode_extended_nibbles(void) {
+    // Delta 15 and length 13 take one extra byte each, length 269 two
+    char segment[270];
+    memset(segment, 's', sizeof(segment));
+    segment[13] = '\0';
+    size_t size = coapEncodeRequest(REQUEST, NULL, segment, NULL, 0, datagram, sizeof(datagram));
+    TEST_ASSERT_EQUAL_size_t(6 + 3 + 13, size);
+    TEST_ASSERT_EQUAL_UINT8(0xDD, datagram[6]);
+    TEST_ASSERT_EQUAL_UINT8(15 - 13, datagram[7]);
+    TEST_ASSERT_EQUAL_UINT8(13 - 13, datagram[8]);
+
+    segment[13] = 's';
+    segment[269] = '\0';
+    size = coapEncodeRequest(REQUEST, segment, NULL, NULL, 0, datagram, sizeof(datagram));
+    TEST_ASSERT_EQUAL_size_t(6 + 3 + 269, size);
+    static const uint8_t OPTION[] = {0xBE, 0x00, 0x00};
+    TEST_ASSERT_EQUAL_MEMORY(OPTION, datagram + 6, sizeof(OPTION));
+}
+
+static void test_encode_does_not_fit(void) {
+    TEST_ASSERT_EQUAL_size_t(0, coapEncodeRequest(REQUEST, "watcher/ping", NULL, NULL, 0, datagram, 15));
+    TEST_ASSERT_EQUAL_size_t(0, coapEncodeEmpty(COAP_ACK, 1, datagram, 3));
+
+    TEST_ASSERT_EQUAL_size_t(4, coapEncodeEmpty(COAP_RST, 0xBEEF, datagram, 4));
+    static const uint8_t RST[] = {0x70, 0x00, 0xBE, 0xEF};
+    TEST_ASSERT_EQUAL_MEMORY(RST, datagram, sizeof(RST));
+}
+
+// ============================================================================
+// DECODING
+// ============================================================================
+
+static void test_round_trip(void) {
+    const uint8_t payload[] = {1, 2, 3};
+    size_t size = coapEncodeRequest(REQUEST, "a/bb", "x=1&y=2", payload, 3, datagram, sizeof(datagram));
+    CoapReader reader;
+    TEST_ASSERT_TRUE(reader.parse(datagram, size));
+    TEST_ASSERT_EQUAL_UINT8(COAP_CON, reader.header().type);
+    TEST_ASSERT_EQUAL_UINT8(COAP_GET, reader.header().code);
+    TEST_ASSERT_EQUAL_UINT16(0x1234, reader.header().messageId);
+    TEST_ASSERT_TRUE(coapSameToken(REQUEST, reader.header()));
+
+    static const struct {
+        uint16_t number;
+        const char* value;
+    } OPTIONS[] = {
+        {COAP_OPTION_URI_PATH, "a"},
+        {COAP_OPTION_URI_PATH, "bb"},
+        {COAP_OPTION_URI_QUERY, "x=1"},
+        {COAP_OPTION_URI_QUERY, "y=2"},
+    };
+    uint16_t number;
+    const uint8_t* value;
+    size_t length;
+    for (const auto& expected : OPTIONS) {
+        TEST_ASSERT_TRUE(reader.nextOption(&number, &value, &length));
+        TEST_ASSERT_EQUAL_UINT16(expected.number, number);
+        TEST_ASSERT_EQUAL_size_t(strlen(expected.value), length);
+        TEST_ASSERT_EQUAL_MEMORY(expected.value, value, length);
+    }
+    TEST_ASSERT_FALSE(reader.nextOption(&number, &value, &length));
+    TEST_ASSERT_EQUAL_size_t(3, reader.payloadBytes());
+    TEST_ASSERT_EQUAL_MEMORY(payload, reader.payload(), 3);
+}
+
+static void test_response_and_uint_option(void) {
+    CoapHeader header = REQUEST;
+    header.type = COAP_ACK;
+    header.code = COAP_CHANGED;
+    size_t size = coapEncodeResponse(header, NULL, 0, datagram, sizeof(datagram));
+    CoapReader reader;
+    TEST_ASSERT_TRUE(reader.parse(datagram, size));
+    TEST_ASSERT_EQUAL_INT(204, coapStatus(reader.header().code));
+    TEST_ASSERT_NULL(reader.payload());
+    TEST_ASSERT_EQUAL_INT(429, coapStatus(COAP_TOO_MANY_REQUESTS));
+
+    // Uri-Path "p", then Max-Age 300; the lookup keeps the iteration going
+    static const uint8_t OPTIONS[] = {0xB1, 'p', 0x32, 0x01, 0x2C};
+    TEST_ASSERT_TRUE(parseWith(&reader, OPTIONS, sizeof(OPTIONS)));
+    uint16_t number;
+    const uint8_t* value;
+    size_t length;
+    TEST_ASSERT_TRUE(reader.nextOption(&number, &value, &length));
+    TEST_ASSERT_EQUAL_UINT32(300, reader.uintOption(COAP_OPTION_MAX_AGE));
+    TEST_ASSERT_EQUAL_UINT32(0, reader.uintOption(COAP_OPTION_URI_QUERY));
+    TEST_ASSERT_TRUE(reader.nextOption(&number, &value, &length));
+    TEST_ASSERT_EQUAL_UINT16(COAP_OPTION_MAX_AGE, number);
+}
+
+static void test_bad_header(void) {
+    CoapReader reader;
+    static const uint8_t SHORT[] = {0x40, 0x01, 0x00};
+    TEST_ASSERT_FALSE(reader.parse(SHORT, sizeof(SHORT)));
+    static const uint8_t VERSION_2[] = {0x80, 0x01, 0x00, 0x01};
+    TEST_ASSERT_FALSE(reader.parse(VERSION_2, sizeof(VERSION_2)));
+    static const uint8_t LONG_TOKEN[] = {0x49, 0x01, 0x00, 0x01, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    TEST_ASSERT_FALSE(reader.parse(LONG_TOKEN, sizeof(LONG_TOKEN)));
+    static const uint8_t CUT_TOKEN[] = {0x44, 0x01, 0x00, 0x01, 1, 2};
+    TEST_ASSERT_FALSE(reader.parse(CUT_TOKEN, sizeof(CUT_TOKEN)));
+}
+
+static void test_truncated_option(void) {
+    CoapReader reader;
+    // Value of 5 bytes, 2 present
+    static const uint8_t CUT_VALUE[] = {0xB5, 'a', 'b'};
+    TEST_ASSERT_FALSE(parseWith(&reader, CUT_VALUE, sizeof(CUT_VALUE)));
+    // Extended delta byte missing
+    static const uint8_t CUT_DELTA[] = {0xD0};
+    TEST_ASSERT_FALSE(parseWith(&reader, CUT_DELTA, sizeof(CUT_DELTA)));
+    // Extended length word cut after one byte
+    static const uint8_t CUT_LENGTH[] = {0xBE, 0x00};
+    TEST_ASSERT_FALSE(parseWith(&reader, CUT_LENGTH, sizeof(CUT_LENGTH)));
+    // A marker with no payload after it
+    static const uint8_t BARE_MARKER[] = {0xB1, 'p', 0xFF};
+    TEST_ASSERT_FALSE(parseWith(&reader, BARE_MARKER, sizeof(BARE_MARKER)));
+
+    // The value exactly to the end is fine
+    static const uint8_t FULL_VALUE[] = {0xB2, 'a', 'b'};
+    TEST_ASSERT_TRUE(parseWith(&reader, FULL_VALUE, sizeof(FULL_VALUE)));
+}
+
+static void test_option_number_overflow(void) {
+    CoapReader reader;
+    // Nibble 15 is reserved outside the payload marker
+    static const uint8_t RESERVED[] = {0xF0};
+    TEST_ASSERT_FALSE(parseWith(&reader, RESERVED, sizeof(RESERVED)));
+    // 269 + 0xFFFF does not fit 16 bits
+    static const uint8_t WORD_DELTA[] = {0xE0, 0xFF, 0xFF};
+    TEST_ASSERT_FALSE(parseWith(&reader, WORD_DELTA, sizeof(WORD_DELTA)));
+    static const uint8_t WORD_LENGTH[] = {0x1E, 0xFF, 0xFF};
+    TEST_ASSERT_FALSE(parseWith(&reader, WORD_LENGTH, sizeof(WORD_LENGTH)));
+
+    // Option 65535 is the last; one more delta runs past it
+    static const uint8_t LAST[] = {0xE0, 0xFE, 0xF2};
+    TEST_ASSERT_TRUE(parseWith(&reader, LAST, sizeof(LAST)));
+    uint16_t number;
+    const uint8_t* value;
+    size_t length;
+    TEST_ASSERT_TRUE(reader.nextOption(&number, &value, &length));
+    TEST_ASSERT_EQUAL_UINT16(0xFFFF, number);
+    static const uint8_t PAST_LAST[] = {0xE0, 0xFE, 0xF2, 0x10};
+    TEST_ASSERT_FALSE(parseWith(&reader, PAST_LAST, sizeof(PAST_LAST)));
+}
+
+// ============================================================================
+// RETRANSMISSION
+// ============================================================================
+
+static const CoapTiming RFC_TIMING = {2000, 1500, 4};
+
+static void test_max_transmit_wait(void) {
+    // RFC 7252, 4.8.2: 93 s
+    TEST_ASSERT_EQUAL_UINT32(93000, coapMaxTransmitWaitMs(RFC_TIMING));
+}
+
+static void test_retransmit_backoff(void) {
+    CoapRetransmitter retransmitter;
+    retransmitter.start(RFC_TIMING, 1000, 0);
+    TEST_ASSERT_EQUAL_UINT32(2000, retransmitter.msUntilDue(1000));
+    TEST_ASSERT_FALSE(retransmitter.due(2999));
+
+    uint32_t nowMs = 3000;
+    uint32_t timeoutMs = 2000;
+    for (uint8_t i = 0; i < RFC_TIMING.maxRetransmit; i++) {
+        TEST_ASSERT_TRUE(retransmitter.due(nowMs));
+        TEST_ASSERT_TRUE(retransmitter.retransmit(nowMs));
+        timeoutMs *= 2;
+        TEST_ASSERT_EQUAL_UINT32(timeoutMs, retransmitter.msUntilDue(nowMs));
+        nowMs += timeoutMs;
+    }
+    TEST_ASSERT_EQUAL_UINT8(5, retransmitter.transmissions());
+    TEST_ASSERT_FALSE(retransmitter.retransmit(nowMs));
+}
+
+static void test_retransmit_random_timeout(void) {
+    // Between ackTimeoutMs and one and a half times it
+    CoapRetransmitter retransmitter;
+    retransmitter.start(RFC_TIMING, 0, 0xFFFF);
+    TEST_ASSERT_EQUAL_UINT32(2999, retransmitter.msUntilDue(0));
+    retransmitter.start(RFC_TIMING, 0, 0x8000);
+    TEST_ASSERT_EQUAL_UINT32(2500, retransmitter.msUntilDue(0));
+
+    // Across the millis() wrap
+    retransmitter.start(RFC_TIMING, UINT32_MAX - 500, 0);
+    TEST_ASSERT_FALSE(retransmitter.due(1000));
+    TEST_ASSERT_TRUE(retransmitter.due(1499));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_encode_request);
+    RUN_TEST(test_encode_extended_nibbles);
+    RUN_TEST(test_encode_does_not_fit);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_response_and_uint_option);
+    RUN_TEST(test_bad_header);
+    RUN_TEST(test_truncated_option);
+    RUN_TEST(test_option_number_overflow);
+    RUN_TEST(test_max_transmit_wait);
+    RUN_TEST(test_retransmit_backoff);
+    RUN_TEST(test_retransmit_random_timeout);
+    return UNITY_END();
+}
@@ -0,0 +1,168 @@
+// Masked body hashing (ContentHasher, lib/WatcherCore/src/ContentHash.cpp)
+
+#include <ContentHash.h>
+#include <string.h>
+#include <unity.h>
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static uint64_t fnv1a(const char* text) {
+    uint64_t hash = FNV1A64_OFFSET;
+    for (const char* c = text; *c != '\0'; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= FNV1A64_PRIME;
+    }
+    return hash;
+}
+
+// Digest of body fed in reads of chunk bytes; hashed gets the bytes that
+// went into it
+static uint64_t hashBody(const ContentWatch* watch, const char* body, size_t chunk, uint32_t* hashed = NULL) {
+    ContentHasher hasher(watch);
+    size_t size = strlen(body);
+    for (size_t i = 0; i < size; i += chunk) {
+        hasher.update((const uint8_t*)body + i, size - i < chunk ? size - i : chunk);
+    }
+    hasher.finish();
+    if (hashed != NULL) {
+        *hashed = hasher.hashedBytes();
+    }
+    return hasher.digest();
+}
+
+static void test_unmasked_is_fnv1a(void) {
+    TEST_ASSERT_EQUAL_HEX64(FNV1A64_OFFSET, hashBody(NULL, "", 1));
+    // Published FNV-1a 64 test vector
+    TEST_ASSERT_EQUAL_HEX64(0xaf63dc4c8601ec8cull, hashBody(NULL, "a", 1));
+    ContentWatch none = {NULL, 0};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("status: ok"), hashBody(&none, "status: ok", 3));
+}
+
+static void test_range_boundaries(void) {
+    // Bytes [4, 7) are left out: the first and last of them, not their neighbours
+    ContentMask mask = {CONTENT_MASK_RANGE, 4, 3, NULL, NULL};
+    ContentWatch watch = {&mask, 1};
+    uint32_t hashed = 0;
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("abcdhij"), hashBody(&watch, "abcdefghij", 1, &hashed));
+    TEST_ASSERT_EQUAL_UINT32(7, hashed);
+
+    ContentHasher hasher(&watch);
+    hasher.update((const uint8_t*)"abcdefghij", 10);
+    TEST_ASSERT_EQUAL_UINT32(10, hasher.bodyBytes());
+    TEST_ASSERT_FALSE(hasher.finished());
+    TEST_ASSERT_EQUAL_HEX64(hashBody(&watch, "abcdXYZhij", 4), hashBody(&watch, "abcdefghij", 1));
+    TEST_ASSERT_NOT_EQUAL_UINT64(hashBody(&watch, "abcXefghij", 1), hashBody(&watch, "abcdefghij", 1));
+    TEST_ASSERT_NOT_EQUAL_UINT64(hashBody(&watch, "abcdefgXij", 1), hashBody(&watch, "abcdefghij", 1));
+}
+
+static void test_range_at_body_edges(void) {
+    ContentMask head = {CONTENT_MASK_RANGE, 0, 2, NULL, NULL};
+    ContentWatch headWatch = {&head, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("cdef"), hashBody(&headWatch, "abcdef", 5));
+
+    // Past the end of the body, and empty
+    ContentMask tail = {CONTENT_MASK_RANGE, 4, 100, NULL, NULL};
+    ContentWatch tailWatch = {&tail, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("abcd"), hashBody(&tailWatch, "abcdef", 2));
+    ContentMask empty = {CONTENT_MASK_RANGE, 2, 0, NULL, NULL};
+    ContentWatch emptyWatch = {&empty, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("abcdef"), hashBody(&emptyWatch, "abcdef", 1));
+
+    // The top of the offset range does not wrap onto the start
+    ContentMask far = {CONTENT_MASK_RANGE, UINT32_MAX - 1, 4, NULL, NULL};
+    ContentWatch farWatch = {&far, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("abcdef"), hashBody(&farWatch, "abcdef", 1));
+}
+
+static void test_between_markers(void) {
+    // The begin marker stays in the hash; the region and the end marker do not
+    ContentMask mask = {CONTENT_MASK_BETWEEN, 0, 0, "<t>", "</t>"};
+    ContentWatch watch = {&mask, 1};
+    const char* body = "up <t>12:00:01</t> ok";
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("up <t> ok"), hashBody(&watch, body, 64));
+    for (size_t chunk = 1; chunk <= 8; chunk++) {
+        TEST_ASSERT_EQUAL_HEX64(fnv1a("up <t> ok"), hashBody(&watch, body, chunk));
+    }
+    TEST_ASSERT_EQUAL_HEX64(hashBody(&watch, "up <t>09:59</t> ok", 1), hashBody(&watch, body, 1));
+}
+
+static void test_between_overlapping_marker_prefix(void) {
+    // "<<t>" must still open the region after the false start "<"
+    ContentMask mask = {CONTENT_MASK_BETWEEN, 0, 0, "<t>", "</t>"};
+    ContentWatch watch = {&mask, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("a<<t>b"), hashBody(&watch, "a<<t>x<</t>b", 1));
+    // A repeated prefix: "aab" in "aaab"
+    ContentMask repeat = {CONTENT_MASK_BETWEEN, 0, 0, "aab", "!"};
+    ContentWatch repeatWatch = {&repeat, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("aaabz"), hashBody(&repeatWatch, "aaabxy!z", 1));
+}
+
+static void test_between_open_at_end(void) {
+    // A region still open when the body ends runs to its end
+    ContentMask mask = {CONTENT_MASK_BETWEEN, 0, 0, "[", "]"};
+    ContentWatch watch = {&mask, 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("ab["), hashBody(&watch, "ab[cd", 1));
+    // and a begin marker without a region leaves everything in
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("ab]cd"), hashBody(&watch, "ab]cd", 1));
+}
+
+static void test_unusable_masks_ignored(void) {
+    ContentMask masks[] = {
+        {CONTENT_MASK_BETWEEN, 0, 0, "", "]"},
+        {CONTENT_MASK_BETWEEN, 0, 0, "[", NULL},
+        {7, 0, 10, NULL, NULL},
+    };
+    ContentWatch watch = {masks, 3};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("a[b]c"), hashBody(&watch, "a[b]c", 1));
+}
+
+static void test_mask_limit(void) {
+    // Masks past CONTENT_MAX_MASKS are not applied
+    ContentMask masks[CONTENT_MAX_MASKS + 1];
+    for (uint8_t i = 0; i <= CONTENT_MAX_MASKS; i++) {
+        masks[i] = {CONTENT_MASK_RANGE, i, 1, NULL, NULL};
+    }
+    ContentWatch watch = {masks, CONTENT_MAX_MASKS + 1};
+    TEST_ASSERT_EQUAL_HEX64(fnv1a("efgh"), hashBody(&watch, "abcdefgh", 1));
+}
+
+static void test_tracker_changes(void) {
+    ContentSlot slots[2];
+    ContentTracker tracker(slots, 2);
+    tracker.begin();
+    HttpValidators validators = {"\"v1\"", ""};
+
+    TEST_ASSERT_EQUAL(CONTENT_FIRST, tracker.record(0, 1, 100, 40, validators));
+    TEST_ASSERT_EQUAL(CONTENT_SAME, tracker.record(0, 1, 100, 40, validators));
+    TEST_ASSERT_EQUAL(CONTENT_CHANGED, tracker.record(0, 2, 100, 40, validators));
+    TEST_ASSERT_EQUAL(CONTENT_FIRST, tracker.record(1, 2, 100, 40, validators));
+    TEST_ASSERT_EQUAL_UINT32(1, tracker.changeCount());
+    TEST_ASSERT_EQUAL_STRING("\"v1\"", tracker.validators(0).etag);
+
+    tracker.recordNotModified(0, 10);
+    tracker.recordNotModified(0, 50);
+    TEST_ASSERT_EQUAL_UINT32(2, tracker.notModifiedCount());
+    TEST_ASSERT_EQUAL_UINT64(200, tracker.savedBytes());
+    TEST_ASSERT_EQUAL_UINT32(30, tracker.savedMs());
+
+    tracker.begin();
+    TEST_ASSERT_EQUAL(CONTENT_FIRST, tracker.record(0, 2, 100, 40, validators));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unmasked_is_fnv1a);
+    RUN_TEST(test_range_boundaries);
+    RUN_TEST(test_range_at_body_edges);
+    RUN_TEST(test_between_markers);
+    RUN_TEST(test_between_overlapping_marker_prefix);
+    RUN_TEST(test_between_open_at_end);
+    RUN_TEST(test_unusable_masks_ignored);
+    RUN_TEST(test_mask_limit);
+    RUN_TEST(test_tracker_changes);
+    return UNITY_END();
+}
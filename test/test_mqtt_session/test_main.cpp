@@ -0,0 +1,307 @@
+// MQTT packet framing and session state (lib/WatcherCore/src/MqttSession.cpp)
+
+#include <MqttSession.h>
+#include <string.h>
+#include <unity.h>
+
+static const MqttConfig CONFIG = {
+    "watcher-01", NULL, NULL, 60, "watcher/status", "offline", "online", 2, 5000,
+};
+
+static MqttMessage slots[4];
+static uint8_t packet[MQTT_PACKET_BYTES];
+
+void setUp(void) {
+    memset(packet, 0, sizeof(packet));
+}
+
+void tearDown(void) {
+}
+
+// ============================================================================
+// REMAINING LENGTH
+// ============================================================================
+
+static void test_encode_length_boundaries(void) {
+    static const struct {
+        uint32_t length;
+        size_t size;
+        uint8_t bytes[4];
+    } CASES[] = {
+        {0, 1, {0x00}},
+        {127, 1, {0x7F}},
+        {128, 2, {0x80, 0x01}},
+        {16383, 2, {0xFF, 0x7F}},
+        {16384, 3, {0x80, 0x80, 0x01}},
+        {2097151, 3, {0xFF, 0xFF, 0x7F}},
+        {2097152, 4, {0x80, 0x80, 0x80, 0x01}},
+        {MQTT_MAX_LENGTH, 4, {0xFF, 0xFF, 0xFF, 0x7F}},
+    };
+    for (const auto& expected : CASES) {
+        uint8_t out[4];
+        TEST_ASSERT_EQUAL_size_t(expected.size, mqttEncodeLength(expected.length, out));
+        TEST_ASSERT_EQUAL_MEMORY(expected.bytes, out, expected.size);
+    }
+}
+
+static void test_encode_length_overflow(void) {
+    uint8_t out[4];
+    TEST_ASSERT_EQUAL_size_t(0, mqttEncodeLength(MQTT_MAX_LENGTH + 1, out));
+    TEST_ASSERT_EQUAL_size_t(0, mqttEncodeLength(UINT32_MAX, out));
+}
+
+// ============================================================================
+// PACKET READER
+// ============================================================================
+
+static void test_reader_byte_by_byte(void) {
+    // PUBACK for packet id 0x1234
+    static const uint8_t PUBACK[] = {0x40, 0x02, 0x12, 0x34};
+    uint8_t body[4];
+    MqttReader reader(body, sizeof(body));
+    for (size_t i = 0; i < sizeof(PUBACK); i++) {
+        TEST_ASSERT_FALSE(reader.complete());
+        TEST_ASSERT_EQUAL_size_t(1, reader.feed(PUBACK + i, 1));
+    }
+    TEST_ASSERT_TRUE(reader.complete());
+    TEST_ASSERT_EQUAL_UINT8(MQTT_PUBACK, reader.type());
+    TEST_ASSERT_EQUAL_UINT32(2, reader.length());
+    TEST_ASSERT_EQUAL_MEMORY(PUBACK + 2, reader.body(), 2);
+}
+
+static void test_reader_stops_at_packet_end(void) {
+    // PINGRESP, then a CONNACK
+    static const uint8_t STREAM[] = {0xD0, 0x00, 0x20, 0x02, 0x01, 0x00};
+    uint8_t body[4];
+    MqttReader reader(body, sizeof(body));
+    TEST_ASSERT_EQUAL_size_t(2, reader.feed(STREAM, sizeof(STREAM)));
+    TEST_ASSERT_TRUE(reader.complete());
+    TEST_ASSERT_EQUAL_UINT8(MQTT_PINGRESP, reader.type());
+    TEST_ASSERT_EQUAL_size_t(4, reader.feed(STREAM + 2, sizeof(STREAM) - 2));
+    TEST_ASSERT_TRUE(reader.complete());
+    TEST_ASSERT_EQUAL_UINT8(MQTT_CONNACK, reader.type());
+    TEST_ASSERT_EQUAL_UINT8(0x01, reader.body()[0]);
+}
+
+static void test_reader_long_body_counted(void) {
+    // A 200-byte body with flags: only the first bytes are kept
+    uint8_t stream[3 + 200];
+    stream[0] = MQTT_PUBLISH << 4 | 0x03;
+    TEST_ASSERT_EQUAL_size_t(2, mqttEncodeLength(200, stream + 1));
+    for (size_t i = 0; i < 200; i++) {
+        stream[3 + i] = (uint8_t)i;
+    }
+    uint8_t body[4];
+    MqttReader reader(body, sizeof(body));
+    TEST_ASSERT_EQUAL_size_t(100, reader.feed(stream, 100));
+    TEST_ASSERT_FALSE(reader.complete());
+    TEST_ASSERT_EQUAL_size_t(103, reader.feed(stream + 100, sizeof(stream) - 100));
+    TEST_ASSERT_TRUE(reader.complete());
+    TEST_ASSERT_EQUAL_UINT8(0x03, reader.flags());
+    TEST_ASSERT_EQUAL_UINT32(200, reader.length());
+    TEST_ASSERT_EQUAL_size_t(4, reader.bodyKept());
+    TEST_ASSERT_EQUAL_MEMORY(stream + 3, reader.body(), 4);
+}
+
+static void test_reader_length_overflow(void) {
+    // The fourth length byte still has the continuation bit set
+    static const uint8_t STREAM[] = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x00};
+    uint8_t body[4];
+    MqttReader reader(body, sizeof(body));
+    TEST_ASSERT_EQUAL_size_t(5, reader.feed(STREAM, sizeof(STREAM)));
+    TEST_ASSERT_TRUE(reader.malformed());
+    TEST_ASSERT_FALSE(reader.complete());
+    TEST_ASSERT_EQUAL_size_t(0, reader.feed(STREAM + 5, 2));
+
+    reader.reset();
+    static const uint8_t LONGEST[] = {0x30, 0xFF, 0xFF, 0xFF, 0x7F};
+    TEST_ASSERT_EQUAL_size_t(5, reader.feed(LONGEST, sizeof(LONGEST)));
+    TEST_ASSERT_FALSE(reader.malformed());
+    TEST_ASSERT_EQUAL_UINT32(MQTT_MAX_LENGTH, reader.length());
+}
+
+// ============================================================================
+// SESSION
+// ============================================================================
+
+static const uint8_t CONNACK_NEW[] = {0x20, 0x02, 0x00, 0x00};
+static const uint8_t CONNACK_RESUMED[] = {0x20, 0x02, 0x01, 0x00};
+
+static void connected(MqttSession& session, uint32_t nowMs) {
+    session.connect(packet, sizeof(packet), nowMs);
+    session.receive(CONNACK_NEW, sizeof(CONNACK_NEW));
+    session.nextPacket(packet, sizeof(packet), nowMs);   // Online message
+}
+
+static void puback(MqttSession& session, uint16_t packetId) {
+    uint8_t ack[] = {0x40, 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
+    session.receive(ack, sizeof(ack));
+}
+
+static void test_connect_packet(void) {
+    MqttSession session(slots, 4, CONFIG);
+    size_t size = session.connect(packet, sizeof(packet), 0);
+    // Header, protocol, flags, keep-alive, client id, will topic and message
+    TEST_ASSERT_EQUAL_size_t(2 + 7 + 1 + 2 + 12 + 16 + 9, size);
+    static const uint8_t START[] = {0x10, 47, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x2C, 0, 60, 0, 10};
+    TEST_ASSERT_EQUAL_MEMORY(START, packet, sizeof(START));
+    TEST_ASSERT_EQUAL(MQTT_CONNECTING, session.state());
+
+    // Too small a buffer: nothing written, nothing changed
+    MqttSession other(slots, 4, CONFIG);
+    TEST_ASSERT_EQUAL_size_t(0, other.connect(packet, 20, 0));
+    TEST_ASSERT_EQUAL(MQTT_DISCONNECTED, other.state());
+}
+
+static void test_connack(void) {
+    MqttSession session(slots, 4, CONFIG);
+    TEST_ASSERT_EQUAL_size_t(0, session.nextPacket(packet, sizeof(packet), 0));
+    session.connect(packet, sizeof(packet), 0);
+    session.receive(CONNACK_RESUMED, 2);
+    TEST_ASSERT_EQUAL(MQTT_CONNECTING, session.state());
+    session.receive(CONNACK_RESUMED + 2, 2);
+    TEST_ASSERT_EQUAL(MQTT_CONNECTED, session.state());
+    TEST_ASSERT_TRUE(session.sessionPresent());
+    TEST_ASSERT_EQUAL_UINT32(1, session.resumed());
+
+    // The online message first: retained, QoS 0
+    size_t size = session.nextPacket(packet, sizeof(packet), 0);
+    TEST_ASSERT_EQUAL_size_t(2 + 16 + 6, size);
+    TEST_ASSERT_EQUAL_UINT8(0x31, packet[0]);
+    TEST_ASSERT_EQUAL_MEMORY("online", packet + size - 6, 6);
+    TEST_ASSERT_EQUAL_size_t(0, session.nextPacket(packet, sizeof(packet), 0));
+}
+
+static void test_connack_refused(void) {
+    static const uint8_t REFUSED[] = {0x20, 0x02, 0x00, 0x05};
+    MqttSession session(slots, 4, CONFIG);
+    session.connect(packet, sizeof(packet), 0);
+    session.receive(REFUSED, sizeof(REFUSED));
+    TEST_ASSERT_EQUAL(MQTT_REFUSED, session.state());
+    TEST_ASSERT_EQUAL_UINT8(5, session.refusedCode());
+    TEST_ASSERT_EQUAL_STRING("not authorized", mqttConnackName(session.refusedCode()));
+    TEST_ASSERT_EQUAL_size_t(0, session.nextPacket(packet, sizeof(packet), 0));
+}
+
+static void test_publish_window(void) {
+    MqttSession session(slots, 4, CONFIG);
+    connected(session, 0);
+    const uint8_t payload[] = {'u', 'p'};
+    TEST_ASSERT_EQUAL_UINT16(1, session.publish("watcher/a", payload, 2, false));
+    TEST_ASSERT_EQUAL_UINT16(2, session.publish("watcher/b", payload, 2, true));
+    TEST_ASSERT_TRUE(session.windowFull());
+    TEST_ASSERT_EQUAL_UINT16(0, session.publish("watcher/c", payload, 2, false));
+
+    // Oldest first, QoS 1 with the packet id after the topic
+    size_t size = session.nextPacket(packet, sizeof(packet), 10);
+    static const uint8_t FIRST[] = {0x32, 15, 0, 9, 'w', 'a', 't', 'c', 'h', 'e', 'r', '/', 'a', 0, 1, 'u', 'p'};
+    TEST_ASSERT_EQUAL_size_t(sizeof(FIRST), size);
+    TEST_ASSERT_EQUAL_MEMORY(FIRST, packet, sizeof(FIRST));
+    session.nextPacket(packet, sizeof(packet), 10);
+    TEST_ASSERT_EQUAL_UINT8(0x33, packet[0]);
+
+    // A PUBACK for an unknown id changes nothing
+    puback(session, 9);
+    TEST_ASSERT_EQUAL_UINT8(2, session.inFlightCount());
+    puback(session, 1);
+    TEST_ASSERT_FALSE(session.inFlight(1));
+    TEST_ASSERT_EQUAL_UINT32(1, session.acked());
+    TEST_ASSERT_EQUAL_UINT16(3, session.publish("watcher/c", payload, 2, false));
+}
+
+static void test_publish_limits(void) {
+    MqttSession session(slots, 4, CONFIG);
+    char topic[MQTT_TOPIC_BYTES + 1];
+    memset(topic, 't', sizeof(topic));
+    topic[MQTT_TOPIC_BYTES] = '\0';
+    uint8_t payload[MQTT_PAYLOAD_BYTES + 1] = {0};
+    TEST_ASSERT_EQUAL_UINT16(0, session.publish("", payload, 1, false));
+    TEST_ASSERT_EQUAL_UINT16(0, session.publish(topic, payload, 1, false));
+    TEST_ASSERT_EQUAL_UINT16(0, session.publish("t", payload, MQTT_PAYLOAD_BYTES + 1, false));
+
+    // The largest message fits MQTT_PACKET_BYTES (a 2-byte length field)
+    topic[MQTT_TOPIC_BYTES - 1] = '\0';
+    TEST_ASSERT_NOT_EQUAL(0, session.publish(topic, payload, MQTT_PAYLOAD_BYTES, false));
+    connected(session, 0);
+    size_t size = session.nextPacket(packet, sizeof(packet), 0);
+    TEST_ASSERT_EQUAL_size_t(1 + 2 + 2 + (MQTT_TOPIC_BYTES - 1) + 2 + MQTT_PAYLOAD_BYTES, size);
+}
+
+static void test_resend_after_reconnect(void) {
+    MqttSession session(slots, 4, CONFIG);
+    connected(session, 0);
+    const uint8_t payload[] = {'x'};
+    uint16_t id = session.publish("watcher/a", payload, 1, false);
+    session.nextPacket(packet, sizeof(packet), 0);
+    session.connectionLost();
+    TEST_ASSERT_TRUE(session.inFlight(id));
+
+    // Written again after the online message, DUP set; a PUBACK before the
+    // write does not count
+    session.connect(packet, sizeof(packet), 100);
+    session.receive(CONNACK_RESUMED, sizeof(CONNACK_RESUMED));
+    puback(session, id);
+    TEST_ASSERT_TRUE(session.inFlight(id));
+    session.nextPacket(packet, sizeof(packet), 100);
+    session.nextPacket(packet, sizeof(packet), 100);
+    TEST_ASSERT_EQUAL_UINT8(0x3A, packet[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, session.resent());
+    puback(session, id);
+    TEST_ASSERT_FALSE(session.inFlight(id));
+}
+
+static void test_keep_alive(void) {
+    MqttSession session(slots, 4, CONFIG);
+    session.connect(packet, sizeof(packet), 0);
+    TEST_ASSERT_EQUAL_UINT32(5000, session.msUntilNextTimer(0));
+    TEST_ASSERT_FALSE(session.responseOverdue(4999));
+    TEST_ASSERT_TRUE(session.responseOverdue(5000));
+    session.receive(CONNACK_NEW, sizeof(CONNACK_NEW));
+    session.nextPacket(packet, sizeof(packet), 1000);
+
+    // PINGREQ once nothing was written for three quarters of 60 s
+    TEST_ASSERT_EQUAL_UINT32(45000, session.msUntilNextTimer(1000));
+    TEST_ASSERT_EQUAL_size_t(0, session.nextPacket(packet, sizeof(packet), 45999));
+    TEST_ASSERT_EQUAL_size_t(2, session.nextPacket(packet, sizeof(packet), 46000));
+    TEST_ASSERT_EQUAL_UINT8(0xC0, packet[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, session.pings());
+    TEST_ASSERT_TRUE(session.responseOverdue(51000));
+
+    static const uint8_t PINGRESP[] = {0xD0, 0x00};
+    session.receive(PINGRESP, sizeof(PINGRESP));
+    TEST_ASSERT_FALSE(session.responseOverdue(51000));
+    TEST_ASSERT_EQUAL_UINT32(45000, session.msUntilNextTimer(46000));
+}
+
+static void test_malformed_drops_connection(void) {
+    MqttSession session(slots, 4, CONFIG);
+    connected(session, 0);
+    static const uint8_t OVERFLOW[] = {0x30, 0x80, 0x80, 0x80, 0x80, 0x01};
+    session.receive(OVERFLOW, sizeof(OVERFLOW));
+    TEST_ASSERT_EQUAL(MQTT_DISCONNECTED, session.state());
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, session.msUntilNextTimer(0));
+
+    // The next connection starts with a clean reader
+    session.connect(packet, sizeof(packet), 0);
+    session.receive(CONNACK_NEW, sizeof(CONNACK_NEW));
+    TEST_ASSERT_EQUAL(MQTT_CONNECTED, session.state());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_encode_length_boundaries);
+    RUN_TEST(test_encode_length_overflow);
+    RUN_TEST(test_reader_byte_by_byte);
+    RUN_TEST(test_reader_stops_at_packet_end);
+    RUN_TEST(test_reader_long_body_counted);
+    RUN_TEST(test_reader_length_overflow);
+    RUN_TEST(test_connect_packet);
+    RUN_TEST(test_connack);
+    RUN_TEST(test_connack_refused);
+    RUN_TEST(test_publish_window);
+    RUN_TEST(test_publish_limits);
+    RUN_TEST(test_resend_after_reconnect);
+    RUN_TEST(test_keep_alive);
+    RUN_TEST(test_malformed_drops_connection);
+    return UNITY_END();
+}
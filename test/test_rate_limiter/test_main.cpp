@@ -0,0 +1,71 @@
+// Retry-After parsing (httpRetryAfterMs, lib/WatcherCore/src/RateLimiter.cpp)
+
+#include <RateLimiter.h>
+#include <unity.h>
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void test_delta_seconds(void) {
+    TEST_ASSERT_EQUAL_UINT32(120000, httpRetryAfterMs("120", NULL));
+    TEST_ASSERT_EQUAL_UINT32(5000, httpRetryAfterMs("  5", NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("0", NULL));
+}
+
+static void test_delta_seconds_capped(void) {
+    TEST_ASSERT_EQUAL_UINT32(4294967000u, httpRetryAfterMs("4294967", NULL));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, httpRetryAfterMs("4294968", NULL));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, httpRetryAfterMs("99999999999999999999999", NULL));
+}
+
+static void test_http_date_relative_to_date(void) {
+    TEST_ASSERT_EQUAL_UINT32(90000,
+                             httpRetryAfterMs("Sun, 06 Nov 1994 08:51:07 GMT", "Sun, 06 Nov 1994 08:49:37 GMT"));
+    // Across a month, a year and a leap day
+    TEST_ASSERT_EQUAL_UINT32(60000, httpRetryAfterMs("Thu, 01 Jan 2026 00:00:30 GMT", "Wed, 31 Dec 2025 23:59:30 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(86400000, httpRetryAfterMs("Fri, 01 Mar 2024 12:00:00 GMT", "Thu, 29 Feb 2024 12:00:00 GMT"));
+}
+
+static void test_http_date_in_the_past(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 Nov 1994 08:49:37 GMT", "Sun, 06 Nov 1994 08:49:38 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 Nov 1994 08:49:37 GMT", "Sun, 06 Nov 1994 08:49:37 GMT"));
+}
+
+static void test_http_date_before_epoch(void) {
+    TEST_ASSERT_EQUAL_UINT32(59000, httpRetryAfterMs("Wed, 31 Dec 1969 23:59:59 GMT", "Wed, 31 Dec 1969 23:59:00 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(2000, httpRetryAfterMs("Thu, 01 Jan 1970 00:00:01 GMT", "Wed, 31 Dec 1969 23:59:59 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Wed, 31 Dec 1969 23:59:59 GMT", "Thu, 01 Jan 1970 00:00:00 GMT"));
+}
+
+static void test_http_date_without_date_header(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 Nov 1994 08:51:07 GMT", NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 Nov 1994 08:51:07 GMT", ""));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 Nov 1994 08:51:07 GMT", "yesterday"));
+}
+
+static void test_not_a_value(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs(NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("", NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("soon", "Sun, 06 Nov 1994 08:49:37 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("-30", NULL));
+    // Obsolete forms and a bad month
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sunday, 06-Nov-94 08:51:07 GMT", "Sun, 06 Nov 1994 08:49:37 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun Nov  6 08:51:07 1994", "Sun, 06 Nov 1994 08:49:37 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 Nob 1994 08:51:07 GMT", "Sun, 06 Nov 1994 08:49:37 GMT"));
+    TEST_ASSERT_EQUAL_UINT32(0, httpRetryAfterMs("Sun, 06 anF 1994 08:51:07 GMT", "Sun, 06 Nov 1994 08:49:37 GMT"));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_delta_seconds);
+    RUN_TEST(test_delta_seconds_capped);
+    RUN_TEST(test_http_date_relative_to_date);
+    RUN_TEST(test_http_date_in_the_past);
+    RUN_TEST(test_http_date_before_epoch);
+    RUN_TEST(test_http_date_without_date_header);
+    RUN_TEST(test_not_a_value);
+    return UNITY_END();
+}